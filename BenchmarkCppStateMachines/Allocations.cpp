@@ -0,0 +1,111 @@
+#include "Harness.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+// Replaces the global allocation functions to track live heap bytes.
+// Every block carries its size in a header, so frees do not need a sized delete. Over-aligned blocks also keep
+// malloc's pointer in theirs, right before the aligned block.
+
+namespace
+{
+	std::atomic<size_t> g_liveBytes(0);
+
+	const size_t HeaderSize = alignof(std::max_align_t) > sizeof(size_t) ? alignof(std::max_align_t) : sizeof(size_t);
+
+	void* Allocate(size_t size)
+	{
+		char* block = (char*)std::malloc(size + HeaderSize);
+		if (block == nullptr) return nullptr;
+
+		*(size_t*)block = size;
+		g_liveBytes.fetch_add(size, std::memory_order_relaxed);
+		return block + HeaderSize;
+	}
+
+	void Free(void* pointer)
+	{
+		if (pointer == nullptr) return;
+
+		char* block = (char*)pointer - HeaderSize;
+		g_liveBytes.fetch_sub(*(size_t*)block, std::memory_order_relaxed);
+		std::free(block);
+	}
+
+	void* Allocate(size_t size, std::align_val_t alignment)
+	{
+		char* block = (char*)std::malloc(size + (size_t)alignment + 2 * sizeof(void*));
+		if (block == nullptr) return nullptr;
+
+		void** header = (void**)(((uintptr_t)(block + 2 * sizeof(void*)) + (size_t)alignment - 1) & ~((uintptr_t)alignment - 1)) - 2;
+		header[0] = (void*)size;
+		header[1] = block;
+		g_liveBytes.fetch_add(size, std::memory_order_relaxed);
+		return header + 2;
+	}
+
+	void Free(void* pointer, std::align_val_t)
+	{
+		if (pointer == nullptr) return;
+
+		void** header = (void**)pointer - 2;
+		g_liveBytes.fetch_sub((size_t)header[0], std::memory_order_relaxed);
+		std::free(header[1]);
+	}
+}
+
+size_t Benchmarks::LiveBytes()
+{
+	return g_liveBytes.load(std::memory_order_relaxed);
+}
+
+void* operator new(size_t size)
+{
+	void* pointer = Allocate(size);
+	if (pointer == nullptr) throw std::bad_alloc();
+	return pointer;
+}
+
+void* operator new[](size_t size)
+{
+	void* pointer = Allocate(size);
+	if (pointer == nullptr) throw std::bad_alloc();
+	return pointer;
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept { return Allocate(size); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { return Allocate(size); }
+
+void operator delete(void* pointer) noexcept { Free(pointer); }
+void operator delete[](void* pointer) noexcept { Free(pointer); }
+void operator delete(void* pointer, size_t) noexcept { Free(pointer); }
+void operator delete[](void* pointer, size_t) noexcept { Free(pointer); }
+void operator delete(void* pointer, const std::nothrow_t&) noexcept { Free(pointer); }
+void operator delete[](void* pointer, const std::nothrow_t&) noexcept { Free(pointer); }
+
+void* operator new(size_t size, std::align_val_t alignment)
+{
+	void* pointer = Allocate(size, alignment);
+	if (pointer == nullptr) throw std::bad_alloc();
+	return pointer;
+}
+
+void* operator new[](size_t size, std::align_val_t alignment)
+{
+	void* pointer = Allocate(size, alignment);
+	if (pointer == nullptr) throw std::bad_alloc();
+	return pointer;
+}
+
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept { return Allocate(size, alignment); }
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept { return Allocate(size, alignment); }
+
+void operator delete(void* pointer, std::align_val_t alignment) noexcept { Free(pointer, alignment); }
+void operator delete[](void* pointer, std::align_val_t alignment) noexcept { Free(pointer, alignment); }
+void operator delete(void* pointer, size_t, std::align_val_t alignment) noexcept { Free(pointer, alignment); }
+void operator delete[](void* pointer, size_t, std::align_val_t alignment) noexcept { Free(pointer, alignment); }
+void operator delete(void* pointer, std::align_val_t alignment, const std::nothrow_t&) noexcept { Free(pointer, alignment); }
+void operator delete[](void* pointer, std::align_val_t alignment, const std::nothrow_t&) noexcept { Free(pointer, alignment); }
@@ -0,0 +1,55 @@
+#include "Baseline.h"
+
+#include <cstdlib>
+#include <fstream>
+
+namespace Benchmarks
+{
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	bool CBaseline::Load(const std::string& path)
+	{
+		std::ifstream file(path);
+		if (!file) return false;
+
+		// Only the fields written by CHarness::Report are understood, no general JSON parsing
+		const std::string idField = "\"id\":\"";
+		const std::string samplesField = "\"samples\":[";
+
+		std::string line;
+		while (std::getline(file, line))
+		{
+			const size_t id = line.find(idField);
+			const size_t samples = line.find(samplesField);
+			if (id == std::string::npos || samples == std::string::npos) continue;
+
+			const size_t idStart = id + idField.size();
+			const size_t idEnd = line.find('"', idStart);
+			if (idEnd == std::string::npos) continue;
+
+			std::vector<double>& values = m_samples[line.substr(idStart, idEnd - idStart)];
+			values.clear();
+
+			const char* cursor = line.c_str() + samples + samplesField.size();
+			while (*cursor != ']' && *cursor != '\0')
+			{
+				char* end = nullptr;
+				const double value = std::strtod(cursor, &end);
+				if (end == cursor) break;
+
+				values.push_back(value);
+				cursor = *end == ',' ? end + 1 : end;
+			}
+		}
+
+		return true;
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	const std::vector<double>* CBaseline::Find(const std::string& id) const
+	{
+		std::map<std::string, std::vector<double>>::const_iterator itr = m_samples.find(id);
+		return itr != m_samples.end() ? &itr->second : nullptr;
+	}
+}
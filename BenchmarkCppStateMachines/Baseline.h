@@ -0,0 +1,26 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace Benchmarks
+{
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	// Samples of an earlier run, read back from the JSON lines it printed (or saved with --save)
+	class CBaseline
+	{
+	private:
+		std::map<std::string, std::vector<double>> m_samples;
+
+	public:
+		// False when the file cannot be read
+		bool Load(const std::string& path);
+
+		// Null when the baseline has no samples for the id
+		const std::vector<double>* Find(const std::string& id) const;
+
+		size_t Size() const { return m_samples.size(); }
+	};
+}
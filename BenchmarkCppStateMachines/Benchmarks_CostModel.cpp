@@ -0,0 +1,157 @@
+#include "Harness.h"
+
+#include "export.h"
+#include "CDefinitionBuilder.h"
+#include "CTransitionTables.h"
+#include "CWorkloadGenerator.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <unistd.h>
+#endif
+
+using namespace FSM;
+
+namespace Benchmarks
+{
+	namespace
+	{
+		////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+		volatile uintptr_t g_sink = 0;
+
+		// Cache line sized links of one random cycle, so every load depends on the previous one & prefetchers can't help
+		struct SLink
+		{
+			SLink* Next;
+			char Padding[64 - sizeof(SLink*)];
+		};
+
+		////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+		// Cache size as the OS reports it, 'fallback' when it doesn't
+		size_t CacheBytes(int level, size_t fallback)
+		{
+			long bytes = 0;
+#if defined(__linux__) && defined(_SC_LEVEL1_DCACHE_SIZE)
+			bytes = sysconf(level == 1 ? _SC_LEVEL1_DCACHE_SIZE : level == 2 ? _SC_LEVEL2_CACHE_SIZE : _SC_LEVEL3_CACHE_SIZE);
+#else
+			(void)level;
+#endif
+			return bytes > 0 ? (size_t)bytes : fallback;
+		}
+
+		////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+		// Nanoseconds per dependent load, chasing pointers through a buffer of 'bytes'
+		double LoadNanoseconds(CHarness& harness, size_t bytes)
+		{
+			std::vector<SLink> links(std::max<size_t>(2, bytes / sizeof(SLink)));
+
+			// Sattolo's algorithm: a single cycle through every link
+			std::vector<size_t> order(links.size());
+			for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+			std::mt19937_64 random(42);
+			for (size_t i = order.size() - 1; i > 0; --i) std::swap(order[i], order[random() % i]);
+			for (size_t i = 0; i < order.size(); ++i) links[i].Next = &links[order[i]];
+
+			SLink* link = &links[0];
+			const STiming timing = harness.Time([&link](uint64_t count)
+			{
+				for (uint64_t n = 0; n < count; ++n) link = link->Next;
+				g_sink = g_sink + (uintptr_t)link;
+			});
+			return *std::min_element(timing.Samples.begin(), timing.Samples.end());
+		}
+
+		////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+		// Nanoseconds per lookup, each one's target being the next one's source
+		double LookupNanoseconds(CHarness& harness, const CCompiledDefinition<uint32_t, uint32_t>& definition, const std::vector<uint32_t>& triggers)
+		{
+			uint32_t state = definition.InitialState();
+			size_t cursor = 0;
+			const STiming timing = harness.Time([&](uint64_t count)
+			{
+				for (uint64_t n = 0; n < count; ++n)
+				{
+					state = definition.Next(state, triggers[cursor]);
+					cursor = (cursor + 1) & (triggers.size() - 1);
+				}
+				g_sink = g_sink + state;
+			});
+			return *std::min_element(timing.Samples.begin(), timing.Samples.end());
+		}
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	void RunCostModelCalibration(CHarness& harness, std::ostream& out)
+	{
+		const STableCostModel defaults;
+		STableCostModel model;
+		model.L1Bytes = CacheBytes(1, defaults.L1Bytes);
+		model.L2Bytes = CacheBytes(2, defaults.L2Bytes);
+		model.LastLevelBytes = CacheBytes(3, defaults.LastLevelBytes);
+
+		// Each level halfway between the one below & its own size, memory twice the last level
+		model.L1Nanoseconds = LoadNanoseconds(harness, model.L1Bytes / 2);
+		model.L2Nanoseconds = LoadNanoseconds(harness, std::max(model.L1Bytes * 2, model.L2Bytes / 2));
+		model.LastLevelNanoseconds = LoadNanoseconds(harness, std::max(model.L2Bytes * 2, model.LastLevelBytes / 2));
+		model.MemoryNanoseconds = LoadNanoseconds(harness, std::max<size_t>(model.LastLevelBytes * 2, 64 * 1024 * 1024));
+
+		// Full 64 x 64 machine, both tables in L1: a compressed lookup costs an extra L1 read plus the overhead
+		CDefinitionBuilder<uint32_t, uint32_t> builder(0);
+		std::mt19937_64 random(7);
+		for (uint32_t state = 0; state < 64; ++state)
+		{
+			for (uint32_t trigger = 0; trigger < 64; ++trigger) builder.Add(state, trigger, (uint32_t)(random() % 64));
+		}
+		std::vector<uint32_t> triggers(4096);
+		for (uint32_t& trigger : triggers) trigger = (uint32_t)(random() % 64);
+
+		const double dense = LookupNanoseconds(harness, builder.Build(DenseTable), triggers);
+		const double compressed = LookupNanoseconds(harness, builder.Build(CompressedTable), triggers);
+		model.CompressedOverheadNanoseconds = std::max(0.0, compressed - dense - model.L1Nanoseconds);
+
+		// Packing of a workload benchmark machine: power-law fan-out, mean 4 over 64 triggers
+		SGraphOptions options;
+		options.States = std::min<uint32_t>(65536, harness.Options().MaxStates);
+		options.Triggers = 64;
+		options.FanOut = PowerLawFanOut;
+		options.MeanFanOut = 4;
+		const CGeneratedMachine generated(options);
+
+		std::vector<uint32_t> keys(options.States);
+		for (uint32_t i = 0; i < options.States; ++i) keys[i] = i;
+		CDefinitionBuilder<uint32_t, uint32_t> workload(0);
+		generated.AddTo(workload, keys, keys);
+		const CCompiledDefinition<uint32_t, uint32_t> packed = workload.Build(CompressedTable);
+
+		// Mirrors ChooseTableLayout's estimate: a 32 bit base per state, then (check, next) pairs including one row's window
+		const size_t entries = (packed.TableBytes() - (size_t)packed.StateCount() * sizeof(uint32_t)) / (2 * packed.IndexBytes());
+		model.CompressedFill = std::min(1.0, (double)packed.TableChoice().Shape.Transitions / (double)std::max<size_t>(1, entries - packed.TriggerCount()));
+
+		char text[1024];
+		std::snprintf(text, sizeof(text),
+			"// Measured by BenchmarkCppStateMachines --cost-model (dense lookup %.2f ns, compressed %.2f ns)\n"
+			"STableCostModel model;\n"
+			"model.L1Bytes = %zu;\n"
+			"model.L2Bytes = %zu;\n"
+			"model.LastLevelBytes = %zu;\n"
+			"model.L1Nanoseconds = %.2f;\n"
+			"model.L2Nanoseconds = %.2f;\n"
+			"model.LastLevelNanoseconds = %.2f;\n"
+			"model.MemoryNanoseconds = %.2f;\n"
+			"model.CompressedOverheadNanoseconds = %.2f;\n"
+			"model.CompressedFill = %.2f;\n",
+			dense, compressed, model.L1Bytes, model.L2Bytes, model.LastLevelBytes, model.L1Nanoseconds, model.L2Nanoseconds,
+			model.LastLevelNanoseconds, model.MemoryNanoseconds, model.CompressedOverheadNanoseconds, model.CompressedFill);
+		out << text;
+	}
+}
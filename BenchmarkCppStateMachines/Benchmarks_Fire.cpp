@@ -0,0 +1,283 @@
+#include "Harness.h"
+
+#include "export.h"
+#include "CCompiledStateMachine.h"
+#include "CDefinitionBuilder.h"
+
+#include <chrono>
+#include <memory>
+#include <random>
+#include <set>
+#include <string>
+#include <tuple>
+#include <vector>
+
+using namespace FSM;
+
+namespace Benchmarks
+{
+	namespace
+	{
+		////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+		enum class EKey : uint32_t { };
+
+		enum EKeyType { EnumKeys, PointerKeys, StringKeys };
+		enum ECallbackType { NoCallback, InstanceCallback, FunctionCallback };
+
+		const char* KeyName(EKeyType key) { return key == EnumKeys ? "enum" : key == PointerKeys ? "pointer" : "string"; }
+		const char* CallbackName(ECallbackType callback) { return callback == NoCallback ? "none" : callback == InstanceCallback ? "instance" : "function"; }
+
+		struct SConfig
+		{
+			uint32_t States;
+			uint32_t FanOut;
+			EKeyType Key;
+			ECallbackType Callback;
+
+			bool operator<(const SConfig& other) const
+			{
+				return std::tie(States, FanOut, Key, Callback) < std::tie(other.States, other.FanOut, other.Key, other.Callback);
+			}
+		};
+
+		const char* Backends[] = { "configured", "compiled-dense", "compiled-compressed" };
+
+		////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+		volatile uintptr_t g_sink = 0;
+		uint64_t g_functionCalls = 0;
+
+		void CountCall() { ++g_functionCalls; }
+
+		class CCountingCallback : public ICallback
+		{
+		public:
+			uint64_t Calls = 0;
+			virtual void Call() override { ++Calls; }
+		};
+
+		////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+		// State & trigger keys of one machine; pointer keys point into Pool, so they stay valid while the keys live
+		template<typename TKey>
+		struct SKeys
+		{
+			std::vector<TKey> States;
+			std::vector<TKey> Triggers;
+			std::vector<uint64_t> Pool;
+		};
+
+		void MakeKeys(SKeys<EKey>& keys, const SConfig& config)
+		{
+			for (uint32_t i = 0; i < config.States; ++i) keys.States.push_back((EKey)i);
+			for (uint32_t i = 0; i < config.FanOut; ++i) keys.Triggers.push_back((EKey)i);
+		}
+
+		void MakeKeys(SKeys<const uint64_t*>& keys, const SConfig& config)
+		{
+			keys.Pool.resize(config.States + config.FanOut);
+			for (uint32_t i = 0; i < config.States; ++i) keys.States.push_back(&keys.Pool[i]);
+			for (uint32_t i = 0; i < config.FanOut; ++i) keys.Triggers.push_back(&keys.Pool[config.States + i]);
+		}
+
+		void MakeKeys(SKeys<std::string>& keys, const SConfig& config)
+		{
+			for (uint32_t i = 0; i < config.States; ++i) keys.States.push_back("state_" + std::to_string(i));
+			for (uint32_t i = 0; i < config.FanOut; ++i) keys.Triggers.push_back("trigger_" + std::to_string(i));
+		}
+
+		// Deterministic pseudo random target, so no graph has to be stored next to the machine
+		uint32_t Target(uint32_t state, uint32_t trigger, uint32_t stateCount)
+		{
+			uint64_t x = ((uint64_t)state << 32 | trigger) * 0x9e3779b97f4a7c15ull;
+			x ^= x >> 29;
+			x *= 0xbf58476d1ce4e5b9ull;
+			x ^= x >> 32;
+			return (uint32_t)(x % stateCount);
+		}
+
+		double Milliseconds(std::chrono::steady_clock::duration duration)
+		{
+			return std::chrono::duration<double, std::milli>(duration).count();
+		}
+
+		////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+		template<typename TKey>
+		void Run(CHarness& harness, const SConfig& config)
+		{
+			typedef std::chrono::steady_clock Clock;
+
+			SResult base;
+			base.States = config.States;
+			base.FanOut = config.FanOut;
+			base.Key = KeyName(config.Key);
+			base.Callback = CallbackName(config.Callback);
+
+			const auto result = [&base](const char* benchmark, const char* backend)
+			{
+				SResult result = base;
+				result.Benchmark = benchmark;
+				result.Backend = backend;
+				return result;
+			};
+
+			bool selected = false;
+			for (const char* backend : Backends)
+			{
+				selected = selected || harness.Selected(result("construct", backend)) || harness.Selected(result("fire", backend));
+			}
+			selected = selected || harness.Selected(result("construct", "builder-dense"));
+			if (!selected) return;
+
+			SKeys<TKey> keys;
+			MakeKeys(keys, config);
+
+			CCountingCallback instance;
+
+			// Trigger stream, every trigger exists in every state
+			const size_t streamMask = (1 << 16) - 1;
+			std::vector<TKey> stream;
+			std::mt19937 random(config.States ^ config.FanOut);
+			for (size_t i = 0; i <= streamMask; ++i) stream.push_back(keys.Triggers[random() % config.FanOut]);
+
+			// Configured machine
+			size_t bytesBefore = LiveBytes();
+			Clock::time_point start = Clock::now();
+
+			std::unique_ptr<CFiniteStateMachine<TKey, TKey>> fsm(new CFiniteStateMachine<TKey, TKey>(keys.States[0]));
+			for (uint32_t state = 0; state < config.States; ++state)
+			{
+				IStateConfigurator<TKey, TKey>* configurator = fsm->Configure(keys.States[state]);
+				for (uint32_t trigger = 0; trigger < config.FanOut; ++trigger)
+				{
+					configurator->AddTrigger(keys.Triggers[trigger], keys.States[Target(state, trigger, config.States)]);
+				}
+
+				if (config.Callback == InstanceCallback) configurator->OnEntry(&instance);
+				if (config.Callback == FunctionCallback) configurator->OnEntry(&CountCall);
+			}
+
+			SResult construct = result("construct", "configured");
+			if (harness.Selected(construct))
+			{
+				const double bytes = (double)(LiveBytes() - bytesBefore);
+				construct.Metrics.push_back(std::make_pair("ms", Milliseconds(Clock::now() - start)));
+				construct.Metrics.push_back(std::make_pair("bytes", bytes));
+				construct.Metrics.push_back(std::make_pair("instance_bytes", bytes + sizeof(CFiniteStateMachine<TKey, TKey>)));
+				harness.Report(construct);
+			}
+
+			// Definitions compiled from the configured machine; the table is shared, instances only hold the current state
+			const ETableLayout layouts[] = { DenseTable, CompressedTable };
+			std::unique_ptr<CCompiledDefinition<TKey, TKey>> definitions[2];
+			for (int i = 0; i < 2; ++i)
+			{
+				bytesBefore = LiveBytes();
+				start = Clock::now();
+
+				definitions[i].reset(new CCompiledDefinition<TKey, TKey>(*fsm, layouts[i]));
+
+				construct = result("construct", Backends[i + 1]);
+				if (harness.Selected(construct))
+				{
+					construct.Metrics.push_back(std::make_pair("ms", Milliseconds(Clock::now() - start)));
+					construct.Metrics.push_back(std::make_pair("bytes", (double)(LiveBytes() - bytesBefore)));
+					construct.Metrics.push_back(std::make_pair("table_bytes", (double)definitions[i]->TableBytes()));
+					construct.Metrics.push_back(std::make_pair("instance_bytes", (double)sizeof(CCompiledStateMachine<TKey, TKey>)));
+					harness.Report(construct);
+				}
+			}
+
+			// Same definition straight from tuples, skipping configuration
+			construct = result("construct", "builder-dense");
+			if (harness.Selected(construct) && config.Callback == NoCallback)
+			{
+				std::vector<STransitionDefinition<TKey, TKey>> transitions;
+				transitions.reserve((size_t)config.States * config.FanOut);
+				for (uint32_t state = 0; state < config.States; ++state)
+				{
+					for (uint32_t trigger = 0; trigger < config.FanOut; ++trigger)
+					{
+						const STransitionDefinition<TKey, TKey> transition = { keys.States[state], keys.Triggers[trigger], keys.States[Target(state, trigger, config.States)] };
+						transitions.push_back(transition);
+					}
+				}
+
+				bytesBefore = LiveBytes();
+				start = Clock::now();
+
+				CDefinitionBuilder<TKey, TKey> builder(keys.States[0]);
+				builder.Add(transitions.data(), transitions.size());
+				CCompiledDefinition<TKey, TKey> built = builder.Build(DenseTable);
+
+				construct.Metrics.push_back(std::make_pair("ms", Milliseconds(Clock::now() - start)));
+				construct.Metrics.push_back(std::make_pair("bytes", (double)(LiveBytes() - bytesBefore)));
+				construct.Metrics.push_back(std::make_pair("table_bytes", (double)built.TableBytes()));
+				harness.Report(construct);
+			}
+
+			// Fire
+			SResult fire = result("fire", "configured");
+			if (harness.Selected(fire))
+			{
+				CFiniteStateMachine<TKey, TKey>& machine = *fsm;
+				const STiming timing = harness.Time([&](uint64_t count)
+				{
+					for (uint64_t n = 0; n < count; ++n) machine.Fire(stream[n & streamMask]);
+					g_sink = g_sink + (uintptr_t)machine.CurrentState();
+				});
+
+				timing.AppendTo(fire, "fire");
+				harness.Report(fire);
+			}
+
+			for (int i = 0; i < 2; ++i)
+			{
+				fire = result("fire", Backends[i + 1]);
+				if (!harness.Selected(fire)) continue;
+
+				CCompiledStateMachine<TKey, TKey> machine(definitions[i].get());
+				const STiming timing = harness.Time([&](uint64_t count)
+				{
+					for (uint64_t n = 0; n < count; ++n) machine.Fire(stream[n & streamMask]);
+					g_sink = g_sink + machine.CurrentStateIndex();
+				});
+
+				timing.AppendTo(fire, "fire");
+				harness.Report(fire);
+			}
+		}
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	void RunFireBenchmarks(CHarness& harness)
+	{
+		// Sweeps over one dimension at a time around a 4096 state, fan-out 4, enum keyed machine without callbacks
+		std::set<SConfig> configs;
+
+		const uint32_t stateCounts[] = { 4, 64, 1024, 16384, 262144, 1048576 };
+		for (uint32_t states : stateCounts) configs.insert({ states, 4, EnumKeys, NoCallback });
+
+		const uint32_t fanOuts[] = { 1, 4, 16, 64, 256 };
+		for (uint32_t fanOut : fanOuts) configs.insert({ 4096, fanOut, EnumKeys, NoCallback });
+
+		configs.insert({ 4096, 4, PointerKeys, NoCallback });
+		configs.insert({ 4096, 4, StringKeys, NoCallback });
+		configs.insert({ 262144, 4, StringKeys, NoCallback });
+
+		configs.insert({ 4096, 4, EnumKeys, InstanceCallback });
+		configs.insert({ 4096, 4, EnumKeys, FunctionCallback });
+
+		for (const SConfig& config : configs)
+		{
+			if (config.States > harness.Options().MaxStates) continue;
+
+			if (config.Key == EnumKeys) Run<EKey>(harness, config);
+			if (config.Key == PointerKeys) Run<const uint64_t*>(harness, config);
+			if (config.Key == StringKeys) Run<std::string>(harness, config);
+		}
+	}
+}
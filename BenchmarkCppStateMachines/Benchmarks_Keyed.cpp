@@ -0,0 +1,233 @@
+#include "Harness.h"
+
+#include "export.h"
+#include "CCompiledStateMachine.h"
+#include "CKeyedStateMachineStore.h"
+#include "CShardedStateMachineStore.h"
+
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+using namespace FSM;
+
+namespace Benchmarks
+{
+	namespace
+	{
+		////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+		const uint32_t RingStates = 4;
+
+		volatile uintptr_t g_sink = 0;
+
+		// Trigger 0 moves on around the ring, trigger 1 goes back to the start, so every trigger is accepted
+		void ConfigureRing(CFiniteStateMachine<uint32_t, uint32_t>& fsm)
+		{
+			for (uint32_t state = 0; state < RingStates; ++state)
+			{
+				fsm.Configure(state)->AddTrigger(0, (state + 1) % RingStates)->AddTrigger(1, 0);
+			}
+		}
+
+		// Scattered like connection or order ids
+		uint64_t KeyAt(uint64_t i) { return i * 0x9e3779b97f4a7c15ull + 1; }
+
+		typedef std::vector<std::pair<uint64_t, uint32_t>> keyed_stream;
+
+		////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+		// Creates an instance for every key, then times random fires at them; TFire(key, trigger) fires at one instance
+		template<typename TFire>
+		void Run(CHarness& harness, SResult& result, uint32_t keys, const keyed_stream& stream, TFire fire)
+		{
+			const size_t bytesBefore = LiveBytes();
+			for (uint32_t i = 0; i < keys; ++i) fire(KeyAt(i), 0);
+			const double bytesPerKey = (double)(LiveBytes() - bytesBefore) / keys;
+
+			const size_t streamMask = stream.size() - 1;
+			const STiming timing = harness.Time([&](uint64_t count)
+			{
+				for (uint64_t n = 0; n < count; ++n) fire(stream[n & streamMask].first, stream[n & streamMask].second);
+			});
+
+			timing.AppendTo(result, "fire");
+			result.Metrics.push_back(std::make_pair("bytes_per_key", bytesPerKey));
+			harness.Report(result);
+		}
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	void RunKeyedBenchmarks(CHarness& harness)
+	{
+		// One small machine per key, against the maps of machines people keep by hand
+		const char* backends[] = { "store", "unordered-map-compiled", "unordered-map-configured" };
+		const uint32_t keyCounts[] = { 1024, 65536, 1048576 };
+
+		CFiniteStateMachine<uint32_t, uint32_t> fsm(0);
+		ConfigureRing(fsm);
+		const CCompiledDefinition<uint32_t, uint32_t> definition(fsm);
+
+		for (uint32_t keys : keyCounts)
+		{
+			// Key counts are capped like state counts
+			if (keys > harness.Options().MaxStates) continue;
+
+			SResult base;
+			base.Benchmark = "keyed-" + std::to_string(keys);
+			base.States = RingStates;
+			base.FanOut = 2;
+			base.Key = "uint64";
+			base.Callback = "none";
+
+			keyed_stream stream(1 << 20);
+			std::mt19937_64 random(keys);
+			for (std::pair<uint64_t, uint32_t>& fire : stream) fire = std::make_pair(KeyAt(random() % keys), (uint32_t)(random() % 8 == 0));
+
+			SResult result = base;
+			result.Backend = backends[0];
+			if (harness.Selected(result))
+			{
+				CKeyedStateMachineStore<uint64_t, uint32_t, uint32_t> store(&definition);
+				Run(harness, result, keys, stream, [&store](uint64_t key, uint32_t trigger) { store.Fire(key, trigger); });
+				g_sink = g_sink + store.Size();
+			}
+
+			result = base;
+			result.Backend = backends[1];
+			if (harness.Selected(result))
+			{
+				std::unordered_map<uint64_t, CCompiledStateMachine<uint32_t, uint32_t>> machines;
+				Run(harness, result, keys, stream, [&machines, &definition](uint64_t key, uint32_t trigger)
+				{
+					machines.try_emplace(key, &definition).first->second.Fire(trigger);
+				});
+				g_sink = g_sink + machines.size();
+			}
+
+			// At-least-once delivery: every trigger comes with a sequence number, checked by the store or by a map in front
+			uint64_t sequence = 0;
+			result = base;
+			result.Backend = "store-sequenced";
+			if (harness.Selected(result))
+			{
+				CKeyedStateMachineStore<uint64_t, uint32_t, uint32_t, std::hash<uint64_t>, CSequenced> store(&definition);
+				Run(harness, result, keys, stream, [&store, &sequence](uint64_t key, uint32_t trigger) { store.Fire(key, ++sequence, trigger); });
+				g_sink = g_sink + store.Size();
+			}
+
+			result = base;
+			result.Backend = "store-dedup-map";
+			if (harness.Selected(result))
+			{
+				CKeyedStateMachineStore<uint64_t, uint32_t, uint32_t> store(&definition);
+				std::unordered_map<uint64_t, uint64_t> applied;
+				Run(harness, result, keys, stream, [&store, &applied, &sequence](uint64_t key, uint32_t trigger)
+				{
+					uint64_t& last = applied[key];
+					if (++sequence <= last) return;
+
+					last = sequence;
+					store.Fire(key, trigger);
+				});
+				g_sink = g_sink + store.Size();
+			}
+
+			// An eighth of the instances fit in memory, the others are spilled and reloaded as they are fired at
+			result = base;
+			result.Backend = "store-spilling";
+			if (harness.Selected(result))
+			{
+				const char* path = "keyed_benchmark_spill.bin";
+				{
+					CKeyedSpillFile<uint64_t> spill(path);
+					CKeyedStateMachineStore<uint64_t, uint32_t, uint32_t> store(&definition);
+					store.SetSpill(&spill);
+					for (uint32_t i = 0; i < keys; ++i) store.Fire(KeyAt(i), 0);
+					store.EvictToSize(keys / 8);
+					store.Shrink();
+
+					const size_t streamMask = stream.size() - 1;
+					const STiming timing = harness.Time([&](uint64_t count)
+					{
+						for (uint64_t n = 0; n < count; ++n)
+						{
+							store.Fire(stream[n & streamMask].first, stream[n & streamMask].second);
+							if ((n & 1023) == 1023) store.EvictToSize(keys / 8);
+						}
+					});
+					spill.Compact();
+
+					timing.AppendTo(result, "fire");
+					result.Metrics.push_back(std::make_pair("bytes_per_key", (double)(store.Bytes() + spill.IndexBytes()) / keys));
+					result.Metrics.push_back(std::make_pair("spilled", (double)spill.Size()));
+					harness.Report(result);
+					g_sink = g_sink + store.Size();
+				}
+				std::remove(path);
+			}
+
+			// Every instance configured from scratch; too heavy for the largest key count
+			result = base;
+			result.Backend = backends[2];
+			if (harness.Selected(result) && keys <= 65536)
+			{
+				std::unordered_map<uint64_t, std::unique_ptr<CFiniteStateMachine<uint32_t, uint32_t>>> machines;
+				Run(harness, result, keys, stream, [&machines](uint64_t key, uint32_t trigger)
+				{
+					std::unique_ptr<CFiniteStateMachine<uint32_t, uint32_t>>& machine = machines[key];
+					if (machine == nullptr)
+					{
+						machine.reset(new CFiniteStateMachine<uint32_t, uint32_t>(0));
+						ConfigureRing(*machine);
+					}
+					machine->Fire(trigger);
+				});
+				g_sink = g_sink + machines.size();
+			}
+
+			// As many producers as shards, each posting its share of the stream; a batch ends once all of it was fired
+			const unsigned int shardCounts[] = { 1, 2, 4, 8 };
+			for (unsigned int shards : shardCounts)
+			{
+				result = base;
+				result.Backend = "sharded-" + std::to_string(shards);
+				if (!harness.Selected(result)) continue;
+
+				const size_t bytesBefore = LiveBytes();
+				CShardedStateMachineStore<uint64_t, uint32_t, uint32_t> store(&definition, shards, 65536, keys);
+				for (uint32_t i = 0; i < keys; ++i) store.Post(KeyAt(i), 0);
+				store.Flush();
+				const double bytesPerKey = (double)(LiveBytes() - bytesBefore) / keys;
+
+				const size_t streamMask = stream.size() - 1;
+				const STiming timing = harness.Time([&](uint64_t count)
+				{
+					std::vector<std::thread> producers;
+					for (unsigned int producer = 0; producer < shards; ++producer)
+					{
+						producers.emplace_back([&store, &stream, streamMask, count, shards, producer]()
+						{
+							for (uint64_t n = producer; n < count; n += shards) store.Post(stream[n & streamMask].first, stream[n & streamMask].second);
+						});
+					}
+					for (std::thread& producer : producers) producer.join();
+					store.Flush();
+				});
+
+				// Shards only scale with cores to run them on, so results carry the count they were measured with
+				timing.AppendTo(result, "fire");
+				result.Metrics.push_back(std::make_pair("bytes_per_key", bytesPerKey));
+				result.Metrics.push_back(std::make_pair("cores", (double)std::thread::hardware_concurrency()));
+				harness.Report(result);
+				g_sink = g_sink + store.Statistics().Keys;
+			}
+		}
+	}
+}
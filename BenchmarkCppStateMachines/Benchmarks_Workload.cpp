@@ -0,0 +1,268 @@
+#include "Harness.h"
+
+#include "export.h"
+#include "CCompiledStateMachine.h"
+#include "CDefinitionImage.h"
+#include "CFlightRecorder.h"
+#include "CInstrumentation.h"
+#include "CLatencyHistograms.h"
+#include "CWorkloadGenerator.h"
+
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace FSM;
+
+namespace Benchmarks
+{
+	namespace
+	{
+		////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+		struct SWorkload
+		{
+			const char* Name;
+			EStreamDistribution Distribution;
+			double Skew;
+		};
+
+		volatile uintptr_t g_sink = 0;
+
+		////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+		// Replays a closed stream from the initial state, over and over; the machine is back in its initial state
+		// whenever the stream wraps, and is left there afterwards
+		template<typename TMachine>
+		STiming Replay(CHarness& harness, TMachine& machine, const std::vector<uint32_t>& stream)
+		{
+			size_t cursor = 0;
+			const STiming timing = harness.Time([&](uint64_t count)
+			{
+				for (uint64_t n = 0; n < count; ++n)
+				{
+					machine.Fire(stream[cursor]);
+					if (++cursor == stream.size()) cursor = 0;
+				}
+				g_sink = g_sink + (uintptr_t)*machine.CurrentState();
+			});
+
+			for (; cursor != 0; cursor = (cursor + 1) % stream.size()) machine.Fire(stream[cursor]);
+			return timing;
+		}
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	void RunWorkloadBenchmarks(CHarness& harness)
+	{
+		// Power-law fan-out & hot target states, driven by walks with different trigger skews
+		const SWorkload workloads[] =
+		{
+			{ "workload-uniform", UniformStream, 0 },
+			{ "workload-zipf", ZipfStream, 1.1 },
+			{ "workload-markov", MarkovStream, 1.1 },
+		};
+		const uint32_t stateCounts[] = { 1024, 65536, 1048576 };
+		const char* backends[] = { "configured", "compiled-dense", "compiled-compressed", "compiled-dense-counting", "compiled-dense-latency", "compiled-dense-recorder", "compiled-dense-relaid", "compiled-auto", "compiled-mapped",
+			"compiled-dense-recorder-coarse", "compiled-dense-recorder-untimed", "compiled-dense-latency-sampled" };
+
+		for (uint32_t states : stateCounts)
+		{
+			if (states > harness.Options().MaxStates) continue;
+
+			SResult base;
+			base.States = states;
+			base.FanOut = 4;
+			base.Key = "uint32";
+			base.Callback = "none";
+
+			bool selected = false;
+			for (const SWorkload& workload : workloads)
+			{
+				for (const char* backend : backends)
+				{
+					SResult result = base;
+					result.Benchmark = workload.Name;
+					result.Backend = backend;
+					selected = selected || harness.Selected(result);
+				}
+			}
+			if (!selected) continue;
+
+			SGraphOptions options;
+			options.States = states;
+			options.Triggers = 64;
+			options.FanOut = PowerLawFanOut;
+			options.MeanFanOut = base.FanOut;
+			options.SelfLoopRatio = 0.1;
+			options.TargetSkew = 1;
+			options.ResetTrigger = true;
+			const CGeneratedMachine generated(options);
+
+			std::vector<uint32_t> keys(states);
+			for (uint32_t i = 0; i < states; ++i) keys[i] = i;
+
+			std::unique_ptr<CFiniteStateMachine<uint32_t, uint32_t>> configured(new CFiniteStateMachine<uint32_t, uint32_t>(0));
+			generated.Configure(*configured, keys, keys);
+
+			const CCompiledDefinition<uint32_t, uint32_t> dense(*configured, DenseTable);
+			const CCompiledDefinition<uint32_t, uint32_t> compressed(*configured, CompressedTable);
+			const CCompiledDefinition<uint32_t, uint32_t> automatic(*configured);
+
+			for (const SWorkload& workload : workloads)
+			{
+				SStreamOptions streamOptions;
+				streamOptions.Distribution = workload.Distribution;
+				streamOptions.Skew = workload.Skew;
+				streamOptions.Length = 1 << 20;
+				const std::vector<uint32_t> stream = generated.Stream(streamOptions);
+
+				SResult result = base;
+				result.Benchmark = workload.Name;
+
+				result.Backend = backends[0];
+				if (harness.Selected(result))
+				{
+					Replay(harness, *configured, stream).AppendTo(result, "fire");
+					harness.Report(result);
+				}
+
+				const CCompiledDefinition<uint32_t, uint32_t>* definitions[] = { &dense, &compressed };
+				for (int i = 0; i < 2; ++i)
+				{
+					result = base;
+					result.Benchmark = workload.Name;
+					result.Backend = backends[i + 1];
+					if (!harness.Selected(result)) continue;
+
+					CCompiledStateMachine<uint32_t, uint32_t> machine(definitions[i]);
+					Replay(harness, machine, stream).AppendTo(result, "fire");
+					harness.Report(result);
+				}
+
+				// Whichever layout the cost model picked; compare against the two above
+				result = base;
+				result.Benchmark = workload.Name;
+				result.Backend = backends[7];
+				if (harness.Selected(result))
+				{
+					CCompiledStateMachine<uint32_t, uint32_t> machine(&automatic);
+					Replay(harness, machine, stream).AppendTo(result, "fire");
+					result.Metrics.push_back(std::make_pair("compressed", automatic.Layout() == CompressedTable ? 1.0 : 0.0));
+					harness.Report(result);
+				}
+
+				// The automatic definition saved as an image and mapped back, against compiling it from the configuration
+				result = base;
+				result.Benchmark = workload.Name;
+				result.Backend = backends[8];
+				if (harness.Selected(result))
+				{
+					const char* path = "workload_benchmark.fsmimage";
+					WriteDefinitionImage(path, automatic);
+					{
+						typedef std::chrono::steady_clock clock;
+						const clock::time_point start = clock::now();
+						const CCompiledDefinition<uint32_t, uint32_t> mapped = LoadDefinitionImage<uint32_t, uint32_t>(path);
+						const clock::time_point loaded = clock::now();
+						const CCompiledDefinition<uint32_t, uint32_t> checked = LoadDefinitionImage<uint32_t, uint32_t>(path, FullImageCheck);
+						const clock::time_point checkedLoaded = clock::now();
+						const CCompiledDefinition<uint32_t, uint32_t> compiled(*configured);
+						const clock::time_point end = clock::now();
+
+						CCompiledStateMachine<uint32_t, uint32_t> machine(&mapped);
+						Replay(harness, machine, stream).AppendTo(result, "fire");
+						result.Metrics.push_back(std::make_pair("load_us", std::chrono::duration<double, std::micro>(loaded - start).count()));
+						result.Metrics.push_back(std::make_pair("checked_load_us", std::chrono::duration<double, std::micro>(checkedLoaded - loaded).count()));
+						result.Metrics.push_back(std::make_pair("compile_us", std::chrono::duration<double, std::micro>(end - checkedLoaded).count()));
+						harness.Report(result);
+						g_sink = g_sink + compiled.StateCount() + checked.StateCount();
+					}
+					std::remove(path);
+				}
+
+				// Dense machine renumbered after a profiling pass over the stream, so its hot rows are packed together
+				result = base;
+				result.Benchmark = workload.Name;
+				result.Backend = backends[6];
+				if (harness.Selected(result))
+				{
+					CInstrumentationCounters counters(dense);
+					CCompiledStateMachine<uint32_t, uint32_t, CCountingInstrumentation> profiled(&dense, CCountingInstrumentation(&counters));
+					for (uint32_t trigger : stream) profiled.Fire(trigger);
+
+					std::vector<uint32_t> mapping;
+					const CCompiledDefinition<uint32_t, uint32_t> relaid = dense.Relayout(counters.Snapshot().Transitions, mapping);
+
+					CCompiledStateMachine<uint32_t, uint32_t> machine(&relaid);
+					Replay(harness, machine, stream).AppendTo(result, "fire");
+					harness.Report(result);
+				}
+
+				// What the instrumentation policies cost over the plain dense machine
+				result = base;
+				result.Benchmark = workload.Name;
+				result.Backend = backends[3];
+				if (harness.Selected(result))
+				{
+					CInstrumentationCounters counters(dense);
+					CCompiledStateMachine<uint32_t, uint32_t, CCountingInstrumentation> machine(&dense, CCountingInstrumentation(&counters));
+					Replay(harness, machine, stream).AppendTo(result, "fire");
+					harness.Report(result);
+				}
+
+				result = base;
+				result.Benchmark = workload.Name;
+				result.Backend = backends[4];
+				if (harness.Selected(result))
+				{
+					CLatencyHistograms histograms(dense);
+					CCompiledStateMachine<uint32_t, uint32_t, CLatencyInstrumentation> machine(&dense, CLatencyInstrumentation(&histograms));
+					Replay(harness, machine, stream).AppendTo(result, "fire");
+					harness.Report(result);
+				}
+
+				// One fire in 16 timed
+				result = base;
+				result.Benchmark = workload.Name;
+				result.Backend = backends[11];
+				if (harness.Selected(result))
+				{
+					CLatencyHistograms histograms(dense);
+					CCompiledStateMachine<uint32_t, uint32_t, CLatencyInstrumentation> machine(&dense, CLatencyInstrumentation(&histograms, 16));
+					Replay(harness, machine, stream).AppendTo(result, "fire");
+					harness.Report(result);
+				}
+
+				result = base;
+				result.Benchmark = workload.Name;
+				result.Backend = backends[5];
+				if (harness.Selected(result))
+				{
+					CFlightRecorder recorder(4096);
+					CCompiledStateMachine<uint32_t, uint32_t, CFlightRecorderInstrumentation> machine(&dense, CFlightRecorderInstrumentation(&recorder));
+					Replay(harness, machine, stream).AppendTo(result, "fire");
+					harness.Report(result);
+				}
+
+				// Recorders which do not read the time stamp counter per transition
+				const EFlightRecorderTimestamps cheaper[] = { CoarseTimestamps, NoTimestamps };
+				for (size_t i = 0; i < 2; ++i)
+				{
+					result = base;
+					result.Benchmark = workload.Name;
+					result.Backend = backends[9 + i];
+					if (!harness.Selected(result)) continue;
+
+					CFlightRecorder recorder(4096, SingleWriter, cheaper[i]);
+					CCompiledStateMachine<uint32_t, uint32_t, CFlightRecorderInstrumentation> machine(&dense, CFlightRecorderInstrumentation(&recorder));
+					Replay(harness, machine, stream).AppendTo(result, "fire");
+					harness.Report(result);
+				}
+			}
+		}
+	}
+}
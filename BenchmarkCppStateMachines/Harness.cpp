@@ -0,0 +1,95 @@
+#include "Harness.h"
+#include "Statistics.h"
+
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+namespace Benchmarks
+{
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	void STiming::AppendTo(SResult& result, const std::string& unit) const
+	{
+		const SSummary summary = Summarize(Samples);
+
+		result.Samples = Samples;
+		result.Metrics.push_back(std::make_pair("ns_per_" + unit, summary.Mean));
+		result.Metrics.push_back(std::make_pair("ns_per_" + unit + "_ci", summary.HalfWidth));
+		for (const std::pair<std::string, double>& counter : Counters) result.Metrics.push_back(std::make_pair(counter.first + "_per_" + unit, counter.second));
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	std::string SResult::Id() const
+	{
+		std::ostringstream id;
+		id << Benchmark << "/" << Backend << "/states=" << States << "/fanout=" << FanOut << "/key=" << Key << "/callback=" << Callback;
+		return id.str();
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	CHarness::CHarness(const SOptions& options, std::ostream& out, std::ostream* save, const CBaseline* baseline)
+		: m_options(options), m_out(out), m_pSave(save), m_pBaseline(baseline), m_regressions(0)
+	{
+		if (m_options.Counters) m_counters.Open();
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	bool CHarness::Selected(const SResult& result) const
+	{
+		return m_options.Filter.empty() || result.Id().find(m_options.Filter) != std::string::npos;
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	void CHarness::Report(SResult& result)
+	{
+		const std::vector<double>* baseline = m_pBaseline != nullptr && !result.Samples.empty() ? m_pBaseline->Find(result.Id()) : nullptr;
+		if (baseline != nullptr && !baseline->empty())
+		{
+			const SSummary before = Summarize(*baseline);
+			const SSummary after = Summarize(result.Samples);
+			const double change = after.Mean / before.Mean - 1.0;
+			const bool regression = change > m_options.Threshold && SignificantlyGreater(after, before);
+
+			result.Metrics.push_back(std::make_pair("baseline", before.Mean));
+			result.Metrics.push_back(std::make_pair("baseline_ci", before.HalfWidth));
+			result.Metrics.push_back(std::make_pair("change_pct", change * 100.0));
+			result.Metrics.push_back(std::make_pair("regression", regression ? 1.0 : 0.0));
+
+			if (regression)
+			{
+				++m_regressions;
+				std::cerr << std::setprecision(4) << "REGRESSION " << result.Id() << ": "
+					<< before.Mean << " +/- " << before.HalfWidth << " -> " << after.Mean << " +/- " << after.HalfWidth
+					<< " (+" << change * 100.0 << "%)" << std::endl;
+			}
+		}
+
+		std::ostringstream line;
+		line << std::setprecision(6)
+			<< "{\"id\":\"" << result.Id() << "\""
+			<< ",\"benchmark\":\"" << result.Benchmark << "\""
+			<< ",\"backend\":\"" << result.Backend << "\""
+			<< ",\"states\":" << result.States
+			<< ",\"fanout\":" << result.FanOut
+			<< ",\"key\":\"" << result.Key << "\""
+			<< ",\"callback\":\"" << result.Callback << "\"";
+
+		for (const std::pair<std::string, double>& metric : result.Metrics) line << ",\"" << metric.first << "\":" << metric.second;
+
+		if (!result.Samples.empty())
+		{
+			line << ",\"samples\":[";
+			for (size_t i = 0; i < result.Samples.size(); ++i) line << (i == 0 ? "" : ",") << result.Samples[i];
+			line << "]";
+		}
+		line << "}";
+
+		m_out << line.str() << std::endl;
+		if (m_pSave != nullptr) *m_pSave << line.str() << std::endl;
+	}
+}
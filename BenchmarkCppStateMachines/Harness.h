@@ -0,0 +1,184 @@
+#pragma once
+
+#include "Baseline.h"
+#include "PerfCounters.h"
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace Benchmarks
+{
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	// Bytes currently allocated through the global operator new (see Allocations.cpp)
+	size_t LiveBytes();
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	struct SOptions
+	{
+		uint32_t MaxStates = 1 << 20;
+		double MinTimeMs = 200;
+		std::string Filter;
+		bool Counters = true;
+
+		// Timed batches per benchmark, the samples behind confidence intervals & comparisons
+		unsigned int Repetitions = 5;
+
+		// Slowdown (0.05 = 5%) a significant difference must exceed to count as a regression
+		double Threshold = 0.05;
+	};
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	struct SResult;
+
+	struct STiming
+	{
+		// Nanoseconds per iteration of every repetition
+		std::vector<double> Samples;
+
+		// Hardware counters per iteration, of every thread the benchmark ran on, over the repetitions in which each could
+		// be read; counters which never could are left out, empty when they are unavailable
+		std::vector<std::pair<std::string, double>> Counters;
+
+		// Adds the samples plus "ns_per_<unit>" (mean), "ns_per_<unit>_ci" (95% half width) & "<counter>_per_<unit>" metrics
+		void AppendTo(SResult& result, const std::string& unit) const;
+	};
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	// One measured configuration and its metrics, printed as a single JSON line
+	struct SResult
+	{
+		std::string Benchmark;
+		std::string Backend;
+		uint32_t States;
+		uint32_t FanOut;
+		std::string Key;
+		std::string Callback;
+		std::vector<std::pair<std::string, double>> Metrics;
+
+		// Repeated measurements of the main metric, compared against baselines
+		std::vector<double> Samples;
+
+		// Stable name of the configuration, e.g. "fire/compiled-dense/states=1024/fanout=4/key=enum/callback=none"
+		std::string Id() const;
+	};
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	class CHarness
+	{
+	private:
+		SOptions m_options;
+		std::ostream& m_out;
+		std::ostream* m_pSave;
+		const CBaseline* m_pBaseline;
+		CPerfCounters m_counters;
+		size_t m_regressions;
+
+	public:
+		// Results are also written to 'save' and compared against 'baseline' when those are given
+		CHarness(const SOptions& options, std::ostream& out, std::ostream* save = nullptr, const CBaseline* baseline = nullptr);
+
+		const SOptions& Options() const { return m_options; }
+		const CPerfCounters& Counters() const { return m_counters; }
+
+		// Whether the configuration passes the --filter option
+		bool Selected(const SResult& result) const;
+
+		void Report(SResult& result);
+
+		// Significant regressions against the baseline reported so far
+		size_t Regressions() const { return m_regressions; }
+
+		// Grows body(iterations) batches until one takes at least MinTimeMs, then repeats that batch.
+		// Returns time per iteration of every repetition & counters per iteration over all of them.
+		template<typename TBody>
+		STiming Time(TBody body);
+	};
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	void RunFireBenchmarks(CHarness& harness);
+	void RunWorkloadBenchmarks(CHarness& harness);
+	void RunKeyedBenchmarks(CHarness& harness);
+
+	// Measures cache latencies & the compressed lookup's overhead on this machine, printed as an FSM::STableCostModel
+	void RunCostModelCalibration(CHarness& harness, std::ostream& out);
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename TBody>
+	inline STiming CHarness::Time(TBody body)
+	{
+		typedef std::chrono::steady_clock Clock;
+
+		body(1024);
+
+		const double target = m_options.MinTimeMs * 1e6;
+		uint64_t iterations = 1024;
+		STiming timing;
+
+		// Summed by counter slot, over the repetitions in which that counter could be read
+		std::vector<std::pair<std::string, double>> counters;
+		std::vector<unsigned int> counted;
+		const auto accumulate = [&counters, &counted](const std::vector<std::pair<std::string, double>>& repetition)
+		{
+			counters.resize(repetition.size());
+			counted.resize(repetition.size(), 0);
+			for (size_t i = 0; i < repetition.size(); ++i)
+			{
+				counters[i].first = repetition[i].first;
+				if (repetition[i].second != repetition[i].second) continue;
+
+				counters[i].second += repetition[i].second;
+				++counted[i];
+			}
+		};
+
+		for (;;)
+		{
+			m_counters.Start();
+			const Clock::time_point start = Clock::now();
+			body(iterations);
+			const double elapsed = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+			const std::vector<std::pair<std::string, double>> repetition = m_counters.Stop();
+
+			if (elapsed >= target || iterations >= (1ull << 40))
+			{
+				timing.Samples.push_back(elapsed / (double)iterations);
+				accumulate(repetition);
+				break;
+			}
+
+			// Aim slightly past the target, growing at most 100x per step
+			const double scale = elapsed > 0 ? target * 1.2 / elapsed : 100.0;
+			iterations = (uint64_t)((double)iterations * (scale < 2.0 ? 2.0 : scale > 100.0 ? 100.0 : scale));
+		}
+
+		// The batch which reached the target is the first repetition
+		while (timing.Samples.size() < m_options.Repetitions)
+		{
+			m_counters.Start();
+			const Clock::time_point start = Clock::now();
+			body(iterations);
+			const double elapsed = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+			const std::vector<std::pair<std::string, double>> repetition = m_counters.Stop();
+
+			timing.Samples.push_back(elapsed / (double)iterations);
+			accumulate(repetition);
+		}
+
+		for (size_t i = 0; i < counters.size(); ++i)
+		{
+			if (counted[i] != 0) timing.Counters.push_back(std::make_pair(counters[i].first, counters[i].second / ((double)iterations * counted[i])));
+		}
+		return timing;
+	}
+}
@@ -0,0 +1,139 @@
+#include "PerfCounters.h"
+
+#include <limits>
+
+#ifdef __linux__
+#include <cerrno>
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace Benchmarks
+{
+#ifdef __linux__
+
+	namespace
+	{
+		struct SEvent
+		{
+			const char* Name;
+			uint32_t Type;
+			uint64_t Config;
+		};
+
+		uint64_t CacheEvent(uint64_t cache)
+		{
+			return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+		}
+
+		int OpenEvent(const SEvent& event)
+		{
+			perf_event_attr attributes;
+			std::memset(&attributes, 0, sizeof(attributes));
+			attributes.size = sizeof(attributes);
+			attributes.type = event.Type;
+			attributes.config = event.Config;
+			attributes.disabled = 1;
+			attributes.exclude_kernel = 1;
+			attributes.exclude_hv = 1;
+			attributes.inherit = 1;
+			attributes.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+			return (int)syscall(SYS_perf_event_open, &attributes, 0, -1, -1, 0);
+		}
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	CPerfCounters::~CPerfCounters()
+	{
+		for (const SCounter& counter : m_counters) close(counter.Descriptor);
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	void CPerfCounters::Open()
+	{
+		const SEvent events[] =
+		{
+			{ "cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+			{ "instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+			{ "l1d_misses", PERF_TYPE_HW_CACHE, CacheEvent(PERF_COUNT_HW_CACHE_L1D) },
+			{ "llc_misses", PERF_TYPE_HW_CACHE, CacheEvent(PERF_COUNT_HW_CACHE_LL) },
+			{ "branch_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+			{ "dtlb_misses", PERF_TYPE_HW_CACHE, CacheEvent(PERF_COUNT_HW_CACHE_DTLB) },
+		};
+
+		int lastError = 0;
+		for (const SEvent& event : events)
+		{
+			const int descriptor = OpenEvent(event);
+			if (descriptor < 0)
+			{
+				lastError = errno;
+				continue;
+			}
+
+			const SCounter counter = { event.Name, descriptor, { 0, 0, 0 } };
+			m_counters.push_back(counter);
+		}
+
+		if (m_counters.empty()) m_error = std::string("perf_event_open failed: ") + std::strerror(lastError);
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	// Inherited counts of threads which exited are kept by the kernel through a reset, so counts are taken as differences
+	void CPerfCounters::Start()
+	{
+		for (SCounter& counter : m_counters)
+		{
+			if (read(counter.Descriptor, counter.Started, sizeof(counter.Started)) != (ssize_t)sizeof(counter.Started))
+			{
+				std::memset(counter.Started, 0xFF, sizeof(counter.Started));
+			}
+			ioctl(counter.Descriptor, PERF_EVENT_IOC_ENABLE, 0);
+		}
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	std::vector<std::pair<std::string, double>> CPerfCounters::Stop()
+	{
+		for (const SCounter& counter : m_counters) ioctl(counter.Descriptor, PERF_EVENT_IOC_DISABLE, 0);
+
+		std::vector<std::pair<std::string, double>> counts;
+		for (const SCounter& counter : m_counters)
+		{
+			// value, time enabled, time running
+			uint64_t values[3] = { 0, 0, 0 };
+			const bool started = counter.Started[0] != UINT64_MAX;
+			const bool stopped = read(counter.Descriptor, values, sizeof(values)) == (ssize_t)sizeof(values);
+			const uint64_t running = values[2] - counter.Started[2];
+			if (!started || !stopped || running == 0)
+			{
+				counts.push_back(std::make_pair(counter.Name, std::numeric_limits<double>::quiet_NaN()));
+				continue;
+			}
+
+			const double enabled = (double)(values[1] - counter.Started[1]);
+			counts.push_back(std::make_pair(counter.Name, (double)(values[0] - counter.Started[0]) * enabled / (double)running));
+		}
+		return counts;
+	}
+
+#else
+
+	CPerfCounters::~CPerfCounters() { }
+
+	void CPerfCounters::Open() { m_error = "hardware counters are only supported on Linux"; }
+
+	void CPerfCounters::Start() { }
+
+	std::vector<std::pair<std::string, double>> CPerfCounters::Stop() { return std::vector<std::pair<std::string, double>>(); }
+
+#endif
+}
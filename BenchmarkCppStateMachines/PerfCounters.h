@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace Benchmarks
+{
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	// Hardware counters (Linux perf_event_open) around a measured region.
+	// Every event is opened on its own, so a machine or VM lacking one event (often dTLB or LLC) still reports the rest.
+	// When nothing can be opened (not Linux, perf_event_paranoid, containers) Available() is false and Stop() returns nothing.
+	class CPerfCounters
+	{
+	private:
+		struct SCounter
+		{
+			std::string Name;
+			int Descriptor;
+			uint64_t Started[3];		// Value, time enabled & time running when Start() was called
+		};
+
+		std::vector<SCounter> m_counters;
+		std::string m_error;
+
+	public:
+		CPerfCounters() { }
+		~CPerfCounters();
+
+		CPerfCounters(const CPerfCounters&) = delete;
+		CPerfCounters& operator=(const CPerfCounters&) = delete;
+
+		// Opens cycles, instructions, L1D / LLC / dTLB read misses & branch misses for the calling thread and every thread
+		// it starts afterwards, so the work of worker threads (e.g. a sharded store's) is counted as well
+		void Open();
+
+		bool Available() const { return !m_counters.empty(); }
+
+		// Why nothing could be opened, empty when Available()
+		const std::string& Error() const { return m_error; }
+
+		void Start();
+
+		// Counts since Start(), scaled up when the kernel had to multiplex the events. One slot per opened counter, always
+		// in the same order; NaN for counters which could not be read or never got to run.
+		std::vector<std::pair<std::string, double>> Stop();
+	};
+}
@@ -0,0 +1,67 @@
+#include "Statistics.h"
+
+#include <cmath>
+
+namespace Benchmarks
+{
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	SSummary Summarize(const std::vector<double>& samples)
+	{
+		SSummary summary = { samples.size(), 0, 0, 0 };
+		if (samples.empty()) return summary;
+
+		for (double sample : samples) summary.Mean += sample;
+		summary.Mean /= (double)samples.size();
+
+		if (samples.size() < 2) return summary;
+
+		for (double sample : samples) summary.Variance += (sample - summary.Mean) * (sample - summary.Mean);
+		summary.Variance /= (double)(samples.size() - 1);
+
+		summary.HalfWidth = StudentT((double)(samples.size() - 1), true) * std::sqrt(summary.Variance / (double)samples.size());
+		return summary;
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	bool SignificantlyGreater(const SSummary& current, const SSummary& baseline)
+	{
+		if (current.Count < 2 || baseline.Count < 2) return current.Mean > baseline.Mean;
+
+		const double a = current.Variance / (double)current.Count;
+		const double b = baseline.Variance / (double)baseline.Count;
+		if (a + b == 0) return current.Mean > baseline.Mean;
+
+		// Welch-Satterthwaite degrees of freedom
+		const double degrees = (a + b) * (a + b) / (a * a / (double)(current.Count - 1) + b * b / (double)(baseline.Count - 1));
+		const double t = (current.Mean - baseline.Mean) / std::sqrt(a + b);
+
+		return t > StudentT(degrees, false);
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	double StudentT(double degreesOfFreedom, bool twoSided)
+	{
+		static const double oneSided95[] =
+		{
+			6.314, 2.920, 2.353, 2.132, 2.015, 1.943, 1.895, 1.860, 1.833, 1.812,
+			1.796, 1.782, 1.771, 1.761, 1.753, 1.746, 1.740, 1.734, 1.729, 1.725,
+			1.721, 1.717, 1.714, 1.711, 1.708, 1.706, 1.703, 1.701, 1.699, 1.697,
+		};
+		static const double twoSided95[] =
+		{
+			12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+			2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+			2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042,
+		};
+
+		// Rounding down is conservative, fewer degrees of freedom give a larger quantile
+		const int degrees = degreesOfFreedom < 1 ? 1 : (int)degreesOfFreedom;
+		if (degrees <= 30) return twoSided ? twoSided95[degrees - 1] : oneSided95[degrees - 1];
+
+		// Close to the tables' tail beyond 30 degrees of freedom
+		return twoSided ? 1.960 + 2.4 / degrees : 1.645 + 1.6 / degrees;
+	}
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace Benchmarks
+{
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	struct SSummary
+	{
+		size_t Count;
+		double Mean;
+		double Variance;
+
+		// Half width of the two sided 95% confidence interval of the mean
+		double HalfWidth;
+	};
+
+	SSummary Summarize(const std::vector<double>& samples);
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	// One sided Welch t-test at 95%: is the mean of 'current' larger than the mean of 'baseline'?
+	bool SignificantlyGreater(const SSummary& current, const SSummary& baseline);
+
+	// Student t quantile for the given degrees of freedom, 'twoSided' picks 97.5% over 95%
+	double StudentT(double degreesOfFreedom, bool twoSided);
+}
@@ -0,0 +1,99 @@
+#include "Harness.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+// Prints one JSON object per line:
+//   {"id":"fire/compiled-dense/states=1024/fanout=4/key=enum/callback=none", ..., "ns_per_fire":3.1, "cycles_per_fire":9.8, ...}
+// Saved output doubles as a baseline for --compare; exits with 1 when a significant regression was found.
+
+void usage(const char* name)
+{
+	std::cerr << "Usage: " << name << " [options]" << std::endl
+		<< "  --quick            small machines & short runs" << std::endl
+		<< "  --max-states N     skip machines with more than N states" << std::endl
+		<< "  --min-time-ms T    minimum duration of a timed batch" << std::endl
+		<< "  --filter TEXT      only run benchmarks whose id contains TEXT" << std::endl
+		<< "  --no-counters      skip hardware performance counters" << std::endl
+		<< "  --repetitions N    timed batches per benchmark (default 5)" << std::endl
+		<< "  --save FILE        also write results to FILE, for a later --compare" << std::endl
+		<< "  --compare FILE     compare against results saved in FILE" << std::endl
+		<< "  --threshold PCT    slowdown that counts as a regression when significant (default 5)" << std::endl
+		<< "  --cost-model       only measure this machine's table cost model & print it as code" << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+	Benchmarks::SOptions options;
+	std::string savePath, comparePath;
+	bool costModel = false;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		const bool hasValue = i + 1 < argc;
+
+		if (std::strcmp(argv[i], "--quick") == 0)
+		{
+			options.MaxStates = 16384;
+			options.MinTimeMs = 10;
+			options.Repetitions = 3;
+		}
+		else if (std::strcmp(argv[i], "--max-states") == 0 && hasValue) options.MaxStates = (uint32_t)std::strtoul(argv[++i], nullptr, 10);
+		else if (std::strcmp(argv[i], "--min-time-ms") == 0 && hasValue) options.MinTimeMs = std::strtod(argv[++i], nullptr);
+		else if (std::strcmp(argv[i], "--filter") == 0 && hasValue) options.Filter = argv[++i];
+		else if (std::strcmp(argv[i], "--no-counters") == 0) options.Counters = false;
+		else if (std::strcmp(argv[i], "--repetitions") == 0 && hasValue) options.Repetitions = (unsigned int)std::strtoul(argv[++i], nullptr, 10);
+		else if (std::strcmp(argv[i], "--save") == 0 && hasValue) savePath = argv[++i];
+		else if (std::strcmp(argv[i], "--compare") == 0 && hasValue) comparePath = argv[++i];
+		else if (std::strcmp(argv[i], "--threshold") == 0 && hasValue) options.Threshold = std::strtod(argv[++i], nullptr) / 100.0;
+		else if (std::strcmp(argv[i], "--cost-model") == 0) costModel = true;
+		else
+		{
+			usage(argv[0]);
+			return 2;
+		}
+	}
+
+	Benchmarks::CBaseline baseline;
+	if (!comparePath.empty() && !baseline.Load(comparePath))
+	{
+		std::cerr << "Cannot read baseline " << comparePath << std::endl;
+		return 2;
+	}
+
+	std::ofstream save;
+	if (!savePath.empty())
+	{
+		save.open(savePath);
+		if (!save)
+		{
+			std::cerr << "Cannot write " << savePath << std::endl;
+			return 2;
+		}
+	}
+
+	Benchmarks::CHarness harness(options, std::cout, savePath.empty() ? nullptr : &save, comparePath.empty() ? nullptr : &baseline);
+	if (options.Counters && !harness.Counters().Available())
+	{
+		std::cerr << "Hardware counters unavailable (" << harness.Counters().Error() << "), reporting time only" << std::endl;
+	}
+
+	if (costModel)
+	{
+		Benchmarks::RunCostModelCalibration(harness, std::cout);
+		return 0;
+	}
+
+	Benchmarks::RunFireBenchmarks(harness);
+	Benchmarks::RunWorkloadBenchmarks(harness);
+	Benchmarks::RunKeyedBenchmarks(harness);
+
+	if (harness.Regressions() > 0)
+	{
+		std::cerr << harness.Regressions() << " significant regression(s) over " << options.Threshold * 100.0 << "%" << std::endl;
+		return 1;
+	}
+	return 0;
+}
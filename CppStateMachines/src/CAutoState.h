@@ -2,6 +2,7 @@
 
 #include "FSMInterfaces.h"
 #include <exception>
+#include <stdexcept>
 #include <map>
 
 #pragma region AUTO STATES
@@ -13,7 +14,7 @@ namespace FSM
 		////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 		template<typename TTrigger, typename TState>
-		class CAutoState : FSM_STATE(TTrigger, TState)
+		class CAutoState : public IConfigurableState<TTrigger, TState>
 		{
 		private:
 			ICallback* m_pOnEntryCallbackInstance;
@@ -43,6 +44,10 @@ namespace FSM
 			virtual IStateConfigurator<TTrigger, TState>* OnExit(state_change_callback onExitCallback) override;
 			virtual IState<TTrigger, TState>* State() override { return this; }
 
+			// Read-only views used when compiling the configured machine
+			const std::map<TTrigger, TState>& Transitions() const { return m_triggerStateMap; }
+			SStateCallbacks Callbacks() const { return { m_pOnEntryCallback, m_pOnExitCallback, m_pOnEntryCallbackInstance, m_pOnExitCallbackInstance }; }
+
 		private:
 
 			void Call(ICallback* callback) { if (callback != nullptr) callback->Call(); }
@@ -53,7 +58,8 @@ namespace FSM
 
 		template<typename TTrigger, typename TState>
 		CAutoState<TTrigger, TState>::CAutoState(const TState& state) 
-			: IState<TTrigger, TState>(state, true),
+			: IConfigurableState<TTrigger, TState>(state, true),
+			m_pOnEntryCallbackInstance(nullptr), m_pOnExitCallbackInstance(nullptr),
 			m_pOnEntryCallback(nullptr), m_pOnExitCallback(nullptr)
 		{
 		}
@@ -76,7 +82,7 @@ namespace FSM
 				return itr->second;
 			}
 
-			throw std::exception("Cannot find the state!");
+			throw std::runtime_error("Cannot find the state!");
 		}
 
 		////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -117,7 +123,7 @@ namespace FSM
 		IStateConfigurator<TTrigger, TState>* CAutoState<TTrigger, TState>::OnEntry(ICallback* onEntryCallback)
 		{
 			// Throw if already subscribed, to avoid memory leaks
-			if (m_pOnEntryCallbackInstance != nullptr) throw new std::exception("Already subscribed to instance!");
+			if (m_pOnEntryCallbackInstance != nullptr) throw std::runtime_error("Already subscribed to instance!");
 			m_pOnEntryCallbackInstance = onEntryCallback;
 			return this;
 		}
@@ -128,7 +134,7 @@ namespace FSM
 		IStateConfigurator<TTrigger, TState>* CAutoState<TTrigger, TState>::OnEntry(state_change_callback onEntryCallback)
 		{
 			// Throw if already subscribed to instance
-			if (m_pOnEntryCallbackInstance != nullptr) throw new std::exception("Already subscribed to instance!");
+			if (m_pOnEntryCallbackInstance != nullptr) throw std::runtime_error("Already subscribed to instance!");
 			m_pOnEntryCallback = onEntryCallback;
 			return this;
 		}
@@ -139,7 +145,7 @@ namespace FSM
 		IStateConfigurator<TTrigger, TState>* CAutoState<TTrigger, TState>::OnExit(ICallback* onExitCallback)
 		{
 			// Throw if already subscribed, to avoid memory leaks
-			if (m_pOnExitCallbackInstance != nullptr) throw new std::exception("Already subscribed to instance!");
+			if (m_pOnExitCallbackInstance != nullptr) throw std::runtime_error("Already subscribed to instance!");
 			m_pOnExitCallbackInstance = onExitCallback;
 			return this;
 		}
@@ -150,7 +156,7 @@ namespace FSM
 		IStateConfigurator<TTrigger, TState>* CAutoState<TTrigger, TState>::OnExit(state_change_callback onExitCallback)
 		{
 			// Throw if already subscribed to instance
-			if (m_pOnExitCallbackInstance != nullptr) throw new std::exception("Already subscribed to instance!");
+			if (m_pOnExitCallbackInstance != nullptr) throw std::runtime_error("Already subscribed to instance!");
 			m_pOnExitCallback = onExitCallback;
 			return this;
 		}
@@ -0,0 +1,250 @@
+#pragma once
+
+#include "CCompiledDefinition.h"
+#include "CFlightRecorder.h"
+#include "CLatencyHistograms.h"
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#pragma region CHROME TRACE WRITER
+
+namespace FSM
+{
+	namespace ___IMPL___
+	{
+		////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+		// Writes 'text' as a JSON string
+		inline void WriteJsonString(std::ostream& out, const std::string& text)
+		{
+			out << '"';
+			for (char c : text)
+			{
+				if (c == '"' || c == '\\') out << '\\' << c;
+				else if ((unsigned char)c < 0x20)
+				{
+					char escaped[8];
+					std::snprintf(escaped, sizeof(escaped), "\\u%04x", (unsigned int)(unsigned char)c);
+					out << escaped;
+				}
+				else out << c;
+			}
+			out << '"';
+		}
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	// Streams flight recorder records as Chrome Trace Event JSON, for Perfetto (ui.perfetto.dev) or chrome://tracing.
+	// Every machine tag gets its own track; the states a machine passes through are slices on it, with the exit &
+	// entry callbacks nested as slices inside the state they belong to; records need TickTimestamps, the recorders'
+	// default. Events are written as records come in, so the writer only keeps a few bytes per machine, however long
+	// the trace gets. The JSON is complete once Close (or the destructor) ran; nothing can be written after it.
+	template<typename TTrigger, typename TState>
+	class CChromeTraceWriter
+	{
+	private:
+		struct STrack
+		{
+			bool Named;
+			bool Open;				// A state slice was begun and not ended yet
+			uint32_t State;			// The open slice's state
+			uint64_t Last;			// Timestamp of the last record written
+			uint64_t End;			// When its entry callbacks were done
+		};
+
+		std::ostream& m_out;
+		std::map<uint32_t, STrack> m_tracks;
+		std::vector<std::string> m_stateNames;
+		std::vector<std::string> m_triggerNames;
+		bool m_first;
+		bool m_closed;
+
+		// Slices entered by a trigger name it in their args
+		void Event(const char* phase, const std::string& name, const char* category, uint32_t machine, uint64_t timestamp, uint64_t duration, const std::string* trigger = nullptr);
+		void WriteMicroseconds(uint64_t ticks);
+		STrack& Track(uint32_t machine);
+
+	public:
+		// Records are named after the definition's states & triggers
+		CChromeTraceWriter(std::ostream& out, const CCompiledDefinition<TTrigger, TState>* definition);
+		~CChromeTraceWriter() { Close(); }
+
+		CChromeTraceWriter(const CChromeTraceWriter&) = delete;
+		CChromeTraceWriter& operator=(const CChromeTraceWriter&) = delete;
+
+		// Names a machine's track; unnamed tracks are called "Machine <tag>". Throws std::runtime_error once closed.
+		void NameMachine(uint32_t machine, const std::string& name);
+
+		// Records of a machine must come oldest first. Records no newer than the last one written for their machine
+		// are skipped, so overlapping snapshots of a flight recorder can be written one after another. When the recorder
+		// overwrote records between two snapshots, the open state slice ends where its entry callbacks were done and
+		// the machine's track carries on with the state the next record left. Throws std::runtime_error once closed and
+		// std::invalid_argument for records of another definition.
+		void Write(const STransitionRecord& record);
+
+		// Slices need CLatencyClock ticks: records of recorders with other EFlightRecorderTimestamps are rejected with
+		// std::invalid_argument
+		void Write(const std::vector<STransitionRecord>& records, EFlightRecorderTimestamps timestamps = TickTimestamps);
+		void Write(const CFlightRecorder& recorder) { Write(recorder.Snapshot(), recorder.Timestamps()); }
+
+		// Ends the open state slices after the last transition of their machine and finishes the JSON
+		void Close();
+	};
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename TTrigger, typename TState>
+	CChromeTraceWriter<TTrigger, TState>::CChromeTraceWriter(std::ostream& out, const CCompiledDefinition<TTrigger, TState>* definition)
+		: m_out(out), m_first(true), m_closed(false)
+	{
+		for (uint32_t i = 0; i < definition->StateCount(); ++i) m_stateNames.push_back(___IMPL___::TraceName(definition->State(i)));
+		for (uint32_t i = 0; i < definition->TriggerCount(); ++i) m_triggerNames.push_back(___IMPL___::TraceName(definition->Trigger(i)));
+
+		m_out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename TTrigger, typename TState>
+	void CChromeTraceWriter<TTrigger, TState>::Event(const char* phase, const std::string& name, const char* category, uint32_t machine, uint64_t timestamp, uint64_t duration, const std::string* trigger)
+	{
+		m_out << (m_first ? "\n" : ",\n");
+		m_first = false;
+
+		m_out << "{\"ph\":\"" << phase << "\",\"name\":";
+		___IMPL___::WriteJsonString(m_out, name);
+		m_out << ",\"cat\":\"" << category << "\",\"pid\":1,\"tid\":" << machine << ",\"ts\":";
+		WriteMicroseconds(timestamp);
+		if (*phase == 'X')
+		{
+			m_out << ",\"dur\":";
+			WriteMicroseconds(duration);
+		}
+		if (trigger != nullptr)
+		{
+			m_out << ",\"args\":{\"trigger\":";
+			___IMPL___::WriteJsonString(m_out, *trigger);
+			m_out << '}';
+		}
+		m_out << '}';
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	// Fixed notation with nanosecond decimals, whatever the stream's format flags
+	template<typename TTrigger, typename TState>
+	inline void CChromeTraceWriter<TTrigger, TState>::WriteMicroseconds(uint64_t ticks)
+	{
+		char text[32];
+		std::snprintf(text, sizeof(text), "%.3f", CLatencyClock::Nanoseconds(ticks) / 1000);
+		m_out << text;
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename TTrigger, typename TState>
+	typename CChromeTraceWriter<TTrigger, TState>::STrack& CChromeTraceWriter<TTrigger, TState>::Track(uint32_t machine)
+	{
+		typename std::map<uint32_t, STrack>::iterator itr = m_tracks.find(machine);
+		if (itr != m_tracks.end()) return itr->second;
+
+		const STrack track = { false, false, 0, 0, 0 };
+		return m_tracks.insert(std::make_pair(machine, track)).first->second;
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename TTrigger, typename TState>
+	void CChromeTraceWriter<TTrigger, TState>::NameMachine(uint32_t machine, const std::string& name)
+	{
+		if (m_closed) throw std::runtime_error("The trace was closed!");
+
+		STrack& track = Track(machine);
+		track.Named = true;
+
+		m_out << (m_first ? "\n" : ",\n");
+		m_first = false;
+
+		m_out << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":" << machine << ",\"args\":{\"name\":";
+		___IMPL___::WriteJsonString(m_out, name);
+		m_out << "}}";
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename TTrigger, typename TState>
+	void CChromeTraceWriter<TTrigger, TState>::Write(const STransitionRecord& record)
+	{
+		if (m_closed) throw std::runtime_error("The trace was closed!");
+		if (record.From >= m_stateNames.size() || record.To >= m_stateNames.size() || record.Trigger >= m_triggerNames.size())
+		{
+			throw std::invalid_argument("Record is of another definition!");
+		}
+
+		STrack& track = Track(record.Machine);
+		if (track.Open && record.Timestamp <= track.Last) return;
+
+		if (!track.Named) NameMachine(record.Machine, "Machine " + std::to_string(record.Machine));
+
+		const std::string& from = m_stateNames[record.From];
+		const std::string& to = m_stateNames[record.To];
+		const uint64_t entered = record.Timestamp + record.ExitTicks;
+
+		// Records were lost in between: the open state ends as its last known record left it
+		if (track.Open && track.State != record.From)
+		{
+			Event("E", m_stateNames[track.State], "state", record.Machine, track.End, 0);
+			track.Open = false;
+		}
+
+		// The first record of a machine opens its track with the state it left
+		if (!track.Open) Event("B", from, "state", record.Machine, record.Timestamp, 0);
+
+		if (record.ExitTicks != 0) Event("X", "OnExit " + from, "callback", record.Machine, record.Timestamp, record.ExitTicks);
+		Event("E", from, "state", record.Machine, entered, 0);
+
+		Event("B", to, "state", record.Machine, entered, 0, &m_triggerNames[record.Trigger]);
+		if (record.EntryTicks != 0) Event("X", "OnEntry " + to, "callback", record.Machine, entered, record.EntryTicks);
+
+		track.Open = true;
+		track.State = record.To;
+		track.Last = record.Timestamp;
+		track.End = entered + record.EntryTicks;
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename TTrigger, typename TState>
+	void CChromeTraceWriter<TTrigger, TState>::Write(const std::vector<STransitionRecord>& records, EFlightRecorderTimestamps timestamps)
+	{
+		if (timestamps != TickTimestamps) throw std::invalid_argument("Records need TickTimestamps!");
+
+		for (const STransitionRecord& record : records) Write(record);
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename TTrigger, typename TState>
+	void CChromeTraceWriter<TTrigger, TState>::Close()
+	{
+		if (m_closed) return;
+		m_closed = true;
+
+		typename std::map<uint32_t, STrack>::const_iterator itr = m_tracks.begin();
+		for (; itr != m_tracks.end(); ++itr)
+		{
+			if (itr->second.Open) Event("E", m_stateNames[itr->second.State], "state", itr->first, itr->second.End, 0);
+		}
+
+		m_out << "\n]}\n";
+		m_out.flush();
+	}
+}
+
+#pragma endregion
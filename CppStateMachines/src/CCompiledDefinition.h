@@ -0,0 +1,641 @@
+#pragma once
+
+#include "export.h"
+#include "CPartitionRefinement.h"
+#include "CPerfectHash.h"
+#include "CTransitionTables.h"
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+#pragma region COMPILED DEFINITION
+
+namespace FSM
+{
+	namespace ___IMPL___
+	{
+		////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+		template<typename T> struct IsStringTrigger : std::false_type { };
+		template<> struct IsStringTrigger<std::string> : std::true_type { };
+		template<> struct IsStringTrigger<std::string_view> : std::true_type { };
+
+		////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+		// Maps arbitrary triggers to their index through an ordered map
+		template<typename TTrigger, bool = IsStringTrigger<TTrigger>::value>
+		class CTriggerIndex
+		{
+		private:
+			std::map<TTrigger, uint32_t> m_indices;
+
+		public:
+			void Build(std::vector<TTrigger>& triggers)
+			{
+				m_indices.clear();
+				for (uint32_t i = 0; i < (uint32_t)triggers.size(); ++i) m_indices.insert(std::make_pair(triggers[i], i));
+			}
+
+			uint32_t Find(const TTrigger& trigger, const std::vector<TTrigger>&) const
+			{
+				typename std::map<TTrigger, uint32_t>::const_iterator itr = m_indices.find(trigger);
+				return itr != m_indices.end() ? itr->second : InvalidIndex;
+			}
+		};
+
+		////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+		// Maps string triggers to their index through a minimal perfect hash; the triggers are
+		// reordered so that a trigger's index is its hash slot
+		template<typename TTrigger>
+		class CTriggerIndex<TTrigger, true>
+		{
+		private:
+			CMinimalPerfectHash m_hash;
+
+		public:
+			void Build(std::vector<TTrigger>& triggers)
+			{
+				std::vector<std::string_view> keys(triggers.begin(), triggers.end());
+				m_hash = CMinimalPerfectHash(keys);
+
+				std::vector<TTrigger> ordered(triggers.size());
+				for (size_t i = 0; i < triggers.size(); ++i) ordered[m_hash.Slot(keys[i])] = triggers[i];
+				triggers.swap(ordered);
+			}
+
+			uint32_t Find(std::string_view trigger, const std::vector<TTrigger>& triggers) const
+			{
+				if (triggers.empty()) return InvalidIndex;
+
+				const uint32_t slot = m_hash.Slot(trigger);
+				return std::string_view(triggers[slot]) == trigger ? slot : InvalidIndex;
+			}
+		};
+
+		////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+		template<typename TTrigger, typename TState>
+		class CAutoStateCollector : public IStateVisitor<TTrigger, TState>
+		{
+		public:
+			std::vector<const CAutoState<TTrigger, TState>*> States;
+
+			virtual void Visit(const SStateEntry<TTrigger, TState>& entry) override
+			{
+				if (!entry.AutoState) throw std::invalid_argument("Cannot compile custom states!");
+
+				States.push_back(static_cast<const CAutoState<TTrigger, TState>*>(entry.Configurator));
+			}
+		};
+
+		template<typename TTrigger, typename TState>
+		class CDefinitionImage;
+
+		////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+		// FNV-1a over everything added, a 32 bit word at a time for indices
+		class CFingerprint
+		{
+		private:
+			uint64_t m_hash;
+
+		public:
+			CFingerprint() : m_hash(0xcbf29ce484222325ull) { }
+
+			void Add(const void* data, size_t bytes)
+			{
+				const unsigned char* bytesOf = static_cast<const unsigned char*>(data);
+				for (size_t i = 0; i < bytes; ++i) m_hash = (m_hash ^ bytesOf[i]) * 0x100000001b3ull;
+			}
+
+			void Add(uint32_t value) { m_hash = (m_hash ^ value) * 0x100000001b3ull; }
+			void Add(uint64_t value) { Add((uint32_t)value); Add((uint32_t)(value >> 32)); }
+
+			void Add(std::string_view text)
+			{
+				Add((uint32_t)text.size());
+				Add(text.data(), text.size());
+			}
+
+			// States & triggers by what stays the same from one run to the next: strings by their text, floats by their
+			// value (-0 as 0), values whose bytes all take part in it (no padding, see has_unique_object_representations)
+			// by their bytes. Addresses, structs with padding and other types only count by their index.
+			template<typename T>
+			void AddValue(const T& value)
+			{
+				if constexpr (IsStringTrigger<T>::value) Add(std::string_view(value));
+				else if constexpr (std::is_same<T, float>::value || std::is_same<T, double>::value)
+				{
+					const T normalized = value == 0 ? (T)0 : value;
+					Add(&normalized, sizeof(T));
+				}
+				else if constexpr (std::has_unique_object_representations<T>::value && !std::is_pointer<T>::value) Add(&value, sizeof(T));
+			}
+
+			// Order independent sum of mixed transitions, so no sorting is needed
+			static uint64_t Mix(const STransition& transition)
+			{
+				uint64_t mixed = ((uint64_t)transition.From << 32 | transition.Trigger) * 0x9e3779b97f4a7c15ull ^ (uint64_t)transition.To * 0xc2b2ae3d27d4eb4full;
+				mixed = (mixed ^ (mixed >> 31)) * 0xbf58476d1ce4e5b9ull;
+				return mixed ^ (mixed >> 29);
+			}
+
+			uint64_t Value() const { return m_hash; }
+		};
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename TTrigger, typename TState>
+	class CDefinitionBuilder;
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	// Immutable, index based snapshot of a configured state machine.
+	// States & triggers are numbered densely and transitions live in a single table, so one definition
+	// can be shared by any number of CCompiledStateMachine instances.
+	template<typename TTrigger, typename TState>
+	class CCompiledDefinition
+	{
+		friend class CDefinitionBuilder<TTrigger, TState>;
+		friend class ___IMPL___::CDefinitionImage<TTrigger, TState>;
+
+	private:
+		std::vector<TState> m_states;
+		std::vector<TTrigger> m_triggers;
+		std::vector<SStateCallbacks> m_callbacks;
+		uint32_t m_callbackMask;						// 0 when all states share the one entry of m_callbacks
+		std::map<TState, uint32_t> m_stateIndices;
+		___IMPL___::CTriggerIndex<TTrigger> m_triggerIndex;
+		uint32_t m_initialState;
+
+		___IMPL___::CTransitionTable m_table;
+
+		// Loaded from a definition image: state lookups search its sorted states instead of m_stateIndices
+		std::shared_ptr<const void> m_pImage;
+		const TState* m_pIndexedStates;
+		const uint32_t* m_pIndexOfStates;
+		size_t m_indexedCount;
+
+		uint64_t m_fingerprint;
+
+		CCompiledDefinition() : m_callbackMask(InvalidIndex), m_initialState(InvalidIndex), m_pIndexedStates(nullptr), m_pIndexOfStates(nullptr), m_indexedCount(0), m_fingerprint(0) { }
+
+		// Builds the table from 'transitions' and fingerprints the finished definition
+		void Seal(ETableLayout layout, const std::vector<___IMPL___::STransition>& transitions);
+
+		// Every state value FindState resolves with its index, in ascending order of states
+		template<typename TVisit>
+		void VisitStateIndices(TVisit visit) const;
+
+	public:
+		// Freezes the machine's current configuration; its current state becomes the initial state.
+		// By default the table layout is picked from the machine's shape; pass a layout to override.
+		explicit CCompiledDefinition(const CFiniteStateMachine<TTrigger, TState>& machine, ETableLayout layout = AutoTable);
+
+		uint32_t StateCount() const { return (uint32_t)m_states.size(); }
+		uint32_t TriggerCount() const { return (uint32_t)m_triggers.size(); }
+		uint32_t InitialState() const { return m_initialState; }
+
+		ETableLayout Layout() const { return m_table.Layout(); }
+		unsigned int IndexBytes() const { return m_table.IndexBytes(); }
+		size_t TableBytes() const { return m_table.Bytes(); }
+
+		// Layout asked for & picked, the machine's shape and the cost model's reasoning
+		const STableChoice& TableChoice() const { return m_table.Choice(); }
+
+		const TState& State(uint32_t index) const { return m_states[index]; }
+		const TTrigger& Trigger(uint32_t index) const { return m_triggers[index]; }
+		const SStateCallbacks& Callbacks(uint32_t state) const { return m_callbacks[state & m_callbackMask]; }
+
+		// Replaces the callbacks of a state, e.g. to attach them again to a definition loaded from an image, which has
+		// none. Merged states share them. Bind before machines use the definition; callbacks do not change Fingerprint.
+		// Throws std::out_of_range for states the definition does not have.
+		void BindCallbacks(const TState& state, const SStateCallbacks& callbacks);
+
+		// Loaded by LoadDefinitionImage; the tables are read from the mapped file
+		bool Mapped() const { return m_pImage != nullptr; }
+
+		// Identifies what state indices mean: state & trigger values in index order, the initial state and every
+		// transition. Table layout & callbacks do not count, renumbering (Relayout, Minimize) does. Pointer states only
+		// count by their index, as addresses change from run to run, and so do structs with padding, whose padding bytes
+		// are indeterminate. Computed once when the definition is built.
+		uint64_t Fingerprint() const { return m_fingerprint; }
+
+		uint32_t FindState(const TState& state) const;
+		uint32_t FindTrigger(const TTrigger& trigger) const;
+
+		// String triggers only; looks the trigger up without materializing a TTrigger
+		uint32_t FindTriggerString(std::string_view trigger) const;
+
+		// Target state index, or InvalidIndex when the state has no transition for the trigger
+		uint32_t Next(uint32_t state, uint32_t trigger) const { return m_table.Next(state, trigger); }
+
+		// All transitions, ordered by state then trigger
+		std::vector<___IMPL___::STransition> Transitions() const { return m_table.Transitions(); }
+
+		// Merges states which cannot be told apart: same callbacks and, for every trigger, either no transition
+		// or transitions to mergeable states. 'mapping' receives the new index of every old state index.
+		// Merged states keep resolving through FindState, but report the lowest merged state as current.
+		CCompiledDefinition<TTrigger, TState> Minimize(std::vector<uint32_t>& mapping) const;
+
+		// Same machine with states & triggers renumbered for locality, given the hits of every transition (ordered like
+		// Transitions(), e.g. an instrumentation snapshot's Transitions). States are placed along their hottest
+		// transitions, so the hot core's rows end up next to each other; cold states keep their order behind it.
+		// Trigger columns are ordered by hits, except for string triggers whose index is their hash slot.
+		// 'mapping' receives the new index of every old state index.
+		CCompiledDefinition<TTrigger, TState> Relayout(const std::vector<uint64_t>& transitionHits, std::vector<uint32_t>& mapping) const;
+	};
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename TTrigger, typename TState>
+	CCompiledDefinition<TTrigger, TState>::CCompiledDefinition(const CFiniteStateMachine<TTrigger, TState>& machine, ETableLayout layout)
+		: CCompiledDefinition()
+	{
+		___IMPL___::CAutoStateCollector<TTrigger, TState> collector;
+		machine.Accept(&collector);
+
+		std::set<TTrigger> triggers;
+		for (uint32_t i = 0; i < (uint32_t)collector.States.size(); ++i)
+		{
+			const ___IMPL___::CAutoState<TTrigger, TState>* state = collector.States[i];
+
+			m_states.push_back(state->StateType);
+			m_callbacks.push_back(state->Callbacks());
+			m_stateIndices.insert(std::make_pair(state->StateType, i));
+
+			typename std::map<TTrigger, TState>::const_iterator itr = state->Transitions().begin();
+			for (; itr != state->Transitions().end(); ++itr) triggers.insert(itr->first);
+		}
+
+		m_triggers.assign(triggers.begin(), triggers.end());
+		m_triggerIndex.Build(m_triggers);
+
+		// Transitions to states which were never configured are left out, and throw when fired
+		std::vector<___IMPL___::STransition> table;
+		for (uint32_t i = 0; i < (uint32_t)collector.States.size(); ++i)
+		{
+			const std::map<TTrigger, TState>& transitions = collector.States[i]->Transitions();
+
+			typename std::map<TTrigger, TState>::const_iterator itr = transitions.begin();
+			for (; itr != transitions.end(); ++itr)
+			{
+				const ___IMPL___::STransition transition = { i, FindTrigger(itr->first), FindState(itr->second) };
+				if (transition.To != InvalidIndex) table.push_back(transition);
+			}
+		}
+
+		m_initialState = FindState(*machine.CurrentState());
+		Seal(layout, table);
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename TTrigger, typename TState>
+	void CCompiledDefinition<TTrigger, TState>::Seal(ETableLayout layout, const std::vector<___IMPL___::STransition>& transitions)
+	{
+		m_table.Build(layout, StateCount(), TriggerCount(), transitions);
+
+		___IMPL___::CFingerprint fingerprint;
+		fingerprint.Add(StateCount());
+		fingerprint.Add(TriggerCount());
+		fingerprint.Add(m_initialState);
+		for (const TState& state : m_states) fingerprint.AddValue(state);
+		for (const TTrigger& trigger : m_triggers) fingerprint.AddValue(trigger);
+
+		uint64_t transitionSum = 0;
+		for (const ___IMPL___::STransition& transition : transitions) transitionSum += ___IMPL___::CFingerprint::Mix(transition);
+		fingerprint.Add((uint64_t)transitions.size());
+		fingerprint.Add(transitionSum);
+		m_fingerprint = fingerprint.Value();
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename TTrigger, typename TState>
+	inline uint32_t CCompiledDefinition<TTrigger, TState>::FindState(const TState& state) const
+	{
+		if (m_pImage != nullptr)
+		{
+			const TState* end = m_pIndexedStates + m_indexedCount;
+			const TState* found = std::lower_bound(m_pIndexedStates, end, state);
+			return found != end && !(state < *found) ? m_pIndexOfStates[found - m_pIndexedStates] : InvalidIndex;
+		}
+
+		typename std::map<TState, uint32_t>::const_iterator itr = m_stateIndices.find(state);
+		return itr != m_stateIndices.end() ? itr->second : InvalidIndex;
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename TTrigger, typename TState>
+	void CCompiledDefinition<TTrigger, TState>::BindCallbacks(const TState& state, const SStateCallbacks& callbacks)
+	{
+		const uint32_t index = FindState(state);
+		if (index == InvalidIndex) throw std::out_of_range("Cannot find the state!");
+
+		if (m_callbackMask == 0)
+		{
+			m_callbacks.assign(m_states.size(), m_callbacks.front());
+			m_callbackMask = InvalidIndex;
+		}
+		m_callbacks[index] = callbacks;
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename TTrigger, typename TState>
+	template<typename TVisit>
+	void CCompiledDefinition<TTrigger, TState>::VisitStateIndices(TVisit visit) const
+	{
+		for (size_t i = 0; i < m_indexedCount; ++i) visit(m_pIndexedStates[i], m_pIndexOfStates[i]);
+
+		typename std::map<TState, uint32_t>::const_iterator itr = m_stateIndices.begin();
+		for (; itr != m_stateIndices.end(); ++itr) visit(itr->first, itr->second);
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename TTrigger, typename TState>
+	inline uint32_t CCompiledDefinition<TTrigger, TState>::FindTrigger(const TTrigger& trigger) const
+	{
+		return m_triggerIndex.Find(trigger, m_triggers);
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename TTrigger, typename TState>
+	inline uint32_t CCompiledDefinition<TTrigger, TState>::FindTriggerString(std::string_view trigger) const
+	{
+		static_assert(___IMPL___::IsStringTrigger<TTrigger>::value, "String lookups need std::string or std::string_view triggers");
+
+		return m_triggerIndex.Find(trigger, m_triggers);
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename TTrigger, typename TState>
+	CCompiledDefinition<TTrigger, TState> CCompiledDefinition<TTrigger, TState>::Minimize(std::vector<uint32_t>& mapping) const
+	{
+		// States only start out together when their callbacks are identical
+		typedef std::tuple<uintptr_t, uintptr_t, uintptr_t, uintptr_t> callback_key;
+		std::map<callback_key, uint32_t> classIds;
+		std::vector<uint32_t> classes(StateCount());
+		for (uint32_t i = 0; i < StateCount(); ++i)
+		{
+			const SStateCallbacks& callbacks = Callbacks(i);
+			const callback_key key(
+				reinterpret_cast<uintptr_t>(callbacks.OnEntry), reinterpret_cast<uintptr_t>(callbacks.OnExit),
+				reinterpret_cast<uintptr_t>(callbacks.OnEntryInstance), reinterpret_cast<uintptr_t>(callbacks.OnExitInstance));
+
+			classes[i] = classIds.insert(std::make_pair(key, (uint32_t)classIds.size())).first->second;
+		}
+
+		const std::vector<___IMPL___::STransition> transitions = Transitions();
+		mapping = ___IMPL___::RefineStates(classes, (uint32_t)classIds.size(), TriggerCount(), transitions);
+
+		// Blocks are numbered by their lowest state, which becomes the representative
+		CCompiledDefinition<TTrigger, TState> minimized;
+		std::vector<bool> representative(StateCount(), false);
+		for (uint32_t i = 0; i < StateCount(); ++i)
+		{
+			if (mapping[i] != minimized.StateCount()) continue;
+
+			representative[i] = true;
+			minimized.m_states.push_back(m_states[i]);
+			minimized.m_callbacks.push_back(Callbacks(i));
+		}
+
+		VisitStateIndices([&minimized, &mapping](const TState& state, uint32_t index)
+		{
+			minimized.m_stateIndices.insert(minimized.m_stateIndices.end(), std::make_pair(state, mapping[index]));
+		});
+
+		minimized.m_triggers = m_triggers;
+		minimized.m_triggerIndex = m_triggerIndex;
+		minimized.m_initialState = mapping[m_initialState];
+
+		std::vector<___IMPL___::STransition> reduced;
+		for (const ___IMPL___::STransition& transition : transitions)
+		{
+			if (!representative[transition.From]) continue;
+
+			const ___IMPL___::STransition merged = { mapping[transition.From], transition.Trigger, mapping[transition.To] };
+			reduced.push_back(merged);
+		}
+
+		minimized.Seal(m_table.Choice().Requested, reduced);
+		return minimized;
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename TTrigger, typename TState>
+	CCompiledDefinition<TTrigger, TState> CCompiledDefinition<TTrigger, TState>::Relayout(const std::vector<uint64_t>& transitionHits, std::vector<uint32_t>& mapping) const
+	{
+		typedef std::pair<uint64_t, uint32_t> weighted;
+
+		const std::vector<___IMPL___::STransition> transitions = Transitions();
+		if (transitionHits.size() != transitions.size()) throw std::invalid_argument("Profile is of another definition!");
+
+		const std::vector<uint32_t> rows = ___IMPL___::RowStarts(StateCount(), transitions);
+
+		std::vector<uint64_t> stateHits(StateCount(), 0), triggerHits(TriggerCount(), 0);
+		for (size_t i = 0; i < transitions.size(); ++i)
+		{
+			stateHits[transitions[i].From] += transitionHits[i];
+			stateHits[transitions[i].To] += transitionHits[i];
+			triggerHits[transitions[i].Trigger] += transitionHits[i];
+		}
+
+		// Hot states in descending order; ties & cold states keep their order
+		std::vector<uint32_t> byHeat(StateCount());
+		for (uint32_t i = 0; i < StateCount(); ++i) byHeat[i] = i;
+		std::stable_sort(byHeat.begin(), byHeat.end(), [&stateHits](uint32_t a, uint32_t b) { return stateHits[a] > stateHits[b]; });
+
+		// Grow chains from the hottest unplaced state, always following the hottest transition out of what is placed
+		std::vector<uint32_t> order;
+		order.reserve(StateCount());
+		mapping.assign(StateCount(), InvalidIndex);
+		std::vector<weighted> frontier;
+		const auto place = [&](uint32_t state)
+		{
+			mapping[state] = (uint32_t)order.size();
+			order.push_back(state);
+			for (uint32_t i = rows[state]; i < rows[state + 1]; ++i)
+			{
+				if (transitionHits[i] == 0 || mapping[transitions[i].To] != InvalidIndex) continue;
+
+				frontier.push_back(weighted(transitionHits[i], transitions[i].To));
+				std::push_heap(frontier.begin(), frontier.end());
+			}
+		};
+
+		for (uint32_t seed : byHeat)
+		{
+			if (mapping[seed] != InvalidIndex) continue;
+
+			if (stateHits[seed] != 0)
+			{
+				place(seed);
+				while (!frontier.empty())
+				{
+					std::pop_heap(frontier.begin(), frontier.end());
+					const uint32_t next = frontier.back().second;
+					frontier.pop_back();
+					if (mapping[next] == InvalidIndex) place(next);
+				}
+			}
+			else
+			{
+				mapping[seed] = (uint32_t)order.size();
+				order.push_back(seed);
+			}
+		}
+
+		// String trigger indices are hash slots and stay put
+		std::vector<uint32_t> triggerOrder(TriggerCount());
+		for (uint32_t i = 0; i < TriggerCount(); ++i) triggerOrder[i] = i;
+		if (!___IMPL___::IsStringTrigger<TTrigger>::value)
+		{
+			std::stable_sort(triggerOrder.begin(), triggerOrder.end(), [&triggerHits](uint32_t a, uint32_t b) { return triggerHits[a] > triggerHits[b]; });
+		}
+		std::vector<uint32_t> triggerMapping(TriggerCount());
+		for (uint32_t i = 0; i < TriggerCount(); ++i) triggerMapping[triggerOrder[i]] = i;
+
+		CCompiledDefinition<TTrigger, TState> relaid;
+		for (uint32_t state : order)
+		{
+			relaid.m_states.push_back(m_states[state]);
+			relaid.m_callbacks.push_back(Callbacks(state));
+		}
+
+		VisitStateIndices([&relaid, &mapping](const TState& state, uint32_t index)
+		{
+			relaid.m_stateIndices.insert(relaid.m_stateIndices.end(), std::make_pair(state, mapping[index]));
+		});
+
+		if (___IMPL___::IsStringTrigger<TTrigger>::value)
+		{
+			relaid.m_triggers = m_triggers;
+			relaid.m_triggerIndex = m_triggerIndex;
+		}
+		else
+		{
+			for (uint32_t trigger : triggerOrder) relaid.m_triggers.push_back(m_triggers[trigger]);
+			relaid.m_triggerIndex.Build(relaid.m_triggers);
+		}
+		relaid.m_initialState = mapping[m_initialState];
+
+		std::vector<___IMPL___::STransition> renumbered;
+		renumbered.reserve(transitions.size());
+		for (const ___IMPL___::STransition& transition : transitions)
+		{
+			const ___IMPL___::STransition moved = { mapping[transition.From], triggerMapping[transition.Trigger], mapping[transition.To] };
+			renumbered.push_back(moved);
+		}
+
+		relaid.Seal(m_table.Choice().Requested, renumbered);
+		return relaid;
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	// True when both definitions behave identically from their initial states: for every trigger sequence they
+	// accept & reject the same triggers and pass through states with identical callbacks. Triggers are matched
+	// by value, state values are not compared. Otherwise 'counterexample' receives a trigger sequence from
+	// the initial states which ends where the definitions differ.
+	// Hopcroft & Karp's union-find check, near linear in the number of transitions.
+	template<typename TTrigger, typename TState>
+	bool AreEquivalent(
+		const CCompiledDefinition<TTrigger, TState>& a,
+		const CCompiledDefinition<TTrigger, TState>& b,
+		std::vector<TTrigger>& counterexample)
+	{
+		struct SPair
+		{
+			uint32_t A;
+			uint32_t B;
+			uint32_t Parent;
+			uint32_t Trigger;	// Index into a's triggers which led here
+		};
+
+		counterexample.clear();
+
+		// Trigger indices of one definition in the other
+		std::vector<uint32_t> aToB(a.TriggerCount()), bToA(b.TriggerCount());
+		for (uint32_t i = 0; i < a.TriggerCount(); ++i) aToB[i] = b.FindTrigger(a.Trigger(i));
+		for (uint32_t i = 0; i < b.TriggerCount(); ++i) bToA[i] = a.FindTrigger(b.Trigger(i));
+
+		const std::vector<___IMPL___::STransition> aTransitions = a.Transitions(), bTransitions = b.Transitions();
+		const std::vector<uint32_t> aRows = ___IMPL___::RowStarts(a.StateCount(), aTransitions);
+		const std::vector<uint32_t> bRows = ___IMPL___::RowStarts(b.StateCount(), bTransitions);
+
+		const auto sameCallbacks = [](const SStateCallbacks& x, const SStateCallbacks& y)
+		{
+			return x.OnEntry == y.OnEntry && x.OnExit == y.OnExit
+				&& x.OnEntryInstance == y.OnEntryInstance && x.OnExitInstance == y.OnExitInstance;
+		};
+
+		// Breadth first, so the pair list doubles as the parent tree for the counterexample
+		const auto fail = [&](const std::vector<SPair>& pairs, uint32_t pair, const TTrigger* last)
+		{
+			for (; pair != InvalidIndex; pair = pairs[pair].Parent)
+			{
+				if (pairs[pair].Parent != InvalidIndex) counterexample.push_back(a.Trigger(pairs[pair].Trigger));
+			}
+			std::reverse(counterexample.begin(), counterexample.end());
+			if (last != nullptr) counterexample.push_back(*last);
+			return false;
+		};
+
+		___IMPL___::CUnionFind sets(a.StateCount() + b.StateCount());
+		std::vector<SPair> pairs;
+
+		const SPair initial = { a.InitialState(), b.InitialState(), InvalidIndex, InvalidIndex };
+		pairs.push_back(initial);
+		sets.Union(initial.A, a.StateCount() + initial.B);
+
+		for (uint32_t current = 0; current < (uint32_t)pairs.size(); ++current)
+		{
+			const uint32_t p = pairs[current].A, q = pairs[current].B;
+
+			if (!sameCallbacks(a.Callbacks(p), b.Callbacks(q))) return fail(pairs, current, nullptr);
+
+			for (uint32_t i = aRows[p]; i < aRows[p + 1]; ++i)
+			{
+				const ___IMPL___::STransition& transition = aTransitions[i];
+				const uint32_t trigger = aToB[transition.Trigger];
+				const uint32_t target = trigger == InvalidIndex ? InvalidIndex : b.Next(q, trigger);
+				if (target == InvalidIndex) return fail(pairs, current, &a.Trigger(transition.Trigger));
+
+				if (sets.Union(transition.To, a.StateCount() + target))
+				{
+					const SPair next = { transition.To, target, current, transition.Trigger };
+					pairs.push_back(next);
+				}
+			}
+
+			// Pairs were covered above, only look for triggers b handles but a does not
+			for (uint32_t i = bRows[q]; i < bRows[q + 1]; ++i)
+			{
+				const uint32_t trigger = bToA[bTransitions[i].Trigger];
+				if (trigger == InvalidIndex || a.Next(p, trigger) == InvalidIndex) return fail(pairs, current, &b.Trigger(bTransitions[i].Trigger));
+			}
+		}
+
+		return true;
+	}
+}
+
+#pragma endregion
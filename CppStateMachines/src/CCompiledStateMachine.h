@@ -0,0 +1,137 @@
+#pragma once
+
+#include "CCompiledDefinition.h"
+#include "CInstrumentation.h"
+#include <cstdint>
+#include <stdexcept>
+#include <string_view>
+
+#pragma region COMPILED STATE MACHINE
+
+namespace FSM
+{
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	// Runs a shared, frozen CCompiledDefinition. Each instance only holds its current state index,
+	// transitions are a trigger lookup plus a table read.
+	// Fire, TryFire and CurrentState never allocate (callbacks aside); only the exception Fire throws
+	// for a rejected trigger does, a std::runtime_error like the configured machine's. TryFire reports those
+	// without throwing.
+	// TInstrumentation is CNoInstrumentation, which compiles away, or e.g. CCountingInstrumentation.
+	template<typename TTrigger, typename TState, typename TInstrumentation = CNoInstrumentation>
+	class CCompiledStateMachine : private TInstrumentation
+	{
+	private:
+		const CCompiledDefinition<TTrigger, TState>* m_pDefinition;
+		uint32_t m_currentState;
+
+	public:
+		// The definition is not owned and must outlive the machine. Throws std::invalid_argument when the instrumentation
+		// records into counters or histograms of another definition.
+		explicit CCompiledStateMachine(const CCompiledDefinition<TTrigger, TState>* definition, const TInstrumentation& instrumentation = TInstrumentation());
+
+		const TState* CurrentState() const;
+		uint32_t CurrentStateIndex() const { return m_currentState; }
+
+		// Puts the machine in the state at index 'state' without running callbacks, e.g. when restoring a snapshot
+		void RestoreStateIndex(uint32_t state) { m_currentState = state; }
+
+		void Fire(const TTrigger& trigger);
+
+		// False, leaving the state unchanged, when the trigger is unknown or not handled by the current state
+		bool TryFire(const TTrigger& trigger);
+
+		// String triggers only; fires without constructing a TTrigger
+		void FireString(std::string_view trigger);
+		bool TryFireString(std::string_view trigger);
+
+	private:
+		bool TryTransition(uint32_t trigger);
+
+		static void Call(ICallback* callback) { if (callback != nullptr) callback->Call(); }
+		static void Call(state_change_callback callback) { if (callback != nullptr) callback(); }
+	};
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename TTrigger, typename TState, typename TInstrumentation>
+	CCompiledStateMachine<TTrigger, TState, TInstrumentation>::CCompiledStateMachine(const CCompiledDefinition<TTrigger, TState>* definition, const TInstrumentation& instrumentation)
+		: TInstrumentation(instrumentation), m_pDefinition(definition), m_currentState(definition->InitialState())
+	{
+		TInstrumentation::Attach(*definition);
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename TTrigger, typename TState, typename TInstrumentation>
+	inline const TState* CCompiledStateMachine<TTrigger, TState, TInstrumentation>::CurrentState() const
+	{
+		return &m_pDefinition->State(m_currentState);
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename TTrigger, typename TState, typename TInstrumentation>
+	inline void CCompiledStateMachine<TTrigger, TState, TInstrumentation>::Fire(const TTrigger& trigger)
+	{
+		if (!TryFire(trigger)) throw std::runtime_error("Cannot find the state!");
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename TTrigger, typename TState, typename TInstrumentation>
+	inline bool CCompiledStateMachine<TTrigger, TState, TInstrumentation>::TryFire(const TTrigger& trigger)
+	{
+		return TInstrumentation::Fire([this, &trigger]() { return TryTransition(m_pDefinition->FindTrigger(trigger)); });
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename TTrigger, typename TState, typename TInstrumentation>
+	inline void CCompiledStateMachine<TTrigger, TState, TInstrumentation>::FireString(std::string_view trigger)
+	{
+		if (!TryFireString(trigger)) throw std::runtime_error("Cannot find the state!");
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename TTrigger, typename TState, typename TInstrumentation>
+	inline bool CCompiledStateMachine<TTrigger, TState, TInstrumentation>::TryFireString(std::string_view trigger)
+	{
+		return TInstrumentation::Fire([this, trigger]() { return TryTransition(m_pDefinition->FindTriggerString(trigger)); });
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename TTrigger, typename TState, typename TInstrumentation>
+	inline bool CCompiledStateMachine<TTrigger, TState, TInstrumentation>::TryTransition(uint32_t trigger)
+	{
+		const uint32_t target = trigger == InvalidIndex ? InvalidIndex : m_pDefinition->Next(m_currentState, trigger);
+		if (target == InvalidIndex)
+		{
+			TInstrumentation::Rejected(m_currentState, trigger);
+			return false;
+		}
+
+		TInstrumentation::Transitioned(m_currentState, trigger, target);
+
+		const SStateCallbacks& exit = m_pDefinition->Callbacks(m_currentState);
+		TInstrumentation::Exit(m_currentState, exit, [&exit]()
+		{
+			Call(exit.OnExit);
+			Call(exit.OnExitInstance);
+		});
+		{
+			m_currentState = target;
+		}
+		const SStateCallbacks& entry = m_pDefinition->Callbacks(m_currentState);
+		TInstrumentation::Entry(m_currentState, entry, [&entry]()
+		{
+			Call(entry.OnEntry);
+			Call(entry.OnEntryInstance);
+		});
+		return true;
+	}
+}
+
+#pragma endregion
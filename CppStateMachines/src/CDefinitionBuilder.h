@@ -0,0 +1,203 @@
+#pragma once
+
+#include "CCompiledDefinition.h"
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#pragma region DEFINITION BUILDER
+
+namespace FSM
+{
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename TTrigger, typename TState>
+	struct STransitionDefinition
+	{
+		TState From;
+		TTrigger Trigger;
+		TState To;
+	};
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	// A transition which repeats an earlier (From, Trigger) pair. Duplicates agree with the transition kept,
+	// conflicts name a different target and fail the build.
+	template<typename TTrigger, typename TState>
+	struct SBuildIssue
+	{
+		TState From;
+		TTrigger Trigger;
+		TState To;
+		TState Kept;
+		bool Conflict;
+	};
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	// Builds a CCompiledDefinition straight from (from, trigger, to) tuples, skipping the per call
+	// Configure / AddTrigger bookkeeping. Every state named by a transition becomes a state of the definition.
+	template<typename TTrigger, typename TState>
+	class CDefinitionBuilder
+	{
+	private:
+		TState m_initialState;
+		std::vector<STransitionDefinition<TTrigger, TState>> m_transitions;
+		std::map<TState, SStateCallbacks> m_callbacks;
+		std::vector<SBuildIssue<TTrigger, TState>> m_issues;
+
+	public:
+		explicit CDefinitionBuilder(const TState& initialState) : m_initialState(initialState) { }
+
+		void Reserve(size_t count) { m_transitions.reserve(count); }
+
+		void Add(const TState& from, const TTrigger& trigger, const TState& to);
+		void Add(const STransitionDefinition<TTrigger, TState>* transitions, size_t count);
+
+		void Callbacks(const TState& state, const SStateCallbacks& callbacks) { m_callbacks[state] = callbacks; }
+
+		// Sorts & indexes the transitions, splitting the work over 'threads' threads.
+		// Throws when any conflicts were found; Issues() then lists every duplicate & conflict.
+		CCompiledDefinition<TTrigger, TState> Build(ETableLayout layout = AutoTable, unsigned int threads = 1);
+
+		// Duplicates & conflicts found by the last Build
+		const std::vector<SBuildIssue<TTrigger, TState>>& Issues() const { return m_issues; }
+	};
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename TTrigger, typename TState>
+	inline void CDefinitionBuilder<TTrigger, TState>::Add(const TState& from, const TTrigger& trigger, const TState& to)
+	{
+		const STransitionDefinition<TTrigger, TState> transition = { from, trigger, to };
+		m_transitions.push_back(transition);
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename TTrigger, typename TState>
+	inline void CDefinitionBuilder<TTrigger, TState>::Add(const STransitionDefinition<TTrigger, TState>* transitions, size_t count)
+	{
+		m_transitions.insert(m_transitions.end(), transitions, transitions + count);
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename TTrigger, typename TState>
+	CCompiledDefinition<TTrigger, TState> CDefinitionBuilder<TTrigger, TState>::Build(ETableLayout layout, unsigned int threads)
+	{
+		CCompiledDefinition<TTrigger, TState> definition;
+		m_issues.clear();
+
+		// States & triggers in sorted order, matching the order CFiniteStateMachine would configure them in
+		std::vector<TState>& states = definition.m_states;
+		std::vector<TTrigger> triggers;
+		states.reserve(m_transitions.size() * 2 + m_callbacks.size() + 1);
+		triggers.reserve(m_transitions.size());
+		states.push_back(m_initialState);
+		for (const STransitionDefinition<TTrigger, TState>& transition : m_transitions)
+		{
+			states.push_back(transition.From);
+			states.push_back(transition.To);
+			triggers.push_back(transition.Trigger);
+		}
+		typename std::map<TState, SStateCallbacks>::const_iterator callbacks = m_callbacks.begin();
+		for (; callbacks != m_callbacks.end(); ++callbacks) states.push_back(callbacks->first);
+
+		std::sort(states.begin(), states.end());
+		states.erase(std::unique(states.begin(), states.end(), [](const TState& a, const TState& b) { return !(a < b) && !(b < a); }), states.end());
+		std::sort(triggers.begin(), triggers.end());
+		triggers.erase(std::unique(triggers.begin(), triggers.end(), [](const TTrigger& a, const TTrigger& b) { return !(a < b) && !(b < a); }), triggers.end());
+
+		const uint32_t stateCount = (uint32_t)states.size();
+		const SStateCallbacks none = { nullptr, nullptr, nullptr, nullptr };
+		definition.m_callbacks.assign(stateCount, none);
+		for (uint32_t i = 0; i < stateCount; ++i)
+		{
+			definition.m_stateIndices.insert(definition.m_stateIndices.end(), std::make_pair(states[i], i));
+
+			callbacks = m_callbacks.find(states[i]);
+			if (callbacks != m_callbacks.end()) definition.m_callbacks[i] = callbacks->second;
+		}
+
+		// The trigger index may reorder triggers (perfect hashing), remap from sorted order
+		definition.m_triggers = triggers;
+		definition.m_triggerIndex.Build(definition.m_triggers);
+		std::vector<uint32_t> triggerOrder(triggers.size());
+		for (uint32_t i = 0; i < (uint32_t)triggers.size(); ++i) triggerOrder[i] = definition.FindTrigger(triggers[i]);
+
+		const auto stateIndex = [&states](const TState& state)
+		{
+			return (uint32_t)(std::lower_bound(states.begin(), states.end(), state) - states.begin());
+		};
+		const auto triggerIndex = [&triggers, &triggerOrder](const TTrigger& trigger)
+		{
+			return triggerOrder[std::lower_bound(triggers.begin(), triggers.end(), trigger) - triggers.begin()];
+		};
+
+		// Index & sort chunks in parallel, then merge them
+		std::vector<___IMPL___::STransition> indexed(m_transitions.size());
+		const size_t chunkCount = std::max<size_t>(1, std::min<size_t>(threads, m_transitions.size() / 4096 + 1));
+		const size_t chunkSize = (m_transitions.size() + chunkCount - 1) / chunkCount;
+		const auto indexChunk = [&](size_t chunk)
+		{
+			const size_t begin = std::min(chunk * chunkSize, m_transitions.size());
+			const size_t end = std::min(begin + chunkSize, m_transitions.size());
+			for (size_t i = begin; i < end; ++i)
+			{
+				const ___IMPL___::STransition transition =
+				{
+					stateIndex(m_transitions[i].From), triggerIndex(m_transitions[i].Trigger), stateIndex(m_transitions[i].To)
+				};
+				indexed[i] = transition;
+			}
+			std::stable_sort(indexed.begin() + begin, indexed.begin() + end);
+		};
+
+		std::vector<std::thread> workers;
+		for (size_t chunk = 1; chunk < chunkCount; ++chunk) workers.push_back(std::thread(indexChunk, chunk));
+		indexChunk(0);
+		for (std::thread& worker : workers) worker.join();
+
+		for (size_t width = chunkSize; width < indexed.size(); width *= 2)
+		{
+			for (size_t begin = 0; begin + width < indexed.size(); begin += 2 * width)
+			{
+				std::inplace_merge(indexed.begin() + begin, indexed.begin() + begin + width,
+					indexed.begin() + std::min(begin + 2 * width, indexed.size()));
+			}
+		}
+
+		// One pass keeps the first transition of every (From, Trigger) and reports the rest
+		std::vector<___IMPL___::STransition> table;
+		table.reserve(indexed.size());
+		for (const ___IMPL___::STransition& transition : indexed)
+		{
+			if (!table.empty() && table.back().From == transition.From && table.back().Trigger == transition.Trigger)
+			{
+				const ___IMPL___::STransition& kept = table.back();
+				const SBuildIssue<TTrigger, TState> issue =
+				{
+					states[transition.From], definition.m_triggers[transition.Trigger], states[transition.To], states[kept.To], kept.To != transition.To
+				};
+				m_issues.push_back(issue);
+				continue;
+			}
+			table.push_back(transition);
+		}
+
+		for (const SBuildIssue<TTrigger, TState>& issue : m_issues)
+		{
+			if (issue.Conflict) throw std::invalid_argument("Conflicting transitions!");
+		}
+
+		definition.m_initialState = stateIndex(m_initialState);
+		definition.Seal(layout, table);
+		return definition;
+	}
+}
+
+#pragma endregion
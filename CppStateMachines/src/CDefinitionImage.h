@@ -0,0 +1,352 @@
+#pragma once
+
+#include "CCompiledDefinition.h"
+#include "CSnapshot.h"
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#pragma region DEFINITION IMAGE
+
+namespace FSM
+{
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	// Where a section lies in a definition image, relative to its start
+	struct SImageSection
+	{
+		uint64_t Offset;
+		uint64_t Bytes;
+	};
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	// Leads every definition image. Sections are addressed by offset and aligned to ImageAlignment, so an image works
+	// wherever it is mapped; like snapshots, it is read back by builds of the same code on the same platform.
+	struct SDefinitionImageHeader
+	{
+		static constexpr uint32_t CurrentVersion = 2;
+
+		char Magic[8];					// "FSMDEFI"
+		uint32_t Version;
+		uint32_t HeaderBytes;			// Size of this header
+		uint32_t StateBytes;			// Size of a state value
+		uint32_t TriggerBytes;			// Size of a trigger value
+		uint32_t States;
+		uint32_t Triggers;
+		uint32_t InitialState;
+		uint32_t TableKind;				// Layout & index width of the table
+		uint32_t RequestedLayout;		// ETableLayout asked for when compiling
+		uint32_t MaxFanOut;
+		uint64_t Transitions;
+		double MeanFanOut;
+		double Density;
+		uint64_t FileBytes;
+		uint64_t Fingerprint;			// Of the definition, see CCompiledDefinition::Fingerprint
+
+		SImageSection StateValues;		// TState per state index
+		SImageSection TriggerValues;	// TTrigger per trigger index
+		SImageSection IndexedStates;	// Every state value FindState resolves, ascending
+		SImageSection IndexOfStates;	// uint32_t state index of each of them
+		SImageSection Table;			// Dense: next states; compressed: row bases
+		SImageSection TableEntries;		// Compressed: (check, next) entries
+	};
+
+	static const uint64_t ImageAlignment = 64;
+
+	// What LoadDefinitionImage checks before a definition reads the image
+	enum EImageCheck
+	{
+		QuickImageCheck,	// Header, section offsets & sizes; O(1), no table page is read. For images written by a trusted build
+		FullImageCheck		// Also every state index in the table & state lookup, one pass over the image; corrupt ones throw
+	};
+
+	namespace ___IMPL___
+	{
+		////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+		// Maps a whole file read-only; pages are shared with every process mapping the same file
+		class CMappedFile
+		{
+		private:
+			const char* m_pData;
+			size_t m_bytes;
+
+		public:
+			// Throws std::runtime_error when the file cannot be opened or mapped
+			explicit CMappedFile(const std::string& path);
+			~CMappedFile();
+
+			CMappedFile(const CMappedFile&) = delete;
+			CMappedFile& operator=(const CMappedFile&) = delete;
+
+			const char* Data() const { return m_pData; }
+			size_t Bytes() const { return m_bytes; }
+		};
+
+		////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#if defined(_WIN32)
+
+		inline CMappedFile::CMappedFile(const std::string& path) : m_pData(nullptr), m_bytes(0)
+		{
+			const HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+			if (file == INVALID_HANDLE_VALUE) throw std::runtime_error("Cannot open definition image " + path + "!");
+
+			LARGE_INTEGER size;
+			const bool sized = GetFileSizeEx(file, &size) != 0;
+			const HANDLE mapping = sized && size.QuadPart != 0 ? CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr) : nullptr;
+			CloseHandle(file);
+			if (mapping == nullptr) throw std::runtime_error("Cannot map definition image " + path + "!");
+
+			// The view keeps the mapping alive
+			m_pData = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+			CloseHandle(mapping);
+			if (m_pData == nullptr) throw std::runtime_error("Cannot map definition image " + path + "!");
+			m_bytes = (size_t)size.QuadPart;
+		}
+
+		inline CMappedFile::~CMappedFile()
+		{
+			UnmapViewOfFile(m_pData);
+		}
+
+#else
+
+		inline CMappedFile::CMappedFile(const std::string& path) : m_pData(nullptr), m_bytes(0)
+		{
+			const int file = open(path.c_str(), O_RDONLY);
+			if (file < 0) throw std::runtime_error("Cannot open definition image " + path + "!");
+
+			struct stat status;
+			void* data = MAP_FAILED;
+			if (fstat(file, &status) == 0 && status.st_size != 0) data = mmap(nullptr, (size_t)status.st_size, PROT_READ, MAP_SHARED, file, 0);
+			close(file);
+			if (data == MAP_FAILED) throw std::runtime_error("Cannot map definition image " + path + "!");
+
+			m_pData = static_cast<const char*>(data);
+			m_bytes = (size_t)status.st_size;
+		}
+
+		inline CMappedFile::~CMappedFile()
+		{
+			munmap(const_cast<char*>(m_pData), m_bytes);
+		}
+
+#endif
+
+		////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+		template<typename TTrigger, typename TState>
+		class CDefinitionImage
+		{
+		private:
+			static_assert(std::is_trivially_copyable<TState>::value && std::is_trivially_copyable<TTrigger>::value,
+				"Definition images hold states & triggers as they are in memory");
+
+			// Points into the image at a section which has to lie within it, aligned & sized for whole T's
+			template<typename T>
+			static const T* Section(const CMappedFile& file, const SImageSection& section, const std::string& path)
+			{
+				if (section.Offset % ImageAlignment != 0 || section.Bytes % sizeof(T) != 0
+					|| section.Offset > file.Bytes() || section.Bytes > file.Bytes() - section.Offset)
+				{
+					throw std::runtime_error("Definition image " + path + " is corrupt!");
+				}
+				return reinterpret_cast<const T*>(file.Data() + section.Offset);
+			}
+
+		public:
+			static void Write(const std::string& path, const CCompiledDefinition<TTrigger, TState>& definition, bool dropCallbacks);
+			static CCompiledDefinition<TTrigger, TState> Load(const std::string& path, EImageCheck check);
+		};
+
+		////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+		template<typename TTrigger, typename TState>
+		void CDefinitionImage<TTrigger, TState>::Write(const std::string& path, const CCompiledDefinition<TTrigger, TState>& definition, bool dropCallbacks)
+		{
+			for (uint32_t i = 0; i < definition.StateCount() && !dropCallbacks; ++i)
+			{
+				const SStateCallbacks& callbacks = definition.Callbacks(i);
+				if (callbacks.OnEntry != nullptr || callbacks.OnExit != nullptr || callbacks.OnEntryInstance != nullptr || callbacks.OnExitInstance != nullptr)
+				{
+					throw std::invalid_argument("Definition images cannot hold callbacks!");
+				}
+			}
+
+			std::vector<TState> indexedStates;
+			std::vector<uint32_t> indexOfStates;
+			definition.VisitStateIndices([&indexedStates, &indexOfStates](const TState& state, uint32_t index)
+			{
+				indexedStates.push_back(state);
+				indexOfStates.push_back(index);
+			});
+
+			const STableChoice& choice = definition.TableChoice();
+			const STableArrays arrays = definition.m_table.Arrays();
+
+			SDefinitionImageHeader header;
+			std::memset(&header, 0, sizeof(header));
+			std::memcpy(header.Magic, "FSMDEFI", 8);
+			header.Version = SDefinitionImageHeader::CurrentVersion;
+			header.HeaderBytes = sizeof(SDefinitionImageHeader);
+			header.StateBytes = sizeof(TState);
+			header.TriggerBytes = sizeof(TTrigger);
+			header.States = definition.StateCount();
+			header.Triggers = definition.TriggerCount();
+			header.InitialState = definition.InitialState();
+			header.TableKind = definition.m_table.Kind();
+			header.RequestedLayout = choice.Requested;
+			header.MaxFanOut = choice.Shape.MaxFanOut;
+			header.Transitions = choice.Shape.Transitions;
+			header.MeanFanOut = choice.Shape.MeanFanOut;
+			header.Density = choice.Shape.Density;
+			header.Fingerprint = definition.Fingerprint();
+
+			// Sections follow the header in order, each starting on an aligned offset
+			const void* data[] = { definition.m_states.data(), definition.m_triggers.data(), indexedStates.data(), indexOfStates.data(), arrays.First, arrays.Second };
+			SImageSection* sections[] = { &header.StateValues, &header.TriggerValues, &header.IndexedStates, &header.IndexOfStates, &header.Table, &header.TableEntries };
+			header.StateValues.Bytes = definition.m_states.size() * sizeof(TState);
+			header.TriggerValues.Bytes = definition.m_triggers.size() * sizeof(TTrigger);
+			header.IndexedStates.Bytes = indexedStates.size() * sizeof(TState);
+			header.IndexOfStates.Bytes = indexOfStates.size() * sizeof(uint32_t);
+			header.Table.Bytes = arrays.FirstBytes;
+			header.TableEntries.Bytes = arrays.SecondBytes;
+
+			uint64_t offset = sizeof(SDefinitionImageHeader);
+			for (SImageSection* section : sections)
+			{
+				section->Offset = (offset + ImageAlignment - 1) / ImageAlignment * ImageAlignment;
+				offset = section->Offset + section->Bytes;
+			}
+			header.FileBytes = offset;
+
+			const char padding[ImageAlignment] = { };
+			CSnapshotWriter writer(path);
+			writer.Write(&header, sizeof(header));
+			offset = sizeof(SDefinitionImageHeader);
+			for (size_t i = 0; i < sizeof(sections) / sizeof(sections[0]); ++i)
+			{
+				writer.Write(padding, (size_t)(sections[i]->Offset - offset));
+				writer.Write(data[i], (size_t)sections[i]->Bytes);
+				offset = sections[i]->Offset + sections[i]->Bytes;
+			}
+			writer.Commit();
+		}
+
+		////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+		template<typename TTrigger, typename TState>
+		CCompiledDefinition<TTrigger, TState> CDefinitionImage<TTrigger, TState>::Load(const std::string& path, EImageCheck check)
+		{
+			std::shared_ptr<const CMappedFile> file = std::make_shared<const CMappedFile>(path);
+
+			SDefinitionImageHeader header;
+			if (file->Bytes() < sizeof(header)) throw std::runtime_error("Not a definition image: " + path + "!");
+			std::memcpy(&header, file->Data(), sizeof(header));
+
+			if (std::memcmp(header.Magic, "FSMDEFI", 8) != 0) throw std::runtime_error("Not a definition image: " + path + "!");
+			if (header.Version != SDefinitionImageHeader::CurrentVersion || header.HeaderBytes != sizeof(header)) throw std::runtime_error("Unsupported definition image version in " + path + "!");
+			if (header.StateBytes != sizeof(TState) || header.TriggerBytes != sizeof(TTrigger)) throw std::invalid_argument("Definition image is of other state or trigger types!");
+			if (header.FileBytes != file->Bytes()) throw std::runtime_error("Definition image " + path + " is truncated!");
+
+			const TState* states = Section<TState>(*file, header.StateValues, path);
+			const TTrigger* triggers = Section<TTrigger>(*file, header.TriggerValues, path);
+			const TState* indexedStates = Section<TState>(*file, header.IndexedStates, path);
+			const uint32_t* indexOfStates = Section<uint32_t>(*file, header.IndexOfStates, path);
+			const size_t indexedCount = (size_t)(header.IndexedStates.Bytes / sizeof(TState));
+
+			const bool initialFits = header.States == 0 ? header.InitialState == InvalidIndex : header.InitialState < header.States;
+			if (header.StateValues.Bytes / sizeof(TState) != header.States || header.TriggerValues.Bytes / sizeof(TTrigger) != header.Triggers
+				|| header.IndexOfStates.Bytes / sizeof(uint32_t) != indexedCount || !initialFits)
+			{
+				throw std::runtime_error("Definition image " + path + " is corrupt!");
+			}
+			for (size_t i = 0; i < indexedCount && check == FullImageCheck; ++i)
+			{
+				if (indexOfStates[i] >= header.States) throw std::runtime_error("Definition image " + path + " is corrupt!");
+			}
+
+			STableShape shape;
+			shape.States = header.States;
+			shape.Triggers = header.Triggers;
+			shape.Transitions = (size_t)header.Transitions;
+			shape.MaxFanOut = header.MaxFanOut;
+			shape.MeanFanOut = header.MeanFanOut;
+			shape.Density = header.Density;
+
+			STableArrays arrays;
+			arrays.First = Section<char>(*file, header.Table, path);
+			arrays.FirstBytes = (size_t)header.Table.Bytes;
+			arrays.Second = Section<char>(*file, header.TableEntries, path);
+			arrays.SecondBytes = (size_t)header.TableEntries.Bytes;
+
+			CCompiledDefinition<TTrigger, TState> definition;
+			if (!definition.m_table.View(header.TableKind, (ETableLayout)header.RequestedLayout, shape, file, arrays, check == FullImageCheck))
+			{
+				throw std::runtime_error("Definition image " + path + " is corrupt!");
+			}
+
+			// Values are copied, they are few next to the table; the trigger index is rebuilt over them
+			definition.m_states.assign(states, states + header.States);
+			definition.m_triggers.assign(triggers, triggers + header.Triggers);
+			definition.m_triggerIndex.Build(definition.m_triggers);
+			definition.m_initialState = header.InitialState;
+			definition.m_fingerprint = header.Fingerprint;
+
+			// Callbacks are addresses in the process which compiled the definition; all states share one empty entry
+			definition.m_callbacks.assign(1, SStateCallbacks{ nullptr, nullptr, nullptr, nullptr });
+			definition.m_callbackMask = 0;
+
+			definition.m_pIndexedStates = indexedStates;
+			definition.m_pIndexOfStates = indexOfStates;
+			definition.m_indexedCount = indexedCount;
+			definition.m_pImage = file;
+			return definition;
+		}
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	// Saves a compiled definition as an image which LoadDefinitionImage maps back without parsing or rebuilding tables.
+	// States & triggers have to be trivially copyable, so string triggers cannot be saved. Callbacks are addresses in
+	// this process and are not saved: definitions with callbacks throw std::invalid_argument unless 'dropCallbacks' is
+	// set, in which case the loader binds them again with BindCallbacks.
+	template<typename TTrigger, typename TState>
+	void WriteDefinitionImage(const std::string& path, const CCompiledDefinition<TTrigger, TState>& definition, bool dropCallbacks = false)
+	{
+		___IMPL___::CDefinitionImage<TTrigger, TState>::Write(path, definition, dropCallbacks);
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	// Maps an image written by WriteDefinitionImage read-only and returns a definition which reads its table and state
+	// index in place, so processes loading the same image share those pages. The mapping lives as long as the definition
+	// and its copies. Loaded definitions have no callbacks until BindCallbacks; Minimize or Relayout them like any other
+	// definition. See EImageCheck for what is checked before the image is used.
+	// Throws std::runtime_error for unreadable, foreign & corrupt files, std::invalid_argument for other value types.
+	template<typename TTrigger, typename TState>
+	CCompiledDefinition<TTrigger, TState> LoadDefinitionImage(const std::string& path, EImageCheck check = QuickImageCheck)
+	{
+		return ___IMPL___::CDefinitionImage<TTrigger, TState>::Load(path, check);
+	}
+}
+
+#pragma endregion
@@ -7,6 +7,8 @@
 #include "export.h"
 
 #include<map>
+#include <stdexcept>
+#include <type_traits>
 
 
 #pragma region STATE MACHINE
@@ -29,6 +31,13 @@ namespace FSM
 		virtual const TState* CurrentState() const override;
 		virtual bool AddState(const TState& state, IState<TTrigger, TState>* instance) override;
 		virtual void Fire(const TTrigger& trigger) override;
+
+		// Custom states declared with FSM_STATE stay reachable through Configure, found at compile time without RTTI
+		template<typename TCustomState>
+		bool AddState(const TState& state, TCustomState* instance);
+
+		// Visits every configured state, in state order
+		void Accept(IStateVisitor<TTrigger, TState>* visitor) const;
 	};
 
 
@@ -59,20 +68,19 @@ namespace FSM
 	template<typename TTrigger, typename TState>
 	inline IStateConfigurator<TTrigger, TState>* CFiniteStateMachine<TTrigger, TState>::Configure(const TState & state)
 	{
-		if (m_pMap->Has(state))
-		{
-			return dynamic_cast<IStateConfigurator<TTrigger, TState>*>(m_pMap->Get(state));
-		}
+		const SStateEntry<TTrigger, TState>* entry = m_pMap->Find(state);
+		if (entry != nullptr) return entry->Configurator;
 
 		___IMPL___::CAutoState<TTrigger, TState>* instance = new ___IMPL___::CAutoState<TTrigger, TState>(state);
-		m_pMap->Add(state, instance);
+		const SStateEntry<TTrigger, TState> added = { instance, instance, true };
+		m_pMap->Add(state, added);
 		return instance;
 	}
 
 	template<typename TTrigger, typename TState>
 	inline const TState* CFiniteStateMachine<TTrigger, TState>::CurrentState() const
 	{
-		if (m_pCurrentState == nullptr) throw std::exception("Current state is null! This should not happen!");
+		if (m_pCurrentState == nullptr) throw std::runtime_error("Current state is null! This should not happen!");
 
 		return &m_pCurrentState->StateType;
 	}
@@ -80,10 +88,23 @@ namespace FSM
 	template<typename TTrigger, typename TState>
 	inline bool CFiniteStateMachine<TTrigger, TState>::AddState(const TState & state, IState<TTrigger, TState>* instance)
 	{
-		if (m_pMap->Has(state)) return false;
+		if (instance == nullptr) return false;
+
+		// Only the state's own Configurator() is known through IState, IConfigurableState supplies it
+		const SStateEntry<TTrigger, TState> entry = { instance, instance->Configurator(), false };
+		return m_pMap->Add(state, entry);
+	}
+
+	template<typename TTrigger, typename TState>
+	template<typename TCustomState>
+	inline bool CFiniteStateMachine<TTrigger, TState>::AddState(const TState & state, TCustomState* instance)
+	{
+		if (instance == nullptr) return false;
 
-		m_pMap->Add(state, instance);
-		return true;
+		SStateEntry<TTrigger, TState> entry = { instance, instance->Configurator(), false };
+		if constexpr (std::is_base_of<IStateConfigurator<TTrigger, TState>, TCustomState>::value) entry.Configurator = instance;
+
+		return m_pMap->Add(state, entry);
 	}
 
 	template<typename TTrigger, typename TState>
@@ -91,9 +112,10 @@ namespace FSM
 	{
 		const TState& state = m_pCurrentState->FindStateForTrigger(trigger);
 
-		if (!m_pMap->Has(state)) throw std::exception("Cannot find state for type");
+		const SStateEntry<TTrigger, TState>* entry = m_pMap->Find(state);
+		if (entry == nullptr) throw std::runtime_error("Cannot find state for type");
 
-		IState<TTrigger, TState>* target = m_pMap->Get(state);
+		IState<TTrigger, TState>* target = entry->State;
 		
 		m_pCurrentState->OnExit();
 		{
@@ -102,6 +124,12 @@ namespace FSM
 		m_pCurrentState->OnEntry();
 
 	}
+
+	template<typename TTrigger, typename TState>
+	inline void CFiniteStateMachine<TTrigger, TState>::Accept(IStateVisitor<TTrigger, TState>* visitor) const
+	{
+		m_pMap->Accept(visitor);
+	}
 }
 
 
@@ -0,0 +1,250 @@
+#pragma once
+
+#include "CInstrumentation.h"
+#include "CLatencyHistograms.h"
+#include <atomic>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+#pragma region FLIGHT RECORDER
+
+namespace FSM
+{
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	// One recorded transition, 32 bytes. Timestamp is when the transition started, see EFlightRecorderTimestamps; the time
+	// taken by the exit callbacks of From & the entry callbacks of To is in CLatencyClock ticks. Machine is the tag of the
+	// recording machine.
+	struct STransitionRecord
+	{
+		uint64_t Timestamp;
+		uint32_t From;
+		uint32_t Trigger;
+		uint32_t To;
+		uint32_t Machine;
+		uint32_t ExitTicks;
+		uint32_t EntryTicks;
+	};
+
+	// Whether a flight recorder is written by one thread only, or shared by machines on several threads
+	enum EFlightRecorderWriters
+	{
+		SingleWriter,
+		MultipleWriters
+	};
+
+	// What a flight recorder stamps its records with. Reading the time stamp counter is most of what recording costs,
+	// so recorders which only need the order of transitions, or the time to within a tick of a coarse clock, skip it.
+	enum EFlightRecorderTimestamps
+	{
+		TickTimestamps,		// CLatencyClock ticks, as CChromeTraceWriter expects
+		CoarseTimestamps,	// The recorder's coarse clock, advanced with SetTime like a keyed store's, in the same unit
+		NoTimestamps		// Always 0; Snapshot keeps the order of records all the same
+	};
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	// Fixed size ring of the most recent transitions. Writes are wait-free: a slot is claimed (a plain increment for a
+	// single writer, one fetch_add otherwise) and written, never waiting on readers or other writers. Every slot carries
+	// a sequence number which is odd while it is written, so a reader on another thread can tell torn slots apart
+	// and Snapshot only returns records which were complete while it read them.
+	// Shared recorders should hold many more slots than there are writers: a writer which stalls a whole ring behind
+	// the others can finish a slot which has been claimed again since.
+	class CFlightRecorder
+	{
+	private:
+		// The 32 bit fields are stored in pairs, so a record takes five stores besides the sequence number
+		struct SSlot
+		{
+			std::atomic<uint64_t> Sequence;		// 2 * position + 2 once written, odd while written
+			std::atomic<uint64_t> Timestamp;
+			std::atomic<uint64_t> FromTrigger;
+			std::atomic<uint64_t> ToMachine;
+			std::atomic<uint64_t> Ticks;		// Exit, entry
+		};
+
+		static uint64_t Pair(uint32_t low, uint32_t high) { return (uint64_t)low | ((uint64_t)high << 32); }
+
+		std::vector<SSlot> m_slots;
+		uint64_t m_mask;
+		EFlightRecorderWriters m_writers;
+		EFlightRecorderTimestamps m_timestamps;
+
+		alignas(64) std::atomic<uint64_t> m_now;
+		alignas(64) std::atomic<uint64_t> m_head;
+
+	public:
+		// Capacity must be a power of two
+		explicit CFlightRecorder(size_t capacity, EFlightRecorderWriters writers = SingleWriter, EFlightRecorderTimestamps timestamps = TickTimestamps);
+
+		size_t Capacity() const { return m_slots.size(); }
+		EFlightRecorderTimestamps Timestamps() const { return m_timestamps; }
+
+		// Coarse clock of CoarseTimestamps recorders, e.g. advanced by a timer thread; any unit will do
+		void SetTime(uint64_t now) { m_now.store(now, std::memory_order_relaxed); }
+		uint64_t Time() const { return m_now.load(std::memory_order_relaxed); }
+
+		// Timestamp for a record starting now
+		uint64_t Stamp() const
+		{
+			if (m_timestamps == TickTimestamps) return CLatencyClock::Now();
+			return m_timestamps == CoarseTimestamps ? m_now.load(std::memory_order_relaxed) : 0;
+		}
+
+		// Transitions recorded so far, including those already overwritten
+		uint64_t Recorded() const { return m_head.load(std::memory_order_acquire); }
+
+		// Stamps the record, without callback times
+		void Record(uint32_t from, uint32_t trigger, uint32_t to, uint32_t machine = 0);
+		void Record(const STransitionRecord& record);
+
+		// The last Capacity() transitions, oldest first. Records overwritten while reading are left out.
+		std::vector<STransitionRecord> Snapshot() const;
+	};
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	// Instrumentation policy recording every transition into a CFlightRecorder, which is not owned and must outlive
+	// the machine. Machines sharing a recorder can be told apart by their tag.
+	// The record is completed while the transition runs and written once the entry callbacks are done; only states
+	// which have callbacks pay for timing them.
+	class CFlightRecorderInstrumentation
+	{
+	private:
+		CFlightRecorder* m_pRecorder;
+		STransitionRecord m_record;
+
+		template<typename TCall>
+		static uint32_t Time(TCall call)
+		{
+			const uint64_t start = CLatencyClock::Now();
+			call();
+			const uint64_t ticks = CLatencyClock::Now() - start;
+			return ticks < 0xFFFFFFFF ? (uint32_t)ticks : 0xFFFFFFFF;
+		}
+
+	public:
+		static constexpr bool Enabled = true;
+
+		explicit CFlightRecorderInstrumentation(CFlightRecorder* recorder, uint32_t machine = 0) : m_pRecorder(recorder), m_record()
+		{
+			m_record.Machine = machine;
+		}
+
+		// Records hold indices only; which definition they are of is up to the reader
+		template<typename TTrigger, typename TState>
+		void Attach(const CCompiledDefinition<TTrigger, TState>&) { }
+
+		template<typename TFire>
+		bool Fire(TFire fire) { return fire(); }
+
+		void Transitioned(uint32_t from, uint32_t trigger, uint32_t to)
+		{
+			m_record.Timestamp = m_pRecorder->Stamp();
+			m_record.From = from;
+			m_record.Trigger = trigger;
+			m_record.To = to;
+		}
+
+		void Rejected(uint32_t, uint32_t) { }
+
+		template<typename TCall>
+		void Exit(uint32_t, const SStateCallbacks& callbacks, TCall call)
+		{
+			const bool timed = callbacks.OnExit != nullptr || callbacks.OnExitInstance != nullptr;
+			m_record.ExitTicks = timed ? Time(call) : 0;
+		}
+
+		template<typename TCall>
+		void Entry(uint32_t, const SStateCallbacks& callbacks, TCall call)
+		{
+			const bool timed = callbacks.OnEntry != nullptr || callbacks.OnEntryInstance != nullptr;
+			m_record.EntryTicks = timed ? Time(call) : 0;
+			m_pRecorder->Record(m_record);
+		}
+	};
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	inline CFlightRecorder::CFlightRecorder(size_t capacity, EFlightRecorderWriters writers, EFlightRecorderTimestamps timestamps)
+		: m_slots(capacity), m_mask(capacity - 1), m_writers(writers), m_timestamps(timestamps), m_now(0), m_head(0)
+	{
+		if (capacity == 0 || (capacity & (capacity - 1)) != 0) throw std::invalid_argument("Capacity must be a power of two!");
+
+		for (SSlot& slot : m_slots) slot.Sequence.store(0, std::memory_order_relaxed);
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	inline void CFlightRecorder::Record(uint32_t from, uint32_t trigger, uint32_t to, uint32_t machine)
+	{
+		const STransitionRecord record = { Stamp(), from, trigger, to, machine, 0, 0 };
+		Record(record);
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	inline void CFlightRecorder::Record(const STransitionRecord& record)
+	{
+		uint64_t position;
+		if (m_writers == SingleWriter)
+		{
+			position = m_head.load(std::memory_order_relaxed);
+			m_head.store(position + 1, std::memory_order_release);
+		}
+		else
+		{
+			position = m_head.fetch_add(1, std::memory_order_acq_rel);
+		}
+
+		SSlot& slot = m_slots[position & m_mask];
+		slot.Sequence.store(2 * position + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+
+		slot.Timestamp.store(record.Timestamp, std::memory_order_relaxed);
+		slot.FromTrigger.store(Pair(record.From, record.Trigger), std::memory_order_relaxed);
+		slot.ToMachine.store(Pair(record.To, record.Machine), std::memory_order_relaxed);
+		slot.Ticks.store(Pair(record.ExitTicks, record.EntryTicks), std::memory_order_relaxed);
+
+		slot.Sequence.store(2 * position + 2, std::memory_order_release);
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	inline std::vector<STransitionRecord> CFlightRecorder::Snapshot() const
+	{
+		const uint64_t head = m_head.load(std::memory_order_acquire);
+		const uint64_t first = head > m_slots.size() ? head - m_slots.size() : 0;
+
+		std::vector<STransitionRecord> records;
+		records.reserve((size_t)(head - first));
+		for (uint64_t position = first; position < head; ++position)
+		{
+			const SSlot& slot = m_slots[position & m_mask];
+			const uint64_t expected = 2 * position + 2;
+			if (slot.Sequence.load(std::memory_order_acquire) != expected) continue;
+
+			STransitionRecord record;
+			record.Timestamp = slot.Timestamp.load(std::memory_order_relaxed);
+			const uint64_t fromTrigger = slot.FromTrigger.load(std::memory_order_relaxed);
+			const uint64_t toMachine = slot.ToMachine.load(std::memory_order_relaxed);
+			const uint64_t ticks = slot.Ticks.load(std::memory_order_relaxed);
+			record.From = (uint32_t)fromTrigger;
+			record.Trigger = (uint32_t)(fromTrigger >> 32);
+			record.To = (uint32_t)toMachine;
+			record.Machine = (uint32_t)(toMachine >> 32);
+			record.ExitTicks = (uint32_t)ticks;
+			record.EntryTicks = (uint32_t)(ticks >> 32);
+
+			// Rewritten while it was read
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (slot.Sequence.load(std::memory_order_relaxed) != expected) continue;
+
+			records.push_back(record);
+		}
+		return records;
+	}
+}
+
+#pragma endregion
@@ -0,0 +1,228 @@
+#pragma once
+
+#include "export.h"
+#include "CHeatProfile.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#pragma region GRAPHVIZ WRITER
+
+namespace FSM
+{
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	struct SGraphvizOptions
+	{
+		// Edges with fewer hits than this share of the hottest edge are left out; 0 keeps every edge.
+		// Only applies with a heat profile.
+		double MinEdgeShare = 0;
+
+		// Leaves out states (but the current one) which end up without edges, e.g. after pruning
+		bool HideIsolatedStates = false;
+
+		// Callback latency percentile shown on states
+		double CallbackPercentile = 99;
+	};
+
+	namespace ___IMPL___
+	{
+		////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+		template<typename TTrigger, typename TState>
+		class CStateEntryCollector : public IStateVisitor<TTrigger, TState>
+		{
+		public:
+			std::vector<SStateEntry<TTrigger, TState>> Entries;
+
+			virtual void Visit(const SStateEntry<TTrigger, TState>& entry) override { Entries.push_back(entry); }
+		};
+
+		////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+		// Writes 'text' as a DOT string
+		inline void WriteDotString(std::ostream& out, const std::string& text)
+		{
+			out << '"';
+			for (char c : text)
+			{
+				if (c == '"' || c == '\\') out << '\\';
+				if (c == '\n') out << "\\n";
+				else out << c;
+			}
+			out << '"';
+		}
+
+		////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+		// Blue for cold through red for hot, by the log of the share of the maximum
+		inline std::string HeatColor(uint64_t value, uint64_t max)
+		{
+			const double heat = max > 1 && value > 0 ? std::log((double)value) / std::log((double)max) : (value > 0 ? 1.0 : 0.0);
+
+			// Hue runs from 0.66 (blue) down to 0 (red)
+			char color[32];
+			std::snprintf(color, sizeof(color), "%.3f 0.85 0.90", 0.66 * (1 - std::min(1.0, std::max(0.0, heat))));
+			return color;
+		}
+
+		////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+		inline std::string FormatNanoseconds(double nanoseconds)
+		{
+			char text[32];
+			if (nanoseconds >= 1e9) std::snprintf(text, sizeof(text), "%.2f s", nanoseconds / 1e9);
+			else if (nanoseconds >= 1e6) std::snprintf(text, sizeof(text), "%.2f ms", nanoseconds / 1e6);
+			else if (nanoseconds >= 1e3) std::snprintf(text, sizeof(text), "%.2f us", nanoseconds / 1e3);
+			else std::snprintf(text, sizeof(text), "%.0f ns", nanoseconds);
+			return text;
+		}
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	// Writes a configured machine as a Graphviz DOT digraph, walking its states and their trigger tables. The current
+	// state is drawn bold, custom states (whose triggers cannot be listed) dashed.
+	// With a heat profile, edges are colored & weighted by their hits and states list their entries, mean time in state
+	// and callback latency; cold edges can be pruned to keep machines with thousands of states readable.
+	template<typename TTrigger, typename TState>
+	void WriteGraphviz(
+		std::ostream& out,
+		const CFiniteStateMachine<TTrigger, TState>& machine,
+		const CHeatProfile<TTrigger, TState>* heat = nullptr,
+		const SGraphvizOptions& options = SGraphvizOptions())
+	{
+		struct SEdge
+		{
+			size_t From;
+			size_t To;
+			const TTrigger* Trigger;
+			uint64_t Hits;
+		};
+
+		___IMPL___::CStateEntryCollector<TTrigger, TState> collector;
+		machine.Accept(&collector);
+		const std::vector<SStateEntry<TTrigger, TState>>& states = collector.Entries;
+
+		// Node ids are positions in the state map, which is ordered by state
+		const auto nodeOf = [&states](const TState& state)
+		{
+			size_t low = 0, high = states.size();
+			while (low < high)
+			{
+				const size_t middle = (low + high) / 2;
+				if (states[middle].State->StateType < state) low = middle + 1;
+				else high = middle;
+			}
+			return low < states.size() && !(state < states[low].State->StateType) ? low : states.size();
+		};
+
+		const uint64_t maxHits = heat != nullptr ? heat->MaxHits() : 0;
+		const uint64_t minHits = heat != nullptr && options.MinEdgeShare > 0 ? (uint64_t)std::ceil(options.MinEdgeShare * maxHits) : 0;
+
+		std::vector<SEdge> edges;
+		std::vector<bool> connected(states.size(), false);
+		for (size_t i = 0; i < states.size(); ++i)
+		{
+			if (!states[i].AutoState) continue;
+
+			const ___IMPL___::CAutoState<TTrigger, TState>* state = static_cast<const ___IMPL___::CAutoState<TTrigger, TState>*>(states[i].Configurator);
+
+			typename std::map<TTrigger, TState>::const_iterator itr = state->Transitions().begin();
+			for (; itr != state->Transitions().end(); ++itr)
+			{
+				const SEdge edge = { i, nodeOf(itr->second), &itr->first, heat != nullptr ? heat->Hits(state->StateType, itr->first) : 0 };
+				if (edge.Hits < minHits) continue;
+
+				edges.push_back(edge);
+				connected[edge.From] = true;
+				if (edge.To < states.size()) connected[edge.To] = true;
+			}
+		}
+
+		const TState* current = machine.CurrentState();
+
+		out << "digraph StateMachine {\n";
+		out << "\tnode [shape=box, style=\"rounded,filled\", fillcolor=white, fontname=Helvetica];\n";
+		out << "\tedge [fontname=Helvetica, fontsize=10];\n";
+
+		uint64_t maxEntries = 0;
+		for (size_t i = 0; heat != nullptr && i < states.size(); ++i)
+		{
+			const SStateHeat* stateHeat = heat->State(states[i].State->StateType);
+			if (stateHeat != nullptr) maxEntries = std::max(maxEntries, stateHeat->Entries);
+		}
+
+		for (size_t i = 0; i < states.size(); ++i)
+		{
+			const TState& state = states[i].State->StateType;
+			const SStateHeat* stateHeat = heat != nullptr ? heat->State(state) : nullptr;
+			const bool isCurrent = current != nullptr && !(*current < state) && !(state < *current);
+
+			if (options.HideIsolatedStates && !connected[i] && !isCurrent) continue;
+
+			std::string label = ___IMPL___::TraceName(state);
+			if (stateHeat != nullptr)
+			{
+				label += "\nentries: " + std::to_string(stateHeat->Entries);
+				if (stateHeat->Visits != 0) label += "\nmean stay: " + ___IMPL___::FormatNanoseconds(stateHeat->MeanNanosecondsInState());
+				if (stateHeat->Callbacks.Count() != 0)
+				{
+					char percentile[16];
+					std::snprintf(percentile, sizeof(percentile), "%g", options.CallbackPercentile);
+					label += "\ncallbacks p" + std::string(percentile) + ": "
+						+ ___IMPL___::FormatNanoseconds(stateHeat->Callbacks.PercentileNanoseconds(options.CallbackPercentile));
+				}
+				else if (stateHeat->CallbackNanoseconds != 0 && stateHeat->Entries != 0)
+				{
+					label += "\ncallbacks: " + ___IMPL___::FormatNanoseconds((double)stateHeat->CallbackNanoseconds / stateHeat->Entries) + " / entry";
+				}
+			}
+
+			out << "\ts" << i << " [label=";
+			___IMPL___::WriteDotString(out, label);
+			if (stateHeat != nullptr) out << ", fillcolor=\"" << ___IMPL___::HeatColor(stateHeat->Entries, maxEntries) << "\", fontcolor=white";
+
+			std::string style = "rounded,filled";
+			if (!states[i].AutoState) style += ",dashed";
+			if (isCurrent) style += ",bold";
+			out << ", style=\"" << style << "\"];\n";
+		}
+
+		// Transitions into states which were never configured point at a placeholder
+		bool unknownTarget = false;
+		for (const SEdge& edge : edges)
+		{
+			out << "\ts" << edge.From << " -> ";
+			if (edge.To < states.size()) out << 's' << edge.To;
+			else
+			{
+				out << "unknown";
+				unknownTarget = true;
+			}
+
+			std::string label = ___IMPL___::TraceName(*edge.Trigger);
+			if (heat != nullptr) label += " (" + std::to_string(edge.Hits) + ")";
+
+			out << " [label=";
+			___IMPL___::WriteDotString(out, label);
+			if (heat != nullptr)
+			{
+				const double share = maxHits != 0 ? (double)edge.Hits / maxHits : 0;
+				char width[16];
+				std::snprintf(width, sizeof(width), "%.2f", 1 + 5 * share);
+				out << ", color=\"" << ___IMPL___::HeatColor(edge.Hits, maxHits) << "\", penwidth=" << width << ", weight=" << 1 + (int)(100 * share);
+			}
+			out << "];\n";
+		}
+		if (unknownTarget) out << "\tunknown [label=\"(not configured)\", style=dotted];\n";
+
+		out << "}\n";
+	}
+}
+
+#pragma endregion
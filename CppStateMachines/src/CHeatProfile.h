@@ -0,0 +1,186 @@
+#pragma once
+
+#include "CCompiledDefinition.h"
+#include "CFlightRecorder.h"
+#include "CInstrumentation.h"
+#include "CLatencyHistograms.h"
+#include <cstdint>
+#include <map>
+#include <stdexcept>
+#include <vector>
+
+#pragma region HEAT PROFILE
+
+namespace FSM
+{
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	// What was measured for one state
+	struct SStateHeat
+	{
+		uint64_t Entries = 0;
+		uint64_t CallbackNanoseconds = 0;		// Total, from instrumentation counters
+		uint64_t Visits = 0;					// Stays with a known length, from flight recorder records
+		uint64_t TicksInState = 0;				// Their total length
+		CLatencyHistogram Callbacks;			// Entry & exit callback latencies, from latency histograms
+
+		double MeanNanosecondsInState() const { return Visits != 0 ? CLatencyClock::Nanoseconds(TicksInState) / Visits : 0; }
+	};
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	// Gathers what the instrumentation measured on the machines of one definition: counter snapshots, latency
+	// snapshots and flight recorder records can be added any number of times. Lookups go by state & trigger value,
+	// so the profile also applies to the configured machine the definition was compiled from.
+	template<typename TTrigger, typename TState>
+	class CHeatProfile
+	{
+	private:
+		const CCompiledDefinition<TTrigger, TState>* m_pDefinition;
+		std::vector<___IMPL___::STransition> m_transitions;
+		std::vector<uint64_t> m_hits;
+		std::vector<SStateHeat> m_states;
+		std::map<uint32_t, STransitionRecord> m_lastRecords;		// Per machine tag
+
+		uint32_t TransitionIndex(uint32_t state, uint32_t trigger) const;
+
+	public:
+		// The definition is not owned and must outlive the profile
+		explicit CHeatProfile(const CCompiledDefinition<TTrigger, TState>* definition);
+
+		const CCompiledDefinition<TTrigger, TState>& Definition() const { return *m_pDefinition; }
+
+		void Add(const SInstrumentationSnapshot& snapshot);
+		void Add(const SLatencySnapshot& snapshot);
+
+		// Records of a machine must come oldest first; a stay is measured from one transition into a state to the next
+		// transition out of it, also across calls. Stays are timed in CLatencyClock ticks, so records of recorders with
+		// other EFlightRecorderTimestamps are rejected with std::invalid_argument.
+		void Add(const std::vector<STransitionRecord>& records, EFlightRecorderTimestamps timestamps = TickTimestamps);
+		void Add(const CFlightRecorder& recorder) { Add(recorder.Snapshot(), recorder.Timestamps()); }
+
+		// Hits of the transition at index i of the definition's Transitions()
+		uint64_t Hits(size_t transition) const { return m_hits[transition]; }
+		uint64_t Hits(const TState& from, const TTrigger& trigger) const;
+		uint64_t MaxHits() const;
+
+		// Null for states the definition does not know
+		const SStateHeat* State(const TState& state) const;
+		const SStateHeat& StateAt(uint32_t state) const { return m_states[state]; }
+	};
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename TTrigger, typename TState>
+	CHeatProfile<TTrigger, TState>::CHeatProfile(const CCompiledDefinition<TTrigger, TState>* definition)
+		: m_pDefinition(definition), m_transitions(definition->Transitions()), m_states(definition->StateCount())
+	{
+		m_hits.assign(m_transitions.size(), 0);
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename TTrigger, typename TState>
+	uint32_t CHeatProfile<TTrigger, TState>::TransitionIndex(uint32_t state, uint32_t trigger) const
+	{
+		const ___IMPL___::STransition key = { state, trigger, 0 };
+		typename std::vector<___IMPL___::STransition>::const_iterator itr = std::lower_bound(m_transitions.begin(), m_transitions.end(), key);
+		return itr != m_transitions.end() && itr->From == state && itr->Trigger == trigger ? (uint32_t)(itr - m_transitions.begin()) : InvalidIndex;
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename TTrigger, typename TState>
+	void CHeatProfile<TTrigger, TState>::Add(const SInstrumentationSnapshot& snapshot)
+	{
+		if (snapshot.Transitions.size() != m_hits.size() || snapshot.Entries.size() != m_states.size())
+		{
+			throw std::invalid_argument("Snapshot is of another definition!");
+		}
+
+		for (size_t i = 0; i < m_hits.size(); ++i) m_hits[i] += snapshot.Transitions[i];
+		for (size_t i = 0; i < m_states.size(); ++i)
+		{
+			m_states[i].Entries += snapshot.Entries[i];
+			m_states[i].CallbackNanoseconds += snapshot.CallbackNanoseconds[i];
+		}
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename TTrigger, typename TState>
+	void CHeatProfile<TTrigger, TState>::Add(const SLatencySnapshot& snapshot)
+	{
+		if (snapshot.Entry.size() != m_states.size()) throw std::invalid_argument("Snapshot is of another definition!");
+
+		for (size_t i = 0; i < m_states.size(); ++i)
+		{
+			m_states[i].Callbacks.Merge(snapshot.Entry[i]);
+			m_states[i].Callbacks.Merge(snapshot.Exit[i]);
+		}
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename TTrigger, typename TState>
+	void CHeatProfile<TTrigger, TState>::Add(const std::vector<STransitionRecord>& records, EFlightRecorderTimestamps timestamps)
+	{
+		if (timestamps != TickTimestamps) throw std::invalid_argument("Records need TickTimestamps!");
+
+		for (const STransitionRecord& record : records)
+		{
+			if (record.From >= m_states.size() || record.To >= m_states.size()) throw std::invalid_argument("Record is of another definition!");
+
+			typename std::map<uint32_t, STransitionRecord>::iterator last = m_lastRecords.find(record.Machine);
+			if (last == m_lastRecords.end())
+			{
+				m_lastRecords.insert(std::make_pair(record.Machine, record));
+				continue;
+			}
+
+			// Overlapping snapshots repeat records
+			if (record.Timestamp <= last->second.Timestamp) continue;
+
+			if (last->second.To == record.From)
+			{
+				SStateHeat& state = m_states[record.From];
+				++state.Visits;
+				state.TicksInState += record.Timestamp - last->second.Timestamp;
+			}
+			last->second = record;
+		}
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename TTrigger, typename TState>
+	uint64_t CHeatProfile<TTrigger, TState>::Hits(const TState& from, const TTrigger& trigger) const
+	{
+		const uint32_t state = m_pDefinition->FindState(from), index = m_pDefinition->FindTrigger(trigger);
+		if (state == InvalidIndex || index == InvalidIndex) return 0;
+
+		const uint32_t transition = TransitionIndex(state, index);
+		return transition != InvalidIndex ? m_hits[transition] : 0;
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename TTrigger, typename TState>
+	uint64_t CHeatProfile<TTrigger, TState>::MaxHits() const
+	{
+		uint64_t max = 0;
+		for (uint64_t hits : m_hits) max = std::max(max, hits);
+		return max;
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename TTrigger, typename TState>
+	const SStateHeat* CHeatProfile<TTrigger, TState>::State(const TState& state) const
+	{
+		const uint32_t index = m_pDefinition->FindState(state);
+		return index != InvalidIndex ? &m_states[index] : nullptr;
+	}
+}
+
+#pragma endregion
@@ -0,0 +1,269 @@
+#pragma once
+
+#include "CCompiledDefinition.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#pragma region INSTRUMENTATION
+
+namespace FSM
+{
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	// Counters of a CInstrumentationCounters at one point in time.
+	// Transitions[i] counts the i-th transition of the definition's Transitions(), the other vectors are per state.
+	struct SInstrumentationSnapshot
+	{
+		std::vector<uint64_t> Transitions;
+		std::vector<uint64_t> Entries;
+		std::vector<uint64_t> Rejected;				// Known triggers the state does not handle
+		std::vector<uint64_t> CallbackNanoseconds;	// Spent in the state's entry & exit callbacks
+		uint64_t UnknownTriggers = 0;
+
+		// Adds the counters of another snapshot of the same definition, e.g. of another thread
+		void Merge(const SInstrumentationSnapshot& other);
+	};
+
+	namespace ___IMPL___
+	{
+		////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+		// Counters are written by a single thread and read by any, so increments are a relaxed load & store
+		// instead of a locked read-modify-write. Whole cache lines keep blocks of different threads apart.
+		class CCounterBlock
+		{
+		private:
+			struct alignas(64) SCacheLine
+			{
+				std::atomic<uint64_t> Values[8];
+			};
+
+			std::vector<SCacheLine> m_lines;
+			size_t m_size;
+
+		public:
+			explicit CCounterBlock(size_t size) : m_lines((size + 7) / 8), m_size(size) { }
+
+			size_t Size() const { return m_size; }
+
+			void Add(size_t index, uint64_t value)
+			{
+				std::atomic<uint64_t>& counter = m_lines[index / 8].Values[index % 8];
+				counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+			}
+
+			uint64_t Get(size_t index) const { return m_lines[index / 8].Values[index % 8].load(std::memory_order_relaxed); }
+
+			void CopyTo(std::vector<uint64_t>& values) const
+			{
+				values.resize(m_size);
+				for (size_t i = 0; i < m_size; ++i) values[i] = Get(i);
+			}
+		};
+
+		////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+		// States & triggers are named in traces & graphs by streaming them, enums show as their value
+		template<typename T>
+		std::string TraceName(const T& value)
+		{
+			std::ostringstream name;
+			name << value;
+			return name.str();
+		}
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	// Hit counters for the machines of one definition. Counting is not synchronized: give every thread which fires
+	// its own counters (e.g. thread_local, or one per worker) and merge their snapshots. Snapshot may be called
+	// from any thread while machines keep firing.
+	class CInstrumentationCounters
+	{
+	private:
+		std::vector<uint32_t> m_rowStarts;
+		std::vector<uint32_t> m_triggers;		// Trigger of every transition, rows in definition order
+
+		___IMPL___::CCounterBlock m_transitions;
+		___IMPL___::CCounterBlock m_entries;
+		___IMPL___::CCounterBlock m_rejected;
+		___IMPL___::CCounterBlock m_callbackNanoseconds;
+		___IMPL___::CCounterBlock m_unknownTriggers;
+
+		uint64_t m_fingerprint;					// Of the definition the counters are laid out for
+		uint32_t m_stateCount;
+
+	public:
+		template<typename TTrigger, typename TState>
+		explicit CInstrumentationCounters(const CCompiledDefinition<TTrigger, TState>& definition);
+
+		// Whether the counters are laid out for the definition, i.e. it or a copy of it
+		template<typename TTrigger, typename TState>
+		bool Matches(const CCompiledDefinition<TTrigger, TState>& definition) const
+		{
+			return definition.Fingerprint() == m_fingerprint && definition.StateCount() == m_stateCount;
+		}
+
+		// Position of the transition in the definition's Transitions() & the snapshot, or InvalidIndex
+		uint32_t TransitionIndex(uint32_t state, uint32_t trigger) const;
+
+		SInstrumentationSnapshot Snapshot() const;
+
+		void Transitioned(uint32_t from, uint32_t trigger, uint32_t to)
+		{
+			m_transitions.Add(TransitionIndex(from, trigger), 1);
+			m_entries.Add(to, 1);
+		}
+
+		void Rejected(uint32_t state, uint32_t trigger)
+		{
+			if (trigger == InvalidIndex) m_unknownTriggers.Add(0, 1);
+			else m_rejected.Add(state, 1);
+		}
+
+		void CallbacksTook(uint32_t state, uint64_t nanoseconds) { m_callbackNanoseconds.Add(state, nanoseconds); }
+	};
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	// Instrumentation policies of CCompiledStateMachine. Attach is called once with the machine's definition, and throws
+	// std::invalid_argument when what the policy records into was made for another one. Fire wraps every fire, trigger
+	// lookup included, and returns what 'fire' returns; Exit & Entry wrap the callbacks of the state which is left or
+	// entered. The hooks of a disabled policy are empty inlines, so it leaves no code and, as an empty base, no storage behind.
+
+	class CNoInstrumentation
+	{
+	public:
+		static constexpr bool Enabled = false;
+
+		template<typename TTrigger, typename TState>
+		void Attach(const CCompiledDefinition<TTrigger, TState>&) { }
+
+		template<typename TFire>
+		bool Fire(TFire fire) { return fire(); }
+
+		void Transitioned(uint32_t, uint32_t, uint32_t) { }
+		void Rejected(uint32_t, uint32_t) { }
+
+		template<typename TCall>
+		void Exit(uint32_t, const SStateCallbacks&, TCall call) { call(); }
+
+		template<typename TCall>
+		void Entry(uint32_t, const SStateCallbacks&, TCall call) { call(); }
+	};
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	// Counts into CInstrumentationCounters, which are not owned and must outlive the machine
+	class CCountingInstrumentation
+	{
+	private:
+		CInstrumentationCounters* m_pCounters;
+
+	public:
+		static constexpr bool Enabled = true;
+
+		explicit CCountingInstrumentation(CInstrumentationCounters* counters) : m_pCounters(counters) { }
+
+		// Counters of another definition would be indexed by states & transitions they do not have
+		template<typename TTrigger, typename TState>
+		void Attach(const CCompiledDefinition<TTrigger, TState>& definition)
+		{
+			if (!m_pCounters->Matches(definition)) throw std::invalid_argument("Instrumentation counters are of another definition!");
+		}
+
+		template<typename TFire>
+		bool Fire(TFire fire) { return fire(); }
+
+		void Transitioned(uint32_t from, uint32_t trigger, uint32_t to) { m_pCounters->Transitioned(from, trigger, to); }
+		void Rejected(uint32_t state, uint32_t trigger) { m_pCounters->Rejected(state, trigger); }
+
+		template<typename TCall>
+		void Exit(uint32_t state, const SStateCallbacks& callbacks, TCall call)
+		{
+			if (callbacks.OnExit != nullptr || callbacks.OnExitInstance != nullptr) Time(state, call);
+		}
+
+		template<typename TCall>
+		void Entry(uint32_t state, const SStateCallbacks& callbacks, TCall call)
+		{
+			if (callbacks.OnEntry != nullptr || callbacks.OnEntryInstance != nullptr) Time(state, call);
+		}
+
+	private:
+		// Only states which have callbacks pay for reading the clock
+		template<typename TCall>
+		void Time(uint32_t state, TCall call)
+		{
+			const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			call();
+			const std::chrono::steady_clock::duration took = std::chrono::steady_clock::now() - start;
+			m_pCounters->CallbacksTook(state, (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(took).count());
+		}
+	};
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	inline void SInstrumentationSnapshot::Merge(const SInstrumentationSnapshot& other)
+	{
+		const auto add = [](std::vector<uint64_t>& values, const std::vector<uint64_t>& others)
+		{
+			values.resize(std::max(values.size(), others.size()), 0);
+			for (size_t i = 0; i < others.size(); ++i) values[i] += others[i];
+		};
+
+		add(Transitions, other.Transitions);
+		add(Entries, other.Entries);
+		add(Rejected, other.Rejected);
+		add(CallbackNanoseconds, other.CallbackNanoseconds);
+		UnknownTriggers += other.UnknownTriggers;
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename TTrigger, typename TState>
+	CInstrumentationCounters::CInstrumentationCounters(const CCompiledDefinition<TTrigger, TState>& definition)
+		: m_transitions(0), m_entries(definition.StateCount()), m_rejected(definition.StateCount()),
+		m_callbackNanoseconds(definition.StateCount()), m_unknownTriggers(1), m_fingerprint(definition.Fingerprint()), m_stateCount(definition.StateCount())
+	{
+		const std::vector<___IMPL___::STransition> transitions = definition.Transitions();
+		m_rowStarts = ___IMPL___::RowStarts(definition.StateCount(), transitions);
+
+		m_triggers.reserve(transitions.size());
+		for (const ___IMPL___::STransition& transition : transitions) m_triggers.push_back(transition.Trigger);
+
+		m_transitions = ___IMPL___::CCounterBlock(transitions.size());
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	inline uint32_t CInstrumentationCounters::TransitionIndex(uint32_t state, uint32_t trigger) const
+	{
+		const std::vector<uint32_t>::const_iterator begin = m_triggers.begin() + m_rowStarts[state];
+		const std::vector<uint32_t>::const_iterator end = m_triggers.begin() + m_rowStarts[state + 1];
+
+		const std::vector<uint32_t>::const_iterator itr = std::lower_bound(begin, end, trigger);
+		return itr != end && *itr == trigger ? (uint32_t)(itr - m_triggers.begin()) : InvalidIndex;
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	inline SInstrumentationSnapshot CInstrumentationCounters::Snapshot() const
+	{
+		SInstrumentationSnapshot snapshot;
+		m_transitions.CopyTo(snapshot.Transitions);
+		m_entries.CopyTo(snapshot.Entries);
+		m_rejected.CopyTo(snapshot.Rejected);
+		m_callbackNanoseconds.CopyTo(snapshot.CallbackNanoseconds);
+		snapshot.UnknownTriggers = m_unknownTriggers.Get(0);
+		return snapshot;
+	}
+}
+
+#pragma endregion
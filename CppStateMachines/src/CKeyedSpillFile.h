@@ -0,0 +1,360 @@
+#pragma once
+
+#include "CSequencing.h"
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#pragma region KEYED SPILL FILE
+
+namespace FSM
+{
+	namespace ___IMPL___
+	{
+		////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+		// Spreads hashes like std::hash of integers (often the value itself) over all bits before they are masked
+		inline uint64_t MixHash(uint64_t hash)
+		{
+			hash ^= hash >> 33;
+			hash *= 0xff51afd7ed558ccdull;
+			hash ^= hash >> 33;
+			hash *= 0xc4ceb9fe1a85ec53ull;
+			hash ^= hash >> 33;
+			return hash;
+		}
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	// Where a keyed store puts the instances it evicts: an append-only file of fixed size (key, state, last transition)
+	// records plus an in memory index of 8 bytes per slot, a 32 bit fingerprint of the key's hash and the record number.
+	// Slots are placed by fingerprint alone, so the index grows and shifts without reading the file back; keys which
+	// were never spilled are told apart by it in all but one in 4 billion probes. A spilled key costs one read.
+	// Appends are gathered in memory and written a few thousand at a time, the file itself is unbuffered.
+	// Taking or erasing a key leaves its record behind, Compact rewrites the file without them.
+	// The file is created empty, or truncated, and is not meant to survive the process. Keys must be trivially copyable.
+	// Records keep what the store's sequencing policy keeps per instance.
+	template<typename TKey, typename THash = std::hash<TKey>, typename TSequencing = CNoSequencing>
+	class CKeyedSpillFile
+	{
+	public:
+		struct SRecord : public TSequencing::SInstance
+		{
+			TKey Key;
+			uint32_t State;
+			uint32_t Touched;		// Time of the last transition, in the store's clock
+		};
+
+	private:
+		struct SSlot
+		{
+			uint32_t Fingerprint;
+			uint32_t Record;		// Record number + 1, 0 while the slot is free
+		};
+
+		static const size_t PendingRecords = 4096;
+
+		std::string m_path;
+		mutable std::fstream m_file;
+		std::vector<SRecord> m_pending;		// Appended, not written yet
+		uint64_t m_records;					// In the file or pending, live or not
+		std::vector<SSlot> m_slots;
+		size_t m_mask;
+		size_t m_size;
+		THash m_hash;
+
+		// Slot holding the key's record, or the free slot ending its probe sequence; fills 'record' when found
+		size_t Probe(const TKey& key, SRecord* record) const;
+
+		void ReadRecord(uint32_t number, SRecord& record) const;
+		void Open();
+		void WritePending();
+		void Index(uint32_t fingerprint, uint32_t number);
+		void RemoveAt(size_t hole);
+		void Rehash(size_t capacity);
+
+		uint32_t Fingerprint(const TKey& key) const { return (uint32_t)(___IMPL___::MixHash((uint64_t)m_hash(key)) >> 32); }
+
+	public:
+		// Throws std::runtime_error when the file cannot be created
+		explicit CKeyedSpillFile(const std::string& path);
+
+		const std::string& Path() const { return m_path; }
+
+		// Keys spilled & not taken back
+		size_t Size() const { return m_size; }
+
+		// Records in the file, including the ones taken back since the last Compact
+		uint64_t Records() const { return m_records; }
+		uint64_t FileBytes() const { return m_records * sizeof(SRecord); }
+		size_t IndexBytes() const { return m_slots.size() * sizeof(SSlot); }
+
+		// Appends the record; an older record of its key is forgotten
+		void Write(const SRecord& record);
+
+		bool Contains(const TKey& key) const { return m_slots[Probe(key, nullptr)].Record != 0; }
+		bool Read(const TKey& key, SRecord& record) const;
+
+		// Reads & forgets the key's record
+		bool Take(const TKey& key, SRecord& record);
+		bool Erase(const TKey& key);
+
+		// Rewrites the file with the live records only
+		void Compact();
+
+		// Forgets every record
+		void Clear();
+
+		// Calls visit(record) for every live record, in file order
+		template<typename TVisit>
+		void ForEach(TVisit visit) const;
+	};
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename TKey, typename THash, typename TSequencing>
+	CKeyedSpillFile<TKey, THash, TSequencing>::CKeyedSpillFile(const std::string& path)
+		: m_path(path), m_records(0), m_mask(0), m_size(0)
+	{
+		static_assert(std::is_trivially_copyable<TKey>::value, "Spilled keys are written as they are in memory");
+
+		m_pending.reserve(PendingRecords);
+		Open();
+		Rehash(16);
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename TKey, typename THash, typename TSequencing>
+	void CKeyedSpillFile<TKey, THash, TSequencing>::Open()
+	{
+		// Without a buffer, reading a record reads its bytes only
+		m_file.rdbuf()->pubsetbuf(nullptr, 0);
+		m_file.open(m_path, std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
+		if (!m_file) throw std::runtime_error("Cannot create spill file " + m_path + "!");
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename TKey, typename THash, typename TSequencing>
+	void CKeyedSpillFile<TKey, THash, TSequencing>::WritePending()
+	{
+		if (m_pending.empty()) return;
+
+		m_file.seekp((std::streamoff)(m_records - m_pending.size()) * sizeof(SRecord));
+		if (!m_file.write(reinterpret_cast<const char*>(m_pending.data()), (std::streamsize)(m_pending.size() * sizeof(SRecord))))
+		{
+			throw std::runtime_error("Cannot write spill file " + m_path + "!");
+		}
+		m_pending.clear();
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename TKey, typename THash, typename TSequencing>
+	size_t CKeyedSpillFile<TKey, THash, TSequencing>::Probe(const TKey& key, SRecord* record) const
+	{
+		const uint32_t fingerprint = Fingerprint(key);
+
+		SRecord stored;
+		size_t slot = fingerprint & m_mask;
+		for (; m_slots[slot].Record != 0; slot = (slot + 1) & m_mask)
+		{
+			if (m_slots[slot].Fingerprint != fingerprint) continue;
+
+			// Same fingerprint, most likely the same key
+			ReadRecord(m_slots[slot].Record - 1, stored);
+			if (!(stored.Key == key)) continue;
+
+			if (record != nullptr) *record = stored;
+			break;
+		}
+		return slot;
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename TKey, typename THash, typename TSequencing>
+	void CKeyedSpillFile<TKey, THash, TSequencing>::ReadRecord(uint32_t number, SRecord& record) const
+	{
+		const uint64_t written = m_records - m_pending.size();
+		if (number >= written)
+		{
+			record = m_pending[(size_t)(number - written)];
+			return;
+		}
+
+		m_file.seekg((std::streamoff)number * sizeof(SRecord));
+		if (!m_file.read(reinterpret_cast<char*>(&record), sizeof(SRecord))) throw std::runtime_error("Cannot read spill file " + m_path + "!");
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename TKey, typename THash, typename TSequencing>
+	void CKeyedSpillFile<TKey, THash, TSequencing>::Index(uint32_t fingerprint, uint32_t number)
+	{
+		if ((m_size + 1) * 5 > m_slots.size() * 4) Rehash(m_slots.size() * 2);
+
+		size_t slot = fingerprint & m_mask;
+		while (m_slots[slot].Record != 0) slot = (slot + 1) & m_mask;
+
+		m_slots[slot].Fingerprint = fingerprint;
+		m_slots[slot].Record = number + 1;
+		++m_size;
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	// Backward shift, as in CKeyedStateMachineStore::Erase
+	template<typename TKey, typename THash, typename TSequencing>
+	void CKeyedSpillFile<TKey, THash, TSequencing>::RemoveAt(size_t hole)
+	{
+		for (size_t slot = (hole + 1) & m_mask; m_slots[slot].Record != 0; slot = (slot + 1) & m_mask)
+		{
+			const size_t home = m_slots[slot].Fingerprint & m_mask;
+			if (((slot - home) & m_mask) < ((slot - hole) & m_mask)) continue;
+
+			m_slots[hole] = m_slots[slot];
+			hole = slot;
+		}
+
+		m_slots[hole].Fingerprint = 0;
+		m_slots[hole].Record = 0;
+		--m_size;
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename TKey, typename THash, typename TSequencing>
+	void CKeyedSpillFile<TKey, THash, TSequencing>::Rehash(size_t capacity)
+	{
+		const SSlot free = { 0, 0 };
+
+		std::vector<SSlot> slots(capacity, free);
+		slots.swap(m_slots);
+		m_mask = capacity - 1;
+		m_size = 0;
+
+		for (const SSlot& slot : slots)
+		{
+			if (slot.Record != 0) Index(slot.Fingerprint, slot.Record - 1);
+		}
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename TKey, typename THash, typename TSequencing>
+	void CKeyedSpillFile<TKey, THash, TSequencing>::Write(const SRecord& record)
+	{
+		if (m_records >= 0xFFFFFFFEull) throw std::runtime_error("Spill file is full, Compact it!");
+
+		const size_t slot = Probe(record.Key, nullptr);
+		if (m_slots[slot].Record != 0) RemoveAt(slot);
+
+		m_pending.push_back(record);
+		Index(Fingerprint(record.Key), (uint32_t)m_records++);
+
+		if (m_pending.size() == PendingRecords) WritePending();
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename TKey, typename THash, typename TSequencing>
+	bool CKeyedSpillFile<TKey, THash, TSequencing>::Read(const TKey& key, SRecord& record) const
+	{
+		return m_slots[Probe(key, &record)].Record != 0;
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename TKey, typename THash, typename TSequencing>
+	bool CKeyedSpillFile<TKey, THash, TSequencing>::Take(const TKey& key, SRecord& record)
+	{
+		const size_t slot = Probe(key, &record);
+		if (m_slots[slot].Record == 0) return false;
+
+		RemoveAt(slot);
+		return true;
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename TKey, typename THash, typename TSequencing>
+	bool CKeyedSpillFile<TKey, THash, TSequencing>::Erase(const TKey& key)
+	{
+		const size_t slot = Probe(key, nullptr);
+		if (m_slots[slot].Record == 0) return false;
+
+		RemoveAt(slot);
+		return true;
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename TKey, typename THash, typename TSequencing>
+	template<typename TVisit>
+	void CKeyedSpillFile<TKey, THash, TSequencing>::ForEach(TVisit visit) const
+	{
+		// Records are live when the index still points at them
+		std::vector<bool> live((size_t)m_records, false);
+		for (const SSlot& slot : m_slots)
+		{
+			if (slot.Record != 0) live[slot.Record - 1] = true;
+		}
+
+		SRecord record;
+		for (uint64_t number = 0; number < m_records; ++number)
+		{
+			if (!live[(size_t)number]) continue;
+
+			ReadRecord((uint32_t)number, record);
+			visit(record);
+		}
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename TKey, typename THash, typename TSequencing>
+	void CKeyedSpillFile<TKey, THash, TSequencing>::Clear()
+	{
+		m_file.close();
+		Open();
+		m_pending.clear();
+		m_records = 0;
+
+		const SSlot free = { 0, 0 };
+		m_slots.assign(m_slots.size(), free);
+		m_size = 0;
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename TKey, typename THash, typename TSequencing>
+	void CKeyedSpillFile<TKey, THash, TSequencing>::Compact()
+	{
+		std::vector<SRecord> records;
+		records.reserve(m_size);
+		ForEach([&records](const SRecord& record) { records.push_back(record); });
+
+		m_file.close();
+		Open();
+		if (!records.empty() && !m_file.write(reinterpret_cast<const char*>(records.data()), (std::streamsize)(records.size() * sizeof(SRecord))))
+		{
+			throw std::runtime_error("Cannot write spill file " + m_path + "!");
+		}
+		m_pending.clear();
+		m_records = records.size();
+
+		const SSlot free = { 0, 0 };
+		m_slots.assign(m_slots.size(), free);
+		m_size = 0;
+		for (uint32_t number = 0; number < (uint32_t)records.size(); ++number) Index(Fingerprint(records[number].Key), number);
+	}
+}
+
+#pragma endregion
@@ -0,0 +1,611 @@
+#pragma once
+
+#include "CCompiledDefinition.h"
+#include "CKeyedSpillFile.h"
+#include "CSequencing.h"
+#include "CSnapshot.h"
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#pragma region KEYED STATE MACHINE STORE
+
+namespace FSM
+{
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	// One state machine per key (connection, order, device...) running a shared CCompiledDefinition. An instance is
+	// created in the initial state by the first trigger it accepts and lives inline in an open addressing table as
+	// its key, a 32 bit state index and the time of its last transition: 16 bytes for 64 bit keys, nothing else on the
+	// heap. Lookups probe linearly from the key's hash; the table doubles beyond 80% load, and erasing shifts entries
+	// back instead of leaving tombstones.
+	// Idle instances can be evicted by EvictIdle & EvictToSize, which sweep the table like a clock hand. With a spill
+	// file attached, evicted instances are written to it and reloaded by the next trigger fired at their key, so
+	// they are never forgotten; without one they start over.
+	// With the CSequenced policy every instance also keeps the sequence number of the last trigger applied to it, and
+	// triggers fired with a sequence number which is not above it are dropped: redelivered triggers apply exactly once.
+	// Firing only allocates when a new key makes the table grow; Reserve avoids that. Not synchronized.
+	template<typename TKey, typename TTrigger, typename TState, typename THash = std::hash<TKey>, typename TSequencing = CNoSequencing>
+	class CKeyedStateMachineStore
+	{
+	public:
+		typedef CKeyedSpillFile<TKey, THash, TSequencing> spill_file;
+
+	private:
+		typedef typename TSequencing::SInstance SInstance;
+
+		struct SEntry : public SInstance
+		{
+			TKey Key;
+			uint32_t State;		// InvalidIndex while the slot is free
+			uint32_t Touched;	// Time of the last transition, with the Referenced bit
+		};
+
+		// Set by every transition, cleared as the hand of EvictToSize passes by
+		static const uint32_t Referenced = 0x80000000u;
+
+		const CCompiledDefinition<TTrigger, TState>* m_pDefinition;
+		spill_file* m_pSpill;
+		std::vector<SEntry> m_entries;
+		size_t m_mask;
+		size_t m_size;
+		size_t m_hand;
+		uint32_t m_now;
+		THash m_hash;
+
+		size_t Home(const TKey& key) const { return (size_t)___IMPL___::MixHash((uint64_t)m_hash(key)) & m_mask; }
+
+		// Slot holding the key, or the free slot ending its probe sequence
+		size_t Probe(const TKey& key) const;
+
+		void Rehash(size_t capacity);
+
+		// Stores the key at its free slot, growing the table first if needed; returns the key's slot
+		size_t Insert(size_t slot, const TKey& key, uint32_t state, uint32_t touched, const SInstance& instance);
+
+		// Fire with or without a sequence number
+		ESequencedFire Apply(const TKey& key, uint32_t trigger, bool sequenced, uint64_t sequence);
+
+		void RemoveAt(size_t hole);
+
+		// Spills & removes the instance at the slot
+		void Evict(size_t slot);
+
+		static size_t CapacityFor(size_t keys);
+
+		static void Call(ICallback* callback) { if (callback != nullptr) callback->Call(); }
+		static void Call(state_change_callback callback) { if (callback != nullptr) callback(); }
+
+	public:
+		// The definition is not owned and must outlive the store
+		explicit CKeyedStateMachineStore(const CCompiledDefinition<TTrigger, TState>* definition, size_t expectedKeys = 0);
+
+		const CCompiledDefinition<TTrigger, TState>& Definition() const { return *m_pDefinition; }
+
+		// Instances in memory
+		size_t Size() const { return m_size; }
+
+		size_t Capacity() const { return m_entries.size(); }
+		size_t Bytes() const { return m_entries.size() * sizeof(SEntry); }
+
+		// Makes room for 'keys' instances, so creating them does not grow the table
+		void Reserve(size_t keys);
+
+		// Gives back the room left by erased & evicted instances
+		void Shrink();
+
+		// In memory or spilled
+		bool Contains(const TKey& key) const;
+
+		// State of the key's instance, in memory or spilled; keys without one are in the initial state
+		uint32_t StateIndex(const TKey& key) const;
+		const TState& State(const TKey& key) const { return m_pDefinition->State(StateIndex(key)); }
+
+		// Fires at the key's instance. Rejected triggers change nothing, and create no instance.
+		// Callbacks run once the new state is stored, so they may fire at the store themselves.
+		void Fire(const TKey& key, const TTrigger& trigger);
+		bool TryFire(const TKey& key, const TTrigger& trigger);
+
+		// String triggers only; fires without constructing a TTrigger
+		void FireString(const TKey& key, std::string_view trigger);
+		bool TryFireString(const TKey& key, std::string_view trigger);
+
+		// Fires the trigger at index 'trigger' of the definition (see FindTrigger); InvalidIndex is rejected
+		bool TryFireIndex(const TKey& key, uint32_t trigger) { return Apply(key, trigger, false, 0) == SequencedFired; }
+
+		// Sequenced stores only. Fires unless 'sequence' is not above the last one applied to the key's instance;
+		// Fire returns false for such duplicates, and throws for rejected triggers like the unsequenced Fire.
+		bool Fire(const TKey& key, uint64_t sequence, const TTrigger& trigger);
+		bool TryFire(const TKey& key, uint64_t sequence, const TTrigger& trigger) { return FireIndex(key, sequence, m_pDefinition->FindTrigger(trigger)) == SequencedFired; }
+		ESequencedFire FireIndex(const TKey& key, uint64_t sequence, uint32_t trigger);
+
+		// Sequence number last applied to the key's instance, in memory or spilled; 0 without one
+		uint64_t LastSequence(const TKey& key) const;
+
+		// Forgets the key's instance, in memory or spilled, which starts over in the initial state
+		bool Erase(const TKey& key);
+
+		// Calls visit(key, state index) for every instance in memory, in no particular order
+		template<typename TVisit>
+		void ForEach(TVisit visit) const;
+
+		// Evicted instances go to 'spill' (not owned, may be null), and keys not in memory are looked up there.
+		// Instances spilled to a file before it is detached are not seen anymore.
+		void SetSpill(spill_file* spill) { m_pSpill = spill; }
+		spill_file* Spill() const { return m_pSpill; }
+
+		// Coarse clock stamped on every transition, in any unit below 2^31 (seconds suit most uses); it is advanced by
+		// the owner, typically from the task which evicts, so firing never reads a clock
+		void SetTime(uint32_t now) { m_now = now & ~Referenced; }
+		uint32_t Time() const { return m_now; }
+
+		// Time of the last transition of the key's instance, in memory or spilled
+		bool LastTransition(const TKey& key, uint32_t& time) const;
+
+		// Evicts the instances which did not transition for at least 'idle' time, looking at no more than 'budget'
+		// slots from where the last sweep stopped, so that large tables can be swept a bit at a time. Returns the
+		// number of instances evicted.
+		size_t EvictIdle(uint32_t idle, size_t budget = SIZE_MAX);
+
+		// Saves every instance, spilled ones included, with the store's time: the table as it is in memory, then the
+		// spilled records, in one sequential write. Keys must be trivially copyable.
+		void WriteSnapshot(const std::string& path) const;
+
+		// Replaces every instance by the ones of a snapshot of a store of the same definition, loading the table as it
+		// was saved; it is only rebuilt when the keys' hashes moved. Spilled instances go back to the spill file, or
+		// into memory without one. Throws std::invalid_argument for snapshots of another definition or store type; the
+		// whole snapshot is read before the store is touched, so a failed read leaves it & its spill file as they were.
+		void ReadSnapshot(const std::string& path);
+
+		// Evicts instances until no more than 'keys' are left in memory, like the CLOCK approximation of LRU: the hand
+		// spares the instances which transitioned since it last passed by once. Returns the number of instances evicted.
+		size_t EvictToSize(size_t keys);
+	};
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename TKey, typename TTrigger, typename TState, typename THash, typename TSequencing>
+	CKeyedStateMachineStore<TKey, TTrigger, TState, THash, TSequencing>::CKeyedStateMachineStore(const CCompiledDefinition<TTrigger, TState>* definition, size_t expectedKeys)
+		: m_pDefinition(definition), m_pSpill(nullptr), m_mask(0), m_size(0), m_hand(0), m_now(0)
+	{
+		Rehash(CapacityFor(expectedKeys));
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	// Smallest power of two, at least 16, which holds 'keys' below 80% load
+	template<typename TKey, typename TTrigger, typename TState, typename THash, typename TSequencing>
+	size_t CKeyedStateMachineStore<TKey, TTrigger, TState, THash, TSequencing>::CapacityFor(size_t keys)
+	{
+		size_t capacity = 16;
+		while (capacity * 4 < keys * 5) capacity *= 2;
+		return capacity;
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename TKey, typename TTrigger, typename TState, typename THash, typename TSequencing>
+	inline size_t CKeyedStateMachineStore<TKey, TTrigger, TState, THash, TSequencing>::Probe(const TKey& key) const
+	{
+		size_t slot = Home(key);
+		while (m_entries[slot].State != InvalidIndex && !(m_entries[slot].Key == key)) slot = (slot + 1) & m_mask;
+		return slot;
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename TKey, typename TTrigger, typename TState, typename THash, typename TSequencing>
+	void CKeyedStateMachineStore<TKey, TTrigger, TState, THash, TSequencing>::Rehash(size_t capacity)
+	{
+		SEntry free = SEntry();
+		free.State = InvalidIndex;
+
+		std::vector<SEntry> entries(capacity, free);
+		entries.swap(m_entries);
+		m_mask = capacity - 1;
+		m_hand = 0;
+
+		for (const SEntry& entry : entries)
+		{
+			if (entry.State != InvalidIndex) m_entries[Probe(entry.Key)] = entry;
+		}
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename TKey, typename TTrigger, typename TState, typename THash, typename TSequencing>
+	size_t CKeyedStateMachineStore<TKey, TTrigger, TState, THash, TSequencing>::Insert(size_t slot, const TKey& key, uint32_t state, uint32_t touched, const SInstance& instance)
+	{
+		if ((m_size + 1) * 5 > m_entries.size() * 4)
+		{
+			Rehash(m_entries.size() * 2);
+			slot = Probe(key);
+		}
+
+		static_cast<SInstance&>(m_entries[slot]) = instance;
+		m_entries[slot].Key = key;
+		m_entries[slot].State = state;
+		m_entries[slot].Touched = touched;
+		++m_size;
+		return slot;
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename TKey, typename TTrigger, typename TState, typename THash, typename TSequencing>
+	void CKeyedStateMachineStore<TKey, TTrigger, TState, THash, TSequencing>::Reserve(size_t keys)
+	{
+		const size_t capacity = CapacityFor(keys);
+		if (capacity > m_entries.size()) Rehash(capacity);
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename TKey, typename TTrigger, typename TState, typename THash, typename TSequencing>
+	void CKeyedStateMachineStore<TKey, TTrigger, TState, THash, TSequencing>::Shrink()
+	{
+		const size_t capacity = CapacityFor(m_size);
+		if (capacity < m_entries.size()) Rehash(capacity);
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename TKey, typename TTrigger, typename TState, typename THash, typename TSequencing>
+	inline bool CKeyedStateMachineStore<TKey, TTrigger, TState, THash, TSequencing>::Contains(const TKey& key) const
+	{
+		if (m_entries[Probe(key)].State != InvalidIndex) return true;
+		return m_pSpill != nullptr && m_pSpill->Contains(key);
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename TKey, typename TTrigger, typename TState, typename THash, typename TSequencing>
+	inline uint32_t CKeyedStateMachineStore<TKey, TTrigger, TState, THash, TSequencing>::StateIndex(const TKey& key) const
+	{
+		const SEntry& entry = m_entries[Probe(key)];
+		if (entry.State != InvalidIndex) return entry.State;
+
+		typename spill_file::SRecord record;
+		if (m_pSpill != nullptr && m_pSpill->Read(key, record)) return record.State;
+		return m_pDefinition->InitialState();
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename TKey, typename TTrigger, typename TState, typename THash, typename TSequencing>
+	bool CKeyedStateMachineStore<TKey, TTrigger, TState, THash, TSequencing>::LastTransition(const TKey& key, uint32_t& time) const
+	{
+		const SEntry& entry = m_entries[Probe(key)];
+		if (entry.State != InvalidIndex)
+		{
+			time = entry.Touched & ~Referenced;
+			return true;
+		}
+
+		typename spill_file::SRecord record;
+		if (m_pSpill == nullptr || !m_pSpill->Read(key, record)) return false;
+
+		time = record.Touched;
+		return true;
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename TKey, typename TTrigger, typename TState, typename THash, typename TSequencing>
+	inline void CKeyedStateMachineStore<TKey, TTrigger, TState, THash, TSequencing>::Fire(const TKey& key, const TTrigger& trigger)
+	{
+		if (!TryFire(key, trigger)) throw std::runtime_error("Cannot find the state!");
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename TKey, typename TTrigger, typename TState, typename THash, typename TSequencing>
+	inline bool CKeyedStateMachineStore<TKey, TTrigger, TState, THash, TSequencing>::TryFire(const TKey& key, const TTrigger& trigger)
+	{
+		return TryFireIndex(key, m_pDefinition->FindTrigger(trigger));
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename TKey, typename TTrigger, typename TState, typename THash, typename TSequencing>
+	inline void CKeyedStateMachineStore<TKey, TTrigger, TState, THash, TSequencing>::FireString(const TKey& key, std::string_view trigger)
+	{
+		if (!TryFireString(key, trigger)) throw std::runtime_error("Cannot find the state!");
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename TKey, typename TTrigger, typename TState, typename THash, typename TSequencing>
+	inline bool CKeyedStateMachineStore<TKey, TTrigger, TState, THash, TSequencing>::TryFireString(const TKey& key, std::string_view trigger)
+	{
+		return TryFireIndex(key, m_pDefinition->FindTriggerString(trigger));
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename TKey, typename TTrigger, typename TState, typename THash, typename TSequencing>
+	inline ESequencedFire CKeyedStateMachineStore<TKey, TTrigger, TState, THash, TSequencing>::Apply(const TKey& key, uint32_t trigger, bool sequenced, uint64_t sequence)
+	{
+		if (trigger == InvalidIndex) return SequencedRejected;
+
+		size_t slot = Probe(key);
+		bool known = m_entries[slot].State != InvalidIndex;
+
+		// A spilled instance comes back even if the trigger is rejected, as it is likely to be fired at again
+		typename spill_file::SRecord record;
+		if (!known && m_pSpill != nullptr && m_pSpill->Take(key, record))
+		{
+			slot = Insert(slot, key, record.State, record.Touched, record);
+			known = true;
+		}
+
+		if (sequenced && known && TSequencing::Stale(m_entries[slot], sequence)) return SequencedDuplicate;
+
+		const uint32_t current = known ? m_entries[slot].State : m_pDefinition->InitialState();
+
+		const uint32_t target = m_pDefinition->Next(current, trigger);
+		if (target == InvalidIndex) return SequencedRejected;
+
+		if (known)
+		{
+			m_entries[slot].State = target;
+			m_entries[slot].Touched = m_now | Referenced;
+		}
+		else slot = Insert(slot, key, target, m_now | Referenced, SInstance());
+		if (sequenced) TSequencing::Applied(m_entries[slot], sequence);
+
+		const SStateCallbacks& exit = m_pDefinition->Callbacks(current);
+		Call(exit.OnExit);
+		Call(exit.OnExitInstance);
+
+		const SStateCallbacks& entry = m_pDefinition->Callbacks(target);
+		Call(entry.OnEntry);
+		Call(entry.OnEntryInstance);
+		return SequencedFired;
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename TKey, typename TTrigger, typename TState, typename THash, typename TSequencing>
+	inline ESequencedFire CKeyedStateMachineStore<TKey, TTrigger, TState, THash, TSequencing>::FireIndex(const TKey& key, uint64_t sequence, uint32_t trigger)
+	{
+		static_assert(TSequencing::Enabled, "Sequence numbers need the CSequenced policy");
+		return Apply(key, trigger, true, sequence);
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename TKey, typename TTrigger, typename TState, typename THash, typename TSequencing>
+	inline bool CKeyedStateMachineStore<TKey, TTrigger, TState, THash, TSequencing>::Fire(const TKey& key, uint64_t sequence, const TTrigger& trigger)
+	{
+		const ESequencedFire fired = FireIndex(key, sequence, m_pDefinition->FindTrigger(trigger));
+		if (fired == SequencedRejected) throw std::runtime_error("Cannot find the state!");
+		return fired == SequencedFired;
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename TKey, typename TTrigger, typename TState, typename THash, typename TSequencing>
+	uint64_t CKeyedStateMachineStore<TKey, TTrigger, TState, THash, TSequencing>::LastSequence(const TKey& key) const
+	{
+		static_assert(TSequencing::Enabled, "Sequence numbers need the CSequenced policy");
+
+		const SEntry& entry = m_entries[Probe(key)];
+		if (entry.State != InvalidIndex) return TSequencing::Last(entry);
+
+		typename spill_file::SRecord record;
+		return m_pSpill != nullptr && m_pSpill->Read(key, record) ? TSequencing::Last(record) : 0;
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename TKey, typename TTrigger, typename TState, typename THash, typename TSequencing>
+	bool CKeyedStateMachineStore<TKey, TTrigger, TState, THash, TSequencing>::Erase(const TKey& key)
+	{
+		const size_t slot = Probe(key);
+		if (m_entries[slot].State == InvalidIndex) return m_pSpill != nullptr && m_pSpill->Erase(key);
+
+		RemoveAt(slot);
+		return true;
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename TKey, typename TTrigger, typename TState, typename THash, typename TSequencing>
+	void CKeyedStateMachineStore<TKey, TTrigger, TState, THash, TSequencing>::RemoveAt(size_t hole)
+	{
+		// Pull back every entry of the cluster whose home is not between the hole and its slot, so that no probe
+		// sequence runs into the hole
+		for (size_t slot = (hole + 1) & m_mask; m_entries[slot].State != InvalidIndex; slot = (slot + 1) & m_mask)
+		{
+			const size_t home = Home(m_entries[slot].Key);
+			if (((slot - home) & m_mask) < ((slot - hole) & m_mask)) continue;
+
+			m_entries[hole] = m_entries[slot];
+			hole = slot;
+		}
+
+		m_entries[hole].Key = TKey();
+		m_entries[hole].State = InvalidIndex;
+		m_entries[hole].Touched = 0;
+		--m_size;
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename TKey, typename TTrigger, typename TState, typename THash, typename TSequencing>
+	void CKeyedStateMachineStore<TKey, TTrigger, TState, THash, TSequencing>::Evict(size_t slot)
+	{
+		const SEntry& entry = m_entries[slot];
+		if (m_pSpill != nullptr)
+		{
+			typename spill_file::SRecord record;
+			static_cast<SInstance&>(record) = entry;
+			record.Key = entry.Key;
+			record.State = entry.State;
+			record.Touched = entry.Touched & ~Referenced;
+			m_pSpill->Write(record);
+		}
+
+		RemoveAt(slot);
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	// Removing an instance may pull the next one back into the hand's slot, which is then looked at again
+	template<typename TKey, typename TTrigger, typename TState, typename THash, typename TSequencing>
+	size_t CKeyedStateMachineStore<TKey, TTrigger, TState, THash, TSequencing>::EvictIdle(uint32_t idle, size_t budget)
+	{
+		size_t evicted = 0;
+		for (size_t visited = 0; visited < budget && visited < m_entries.size(); ++visited)
+		{
+			SEntry& entry = m_entries[m_hand];
+			while (entry.State != InvalidIndex && m_now - (entry.Touched & ~Referenced) >= idle)
+			{
+				Evict(m_hand);
+				++evicted;
+			}
+			m_hand = (m_hand + 1) & m_mask;
+		}
+		return evicted;
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename TKey, typename TTrigger, typename TState, typename THash, typename TSequencing>
+	size_t CKeyedStateMachineStore<TKey, TTrigger, TState, THash, TSequencing>::EvictToSize(size_t keys)
+	{
+		size_t evicted = 0;
+		while (m_size > keys)
+		{
+			SEntry& entry = m_entries[m_hand];
+			if (entry.State != InvalidIndex && (entry.Touched & Referenced) == 0)
+			{
+				Evict(m_hand);
+				++evicted;
+				continue;
+			}
+
+			entry.Touched &= ~Referenced;
+			m_hand = (m_hand + 1) & m_mask;
+		}
+		return evicted;
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename TKey, typename TTrigger, typename TState, typename THash, typename TSequencing>
+	void CKeyedStateMachineStore<TKey, TTrigger, TState, THash, TSequencing>::WriteSnapshot(const std::string& path) const
+	{
+		static_assert(std::is_trivially_copyable<TKey>::value, "Snapshot keys are written as they are in memory");
+
+		SSnapshotHeader header = ___IMPL___::MakeSnapshotHeader(SnapshotKeyed, DefinitionFingerprint(*m_pDefinition));
+		header.KeyBytes = sizeof(TKey);
+		header.EntryBytes = sizeof(SEntry);
+		header.Count = m_entries.size();
+		header.Instances = m_size;
+		header.Spilled = m_pSpill != nullptr ? m_pSpill->Size() : 0;
+		header.Time = m_now;
+		header.Flags = TSequencing::Enabled ? SnapshotSequenced : 0;
+
+		___IMPL___::CSnapshotWriter writer(path);
+		writer.Write(&header, sizeof(header));
+		writer.Write(m_entries.data(), m_entries.size() * sizeof(SEntry));
+		if (m_pSpill != nullptr)
+		{
+			m_pSpill->ForEach([&writer](const typename spill_file::SRecord& record) { writer.Write(&record, sizeof(record)); });
+		}
+		writer.Commit();
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename TKey, typename TTrigger, typename TState, typename THash, typename TSequencing>
+	void CKeyedStateMachineStore<TKey, TTrigger, TState, THash, TSequencing>::ReadSnapshot(const std::string& path)
+	{
+		static_assert(std::is_trivially_copyable<TKey>::value, "Snapshot keys are written as they are in memory");
+
+		___IMPL___::CSnapshotReader reader(path, SnapshotKeyed, DefinitionFingerprint(*m_pDefinition));
+		const SSnapshotHeader& header = reader.Header();
+		if (header.KeyBytes != sizeof(TKey) || header.EntryBytes != sizeof(SEntry) || header.Flags != (TSequencing::Enabled ? SnapshotSequenced : 0u))
+		{
+			throw std::invalid_argument("Snapshot is of another store type!");
+		}
+
+		const size_t capacity = (size_t)header.Count;
+		if (capacity < 16 || (capacity & (capacity - 1)) != 0 || header.Instances * 5 > capacity * 4) throw std::runtime_error("Snapshot " + path + " is corrupt!");
+
+		std::vector<SEntry> entries(capacity);
+		reader.Read(entries.data(), capacity * sizeof(SEntry));
+
+		size_t instances = 0;
+		for (const SEntry& entry : entries)
+		{
+			if (entry.State == InvalidIndex) continue;
+			if (entry.State >= m_pDefinition->StateCount()) throw std::runtime_error("Snapshot " + path + " is corrupt!");
+			++instances;
+		}
+		if (instances != header.Instances) throw std::runtime_error("Snapshot " + path + " is corrupt!");
+
+		// Spilled records are read & checked before anything is replaced, so a bad tail leaves the store as it was.
+		// The count is not trusted for reserving, a truncated file ends the reads first.
+		std::vector<typename spill_file::SRecord> spilled;
+		spilled.reserve((size_t)std::min<uint64_t>(header.Spilled, 65536));
+		typename spill_file::SRecord record;
+		for (uint64_t i = 0; i < header.Spilled; ++i)
+		{
+			reader.Read(&record, sizeof(record));
+			if (record.State >= m_pDefinition->StateCount()) throw std::runtime_error("Snapshot " + path + " is corrupt!");
+			spilled.push_back(record);
+		}
+
+		m_entries.swap(entries);
+		m_mask = capacity - 1;
+		m_size = instances;
+		m_hand = 0;
+		m_now = header.Time;
+
+		// Every key must be found where its probe sequence ends, or lookups & deletes of other keys go wrong later; if
+		// one is not, the hash differs from the one which laid the table out, and every key is placed again
+		for (size_t slot = 0; slot < capacity; ++slot)
+		{
+			if (m_entries[slot].State == InvalidIndex) continue;
+
+			if (Probe(m_entries[slot].Key) != slot)
+			{
+				Rehash(capacity);
+				break;
+			}
+		}
+
+		if (m_pSpill != nullptr) m_pSpill->Clear();
+		for (const typename spill_file::SRecord& saved : spilled)
+		{
+			if (m_pSpill != nullptr) m_pSpill->Write(saved);
+			else
+			{
+				const size_t slot = Probe(saved.Key);
+				if (m_entries[slot].State == InvalidIndex) Insert(slot, saved.Key, saved.State, saved.Touched, saved);
+			}
+		}
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename TKey, typename TTrigger, typename TState, typename THash, typename TSequencing>
+	template<typename TVisit>
+	void CKeyedStateMachineStore<TKey, TTrigger, TState, THash, TSequencing>::ForEach(TVisit visit) const
+	{
+		for (const SEntry& entry : m_entries)
+		{
+			if (entry.State != InvalidIndex) visit(entry.Key, entry.State);
+		}
+	}
+}
+
+#pragma endregion
@@ -0,0 +1,374 @@
+#pragma once
+
+#include "CInstrumentation.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#pragma region LATENCY HISTOGRAMS
+
+namespace FSM
+{
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	// Time source of the latency histograms: the time stamp counter where the CPU has one, else the steady clock
+	class CLatencyClock
+	{
+	private:
+		// 0 until calibrated
+		static std::atomic<double>& Ratio()
+		{
+			static std::atomic<double> nanosecondsPerTick(0);
+			return nanosecondsPerTick;
+		}
+
+	public:
+		static uint64_t Now()
+		{
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+			return __rdtsc();
+#elif defined(__x86_64__) || defined(__i386__)
+			return __rdtsc();
+#else
+			return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+		}
+
+		// Measures the tick length against the steady clock, sleeping for 10 ms, and returns it. Call it at startup:
+		// otherwise the first conversion of ticks (e.g. a percentile query on a monitoring path) sleeps for it.
+		// Calling it again measures again.
+		static double Calibrate();
+
+		// As calibrated, calibrating on first use
+		static double NanosecondsPerTick()
+		{
+			const double nanosecondsPerTick = Ratio().load(std::memory_order_relaxed);
+			return nanosecondsPerTick != 0 ? nanosecondsPerTick : Calibrate();
+		}
+
+		static double Nanoseconds(uint64_t ticks) { return ticks * NanosecondsPerTick(); }
+	};
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	// Log-linear (HDR style) histogram of tick counts. Values below 16 get a bucket each, above that every power of two
+	// is split into 16 buckets, so a bucket is never wider than 1/16th of its values: percentiles are within 6.25%.
+	class CLatencyHistogram
+	{
+	public:
+		static constexpr unsigned int SubBucketBits = 4;
+		static constexpr unsigned int SubBuckets = 1u << SubBucketBits;
+		static constexpr unsigned int BucketCount = SubBuckets + (64 - SubBucketBits) * SubBuckets;
+
+	private:
+		std::vector<uint64_t> m_counts;		// Empty until something is recorded or merged
+		uint64_t m_total;
+
+	public:
+		CLatencyHistogram() : m_total(0) { }
+
+		static unsigned int Bucket(uint64_t ticks);
+
+		// Largest value which falls into the bucket
+		static uint64_t BucketLimit(unsigned int bucket);
+
+		void Record(uint64_t ticks, uint64_t count = 1);
+		void Merge(const CLatencyHistogram& other);
+
+		uint64_t Count() const { return m_total; }
+		uint64_t Count(unsigned int bucket) const { return bucket < m_counts.size() ? m_counts[bucket] : 0; }
+
+		// Smallest bucket limit at or below which 'percentile' (0 to 100) percent of the values fall; 0 when empty
+		uint64_t Percentile(double percentile) const;
+		double PercentileNanoseconds(double percentile) const { return CLatencyClock::Nanoseconds(Percentile(percentile)); }
+
+		uint64_t Max() const { return Percentile(100); }
+	};
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	// Histograms of a CLatencyHistograms at one point in time; Entry & Exit are per state
+	struct SLatencySnapshot
+	{
+		CLatencyHistogram Fire;
+		std::vector<CLatencyHistogram> Entry;
+		std::vector<CLatencyHistogram> Exit;
+
+		// Adds the histograms of another snapshot of the same definition, e.g. of another thread
+		void Merge(const SLatencySnapshot& other);
+	};
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	// Fire latencies, and entry & exit callback latencies of every state which has such callbacks (about 8 KB each).
+	// Like CInstrumentationCounters, recording is not synchronized: one CLatencyHistograms per machine or per firing
+	// thread, snapshots from any thread.
+	class CLatencyHistograms
+	{
+	private:
+		typedef ___IMPL___::CCounterBlock live_histogram;
+
+		live_histogram m_fire;
+		std::vector<std::unique_ptr<live_histogram>> m_entry;
+		std::vector<std::unique_ptr<live_histogram>> m_exit;
+		uint64_t m_fingerprint;		// Of the definition the histograms are laid out for
+
+		static void CopyTo(const live_histogram& live, CLatencyHistogram& histogram);
+
+	public:
+		template<typename TTrigger, typename TState>
+		explicit CLatencyHistograms(const CCompiledDefinition<TTrigger, TState>& definition);
+
+		// Whether the histograms are laid out for the definition, i.e. it or a copy of it
+		template<typename TTrigger, typename TState>
+		bool Matches(const CCompiledDefinition<TTrigger, TState>& definition) const
+		{
+			return definition.Fingerprint() == m_fingerprint && definition.StateCount() == m_entry.size();
+		}
+
+		SLatencySnapshot Snapshot() const;
+
+		// Callbacks bound after the histograms were made have none, and are not recorded
+		void RecordFire(uint64_t ticks) { m_fire.Add(CLatencyHistogram::Bucket(ticks), 1); }
+		void RecordEntry(uint32_t state, uint64_t ticks) { if (m_entry[state] != nullptr) m_entry[state]->Add(CLatencyHistogram::Bucket(ticks), 1); }
+		void RecordExit(uint32_t state, uint64_t ticks) { if (m_exit[state] != nullptr) m_exit[state]->Add(CLatencyHistogram::Bucket(ticks), 1); }
+	};
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	// Instrumentation policy recording into CLatencyHistograms, which are not owned and must outlive the machine.
+	// Rejected fires are timed as well. Reading the time stamp counter twice is most of what timing a fire costs, so
+	// one fire in 'sampleEvery' can be timed, callbacks included, while the others only count down: percentiles stay
+	// those of every fire, the histograms hold 1 / sampleEvery of the counts.
+	class CLatencyInstrumentation
+	{
+	private:
+		CLatencyHistograms* m_pHistograms;
+		uint32_t m_sampleEvery;
+		uint32_t m_countdown;		// Back at m_sampleEvery while a sampled fire runs
+
+		bool Sampled() const { return m_countdown == m_sampleEvery; }
+
+	public:
+		static constexpr bool Enabled = true;
+
+		explicit CLatencyInstrumentation(CLatencyHistograms* histograms, uint32_t sampleEvery = 1)
+			: m_pHistograms(histograms), m_sampleEvery(sampleEvery), m_countdown(sampleEvery)
+		{
+			if (sampleEvery == 0) throw std::invalid_argument("Sample at least one fire in one!");
+		}
+
+		template<typename TTrigger, typename TState>
+		void Attach(const CCompiledDefinition<TTrigger, TState>& definition)
+		{
+			if (!m_pHistograms->Matches(definition)) throw std::invalid_argument("Latency histograms are of another definition!");
+		}
+
+		template<typename TFire>
+		bool Fire(TFire fire)
+		{
+			if (--m_countdown != 0) return fire();
+			m_countdown = m_sampleEvery;
+
+			const uint64_t start = CLatencyClock::Now();
+			const bool fired = fire();
+			m_pHistograms->RecordFire(CLatencyClock::Now() - start);
+			return fired;
+		}
+
+		void Transitioned(uint32_t, uint32_t, uint32_t) { }
+		void Rejected(uint32_t, uint32_t) { }
+
+		template<typename TCall>
+		void Exit(uint32_t state, const SStateCallbacks& callbacks, TCall call)
+		{
+			if (callbacks.OnExit == nullptr && callbacks.OnExitInstance == nullptr) return;
+			if (!Sampled())
+			{
+				call();
+				return;
+			}
+
+			const uint64_t start = CLatencyClock::Now();
+			call();
+			m_pHistograms->RecordExit(state, CLatencyClock::Now() - start);
+		}
+
+		template<typename TCall>
+		void Entry(uint32_t state, const SStateCallbacks& callbacks, TCall call)
+		{
+			if (callbacks.OnEntry == nullptr && callbacks.OnEntryInstance == nullptr) return;
+			if (!Sampled())
+			{
+				call();
+				return;
+			}
+
+			const uint64_t start = CLatencyClock::Now();
+			call();
+			m_pHistograms->RecordEntry(state, CLatencyClock::Now() - start);
+		}
+	};
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	inline double CLatencyClock::Calibrate()
+	{
+		const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		const uint64_t ticks = Now();
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		const uint64_t elapsedTicks = Now() - ticks;
+		const std::chrono::steady_clock::duration elapsed = std::chrono::steady_clock::now() - start;
+
+		const double nanoseconds = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+		const double nanosecondsPerTick = elapsedTicks != 0 ? nanoseconds / elapsedTicks : 1.0;
+		Ratio().store(nanosecondsPerTick, std::memory_order_relaxed);
+		return nanosecondsPerTick;
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	inline unsigned int CLatencyHistogram::Bucket(uint64_t ticks)
+	{
+		if (ticks < SubBuckets) return (unsigned int)ticks;
+
+#if defined(_MSC_VER) && defined(_M_X64)
+		unsigned long highest;
+		_BitScanReverse64(&highest, ticks);
+#elif defined(_MSC_VER)
+		unsigned long highest = 0;
+		for (uint64_t value = ticks; value > 1; value >>= 1) ++highest;
+#else
+		const unsigned int highest = 63 - (unsigned int)__builtin_clzll(ticks);
+#endif
+
+		// The highest bit picks the power of two, the next SubBucketBits bits the bucket within it
+		const unsigned int shift = (unsigned int)highest - SubBucketBits;
+		return SubBuckets + shift * SubBuckets + (unsigned int)((ticks >> shift) - SubBuckets);
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	inline uint64_t CLatencyHistogram::BucketLimit(unsigned int bucket)
+	{
+		if (bucket < SubBuckets) return bucket;
+
+		const unsigned int shift = (bucket - SubBuckets) / SubBuckets;
+		const uint64_t lowest = (uint64_t)(SubBuckets + (bucket - SubBuckets) % SubBuckets) << shift;
+		return lowest + ((uint64_t)1 << shift) - 1;
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	inline void CLatencyHistogram::Record(uint64_t ticks, uint64_t count)
+	{
+		if (m_counts.empty()) m_counts.assign(BucketCount, 0);
+
+		m_counts[Bucket(ticks)] += count;
+		m_total += count;
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	inline void CLatencyHistogram::Merge(const CLatencyHistogram& other)
+	{
+		if (other.m_total == 0) return;
+		if (m_counts.empty()) m_counts.assign(BucketCount, 0);
+
+		for (unsigned int i = 0; i < BucketCount; ++i) m_counts[i] += other.m_counts[i];
+		m_total += other.m_total;
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	inline uint64_t CLatencyHistogram::Percentile(double percentile) const
+	{
+		if (m_total == 0) return 0;
+
+		const double clamped = percentile < 0 ? 0 : percentile > 100 ? 100 : percentile;
+		const uint64_t rank = std::max<uint64_t>(1, (uint64_t)std::ceil(clamped / 100 * m_total));
+
+		uint64_t seen = 0;
+		for (unsigned int i = 0; i < BucketCount; ++i)
+		{
+			seen += m_counts[i];
+			if (seen >= rank) return BucketLimit(i);
+		}
+		return BucketLimit(BucketCount - 1);
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	inline void SLatencySnapshot::Merge(const SLatencySnapshot& other)
+	{
+		Fire.Merge(other.Fire);
+
+		Entry.resize(std::max(Entry.size(), other.Entry.size()));
+		for (size_t i = 0; i < other.Entry.size(); ++i) Entry[i].Merge(other.Entry[i]);
+
+		Exit.resize(std::max(Exit.size(), other.Exit.size()));
+		for (size_t i = 0; i < other.Exit.size(); ++i) Exit[i].Merge(other.Exit[i]);
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename TTrigger, typename TState>
+	CLatencyHistograms::CLatencyHistograms(const CCompiledDefinition<TTrigger, TState>& definition)
+		: m_fire(CLatencyHistogram::BucketCount), m_entry(definition.StateCount()), m_exit(definition.StateCount()), m_fingerprint(definition.Fingerprint())
+	{
+		for (uint32_t i = 0; i < definition.StateCount(); ++i)
+		{
+			const SStateCallbacks& callbacks = definition.Callbacks(i);
+			if (callbacks.OnEntry != nullptr || callbacks.OnEntryInstance != nullptr)
+			{
+				m_entry[i].reset(new live_histogram(CLatencyHistogram::BucketCount));
+			}
+			if (callbacks.OnExit != nullptr || callbacks.OnExitInstance != nullptr)
+			{
+				m_exit[i].reset(new live_histogram(CLatencyHistogram::BucketCount));
+			}
+		}
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	inline void CLatencyHistograms::CopyTo(const live_histogram& live, CLatencyHistogram& histogram)
+	{
+		for (unsigned int i = 0; i < CLatencyHistogram::BucketCount; ++i)
+		{
+			const uint64_t count = live.Get(i);
+			if (count != 0) histogram.Record(CLatencyHistogram::BucketLimit(i), count);
+		}
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	inline SLatencySnapshot CLatencyHistograms::Snapshot() const
+	{
+		SLatencySnapshot snapshot;
+		CopyTo(m_fire, snapshot.Fire);
+
+		snapshot.Entry.resize(m_entry.size());
+		snapshot.Exit.resize(m_exit.size());
+		for (size_t i = 0; i < m_entry.size(); ++i)
+		{
+			if (m_entry[i] != nullptr) CopyTo(*m_entry[i], snapshot.Entry[i]);
+			if (m_exit[i] != nullptr) CopyTo(*m_exit[i], snapshot.Exit[i]);
+		}
+		return snapshot;
+	}
+}
+
+#pragma endregion
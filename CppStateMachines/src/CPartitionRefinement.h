@@ -0,0 +1,250 @@
+#pragma once
+
+#include "CTransitionTables.h"
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#pragma region PARTITION REFINEMENT
+
+namespace FSM
+{
+	namespace ___IMPL___
+	{
+		////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+		// Partition of the elements [0, n) into sets, supporting "mark some elements, then split every touched
+		// set into its marked & unmarked part" in time proportional to the marked elements.
+		// Elements of a set occupy Elements[First[s], Past[s]), marked ones at the front.
+		class CRefinablePartition
+		{
+		public:
+			uint32_t SetCount;
+			std::vector<uint32_t> Elements;
+			std::vector<uint32_t> Location;
+			std::vector<uint32_t> SetOf;
+			std::vector<uint32_t> First;
+			std::vector<uint32_t> Past;
+
+		private:
+			std::vector<uint32_t> m_marked;
+			std::vector<uint32_t> m_touched;
+
+		public:
+			// Elements with equal keys (in [0, keyCount)) start out in the same set
+			void Init(const std::vector<uint32_t>& keys, uint32_t keyCount);
+
+			// Every element may be marked at most once between splits
+			void Mark(uint32_t element);
+
+			// The smaller part of each touched set becomes a new set
+			void Split();
+		};
+
+		////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+		inline void CRefinablePartition::Init(const std::vector<uint32_t>& keys, uint32_t keyCount)
+		{
+			const uint32_t count = (uint32_t)keys.size();
+
+			std::vector<uint32_t> start(keyCount + 1, 0);
+			for (uint32_t key : keys) ++start[key + 1];
+			for (uint32_t i = 0; i < keyCount; ++i) start[i + 1] += start[i];
+
+			// Number the non-empty keys densely
+			std::vector<uint32_t> setOfKey(keyCount, 0);
+			SetCount = 0;
+			First.assign(count, 0);
+			Past.assign(count, 0);
+			for (uint32_t key = 0; key < keyCount; ++key)
+			{
+				if (start[key] == start[key + 1]) continue;
+
+				setOfKey[key] = SetCount;
+				First[SetCount] = start[key];
+				Past[SetCount] = start[key + 1];
+				++SetCount;
+			}
+
+			Elements.assign(count, 0);
+			Location.assign(count, 0);
+			SetOf.assign(count, 0);
+			for (uint32_t element = 0; element < count; ++element)
+			{
+				const uint32_t position = start[keys[element]]++;
+				Elements[position] = element;
+				Location[element] = position;
+				SetOf[element] = setOfKey[keys[element]];
+			}
+
+			m_marked.assign(count, 0);
+			m_touched.clear();
+		}
+
+		////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+		inline void CRefinablePartition::Mark(uint32_t element)
+		{
+			const uint32_t set = SetOf[element];
+			const uint32_t from = Location[element];
+			const uint32_t to = First[set] + m_marked[set];
+
+			Elements[from] = Elements[to];
+			Location[Elements[from]] = from;
+			Elements[to] = element;
+			Location[element] = to;
+
+			if (m_marked[set]++ == 0) m_touched.push_back(set);
+		}
+
+		////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+		inline void CRefinablePartition::Split()
+		{
+			while (!m_touched.empty())
+			{
+				const uint32_t set = m_touched.back();
+				m_touched.pop_back();
+
+				const uint32_t middle = First[set] + m_marked[set];
+				if (middle == Past[set])
+				{
+					m_marked[set] = 0;
+					continue;
+				}
+
+				if (m_marked[set] <= Past[set] - middle)
+				{
+					First[SetCount] = First[set];
+					Past[SetCount] = First[set] = middle;
+				}
+				else
+				{
+					Past[SetCount] = Past[set];
+					First[SetCount] = Past[set] = middle;
+				}
+
+				for (uint32_t i = First[SetCount]; i < Past[SetCount]; ++i) SetOf[Elements[i]] = SetCount;
+				m_marked[set] = m_marked[SetCount++] = 0;
+			}
+		}
+
+		////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+		// Disjoint sets with union by size & path halving
+		class CUnionFind
+		{
+		private:
+			std::vector<uint32_t> m_parent;
+			std::vector<uint32_t> m_size;
+
+		public:
+			explicit CUnionFind(uint32_t count) : m_parent(count), m_size(count, 1)
+			{
+				for (uint32_t i = 0; i < count; ++i) m_parent[i] = i;
+			}
+
+			uint32_t Find(uint32_t element)
+			{
+				while (m_parent[element] != element)
+				{
+					m_parent[element] = m_parent[m_parent[element]];
+					element = m_parent[element];
+				}
+				return element;
+			}
+
+			// False when both were already in the same set
+			bool Union(uint32_t a, uint32_t b)
+			{
+				a = Find(a);
+				b = Find(b);
+				if (a == b) return false;
+
+				if (m_size[a] < m_size[b]) std::swap(a, b);
+				m_parent[b] = a;
+				m_size[a] += m_size[b];
+				return true;
+			}
+		};
+
+		////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+		// Offsets of every state's transitions in a list ordered by state
+		inline std::vector<uint32_t> RowStarts(uint32_t stateCount, const std::vector<STransition>& transitions)
+		{
+			std::vector<uint32_t> starts(stateCount + 1, 0);
+			for (const STransition& transition : transitions) ++starts[transition.From + 1];
+			for (uint32_t i = 0; i < stateCount; ++i) starts[i + 1] += starts[i];
+			return starts;
+		}
+
+		////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+		// Coarsest partition of the states of a (partial) deterministic machine that respects the initial classes
+		// and the transitions: states end up together only if they are in the same class and, for every trigger,
+		// either both lack a transition or both move to states which are together.
+		// Valmari & Lehtinen's refinement of Hopcroft's algorithm, O(m log n) for m transitions.
+		// Returns the block of every state; blocks are numbered by their lowest state.
+		inline std::vector<uint32_t> RefineStates(
+			const std::vector<uint32_t>& classes, uint32_t classCount,
+			uint32_t triggerCount, const std::vector<STransition>& transitions)
+		{
+			const uint32_t stateCount = (uint32_t)classes.size();
+			const uint32_t transitionCount = (uint32_t)transitions.size();
+
+			CRefinablePartition blocks;
+			blocks.Init(classes, classCount);
+
+			// Cords group transitions by trigger, and later also by target block
+			std::vector<uint32_t> labels(transitionCount);
+			for (uint32_t i = 0; i < transitionCount; ++i) labels[i] = transitions[i].Trigger;
+
+			CRefinablePartition cords;
+			cords.Init(labels, triggerCount);
+
+			// Incoming transitions per state
+			std::vector<uint32_t> inStart(stateCount + 1, 0), incoming(transitionCount);
+			for (const STransition& transition : transitions) ++inStart[transition.To + 1];
+			for (uint32_t i = 0; i < stateCount; ++i) inStart[i + 1] += inStart[i];
+			{
+				std::vector<uint32_t> position(inStart.begin(), inStart.end() - 1);
+				for (uint32_t i = 0; i < transitionCount; ++i) incoming[position[transitions[i].To]++] = i;
+			}
+
+			uint32_t block = 0, cord = 0;
+			for (;;)
+			{
+				for (; block < blocks.SetCount; ++block)
+				{
+					for (uint32_t i = blocks.First[block]; i < blocks.Past[block]; ++i)
+					{
+						const uint32_t state = blocks.Elements[i];
+						for (uint32_t j = inStart[state]; j < inStart[state + 1]; ++j) cords.Mark(incoming[j]);
+					}
+					cords.Split();
+				}
+
+				if (cord == cords.SetCount) break;
+
+				for (uint32_t i = cords.First[cord]; i < cords.Past[cord]; ++i) blocks.Mark(transitions[cords.Elements[i]].From);
+				blocks.Split();
+				++cord;
+			}
+
+			// Renumber blocks in order of their lowest state, so results do not depend on split order
+			std::vector<uint32_t> renumbered(blocks.SetCount, InvalidIndex), result(stateCount);
+			uint32_t next = 0;
+			for (uint32_t state = 0; state < stateCount; ++state)
+			{
+				uint32_t& id = renumbered[blocks.SetOf[state]];
+				if (id == InvalidIndex) id = next++;
+				result[state] = id;
+			}
+
+			return result;
+		}
+	}
+}
+
+#pragma endregion
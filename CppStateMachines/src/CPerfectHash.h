@@ -0,0 +1,148 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+
+#pragma region PERFECT HASH
+
+namespace FSM
+{
+	namespace ___IMPL___
+	{
+		////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+		// Minimal perfect hash (hash & displace) over a fixed set of string keys.
+		// Every key maps to a unique slot in [0, Size()), so a lookup is one pass over the key bytes
+		// followed by a single compare against the key stored at that slot. Unknown keys land on
+		// an arbitrary slot, hence the caller must always verify.
+		class CMinimalPerfectHash
+		{
+		private:
+			std::vector<uint32_t> m_seeds;
+			uint32_t m_size;
+
+		public:
+			CMinimalPerfectHash();
+			explicit CMinimalPerfectHash(const std::vector<std::string_view>& keys);
+
+			uint32_t Size() const { return m_size; }
+
+			uint32_t Slot(std::string_view key) const;
+
+			static uint64_t Hash(std::string_view key);
+
+		private:
+			static uint32_t Bucket(uint64_t hash, uint32_t bucketCount) { return (uint32_t)(((hash >> 32) * bucketCount) >> 32); }
+			static uint32_t Displace(uint64_t hash, uint32_t seed, uint32_t size);
+		};
+
+		////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+		inline CMinimalPerfectHash::CMinimalPerfectHash() : m_size(0)
+		{
+		}
+
+		////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+		inline CMinimalPerfectHash::CMinimalPerfectHash(const std::vector<std::string_view>& keys)
+			: m_size((uint32_t)keys.size())
+		{
+			if (m_size == 0) return;
+
+			std::vector<uint64_t> hashes(keys.size());
+			for (size_t i = 0; i < keys.size(); ++i) hashes[i] = Hash(keys[i]);
+
+			// Equal hashes can never be displaced apart, reject them up front instead of searching forever
+			std::vector<uint64_t> sorted(hashes);
+			std::sort(sorted.begin(), sorted.end());
+			if (std::adjacent_find(sorted.begin(), sorted.end()) != sorted.end())
+				throw std::invalid_argument("Duplicate keys in perfect hash!");
+
+			// Two keys per bucket on average keeps the seed search short
+			const uint32_t bucketCount = (m_size + 1) / 2;
+			std::vector<std::vector<uint32_t>> buckets(bucketCount);
+			for (uint32_t i = 0; i < m_size; ++i) buckets[Bucket(hashes[i], bucketCount)].push_back(i);
+
+			// Place the largest buckets first, while most slots are still free
+			std::vector<uint32_t> order(bucketCount);
+			for (uint32_t i = 0; i < bucketCount; ++i) order[i] = i;
+			std::stable_sort(order.begin(), order.end(),
+				[&buckets](uint32_t a, uint32_t b) { return buckets[a].size() > buckets[b].size(); });
+
+			m_seeds.assign(bucketCount, 0);
+			std::vector<bool> taken(m_size, false);
+			std::vector<uint32_t> slots;
+
+			for (uint32_t b : order)
+			{
+				const std::vector<uint32_t>& bucket = buckets[b];
+				if (bucket.empty()) break;
+
+				for (uint32_t seed = 0;; ++seed)
+				{
+					if (seed == 0xFFFFFFFF) throw std::runtime_error("Cannot build perfect hash!");
+
+					slots.clear();
+					bool placed = true;
+					for (uint32_t key : bucket)
+					{
+						const uint32_t slot = Displace(hashes[key], seed, m_size);
+						if (taken[slot] || std::find(slots.begin(), slots.end(), slot) != slots.end())
+						{
+							placed = false;
+							break;
+						}
+						slots.push_back(slot);
+					}
+
+					if (!placed) continue;
+
+					for (uint32_t slot : slots) taken[slot] = true;
+					m_seeds[b] = seed;
+					break;
+				}
+			}
+		}
+
+		////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+		inline uint32_t CMinimalPerfectHash::Slot(std::string_view key) const
+		{
+			const uint64_t hash = Hash(key);
+			return Displace(hash, m_seeds[Bucket(hash, (uint32_t)m_seeds.size())], m_size);
+		}
+
+		////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+		inline uint64_t CMinimalPerfectHash::Hash(std::string_view key)
+		{
+			// FNV-1a, finalized so that the high bits used for bucketing depend on every byte
+			uint64_t hash = 0xcbf29ce484222325ull;
+			for (char c : key)
+			{
+				hash ^= (unsigned char)c;
+				hash *= 0x100000001b3ull;
+			}
+			hash ^= hash >> 33;
+			hash *= 0xc4ceb9fe1a85ec53ull;
+			hash ^= hash >> 33;
+			return hash;
+		}
+
+		////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+		inline uint32_t CMinimalPerfectHash::Displace(uint64_t hash, uint32_t seed, uint32_t size)
+		{
+			uint64_t mixed = hash ^ (seed * 0x9e3779b97f4a7c15ull);
+			mixed ^= mixed >> 33;
+			mixed *= 0xff51afd7ed558ccdull;
+			mixed ^= mixed >> 33;
+			return (uint32_t)(((mixed & 0xFFFFFFFF) * size) >> 32);
+		}
+	}
+}
+
+#pragma endregion
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+
+#pragma region SEQUENCING
+
+namespace FSM
+{
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	// What became of a trigger fired with a sequence number
+	enum ESequencedFire
+	{
+		SequencedFired,			// Accepted, the instance transitioned
+		SequencedRejected,		// Unknown or not handled in the instance's state; the sequence number is not taken
+		SequencedDuplicate		// Not above the last sequence number applied to the instance, dropped unseen
+	};
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	// Sequencing policies of CKeyedStateMachineStore. Every instance derives from the policy's SInstance, so a disabled
+	// policy leaves no storage behind. Stale tells whether a sequence number was applied already, Applied records it.
+
+	class CNoSequencing
+	{
+	public:
+		static constexpr bool Enabled = false;
+
+		struct SInstance { };
+
+		static bool Stale(const SInstance&, uint64_t) { return false; }
+		static void Applied(SInstance&, uint64_t) { }
+		static uint64_t Last(const SInstance&) { return 0; }
+	};
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	// Keeps the sequence number of the last trigger applied to every instance, 8 more bytes each. Numbers are per key
+	// and should start at 1: instances created by unsequenced fires start at 0, which counts as applied.
+	class CSequenced
+	{
+	public:
+		static constexpr bool Enabled = true;
+
+		struct SInstance
+		{
+			uint64_t Sequence;
+		};
+
+		// One compare drops duplicates as well as replays of older triggers
+		static bool Stale(const SInstance& instance, uint64_t sequence) { return sequence <= instance.Sequence; }
+		static void Applied(SInstance& instance, uint64_t sequence) { instance.Sequence = sequence; }
+		static uint64_t Last(const SInstance& instance) { return instance.Sequence; }
+	};
+}
+
+#pragma endregion
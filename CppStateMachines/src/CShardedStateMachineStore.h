@@ -0,0 +1,404 @@
+#pragma once
+
+#include "CKeyedStateMachineStore.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#pragma region SHARDED STATE MACHINE STORE
+
+namespace FSM
+{
+	namespace ___IMPL___
+	{
+		////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+		// Fixed size queue for any number of producers and one consumer, after Dmitry Vyukov's bounded queue: producers
+		// claim a cell with one compare & swap on the tail, every cell's sequence number tells whether it is free or
+		// filled. Items of one producer come out in the order they went in. Never allocates after construction.
+		template<typename TItem>
+		class CBoundedMpscQueue
+		{
+		private:
+			struct SCell
+			{
+				std::atomic<uint64_t> Sequence;
+				TItem Item;
+			};
+
+			std::vector<SCell> m_cells;
+			uint64_t m_mask;
+
+			alignas(64) std::atomic<uint64_t> m_tail;
+			alignas(64) std::atomic<uint64_t> m_head;
+
+		public:
+			// Capacity must be a power of two
+			explicit CBoundedMpscQueue(size_t capacity);
+
+			size_t Capacity() const { return m_cells.size(); }
+
+			// Items pushed & popped so far
+			uint64_t Pushed() const { return m_tail.load(std::memory_order_acquire); }
+			uint64_t Popped() const { return m_head.load(std::memory_order_acquire); }
+
+			// Any thread; false when the queue is full
+			bool TryPush(const TItem& item);
+
+			// Consumer only; false when the queue is empty
+			bool TryPop(TItem& item);
+		};
+
+		////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+		template<typename TItem>
+		CBoundedMpscQueue<TItem>::CBoundedMpscQueue(size_t capacity)
+			: m_cells(capacity), m_mask(capacity - 1), m_tail(0), m_head(0)
+		{
+			if (capacity == 0 || (capacity & (capacity - 1)) != 0) throw std::invalid_argument("Capacity must be a power of two!");
+
+			for (size_t i = 0; i < capacity; ++i) m_cells[i].Sequence.store(i, std::memory_order_relaxed);
+		}
+
+		////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+		template<typename TItem>
+		bool CBoundedMpscQueue<TItem>::TryPush(const TItem& item)
+		{
+			uint64_t position = m_tail.load(std::memory_order_relaxed);
+			for (;;)
+			{
+				SCell& cell = m_cells[position & m_mask];
+				const int64_t lag = (int64_t)(cell.Sequence.load(std::memory_order_acquire) - position);
+				if (lag == 0)
+				{
+					if (m_tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+					{
+						cell.Item = item;
+						cell.Sequence.store(position + 1, std::memory_order_release);
+						return true;
+					}
+				}
+				else if (lag < 0)
+				{
+					// Still holds the item from one lap ago
+					return false;
+				}
+				else
+				{
+					position = m_tail.load(std::memory_order_relaxed);
+				}
+			}
+		}
+
+		////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+		template<typename TItem>
+		bool CBoundedMpscQueue<TItem>::TryPop(TItem& item)
+		{
+			const uint64_t position = m_head.load(std::memory_order_relaxed);
+			SCell& cell = m_cells[position & m_mask];
+			if (cell.Sequence.load(std::memory_order_acquire) != position + 1) return false;
+
+			item = cell.Item;
+			cell.Sequence.store(position + m_mask + 1, std::memory_order_release);
+			m_head.store(position + 1, std::memory_order_release);
+			return true;
+		}
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	// What the workers of a sharded store have done so far
+	struct SShardStatistics
+	{
+		uint64_t Processed = 0;		// Posted triggers fired, accepted or not
+		uint64_t Rejected = 0;		// Unknown or not handled in the key's state
+		uint64_t Duplicates = 0;	// Dropped for their sequence number
+		uint64_t Keys = 0;			// Instances, as of the last batch
+	};
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	// Keyed state machines split by key hash over shards, each a CKeyedStateMachineStore owned by one worker thread.
+	// Post hands a trigger to the key's shard through a lock-free queue; the worker drains its queue in batches and is
+	// the only thread touching its store, so nothing on the path is locked and the triggers of one producer reach a key
+	// in the order they were posted. Callbacks run on the workers. An idle worker parks on a condition variable after
+	// a short spin; producers only take its lock to wake it.
+	// With the CSequenced policy triggers are posted with their sequence numbers, which the shards check per key.
+	template<typename TKey, typename TTrigger, typename TState, typename THash = std::hash<TKey>, typename TSequencing = CNoSequencing>
+	class CShardedStateMachineStore
+	{
+	public:
+		typedef CKeyedStateMachineStore<TKey, TTrigger, TState, THash, TSequencing> shard_store;
+
+	private:
+		// The sequence number travels in the policy's instance data
+		struct SPost : public TSequencing::SInstance
+		{
+			TKey Key;
+			uint32_t Trigger;
+		};
+
+		struct SShard
+		{
+			___IMPL___::CBoundedMpscQueue<SPost> Queue;
+			shard_store Store;
+
+			// Written by the worker once per batch, off the line producers read on every Post
+			alignas(64) std::atomic<uint64_t> Processed;
+			std::atomic<uint64_t> Rejected;
+			std::atomic<uint64_t> Duplicates;
+			std::atomic<uint64_t> Keys;
+
+			alignas(64) std::atomic<bool> Parked;
+			std::mutex Mutex;
+			std::condition_variable Wake;
+			std::thread Worker;
+
+			SShard(const CCompiledDefinition<TTrigger, TState>* definition, size_t queueCapacity, size_t expectedKeys)
+				: Queue(queueCapacity), Store(definition, expectedKeys), Processed(0), Rejected(0), Duplicates(0), Keys(0), Parked(false) { }
+		};
+
+		const CCompiledDefinition<TTrigger, TState>* m_pDefinition;
+		std::vector<std::unique_ptr<SShard>> m_shards;
+		THash m_hash;
+		std::atomic<bool> m_stopping;
+
+		void Work(SShard& shard);
+		bool PostIndex(const TKey& key, uint64_t sequence, uint32_t trigger, bool wait);
+
+	public:
+		// Triggers handled per batch before the worker publishes its statistics
+		static constexpr size_t BatchSize = 256;
+
+		// The definition is not owned and must outlive the store. Queue capacity is per shard and must be a power of two;
+		// expected keys are spread over the shards.
+		CShardedStateMachineStore(const CCompiledDefinition<TTrigger, TState>* definition, unsigned int shards, size_t queueCapacity = 65536, size_t expectedKeys = 0);
+
+		// Processes what was posted, then stops the workers
+		~CShardedStateMachineStore();
+
+		CShardedStateMachineStore(const CShardedStateMachineStore&) = delete;
+		CShardedStateMachineStore& operator=(const CShardedStateMachineStore&) = delete;
+
+		unsigned int ShardCount() const { return (unsigned int)m_shards.size(); }
+		unsigned int ShardOf(const TKey& key) const;
+
+		// Any thread. Post waits while the shard's queue is full, TryPost returns false instead.
+		// Unknown triggers are posted all the same, and counted as rejected.
+		void Post(const TKey& key, const TTrigger& trigger) { PostIndex(key, 0, m_pDefinition->FindTrigger(trigger), true); }
+		bool TryPost(const TKey& key, const TTrigger& trigger) { return PostIndex(key, 0, m_pDefinition->FindTrigger(trigger), false); }
+
+		// Sequenced stores only; see CKeyedStateMachineStore::Fire
+		void Post(const TKey& key, uint64_t sequence, const TTrigger& trigger);
+		bool TryPost(const TKey& key, uint64_t sequence, const TTrigger& trigger);
+
+		// Waits until everything posted before the call has been processed
+		void Flush() const;
+
+		SShardStatistics Statistics(unsigned int shard) const;
+		SShardStatistics Statistics() const;
+
+		// Only while nothing is posted and after a Flush: the workers are idle then
+		const shard_store& Shard(unsigned int shard) const { return m_shards[shard]->Store; }
+		const TState& State(const TKey& key) const { return Shard(ShardOf(key)).State(key); }
+	};
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename TKey, typename TTrigger, typename TState, typename THash, typename TSequencing>
+	CShardedStateMachineStore<TKey, TTrigger, TState, THash, TSequencing>::CShardedStateMachineStore(
+		const CCompiledDefinition<TTrigger, TState>* definition, unsigned int shards, size_t queueCapacity, size_t expectedKeys)
+		: m_pDefinition(definition), m_stopping(false)
+	{
+		if (shards == 0) throw std::invalid_argument("At least one shard is needed!");
+
+		for (unsigned int i = 0; i < shards; ++i)
+		{
+			m_shards.emplace_back(new SShard(definition, queueCapacity, expectedKeys / shards));
+		}
+		for (std::unique_ptr<SShard>& shard : m_shards)
+		{
+			SShard* pShard = shard.get();
+			shard->Worker = std::thread([this, pShard]() { Work(*pShard); });
+		}
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename TKey, typename TTrigger, typename TState, typename THash, typename TSequencing>
+	CShardedStateMachineStore<TKey, TTrigger, TState, THash, TSequencing>::~CShardedStateMachineStore()
+	{
+		m_stopping.store(true, std::memory_order_seq_cst);
+		for (std::unique_ptr<SShard>& shard : m_shards)
+		{
+			{
+				std::lock_guard<std::mutex> lock(shard->Mutex);
+			}
+			shard->Wake.notify_one();
+			shard->Worker.join();
+		}
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	// High hash bits pick the shard, the low ones the slot within it
+	template<typename TKey, typename TTrigger, typename TState, typename THash, typename TSequencing>
+	inline unsigned int CShardedStateMachineStore<TKey, TTrigger, TState, THash, TSequencing>::ShardOf(const TKey& key) const
+	{
+		return (unsigned int)((___IMPL___::MixHash((uint64_t)m_hash(key)) >> 32) % m_shards.size());
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename TKey, typename TTrigger, typename TState, typename THash, typename TSequencing>
+	bool CShardedStateMachineStore<TKey, TTrigger, TState, THash, TSequencing>::PostIndex(const TKey& key, uint64_t sequence, uint32_t trigger, bool wait)
+	{
+		SShard& shard = *m_shards[ShardOf(key)];
+		SPost post;
+		TSequencing::Applied(post, sequence);
+		post.Key = key;
+		post.Trigger = trigger;
+		while (!shard.Queue.TryPush(post))
+		{
+			if (!wait) return false;
+			std::this_thread::yield();
+		}
+
+		// Pairs with the worker announcing it parks, then looking at the queue once more
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (shard.Parked.load(std::memory_order_relaxed))
+		{
+			{
+				std::lock_guard<std::mutex> lock(shard.Mutex);
+			}
+			shard.Wake.notify_one();
+		}
+		return true;
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename TKey, typename TTrigger, typename TState, typename THash, typename TSequencing>
+	void CShardedStateMachineStore<TKey, TTrigger, TState, THash, TSequencing>::Work(SShard& shard)
+	{
+		const unsigned int spins = 64;
+
+		SPost post;
+		unsigned int idle = 0;
+		for (;;)
+		{
+			size_t processed = 0, rejected = 0, duplicates = 0;
+			while (processed < BatchSize && shard.Queue.TryPop(post))
+			{
+				++processed;
+				if constexpr (TSequencing::Enabled)
+				{
+					const ESequencedFire fired = shard.Store.FireIndex(post.Key, TSequencing::Last(post), post.Trigger);
+					if (fired == SequencedRejected) ++rejected;
+					else if (fired == SequencedDuplicate) ++duplicates;
+				}
+				else if (!shard.Store.TryFireIndex(post.Key, post.Trigger)) ++rejected;
+			}
+
+			if (processed != 0)
+			{
+				// Counts first, so that they are complete once Processed shows the batch
+				shard.Rejected.store(shard.Rejected.load(std::memory_order_relaxed) + rejected, std::memory_order_relaxed);
+				shard.Duplicates.store(shard.Duplicates.load(std::memory_order_relaxed) + duplicates, std::memory_order_relaxed);
+				shard.Keys.store(shard.Store.Size(), std::memory_order_relaxed);
+				shard.Processed.store(shard.Processed.load(std::memory_order_relaxed) + processed, std::memory_order_release);
+				idle = 0;
+				continue;
+			}
+
+			if (m_stopping.load(std::memory_order_acquire) && shard.Queue.Popped() == shard.Queue.Pushed()) return;
+
+			if (++idle < spins)
+			{
+				std::this_thread::yield();
+				continue;
+			}
+
+			// Park, unless something was pushed since the queue was found empty
+			std::unique_lock<std::mutex> lock(shard.Mutex);
+			shard.Parked.store(true, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if (shard.Queue.Popped() == shard.Queue.Pushed() && !m_stopping.load(std::memory_order_relaxed))
+			{
+				shard.Wake.wait_for(lock, std::chrono::milliseconds(10));
+			}
+			shard.Parked.store(false, std::memory_order_relaxed);
+			idle = 0;
+		}
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename TKey, typename TTrigger, typename TState, typename THash, typename TSequencing>
+	inline void CShardedStateMachineStore<TKey, TTrigger, TState, THash, TSequencing>::Post(const TKey& key, uint64_t sequence, const TTrigger& trigger)
+	{
+		static_assert(TSequencing::Enabled, "Sequence numbers need the CSequenced policy");
+		PostIndex(key, sequence, m_pDefinition->FindTrigger(trigger), true);
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename TKey, typename TTrigger, typename TState, typename THash, typename TSequencing>
+	inline bool CShardedStateMachineStore<TKey, TTrigger, TState, THash, TSequencing>::TryPost(const TKey& key, uint64_t sequence, const TTrigger& trigger)
+	{
+		static_assert(TSequencing::Enabled, "Sequence numbers need the CSequenced policy");
+		return PostIndex(key, sequence, m_pDefinition->FindTrigger(trigger), false);
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename TKey, typename TTrigger, typename TState, typename THash, typename TSequencing>
+	void CShardedStateMachineStore<TKey, TTrigger, TState, THash, TSequencing>::Flush() const
+	{
+		for (const std::unique_ptr<SShard>& shard : m_shards)
+		{
+			const uint64_t posted = shard->Queue.Pushed();
+			while (shard->Processed.load(std::memory_order_acquire) < posted) std::this_thread::yield();
+		}
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename TKey, typename TTrigger, typename TState, typename THash, typename TSequencing>
+	SShardStatistics CShardedStateMachineStore<TKey, TTrigger, TState, THash, TSequencing>::Statistics(unsigned int shard) const
+	{
+		SShardStatistics statistics;
+		statistics.Processed = m_shards[shard]->Processed.load(std::memory_order_acquire);
+		statistics.Rejected = m_shards[shard]->Rejected.load(std::memory_order_relaxed);
+		statistics.Duplicates = m_shards[shard]->Duplicates.load(std::memory_order_relaxed);
+		statistics.Keys = m_shards[shard]->Keys.load(std::memory_order_relaxed);
+		return statistics;
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename TKey, typename TTrigger, typename TState, typename THash, typename TSequencing>
+	SShardStatistics CShardedStateMachineStore<TKey, TTrigger, TState, THash, TSequencing>::Statistics() const
+	{
+		SShardStatistics total;
+		for (unsigned int i = 0; i < ShardCount(); ++i)
+		{
+			const SShardStatistics shard = Statistics(i);
+			total.Processed += shard.Processed;
+			total.Rejected += shard.Rejected;
+			total.Duplicates += shard.Duplicates;
+			total.Keys += shard.Keys;
+		}
+		return total;
+	}
+}
+
+#pragma endregion
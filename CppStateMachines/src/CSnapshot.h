@@ -0,0 +1,207 @@
+#pragma once
+
+#include "CCompiledStateMachine.h"
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#pragma region SNAPSHOT
+
+namespace FSM
+{
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	enum ESnapshotKind
+	{
+		SnapshotFleet = 1,		// State index of every machine of a fleet
+		SnapshotKeyed = 2		// Table of a keyed store, then its spilled instances
+	};
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	// Leads every snapshot file; the data which follows is written as it is in memory, so snapshots are read back by
+	// builds of the same code on the same platform
+	struct SSnapshotHeader
+	{
+		static constexpr uint32_t CurrentVersion = 2;
+
+		char Magic[8];				// "FSMSNAP"
+		uint32_t Version;
+		uint32_t Kind;				// ESnapshotKind
+		uint64_t Fingerprint;		// Of the definition, see DefinitionFingerprint
+		uint32_t KeyBytes;			// Keyed: size of a key
+		uint32_t EntryBytes;		// Size of a machine's state index, or of a keyed table entry
+		uint64_t Count;				// Machines, or table slots
+		uint64_t Instances;			// Keyed: instances in the table
+		uint64_t Spilled;			// Keyed: spilled instances following the table
+		uint32_t Time;				// Keyed: the store's clock
+		uint32_t Flags;				// Keyed: SnapshotSequenced
+	};
+
+	static const uint32_t SnapshotSequenced = 1;
+
+	namespace ___IMPL___
+	{
+		////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+		inline SSnapshotHeader MakeSnapshotHeader(ESnapshotKind kind, uint64_t fingerprint)
+		{
+			SSnapshotHeader header;
+			std::memset(&header, 0, sizeof(header));
+			std::memcpy(header.Magic, "FSMSNAP", 8);
+			header.Version = SSnapshotHeader::CurrentVersion;
+			header.Kind = kind;
+			header.Fingerprint = fingerprint;
+			return header;
+		}
+
+		////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+		// Writes a snapshot next to 'path' and moves it there once complete, so a crash while writing leaves the
+		// previous snapshot in place
+		class CSnapshotWriter
+		{
+		private:
+			std::string m_path;
+			std::string m_temporaryPath;
+			std::FILE* m_pFile;
+
+		public:
+			explicit CSnapshotWriter(const std::string& path)
+				: m_path(path), m_temporaryPath(path + ".tmp"), m_pFile(std::fopen(m_temporaryPath.c_str(), "wb"))
+			{
+				if (m_pFile == nullptr) throw std::runtime_error("Cannot create snapshot " + m_temporaryPath + "!");
+			}
+
+			~CSnapshotWriter()
+			{
+				if (m_pFile == nullptr) return;
+
+				std::fclose(m_pFile);
+				std::remove(m_temporaryPath.c_str());
+			}
+
+			CSnapshotWriter(const CSnapshotWriter&) = delete;
+			CSnapshotWriter& operator=(const CSnapshotWriter&) = delete;
+
+			void Write(const void* data, size_t bytes)
+			{
+				if (bytes != 0 && std::fwrite(data, 1, bytes, m_pFile) != bytes) throw std::runtime_error("Cannot write snapshot " + m_temporaryPath + "!");
+			}
+
+			void Commit()
+			{
+				const bool written = std::fflush(m_pFile) == 0;
+				std::fclose(m_pFile);
+				m_pFile = nullptr;
+				if (!written) throw std::runtime_error("Cannot write snapshot " + m_temporaryPath + "!");
+
+				// Renaming over an existing file fails on some platforms
+				if (std::rename(m_temporaryPath.c_str(), m_path.c_str()) != 0)
+				{
+					std::remove(m_path.c_str());
+					if (std::rename(m_temporaryPath.c_str(), m_path.c_str()) != 0) throw std::runtime_error("Cannot replace snapshot " + m_path + "!");
+				}
+			}
+		};
+
+		////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+		class CSnapshotReader
+		{
+		private:
+			std::string m_path;
+			std::FILE* m_pFile;
+			SSnapshotHeader m_header;
+
+		public:
+			// Throws std::runtime_error for unreadable files & foreign formats, std::invalid_argument for snapshots of
+			// another definition or kind
+			CSnapshotReader(const std::string& path, ESnapshotKind kind, uint64_t fingerprint)
+				: m_path(path), m_pFile(std::fopen(path.c_str(), "rb"))
+			{
+				if (m_pFile == nullptr) throw std::runtime_error("Cannot open snapshot " + path + "!");
+
+				Read(&m_header, sizeof(m_header));
+				if (std::memcmp(m_header.Magic, "FSMSNAP", 8) != 0) throw std::runtime_error("Not a snapshot: " + path + "!");
+				if (m_header.Version != SSnapshotHeader::CurrentVersion) throw std::runtime_error("Unsupported snapshot version in " + path + "!");
+				if (m_header.Kind != (uint32_t)kind) throw std::invalid_argument("Snapshot is of another kind!");
+				if (m_header.Fingerprint != fingerprint) throw std::invalid_argument("Snapshot is of another definition!");
+			}
+
+			~CSnapshotReader() { std::fclose(m_pFile); }
+
+			CSnapshotReader(const CSnapshotReader&) = delete;
+			CSnapshotReader& operator=(const CSnapshotReader&) = delete;
+
+			const SSnapshotHeader& Header() const { return m_header; }
+
+			void Read(void* data, size_t bytes)
+			{
+				if (bytes != 0 && std::fread(data, 1, bytes, m_pFile) != bytes) throw std::runtime_error("Snapshot " + m_path + " is truncated!");
+			}
+		};
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	// What snapshots are checked against, see CCompiledDefinition::Fingerprint
+	template<typename TTrigger, typename TState>
+	uint64_t DefinitionFingerprint(const CCompiledDefinition<TTrigger, TState>& definition)
+	{
+		return definition.Fingerprint();
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	// Saves the state index of 'count' machines of 'definition' in one write
+	template<typename TTrigger, typename TState, typename TInstrumentation>
+	void WriteFleetSnapshot(
+		const std::string& path,
+		const CCompiledDefinition<TTrigger, TState>& definition,
+		const CCompiledStateMachine<TTrigger, TState, TInstrumentation>* machines,
+		size_t count)
+	{
+		std::vector<uint32_t> states(count);
+		for (size_t i = 0; i < count; ++i) states[i] = machines[i].CurrentStateIndex();
+
+		SSnapshotHeader header = ___IMPL___::MakeSnapshotHeader(SnapshotFleet, DefinitionFingerprint(definition));
+		header.EntryBytes = sizeof(uint32_t);
+		header.Count = count;
+
+		___IMPL___::CSnapshotWriter writer(path);
+		writer.Write(&header, sizeof(header));
+		writer.Write(states.data(), states.size() * sizeof(uint32_t));
+		writer.Commit();
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	// Puts 'count' machines of 'definition' back in the states saved by WriteFleetSnapshot, without running callbacks.
+	// Throws std::invalid_argument for snapshots of another definition or fleet size.
+	template<typename TTrigger, typename TState, typename TInstrumentation>
+	void ReadFleetSnapshot(
+		const std::string& path,
+		const CCompiledDefinition<TTrigger, TState>& definition,
+		CCompiledStateMachine<TTrigger, TState, TInstrumentation>* machines,
+		size_t count)
+	{
+		___IMPL___::CSnapshotReader reader(path, SnapshotFleet, DefinitionFingerprint(definition));
+		if (reader.Header().EntryBytes != sizeof(uint32_t)) throw std::runtime_error("Snapshot " + path + " is of another format!");
+		if (reader.Header().Count != count) throw std::invalid_argument("Snapshot is of another fleet size!");
+
+		std::vector<uint32_t> states(count);
+		reader.Read(states.data(), states.size() * sizeof(uint32_t));
+
+		for (uint32_t state : states)
+		{
+			if (state >= definition.StateCount()) throw std::runtime_error("Snapshot " + path + " is corrupt!");
+		}
+		for (size_t i = 0; i < count; ++i) machines[i].RestoreStateIndex(states[i]);
+	}
+}
+
+#pragma endregion
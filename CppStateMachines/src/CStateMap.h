@@ -16,18 +16,22 @@ namespace FSM
 		class CStateMap : public IStateMap<TTrigger, TState>
 		{
 		private:
-			std::map<TState, IState<TTrigger, TState>*> m_stateMap;
+			std::map<TState, SStateEntry<TTrigger, TState>> m_stateMap;
 
 		public:
 
 			CStateMap();
 			virtual ~CStateMap();
 
-			virtual bool Add(const TState& state, IState<TTrigger, TState>* instance) override;
+			virtual bool Add(const TState& state, const SStateEntry<TTrigger, TState>& entry) override;
 
 			virtual IState<TTrigger, TState>* Get(const TState& state) const override;
 
+			virtual const SStateEntry<TTrigger, TState>* Find(const TState& state) const override;
+
 			virtual bool Has(const TState& state) const override;
+
+			virtual void Accept(IStateVisitor<TTrigger, TState>* visitor) const override;
 		};
 
 		////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -42,13 +46,13 @@ namespace FSM
 		template<typename TTrigger, typename TState>
 		inline CStateMap<TTrigger, TState>::~CStateMap()
 		{
-			typename std::map<TState, IState<TTrigger, TState>*>::iterator itr = m_stateMap.begin();
+			typename std::map<TState, SStateEntry<TTrigger, TState>>::iterator itr = m_stateMap.begin();
 			while (!m_stateMap.empty())
 			{
-				typename std::map<TState, IState<TTrigger, TState>*>::iterator cloneItr = itr;
+				typename std::map<TState, SStateEntry<TTrigger, TState>>::iterator cloneItr = itr;
 				++itr;
 
-				IState<TTrigger, TState>* toDelete = cloneItr->second;
+				IState<TTrigger, TState>* toDelete = cloneItr->second.State;
 				m_stateMap.erase(cloneItr);
 
 				if (toDelete != nullptr && toDelete->Disposable)
@@ -62,22 +66,27 @@ namespace FSM
 		////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 		template<typename TTrigger, typename TState>
-		inline bool CStateMap<TTrigger, TState>::Add(const TState & state, IState<TTrigger, TState>* instance)
+		inline bool CStateMap<TTrigger, TState>::Add(const TState & state, const SStateEntry<TTrigger, TState>& entry)
 		{
-			if (Has(state)) return false;
+			return m_stateMap.insert(std::make_pair(state, entry)).second;
+		}
 
-			m_stateMap.insert(std::make_pair(state, instance));
+		////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-			return true;
+		template<typename TTrigger, typename TState>
+		inline IState<TTrigger, TState>* CStateMap<TTrigger, TState>::Get(const TState & state) const
+		{
+			typename std::map<TState, SStateEntry<TTrigger, TState>>::const_iterator itr = m_stateMap.find(state);
+			return itr->second.State;
 		}
 
 		////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 		template<typename TTrigger, typename TState>
-		inline IState<TTrigger, TState>* CStateMap<TTrigger, TState>::Get(const TState & state) const
+		inline const SStateEntry<TTrigger, TState>* CStateMap<TTrigger, TState>::Find(const TState & state) const
 		{
-			typename std::map<TState, IState<TTrigger, TState>*>::const_iterator itr = m_stateMap.find(state);
-			return itr->second;
+			typename std::map<TState, SStateEntry<TTrigger, TState>>::const_iterator itr = m_stateMap.find(state);
+			return itr != m_stateMap.end() ? &itr->second : nullptr;
 		}
 
 		////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -85,11 +94,23 @@ namespace FSM
 		template<typename TTrigger, typename TState>
 		inline bool CStateMap<TTrigger, TState>::Has(const TState & state) const
 		{
-			typename std::map<TState, IState<TTrigger, TState>*>::const_iterator itr = m_stateMap.find(state);
+			typename std::map<TState, SStateEntry<TTrigger, TState>>::const_iterator itr = m_stateMap.find(state);
 
 			return itr != m_stateMap.end();
 		}
 
+		////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+		template<typename TTrigger, typename TState>
+		inline void CStateMap<TTrigger, TState>::Accept(IStateVisitor<TTrigger, TState>* visitor) const
+		{
+			typename std::map<TState, SStateEntry<TTrigger, TState>>::const_iterator itr = m_stateMap.begin();
+			for (; itr != m_stateMap.end(); ++itr)
+			{
+				visitor->Visit(itr->second);
+			}
+		}
+
 		////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 		////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 	}
@@ -0,0 +1,659 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+
+#pragma region TRANSITION TABLES
+
+namespace FSM
+{
+	// Returned by index lookups on compiled definitions when nothing matches
+	const uint32_t InvalidIndex = 0xFFFFFFFF;
+
+	// Storage used for a compiled definition's transition table
+	enum ETableLayout
+	{
+		DenseTable,			// states x triggers matrix, fastest for small or well populated machines
+		CompressedTable,	// row displacement (comb vector) with a check array, for large sparse machines
+		AutoTable			// picked from the machine's shape by ChooseTableLayout
+	};
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	// What a transition table has to hold
+	struct STableShape
+	{
+		uint32_t States = 0;
+		uint32_t Triggers = 0;
+		size_t Transitions = 0;
+		uint32_t MaxFanOut = 0;				// Most transitions out of one state
+		double MeanFanOut = 0;				// Over the states which have transitions
+		double Density = 0;					// Share of the states x triggers matrix holding a transition
+	};
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	// Estimates the cost of a lookup from the size of what it touches: a dense lookup reads one entry of the matrix,
+	// a compressed one reads the row's base and then its entry. Each read costs the latency of the smallest cache the
+	// structure fits in. Defaults follow the workload benchmarks (compiled-dense vs compiled-compressed) on a recent
+	// x86 server; BenchmarkCppStateMachines --cost-model measures the target's and prints them as a model.
+	struct STableCostModel
+	{
+		size_t L1Bytes = 48 * 1024;
+		size_t L2Bytes = 2 * 1024 * 1024;
+		size_t LastLevelBytes = 32 * 1024 * 1024;
+
+		double L1Nanoseconds = 1;
+		double L2Nanoseconds = 4;
+		double LastLevelNanoseconds = 15;
+		double MemoryNanoseconds = 80;
+
+		double CompressedOverheadNanoseconds = 1;		// Check compare & base arithmetic
+		double CompressedFill = 0.9;					// Expected share of used entries after packing
+
+		// The larger table is only picked when it is this much cheaper
+		double SizePremium = 0.25;
+
+		double ReadNanoseconds(size_t bytes) const
+		{
+			return bytes <= L1Bytes ? L1Nanoseconds : bytes <= L2Bytes ? L2Nanoseconds : bytes <= LastLevelBytes ? LastLevelNanoseconds : MemoryNanoseconds;
+		}
+	};
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	// Which layout a compiled definition got, and why. Sizes & costs are the cost model's estimates for either layout.
+	struct STableChoice
+	{
+		ETableLayout Requested = AutoTable;
+		ETableLayout Layout = DenseTable;
+		unsigned int IndexBytes = 4;
+		STableShape Shape;
+
+		size_t DenseBytes = 0;
+		size_t CompressedBytes = 0;
+		double DenseNanoseconds = 0;
+		double CompressedNanoseconds = 0;
+
+		std::string Reason;
+	};
+
+	// Picks the layout with the cheaper estimated lookup, preferring the smaller table unless the larger one is
+	// cheaper by more than the model's SizePremium
+	inline STableChoice ChooseTableLayout(const STableShape& shape, const STableCostModel& model = STableCostModel());
+
+	namespace ___IMPL___
+	{
+		////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+		struct STransition
+		{
+			uint32_t From;
+			uint32_t Trigger;
+			uint32_t To;
+
+			bool operator<(const STransition& other) const
+			{
+				return From != other.From ? From < other.From : Trigger < other.Trigger;
+			}
+
+			bool operator==(const STransition& other) const
+			{
+				return From == other.From && Trigger == other.Trigger && To == other.To;
+			}
+		};
+
+		////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+		inline STableShape MeasureTableShape(uint32_t stateCount, uint32_t triggerCount, const std::vector<STransition>& transitions)
+		{
+			STableShape shape;
+			shape.States = stateCount;
+			shape.Triggers = triggerCount;
+			shape.Transitions = transitions.size();
+
+			std::vector<uint32_t> fanOut(stateCount, 0);
+			for (const STransition& transition : transitions) ++fanOut[transition.From];
+
+			uint32_t busyStates = 0;
+			for (uint32_t count : fanOut)
+			{
+				shape.MaxFanOut = std::max(shape.MaxFanOut, count);
+				if (count != 0) ++busyStates;
+			}
+
+			shape.MeanFanOut = busyStates != 0 ? (double)transitions.size() / busyStates : 0;
+			shape.Density = stateCount != 0 && triggerCount != 0 ? (double)transitions.size() / ((double)stateCount * triggerCount) : 0;
+			return shape;
+		}
+
+		////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+		// State indices are stored as TIndex; its largest value marks a missing transition
+		template<typename TIndex>
+		struct SIndexWidth
+		{
+			static constexpr TIndex None = std::numeric_limits<TIndex>::max();
+
+			static bool Fits(uint32_t stateCount) { return stateCount < (uint32_t)None; }
+			static uint32_t Widen(TIndex index) { return index == None ? InvalidIndex : index; }
+		};
+
+		////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+		// The arrays a table is made of, as written to & viewed from a definition image; dense tables have one
+		struct STableArrays
+		{
+			const void* First = nullptr;
+			size_t FirstBytes = 0;
+			const void* Second = nullptr;
+			size_t SecondBytes = 0;
+		};
+
+		////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+		// Tables are immutable once built: kernels read through plain pointers into storage which copies share, either
+		// the vectors they built or a mapped definition image
+
+		template<typename TIndex>
+		class CDenseTable
+		{
+		private:
+			std::shared_ptr<const void> m_pStorage;
+			const TIndex* m_pNext;
+			size_t m_size;
+			uint32_t m_triggerCount;
+
+		public:
+			CDenseTable() : m_pNext(nullptr), m_size(0), m_triggerCount(0) { }
+
+			void Build(uint32_t stateCount, uint32_t triggerCount, const std::vector<STransition>& transitions)
+			{
+				std::shared_ptr<std::vector<TIndex>> next = std::make_shared<std::vector<TIndex>>((size_t)stateCount * triggerCount, SIndexWidth<TIndex>::None);
+				for (const STransition& transition : transitions)
+				{
+					(*next)[(size_t)transition.From * triggerCount + transition.Trigger] = (TIndex)transition.To;
+				}
+
+				m_triggerCount = triggerCount;
+				m_pNext = next->data();
+				m_size = next->size();
+				m_pStorage = next;
+			}
+
+			// False when the arrays cannot hold a table of this size, or with 'checkEntries' lead to states it does not have
+			bool View(std::shared_ptr<const void> storage, const STableArrays& arrays, uint32_t stateCount, uint32_t triggerCount, bool checkEntries)
+			{
+				if (arrays.FirstBytes != (size_t)stateCount * triggerCount * sizeof(TIndex) || arrays.SecondBytes != 0) return false;
+
+				const TIndex* next = static_cast<const TIndex*>(arrays.First);
+				const size_t size = (size_t)stateCount * triggerCount;
+				for (size_t i = 0; i < size && checkEntries; ++i)
+				{
+					if (next[i] != SIndexWidth<TIndex>::None && next[i] >= stateCount) return false;
+				}
+
+				m_triggerCount = triggerCount;
+				m_pNext = next;
+				m_size = size;
+				m_pStorage = storage;
+				return true;
+			}
+
+			uint32_t Next(uint32_t state, uint32_t trigger) const
+			{
+				return SIndexWidth<TIndex>::Widen(m_pNext[(size_t)state * m_triggerCount + trigger]);
+			}
+
+			size_t Bytes() const { return m_size * sizeof(TIndex); }
+
+			STableArrays Arrays() const
+			{
+				STableArrays arrays;
+				arrays.First = m_pNext;
+				arrays.FirstBytes = Bytes();
+				return arrays;
+			}
+
+			void CopyTo(std::vector<STransition>& transitions) const
+			{
+				for (size_t i = 0; i < m_size; ++i)
+				{
+					if (m_pNext[i] == SIndexWidth<TIndex>::None) continue;
+
+					const STransition transition = { (uint32_t)(i / m_triggerCount), (uint32_t)(i % m_triggerCount), m_pNext[i] };
+					transitions.push_back(transition);
+				}
+			}
+		};
+
+		////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+		// Rows are overlaid into one entry array at per-state offsets so that their occupied columns never
+		// collide; every entry records its owning state, and a lookup is valid only when that check matches
+		template<typename TIndex>
+		class CCompressedTable
+		{
+		private:
+			struct SEntry
+			{
+				TIndex Check;
+				TIndex Next;
+			};
+
+			struct SStorage
+			{
+				std::vector<uint32_t> Base;
+				std::vector<SEntry> Entries;
+			};
+
+			std::shared_ptr<const void> m_pStorage;
+			const uint32_t* m_pBase;
+			const SEntry* m_pEntries;
+			size_t m_stateCount;
+			size_t m_entryCount;
+			uint32_t m_triggerCount;
+
+		public:
+			CCompressedTable() : m_pBase(nullptr), m_pEntries(nullptr), m_stateCount(0), m_entryCount(0), m_triggerCount(0) { }
+
+			void Build(uint32_t stateCount, uint32_t triggerCount, const std::vector<STransition>& transitions);
+
+			// False when the arrays cannot hold a table of this size. With 'checkEntries' also when a row reaches past the
+			// entries, or an entry belongs to or leads to a state the table does not have; entries outside their state's
+			// row are never looked up. Without, bases & entries are not read at all.
+			bool View(std::shared_ptr<const void> storage, const STableArrays& arrays, uint32_t stateCount, uint32_t triggerCount, bool checkEntries)
+			{
+				if (arrays.FirstBytes != (size_t)stateCount * sizeof(uint32_t) || arrays.SecondBytes % sizeof(SEntry) != 0) return false;
+
+				const uint32_t* bases = static_cast<const uint32_t*>(arrays.First);
+				const SEntry* entries = static_cast<const SEntry*>(arrays.Second);
+				const size_t entryCount = arrays.SecondBytes / sizeof(SEntry);
+				if (stateCount != 0 && entryCount < triggerCount) return false;
+
+				for (uint32_t state = 0; state < stateCount && checkEntries; ++state)
+				{
+					if ((size_t)bases[state] + triggerCount > entryCount) return false;
+				}
+				for (size_t i = 0; i < entryCount && checkEntries; ++i)
+				{
+					const SEntry& entry = entries[i];
+					if (entry.Check == SIndexWidth<TIndex>::None) continue;
+					if (entry.Check >= stateCount || entry.Next >= stateCount) return false;
+				}
+
+				m_pBase = bases;
+				m_pEntries = entries;
+				m_stateCount = stateCount;
+				m_entryCount = entryCount;
+				m_triggerCount = triggerCount;
+				m_pStorage = storage;
+				return true;
+			}
+
+			uint32_t Next(uint32_t state, uint32_t trigger) const
+			{
+				const SEntry& entry = m_pEntries[(size_t)m_pBase[state] + trigger];
+				return entry.Check == (TIndex)state ? entry.Next : InvalidIndex;
+			}
+
+			size_t Bytes() const { return m_stateCount * sizeof(uint32_t) + m_entryCount * sizeof(SEntry); }
+
+			STableArrays Arrays() const
+			{
+				STableArrays arrays;
+				arrays.First = m_pBase;
+				arrays.FirstBytes = m_stateCount * sizeof(uint32_t);
+				arrays.Second = m_pEntries;
+				arrays.SecondBytes = m_entryCount * sizeof(SEntry);
+				return arrays;
+			}
+
+			void CopyTo(std::vector<STransition>& transitions) const
+			{
+				for (size_t i = 0; i < m_entryCount; ++i)
+				{
+					const SEntry& entry = m_pEntries[i];
+					if (entry.Check == SIndexWidth<TIndex>::None) continue;
+
+					// Only a corrupt image places an entry outside its state's row, where Next never finds it
+					if (i < m_pBase[entry.Check] || i - m_pBase[entry.Check] >= m_triggerCount) continue;
+
+					const STransition transition = { entry.Check, (uint32_t)(i - m_pBase[entry.Check]), entry.Next };
+					transitions.push_back(transition);
+				}
+			}
+		};
+
+		////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+		template<typename TIndex>
+		void CCompressedTable<TIndex>::Build(uint32_t stateCount, uint32_t triggerCount, const std::vector<STransition>& transitions)
+		{
+			const SEntry empty = { SIndexWidth<TIndex>::None, SIndexWidth<TIndex>::None };
+
+			std::shared_ptr<SStorage> storage = std::make_shared<SStorage>();
+			std::vector<uint32_t>& bases = storage->Base;
+			std::vector<SEntry>& entries = storage->Entries;
+
+			std::vector<STransition> sorted(transitions);
+			std::sort(sorted.begin(), sorted.end());
+
+			// Row ranges into the sorted transitions
+			std::vector<size_t> rowStart(stateCount + 1, 0);
+			for (const STransition& transition : sorted) ++rowStart[transition.From + 1];
+			for (uint32_t i = 0; i < stateCount; ++i) rowStart[i + 1] += rowStart[i];
+
+			// First fit, fullest rows first
+			std::vector<uint32_t> rows(stateCount);
+			for (uint32_t i = 0; i < stateCount; ++i) rows[i] = i;
+			std::stable_sort(rows.begin(), rows.end(), [&rowStart](uint32_t a, uint32_t b)
+			{
+				return rowStart[a + 1] - rowStart[a] > rowStart[b + 1] - rowStart[b];
+			});
+
+			bases.assign(stateCount, 0);
+
+			// nextFree[i] leads to the first free entry at or after i, so candidates only land on free slots
+			std::vector<size_t> nextFree;
+			const auto findFree = [&nextFree](size_t slot)
+			{
+				size_t root = slot;
+				while (root < nextFree.size() && nextFree[root] != root) root = nextFree[root];
+				while (slot < nextFree.size() && nextFree[slot] != slot)
+				{
+					const size_t next = nextFree[slot];
+					nextFree[slot] = root;
+					slot = next;
+				}
+				return root;
+			};
+
+			// Bounds the first fit search per row; rows which do not fit by then go past the end
+			const unsigned int maxAttempts = 1024;
+
+			size_t maxBase = 0;
+
+			// Rows of one size rarely fit where the previous row of that size did not, so each size class
+			// resumes its search there instead of rescanning the densely packed front
+			size_t searchFrom = 0, searchSize = 0;
+			for (uint32_t row : rows)
+			{
+				const size_t begin = rowStart[row], end = rowStart[row + 1];
+				if (begin == end) break;
+
+				const uint32_t firstColumn = sorted[begin].Trigger, lastColumn = sorted[end - 1].Trigger;
+				size_t base = entries.size() > firstColumn ? entries.size() - firstColumn : 0;
+
+				if (end - begin != searchSize)
+				{
+					searchSize = end - begin;
+					searchFrom = 0;
+				}
+
+				size_t slot = searchFrom + firstColumn;
+				for (unsigned int attempt = 0; attempt < maxAttempts; ++attempt, ++slot)
+				{
+					slot = findFree(slot);
+					if (slot >= entries.size())
+					{
+						base = slot - firstColumn;
+						break;
+					}
+
+					size_t i = begin + 1;
+					while (i < end)
+					{
+						const size_t column = slot - firstColumn + sorted[i].Trigger;
+						if (column < entries.size() && entries[column].Check != SIndexWidth<TIndex>::None) break;
+						++i;
+					}
+
+					if (i == end)
+					{
+						base = slot - firstColumn;
+						break;
+					}
+				}
+
+				if (base + lastColumn >= entries.size())
+				{
+					const size_t size = entries.size();
+					entries.resize(base + lastColumn + 1, empty);
+					nextFree.resize(entries.size());
+					for (size_t i = size; i < nextFree.size(); ++i) nextFree[i] = i;
+				}
+
+				for (size_t i = begin; i < end; ++i)
+				{
+					const size_t column = base + sorted[i].Trigger;
+					entries[column].Check = (TIndex)row;
+					entries[column].Next = (TIndex)sorted[i].To;
+					nextFree[column] = column + 1;
+				}
+
+				bases[row] = (uint32_t)base;
+				maxBase = std::max(maxBase, base);
+				searchFrom = base;
+			}
+
+			// Keep every row's full window addressable, so lookups never need a bounds check
+			entries.resize(maxBase + triggerCount, empty);
+
+			m_pBase = bases.data();
+			m_pEntries = entries.data();
+			m_stateCount = bases.size();
+			m_entryCount = entries.size();
+			m_triggerCount = triggerCount;
+			m_pStorage = storage;
+		}
+
+		////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+		// Holds the table of the chosen layout at the narrowest index width that fits the state count,
+		// and dispatches lookups to the kernel specialized for it
+		class CTransitionTable
+		{
+		private:
+			enum EKind { Dense8, Dense16, Dense32, Compressed8, Compressed16, Compressed32 };
+
+			EKind m_kind;
+			STableChoice m_choice;
+			CDenseTable<uint8_t> m_dense8;
+			CDenseTable<uint16_t> m_dense16;
+			CDenseTable<uint32_t> m_dense32;
+			CCompressedTable<uint8_t> m_compressed8;
+			CCompressedTable<uint16_t> m_compressed16;
+			CCompressedTable<uint32_t> m_compressed32;
+
+			void Choose(ETableLayout layout, const STableShape& shape);
+
+		public:
+			CTransitionTable() : m_kind(Dense32) { }
+
+			// AutoTable picks the layout with the default cost model
+			void Build(ETableLayout layout, uint32_t stateCount, uint32_t triggerCount, const std::vector<STransition>& transitions);
+
+			// Reads a table of the given kind (see Kind) straight from 'arrays', which 'storage' keeps alive. False when
+			// the kind is unknown or the arrays do not fit the shape; with 'checkEntries' also when they hold states it
+			// does not have, which reads every entry.
+			bool View(uint32_t kind, ETableLayout requested, const STableShape& shape, std::shared_ptr<const void> storage, const STableArrays& arrays, bool checkEntries);
+
+			// Layout & index width, as saved in definition images
+			uint32_t Kind() const { return m_kind; }
+
+			STableArrays Arrays() const;
+
+			const STableChoice& Choice() const { return m_choice; }
+
+			uint32_t Next(uint32_t state, uint32_t trigger) const
+			{
+				switch (m_kind)
+				{
+				case Dense8:		return m_dense8.Next(state, trigger);
+				case Dense16:		return m_dense16.Next(state, trigger);
+				case Compressed8:	return m_compressed8.Next(state, trigger);
+				case Compressed16:	return m_compressed16.Next(state, trigger);
+				case Compressed32:	return m_compressed32.Next(state, trigger);
+				default:			return m_dense32.Next(state, trigger);
+				}
+			}
+
+			ETableLayout Layout() const { return m_kind >= Compressed8 ? CompressedTable : DenseTable; }
+
+			// Bytes per stored state index: 1, 2 or 4
+			unsigned int IndexBytes() const { return 1u << (m_kind % 3); }
+
+			size_t Bytes() const
+			{
+				return m_dense8.Bytes() + m_dense16.Bytes() + m_dense32.Bytes()
+					+ m_compressed8.Bytes() + m_compressed16.Bytes() + m_compressed32.Bytes();
+			}
+
+			// All transitions, ordered by state then trigger
+			std::vector<STransition> Transitions() const;
+		};
+
+		////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+		inline void CTransitionTable::Choose(ETableLayout layout, const STableShape& shape)
+		{
+			m_choice = ChooseTableLayout(shape);
+			if (layout != AutoTable)
+			{
+				m_choice.Reason = std::string(layout == CompressedTable ? "compressed" : "dense") + " table requested; the cost model would pick "
+					+ (m_choice.Layout == CompressedTable ? "compressed" : "dense");
+				m_choice.Requested = layout;
+				m_choice.Layout = layout;
+			}
+		}
+
+		////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+		inline void CTransitionTable::Build(ETableLayout layout, uint32_t stateCount, uint32_t triggerCount, const std::vector<STransition>& transitions)
+		{
+			Choose(layout, MeasureTableShape(stateCount, triggerCount, transitions));
+
+			const int width = SIndexWidth<uint8_t>::Fits(stateCount) ? 0 : SIndexWidth<uint16_t>::Fits(stateCount) ? 1 : 2;
+			m_kind = (EKind)((m_choice.Layout == CompressedTable ? Compressed8 : Dense8) + width);
+
+			switch (m_kind)
+			{
+			case Dense8:		m_dense8.Build(stateCount, triggerCount, transitions); break;
+			case Dense16:		m_dense16.Build(stateCount, triggerCount, transitions); break;
+			case Compressed8:	m_compressed8.Build(stateCount, triggerCount, transitions); break;
+			case Compressed16:	m_compressed16.Build(stateCount, triggerCount, transitions); break;
+			case Compressed32:	m_compressed32.Build(stateCount, triggerCount, transitions); break;
+			default:			m_dense32.Build(stateCount, triggerCount, transitions); break;
+			}
+		}
+
+		////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+		inline bool CTransitionTable::View(uint32_t kind, ETableLayout requested, const STableShape& shape, std::shared_ptr<const void> storage, const STableArrays& arrays, bool checkEntries)
+		{
+			if (kind > Compressed32 || requested > AutoTable) return false;
+
+			// The width is what Build would pick, so that Choice() & IndexBytes() agree
+			const uint32_t width = SIndexWidth<uint8_t>::Fits(shape.States) ? 0 : SIndexWidth<uint16_t>::Fits(shape.States) ? 1 : 2;
+			if (kind % 3 != width) return false;
+
+			bool viewed = false;
+			switch (kind)
+			{
+			case Dense8:		viewed = m_dense8.View(storage, arrays, shape.States, shape.Triggers, checkEntries); break;
+			case Dense16:		viewed = m_dense16.View(storage, arrays, shape.States, shape.Triggers, checkEntries); break;
+			case Compressed8:	viewed = m_compressed8.View(storage, arrays, shape.States, shape.Triggers, checkEntries); break;
+			case Compressed16:	viewed = m_compressed16.View(storage, arrays, shape.States, shape.Triggers, checkEntries); break;
+			case Compressed32:	viewed = m_compressed32.View(storage, arrays, shape.States, shape.Triggers, checkEntries); break;
+			default:			viewed = m_dense32.View(storage, arrays, shape.States, shape.Triggers, checkEntries); break;
+			}
+			if (!viewed) return false;
+
+			m_kind = (EKind)kind;
+			Choose(requested, shape);
+			m_choice.Layout = Layout();
+			return true;
+		}
+
+		////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+		inline STableArrays CTransitionTable::Arrays() const
+		{
+			switch (m_kind)
+			{
+			case Dense8:		return m_dense8.Arrays();
+			case Dense16:		return m_dense16.Arrays();
+			case Compressed8:	return m_compressed8.Arrays();
+			case Compressed16:	return m_compressed16.Arrays();
+			case Compressed32:	return m_compressed32.Arrays();
+			default:			return m_dense32.Arrays();
+			}
+		}
+
+		////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+		inline std::vector<STransition> CTransitionTable::Transitions() const
+		{
+			std::vector<STransition> transitions;
+			m_dense8.CopyTo(transitions);
+			m_dense16.CopyTo(transitions);
+			m_dense32.CopyTo(transitions);
+			m_compressed8.CopyTo(transitions);
+			m_compressed16.CopyTo(transitions);
+			m_compressed32.CopyTo(transitions);
+
+			std::sort(transitions.begin(), transitions.end());
+			return transitions;
+		}
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	inline STableChoice ChooseTableLayout(const STableShape& shape, const STableCostModel& model)
+	{
+		STableChoice choice;
+		choice.Shape = shape;
+		choice.IndexBytes = ___IMPL___::SIndexWidth<uint8_t>::Fits(shape.States) ? 1 : ___IMPL___::SIndexWidth<uint16_t>::Fits(shape.States) ? 2 : 4;
+
+		// Compressed: a 32 bit base per state, then (check, next) pairs for the packed transitions plus one row's window
+		const size_t baseBytes = (size_t)shape.States * sizeof(uint32_t);
+		const size_t entryBytes = ((size_t)std::ceil(shape.Transitions / model.CompressedFill) + shape.Triggers) * 2 * choice.IndexBytes;
+
+		choice.DenseBytes = (size_t)shape.States * shape.Triggers * choice.IndexBytes;
+		choice.CompressedBytes = baseBytes + entryBytes;
+		choice.DenseNanoseconds = model.ReadNanoseconds(choice.DenseBytes);
+		choice.CompressedNanoseconds = model.ReadNanoseconds(baseBytes) + model.ReadNanoseconds(entryBytes) + model.CompressedOverheadNanoseconds;
+
+		const bool denseSmaller = choice.DenseBytes <= choice.CompressedBytes;
+		const double smallerCost = denseSmaller ? choice.DenseNanoseconds : choice.CompressedNanoseconds;
+		const double largerCost = denseSmaller ? choice.CompressedNanoseconds : choice.DenseNanoseconds;
+		const bool largerPays = largerCost < smallerCost * (1 - model.SizePremium);
+		choice.Layout = denseSmaller != largerPays ? DenseTable : CompressedTable;
+
+		const char* smaller = denseSmaller ? "dense" : "compressed";
+		const char* larger = denseSmaller ? "compressed" : "dense";
+		const double sizeRatio = (double)std::max(choice.DenseBytes, choice.CompressedBytes) / std::max<size_t>(1, std::min(choice.DenseBytes, choice.CompressedBytes));
+
+		char verdict[128];
+		if (largerPays) std::snprintf(verdict, sizeof(verdict), "%s is %.0f%% cheaper, worth %.1fx the memory", larger, 100 * (1 - largerCost / smallerCost), sizeRatio);
+		else if (largerCost < smallerCost) std::snprintf(verdict, sizeof(verdict), "%s would be %.0f%% cheaper, not worth %.1fx the memory", larger, 100 * (1 - largerCost / smallerCost), sizeRatio);
+		else std::snprintf(verdict, sizeof(verdict), "%s is smaller and no slower", smaller);
+
+		char reason[384];
+		std::snprintf(reason, sizeof(reason),
+			"%u states x %u triggers, %zu transitions (%.2f%% full, fan-out mean %.1f max %u); dense %.1f KB ~%.0f ns, compressed %.1f KB ~%.0f ns; %s",
+			shape.States, shape.Triggers, shape.Transitions, 100 * shape.Density, shape.MeanFanOut, shape.MaxFanOut,
+			choice.DenseBytes / 1024.0, choice.DenseNanoseconds, choice.CompressedBytes / 1024.0, choice.CompressedNanoseconds, verdict);
+		choice.Reason = reason;
+		return choice;
+	}
+}
+
+#pragma endregion
@@ -0,0 +1,320 @@
+#pragma once
+
+#include "export.h"
+#include "CDefinitionBuilder.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+#pragma region WORKLOAD GENERATOR
+
+namespace FSM
+{
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	enum EFanOutDistribution
+	{
+		FixedFanOut,		// every state has MeanFanOut transitions
+		UniformFanOut,		// uniform in [1, 2 * MeanFanOut - 1]
+		PowerLawFanOut		// Pareto with FanOutExponent scaled to MeanFanOut, at least 1: few states with huge fan-out
+	};
+
+	struct SGraphOptions
+	{
+		uint32_t States = 1024;
+
+		// Size of the trigger alphabet, caps the fan-out of every state
+		uint32_t Triggers = 16;
+
+		EFanOutDistribution FanOut = FixedFanOut;
+		double MeanFanOut = 4;
+		double FanOutExponent = 2.5;
+
+		// Share of transitions leading back to their own state
+		double SelfLoopRatio = 0;
+
+		// Zipf exponent of the target state popularity; 0 picks targets uniformly, ~1 gives power-law hot states
+		double TargetSkew = 0;
+
+		// Adds one more trigger (index Triggers) leading from every state back to state 0, so streams can loop
+		bool ResetTrigger = false;
+
+		uint64_t Seed = 1;
+	};
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	enum EStreamDistribution
+	{
+		UniformStream,		// any transition of the current state, equally likely
+		ZipfStream,			// transitions of the current state ranked by trigger, rank r weighted 1 / r^Skew
+		MarkovStream		// every previous trigger ranks the next triggers differently, weighted 1 / r^Skew
+	};
+
+	struct SStreamOptions
+	{
+		EStreamDistribution Distribution = UniformStream;
+		double Skew = 1;
+		size_t Length = 1 << 16;
+		uint64_t Seed = 1;
+	};
+
+	namespace ___IMPL___
+	{
+		////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+		// std distributions differ between standard libraries; these only rely on mt19937_64, so seeds reproduce everywhere
+		class CRandom
+		{
+		private:
+			std::mt19937_64 m_engine;
+
+		public:
+			explicit CRandom(uint64_t seed) : m_engine(seed) { }
+
+			// [0, 1)
+			double Uniform() { return (double)(m_engine() >> 11) * (1.0 / 9007199254740992.0); }
+
+			// [0, count)
+			uint32_t Below(uint32_t count) { return (uint32_t)(((m_engine() >> 32) * count) >> 32); }
+		};
+
+		////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+		// Ranks [0, count) with weight 1 / (rank + 1)^exponent, sampled by binary search over the cumulative weights
+		class CZipfDistribution
+		{
+		private:
+			std::vector<double> m_cumulative;
+
+		public:
+			CZipfDistribution(uint32_t count, double exponent) : m_cumulative(count)
+			{
+				double total = 0;
+				for (uint32_t rank = 0; rank < count; ++rank) m_cumulative[rank] = total += std::pow(rank + 1.0, -exponent);
+			}
+
+			uint32_t operator()(CRandom& random) const
+			{
+				const double point = random.Uniform() * m_cumulative.back();
+				const size_t rank = std::upper_bound(m_cumulative.begin(), m_cumulative.end(), point) - m_cumulative.begin();
+				return (uint32_t)std::min(rank, m_cumulative.size() - 1);
+			}
+		};
+
+		////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+		// Picks one of the candidates, candidate i weighted 1 / (ranks[i] + 1)^exponent
+		inline uint32_t PickRanked(CRandom& random, const std::vector<uint32_t>& ranks, double exponent, std::vector<double>& cumulative)
+		{
+			double total = 0;
+			cumulative.resize(ranks.size());
+			for (size_t i = 0; i < ranks.size(); ++i) cumulative[i] = total += std::pow(ranks[i] + 1.0, -exponent);
+
+			const size_t pick = std::upper_bound(cumulative.begin(), cumulative.end(), random.Uniform() * total) - cumulative.begin();
+			return (uint32_t)std::min(pick, ranks.size() - 1);
+		}
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	// Random machine graph over state & trigger indices, state 0 being the initial state.
+	// Every state has at least one transition, so a walk never gets stuck.
+	class CGeneratedMachine
+	{
+	private:
+		uint32_t m_stateCount;
+		uint32_t m_triggerCount;
+		bool m_resetTrigger;
+
+		// Transitions of state s are [m_first[s], m_first[s + 1]), ordered by trigger
+		std::vector<uint32_t> m_first;
+		std::vector<uint32_t> m_triggers;
+		std::vector<uint32_t> m_targets;
+
+	public:
+		explicit CGeneratedMachine(const SGraphOptions& options);
+
+		uint32_t StateCount() const { return m_stateCount; }
+		uint32_t TriggerCount() const { return m_triggerCount; }
+		size_t TransitionCount() const { return m_targets.size(); }
+
+		uint32_t FanOut(uint32_t state) const { return m_first[state + 1] - m_first[state]; }
+
+		// Target of the state's trigger, InvalidIndex when it has none
+		uint32_t Next(uint32_t state, uint32_t trigger) const;
+
+		// Walk from state 0; with a reset trigger the stream is closed by returning to state 0, so it can be replayed forever
+		std::vector<uint32_t> Stream(const SStreamOptions& options) const;
+
+		// Configures 'machine' with states[i] & triggers[i] for indices i; callbacks are left to the caller
+		template<typename TTrigger, typename TState>
+		void Configure(IFiniteStateMachine<TTrigger, TState>& machine, const std::vector<TState>& states, const std::vector<TTrigger>& triggers) const;
+
+		template<typename TTrigger, typename TState>
+		void AddTo(CDefinitionBuilder<TTrigger, TState>& builder, const std::vector<TState>& states, const std::vector<TTrigger>& triggers) const;
+
+		// Maps a stream of trigger indices to trigger keys
+		template<typename TTrigger>
+		static std::vector<TTrigger> Keys(const std::vector<uint32_t>& stream, const std::vector<TTrigger>& triggers);
+	};
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	inline CGeneratedMachine::CGeneratedMachine(const SGraphOptions& options)
+		: m_stateCount(options.States), m_triggerCount(options.Triggers + (options.ResetTrigger ? 1 : 0)), m_resetTrigger(options.ResetTrigger)
+	{
+		if (options.States == 0 || options.Triggers == 0) throw std::invalid_argument("Generated machines need states & triggers!");
+		if (options.MeanFanOut < 1) throw std::invalid_argument("Mean fan-out must be at least 1!");
+
+		___IMPL___::CRandom random(options.Seed);
+
+		// Popular targets are scattered over the state indices rather than being the lowest ones
+		std::vector<uint32_t> popularity(options.States);
+		for (uint32_t i = 0; i < options.States; ++i) popularity[i] = i;
+		for (uint32_t i = options.States; i > 1; --i) std::swap(popularity[i - 1], popularity[random.Below(i)]);
+		const ___IMPL___::CZipfDistribution targets(options.States, options.TargetSkew);
+
+		// A Pareto with minimum xm has mean xm * a / (a - 1); pick xm so the mean lands on MeanFanOut
+		const double exponent = std::max(options.FanOutExponent, 1.01);
+		const double minimum = options.MeanFanOut * (exponent - 1) / exponent;
+
+		std::vector<uint32_t> chosen;
+		m_first.reserve(options.States + 1);
+		m_first.push_back(0);
+		for (uint32_t state = 0; state < options.States; ++state)
+		{
+			double fanOut = options.MeanFanOut;
+			if (options.FanOut == UniformFanOut) fanOut = 1 + random.Below((uint32_t)std::lround(2 * options.MeanFanOut - 1));
+			if (options.FanOut == PowerLawFanOut) fanOut = minimum / std::pow(1.0 - random.Uniform(), 1.0 / exponent);
+
+			const uint32_t count = (uint32_t)std::min<double>(std::max<double>(std::lround(fanOut), 1.0), options.Triggers);
+
+			// Floyd's algorithm: 'count' distinct triggers
+			chosen.clear();
+			for (uint32_t j = options.Triggers - count; j < options.Triggers; ++j)
+			{
+				const uint32_t pick = random.Below(j + 1);
+				chosen.push_back(std::find(chosen.begin(), chosen.end(), pick) == chosen.end() ? pick : j);
+			}
+			std::sort(chosen.begin(), chosen.end());
+
+			for (uint32_t trigger : chosen)
+			{
+				const bool selfLoop = random.Uniform() < options.SelfLoopRatio;
+				m_triggers.push_back(trigger);
+				m_targets.push_back(selfLoop ? state : popularity[targets(random)]);
+			}
+
+			if (options.ResetTrigger)
+			{
+				m_triggers.push_back(options.Triggers);
+				m_targets.push_back(0);
+			}
+
+			m_first.push_back((uint32_t)m_targets.size());
+		}
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	inline uint32_t CGeneratedMachine::Next(uint32_t state, uint32_t trigger) const
+	{
+		const std::vector<uint32_t>::const_iterator first = m_triggers.begin() + m_first[state];
+		const std::vector<uint32_t>::const_iterator last = m_triggers.begin() + m_first[state + 1];
+		const std::vector<uint32_t>::const_iterator itr = std::lower_bound(first, last, trigger);
+		return itr != last && *itr == trigger ? m_targets[itr - m_triggers.begin()] : InvalidIndex;
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	inline std::vector<uint32_t> CGeneratedMachine::Stream(const SStreamOptions& options) const
+	{
+		___IMPL___::CRandom random(options.Seed);
+
+		// Markov streams: how much each previous trigger favours each next trigger (0 = most)
+		std::vector<uint32_t> preference;
+		if (options.Distribution == MarkovStream)
+		{
+			preference.resize((size_t)m_triggerCount * m_triggerCount);
+			for (uint32_t previous = 0; previous < m_triggerCount; ++previous)
+			{
+				uint32_t* row = &preference[(size_t)previous * m_triggerCount];
+				for (uint32_t i = 0; i < m_triggerCount; ++i) row[i] = i;
+				for (uint32_t i = m_triggerCount; i > 1; --i) std::swap(row[i - 1], row[random.Below(i)]);
+			}
+		}
+
+		const size_t length = options.Length > 0 && m_resetTrigger ? options.Length - 1 : options.Length;
+
+		std::vector<uint32_t> stream;
+		std::vector<uint32_t> ranks;
+		std::vector<double> cumulative;
+		stream.reserve(options.Length);
+		uint32_t state = 0, previous = 0;
+		while (stream.size() < length)
+		{
+			const uint32_t first = m_first[state];
+			const uint32_t count = m_first[state + 1] - first;
+
+			uint32_t pick = 0;
+			if (options.Distribution == UniformStream) pick = random.Below(count);
+			else
+			{
+				ranks.resize(count);
+				for (uint32_t i = 0; i < count; ++i)
+				{
+					ranks[i] = options.Distribution == ZipfStream ? i : preference[(size_t)previous * m_triggerCount + m_triggers[first + i]];
+				}
+				pick = ___IMPL___::PickRanked(random, ranks, options.Skew, cumulative);
+			}
+
+			previous = m_triggers[first + pick];
+			state = m_targets[first + pick];
+			stream.push_back(previous);
+		}
+
+		if (m_resetTrigger && options.Length > 0) stream.push_back(m_triggerCount - 1);
+		return stream;
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename TTrigger, typename TState>
+	inline void CGeneratedMachine::Configure(IFiniteStateMachine<TTrigger, TState>& machine, const std::vector<TState>& states, const std::vector<TTrigger>& triggers) const
+	{
+		for (uint32_t state = 0; state < m_stateCount; ++state)
+		{
+			IStateConfigurator<TTrigger, TState>* configurator = machine.Configure(states[state]);
+			for (uint32_t i = m_first[state]; i < m_first[state + 1]; ++i) configurator->AddTrigger(triggers[m_triggers[i]], states[m_targets[i]]);
+		}
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename TTrigger, typename TState>
+	inline void CGeneratedMachine::AddTo(CDefinitionBuilder<TTrigger, TState>& builder, const std::vector<TState>& states, const std::vector<TTrigger>& triggers) const
+	{
+		builder.Reserve(m_targets.size());
+		for (uint32_t state = 0; state < m_stateCount; ++state)
+		{
+			for (uint32_t i = m_first[state]; i < m_first[state + 1]; ++i) builder.Add(states[state], triggers[m_triggers[i]], states[m_targets[i]]);
+		}
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename TTrigger>
+	inline std::vector<TTrigger> CGeneratedMachine::Keys(const std::vector<uint32_t>& stream, const std::vector<TTrigger>& triggers)
+	{
+		std::vector<TTrigger> keys;
+		keys.reserve(stream.size());
+		for (uint32_t trigger : stream) keys.push_back(triggers[trigger]);
+		return keys;
+	}
+}
+
+#pragma endregion
@@ -20,13 +20,24 @@ namespace FSM
 
 	typedef void(*state_change_callback)();
 
+	struct SStateCallbacks
+	{
+		state_change_callback OnEntry;
+		state_change_callback OnExit;
+		ICallback* OnEntryInstance;
+		ICallback* OnExitInstance;
+	};
+
 	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
+	template<typename TTrigger, typename TState>
+	class IStateConfigurator;
+
 	template<typename TTrigger, typename TState>
 	class IState
 	{
 	public:
-		IState(const TState& state, bool disposable) : StateType(state), Disposable(disposable) {  }
+		IState(const TState& state, bool disposable) : Disposable(disposable), StateType(state) {  }
 		virtual ~IState() { /* Needs to remain empty */ }
 
 		const bool Disposable;
@@ -36,6 +47,9 @@ namespace FSM
 
 		virtual void OnEntry() = 0;
 		virtual void OnExit() = 0;
+
+		// The state's configurator face, if it has one; lets Configure reach custom states added as plain IState
+		virtual IStateConfigurator<TTrigger, TState>* Configurator() { return nullptr; }
 	};
 
 	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -62,6 +76,29 @@ namespace FSM
 
 	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
+	// Both faces of a stored state, so looking one up never needs a cast.
+	// Configurator is null for custom states that cannot be configured
+	template<typename TTrigger, typename TState>
+	struct SStateEntry
+	{
+		IState<TTrigger, TState>* State;
+		IStateConfigurator<TTrigger, TState>* Configurator;
+		bool AutoState;
+	};
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename TTrigger, typename TState>
+	class IStateVisitor
+	{
+	public:
+		virtual ~IStateVisitor() { /* Needs to remain empty */ }
+
+		virtual void Visit(const SStateEntry<TTrigger, TState>& entry) = 0;
+	};
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
 	template<typename TTrigger, typename TState>
 	class IStateMap
 	{
@@ -69,11 +106,16 @@ namespace FSM
 
 		virtual ~IStateMap() { /* Needs to remain empty */ }
 		
-		virtual bool Add(const TState& state, IState<TTrigger, TState>* instance) = 0;
+		virtual bool Add(const TState& state, const SStateEntry<TTrigger, TState>& entry) = 0;
 
 		virtual IState<TTrigger, TState>* Get(const TState& state) const = 0;
 
+		// Null when the state is unknown
+		virtual const SStateEntry<TTrigger, TState>* Find(const TState& state) const = 0;
+
 		virtual bool Has(const TState& state) const = 0;
+
+		virtual void Accept(IStateVisitor<TTrigger, TState>* visitor) const = 0;
 	};
 
 	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -88,16 +130,29 @@ namespace FSM
 
 		virtual const TState* CurrentState() const = 0;
 
+		// False when the instance is null or the state exists already
 		virtual bool AddState(const TState& state, IState<TTrigger, TState>* instance) = 0;
 
 		virtual void Fire(const TTrigger& trigger) = 0;
 	};
 
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	// Both faces in one base, the state is its own configurator without a cast
+	template<typename TTrigger, typename TState>
+	class IConfigurableState : public IState<TTrigger, TState>, public IStateConfigurator<TTrigger, TState>
+	{
+	public:
+		IConfigurableState(const TState& state, bool disposable) : IState<TTrigger, TState>(state, disposable) {  }
+
+		virtual IStateConfigurator<TTrigger, TState>* Configurator() override { return this; }
+	};
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 #define FSM_STATE(TRIGGER, STATE) \
-public IState<TRIGGER, STATE>, \
-public IStateConfigurator<TRIGGER, STATE>
+public FSM::IState<TRIGGER, STATE>, \
+public FSM::IStateConfigurator<TRIGGER, STATE>
 
 }
 
@@ -2,6 +2,8 @@
 
 #include <map>
 #include <exception>
+#include <stdexcept>
+#include <type_traits>
 
 /****************************************************************************************************************************/
 
@@ -21,13 +23,24 @@ namespace FSM
 
 	typedef void(*state_change_callback)();
 
+	struct SStateCallbacks
+	{
+		state_change_callback OnEntry;
+		state_change_callback OnExit;
+		ICallback* OnEntryInstance;
+		ICallback* OnExitInstance;
+	};
+
 	//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 
+	template<typename TTrigger, typename TState>
+	class IStateConfigurator;
+
 	template<typename TTrigger, typename TState>
 	class IState
 	{
 	public:
-		IState(const TState& state, bool disposable) : StateType(state), Disposable(disposable) {  }
+		IState(const TState& state, bool disposable) : Disposable(disposable), StateType(state) {  }
 		virtual ~IState() { /* Needs to remain empty */ }
 
 		const bool Disposable;
@@ -37,6 +50,9 @@ namespace FSM
 
 		virtual void OnEntry() = 0;
 		virtual void OnExit() = 0;
+
+		// The state's configurator face, if it has one; lets Configure reach custom states added as plain IState
+		virtual IStateConfigurator<TTrigger, TState>* Configurator() { return nullptr; }
 	};
 
 	//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
@@ -63,6 +79,29 @@ namespace FSM
 
 	//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 
+	// Both faces of a stored state, so looking one up never needs a cast.
+	// Configurator is null for custom states that cannot be configured
+	template<typename TTrigger, typename TState>
+	struct SStateEntry
+	{
+		IState<TTrigger, TState>* State;
+		IStateConfigurator<TTrigger, TState>* Configurator;
+		bool AutoState;
+	};
+
+	//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+	template<typename TTrigger, typename TState>
+	class IStateVisitor
+	{
+	public:
+		virtual ~IStateVisitor() { /* Needs to remain empty */ }
+
+		virtual void Visit(const SStateEntry<TTrigger, TState>& entry) = 0;
+	};
+
+	//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
 	template<typename TTrigger, typename TState>
 	class IStateMap
 	{
@@ -70,11 +109,16 @@ namespace FSM
 
 		virtual ~IStateMap() { /* Needs to remain empty */ }
 
-		virtual bool Add(const TState& state, IState<TTrigger, TState>* instance) = 0;
+		virtual bool Add(const TState& state, const SStateEntry<TTrigger, TState>& entry) = 0;
 
 		virtual IState<TTrigger, TState>* Get(const TState& state) const = 0;
 
+		// Null when the state is unknown
+		virtual const SStateEntry<TTrigger, TState>* Find(const TState& state) const = 0;
+
 		virtual bool Has(const TState& state) const = 0;
+
+		virtual void Accept(IStateVisitor<TTrigger, TState>* visitor) const = 0;
 	};
 
 	//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
@@ -89,6 +133,7 @@ namespace FSM
 
 		virtual const TState* CurrentState() const = 0;
 
+		// False when the instance is null or the state exists already
 		virtual bool AddState(const TState& state, IState<TTrigger, TState>* instance) = 0;
 
 		virtual void Fire(const TTrigger& trigger) = 0;
@@ -96,9 +141,21 @@ namespace FSM
 
 	//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 
+	// Both faces in one base, the state is its own configurator without a cast
+	template<typename TTrigger, typename TState>
+	class IConfigurableState : public IState<TTrigger, TState>, public IStateConfigurator<TTrigger, TState>
+	{
+	public:
+		IConfigurableState(const TState& state, bool disposable) : IState<TTrigger, TState>(state, disposable) {  }
+
+		virtual IStateConfigurator<TTrigger, TState>* Configurator() override { return this; }
+	};
+
+	//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
 #define FSM_STATE(TRIGGER, STATE) \
-public IState<TRIGGER, STATE>, \
-public IStateConfigurator<TRIGGER, STATE>
+public FSM::IState<TRIGGER, STATE>, \
+public FSM::IStateConfigurator<TRIGGER, STATE>
 
 }
 
@@ -115,7 +172,7 @@ namespace FSM
 		//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 
 		template<typename TTrigger, typename TState>
-		class CAutoState : FSM_STATE(TTrigger, TState)
+		class CAutoState : public IConfigurableState<TTrigger, TState>
 		{
 		private:
 			ICallback* m_pOnEntryCallbackInstance;
@@ -145,6 +202,10 @@ namespace FSM
 			virtual IStateConfigurator<TTrigger, TState>* OnExit(state_change_callback onExitCallback) override;
 			virtual IState<TTrigger, TState>* State() override { return this; }
 
+			// Read-only views used when compiling the configured machine
+			const std::map<TTrigger, TState>& Transitions() const { return m_triggerStateMap; }
+			SStateCallbacks Callbacks() const { return { m_pOnEntryCallback, m_pOnExitCallback, m_pOnEntryCallbackInstance, m_pOnExitCallbackInstance }; }
+
 		private:
 
 			void Call(ICallback* callback) { if (callback != nullptr) callback->Call(); }
@@ -155,7 +216,8 @@ namespace FSM
 
 		template<typename TTrigger, typename TState>
 		CAutoState<TTrigger, TState>::CAutoState(const TState& state)
-			: IState<TTrigger, TState>(state, true),
+			: IConfigurableState<TTrigger, TState>(state, true),
+			m_pOnEntryCallbackInstance(nullptr), m_pOnExitCallbackInstance(nullptr),
 			m_pOnEntryCallback(nullptr), m_pOnExitCallback(nullptr)
 		{
 		}
@@ -178,7 +240,7 @@ namespace FSM
 				return itr->second;
 			}
 
-			throw std::exception("Cannot find the state!");
+			throw std::runtime_error("Cannot find the state!");
 		}
 
 		//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
@@ -219,7 +281,7 @@ namespace FSM
 		IStateConfigurator<TTrigger, TState>* CAutoState<TTrigger, TState>::OnEntry(ICallback* onEntryCallback)
 		{
 			// Throw if already subscribed, to avoid memory leaks
-			if (m_pOnEntryCallbackInstance != nullptr) throw new std::exception("Already subscribed to instance!");
+			if (m_pOnEntryCallbackInstance != nullptr) throw std::runtime_error("Already subscribed to instance!");
 			m_pOnEntryCallbackInstance = onEntryCallback;
 			return this;
 		}
@@ -230,7 +292,7 @@ namespace FSM
 		IStateConfigurator<TTrigger, TState>* CAutoState<TTrigger, TState>::OnEntry(state_change_callback onEntryCallback)
 		{
 			// Throw if already subscribed to instance
-			if (m_pOnEntryCallbackInstance != nullptr) throw new std::exception("Already subscribed to instance!");
+			if (m_pOnEntryCallbackInstance != nullptr) throw std::runtime_error("Already subscribed to instance!");
 			m_pOnEntryCallback = onEntryCallback;
 			return this;
 		}
@@ -241,7 +303,7 @@ namespace FSM
 		IStateConfigurator<TTrigger, TState>* CAutoState<TTrigger, TState>::OnExit(ICallback* onExitCallback)
 		{
 			// Throw if already subscribed, to avoid memory leaks
-			if (m_pOnExitCallbackInstance != nullptr) throw new std::exception("Already subscribed to instance!");
+			if (m_pOnExitCallbackInstance != nullptr) throw std::runtime_error("Already subscribed to instance!");
 			m_pOnExitCallbackInstance = onExitCallback;
 			return this;
 		}
@@ -252,7 +314,7 @@ namespace FSM
 		IStateConfigurator<TTrigger, TState>* CAutoState<TTrigger, TState>::OnExit(state_change_callback onExitCallback)
 		{
 			// Throw if already subscribed to instance
-			if (m_pOnExitCallbackInstance != nullptr) throw new std::exception("Already subscribed to instance!");
+			if (m_pOnExitCallbackInstance != nullptr) throw std::runtime_error("Already subscribed to instance!");
 			m_pOnExitCallback = onExitCallback;
 			return this;
 		}
@@ -275,18 +337,22 @@ namespace FSM
 		class CStateMap : public IStateMap<TTrigger, TState>
 		{
 		private:
-			std::map<TState, IState<TTrigger, TState>*> m_stateMap;
+			std::map<TState, SStateEntry<TTrigger, TState>> m_stateMap;
 
 		public:
 
 			CStateMap();
 			virtual ~CStateMap();
 
-			virtual bool Add(const TState& state, IState<TTrigger, TState>* instance) override;
+			virtual bool Add(const TState& state, const SStateEntry<TTrigger, TState>& entry) override;
 
 			virtual IState<TTrigger, TState>* Get(const TState& state) const override;
 
+			virtual const SStateEntry<TTrigger, TState>* Find(const TState& state) const override;
+
 			virtual bool Has(const TState& state) const override;
+
+			virtual void Accept(IStateVisitor<TTrigger, TState>* visitor) const override;
 		};
 
 		//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
@@ -301,13 +367,13 @@ namespace FSM
 		template<typename TTrigger, typename TState>
 		inline CStateMap<TTrigger, TState>::~CStateMap()
 		{
-			typename std::map<TState, IState<TTrigger, TState>*>::iterator itr = m_stateMap.begin();
+			typename std::map<TState, SStateEntry<TTrigger, TState>>::iterator itr = m_stateMap.begin();
 			while (!m_stateMap.empty())
 			{
-				typename std::map<TState, IState<TTrigger, TState>*>::iterator cloneItr = itr;
+				typename std::map<TState, SStateEntry<TTrigger, TState>>::iterator cloneItr = itr;
 				++itr;
 
-				IState<TTrigger, TState>* toDelete = cloneItr->second;
+				IState<TTrigger, TState>* toDelete = cloneItr->second.State;
 				m_stateMap.erase(cloneItr);
 
 				if (toDelete != nullptr && toDelete->Disposable)
@@ -321,22 +387,27 @@ namespace FSM
 		//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 
 		template<typename TTrigger, typename TState>
-		inline bool CStateMap<TTrigger, TState>::Add(const TState & state, IState<TTrigger, TState>* instance)
+		inline bool CStateMap<TTrigger, TState>::Add(const TState & state, const SStateEntry<TTrigger, TState>& entry)
 		{
-			if (Has(state)) return false;
+			return m_stateMap.insert(std::make_pair(state, entry)).second;
+		}
 
-			m_stateMap.insert(std::make_pair(state, instance));
+		//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 
-			return true;
+		template<typename TTrigger, typename TState>
+		inline IState<TTrigger, TState>* CStateMap<TTrigger, TState>::Get(const TState & state) const
+		{
+			typename std::map<TState, SStateEntry<TTrigger, TState>>::const_iterator itr = m_stateMap.find(state);
+			return itr->second.State;
 		}
 
 		//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 
 		template<typename TTrigger, typename TState>
-		inline IState<TTrigger, TState>* CStateMap<TTrigger, TState>::Get(const TState & state) const
+		inline const SStateEntry<TTrigger, TState>* CStateMap<TTrigger, TState>::Find(const TState & state) const
 		{
-			typename std::map<TState, IState<TTrigger, TState>*>::const_iterator itr = m_stateMap.find(state);
-			return itr->second;
+			typename std::map<TState, SStateEntry<TTrigger, TState>>::const_iterator itr = m_stateMap.find(state);
+			return itr != m_stateMap.end() ? &itr->second : nullptr;
 		}
 
 		//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
@@ -344,12 +415,24 @@ namespace FSM
 		template<typename TTrigger, typename TState>
 		inline bool CStateMap<TTrigger, TState>::Has(const TState & state) const
 		{
-			typename std::map<TState, IState<TTrigger, TState>*>::const_iterator itr = m_stateMap.find(state);
+			typename std::map<TState, SStateEntry<TTrigger, TState>>::const_iterator itr = m_stateMap.find(state);
 
 			return itr != m_stateMap.end();
 		}
 
 		//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+		template<typename TTrigger, typename TState>
+		inline void CStateMap<TTrigger, TState>::Accept(IStateVisitor<TTrigger, TState>* visitor) const
+		{
+			typename std::map<TState, SStateEntry<TTrigger, TState>>::const_iterator itr = m_stateMap.begin();
+			for (; itr != m_stateMap.end(); ++itr)
+			{
+				visitor->Visit(itr->second);
+			}
+		}
+
+		//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 	}
 }
 
@@ -380,6 +463,13 @@ namespace FSM
 		virtual const TState* CurrentState() const override;
 		virtual bool AddState(const TState& state, IState<TTrigger, TState>* instance) override;
 		virtual void Fire(const TTrigger& trigger) override;
+
+		// Custom states declared with FSM_STATE stay reachable through Configure, found at compile time without RTTI
+		template<typename TCustomState>
+		bool AddState(const TState& state, TCustomState* instance);
+
+		// Visits every configured state, in state order
+		void Accept(IStateVisitor<TTrigger, TState>* visitor) const;
 	};
 
 	//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
@@ -408,13 +498,12 @@ namespace FSM
 	template<typename TTrigger, typename TState>
 	inline IStateConfigurator<TTrigger, TState>* CFiniteStateMachine<TTrigger, TState>::Configure(const TState & state)
 	{
-		if (m_pMap->Has(state))
-		{
-			return dynamic_cast<IStateConfigurator<TTrigger, TState>*>(m_pMap->Get(state));
-		}
+		const SStateEntry<TTrigger, TState>* entry = m_pMap->Find(state);
+		if (entry != nullptr) return entry->Configurator;
 
 		___IMPL___::CAutoState<TTrigger, TState>* instance = new ___IMPL___::CAutoState<TTrigger, TState>(state);
-		m_pMap->Add(state, instance);
+		const SStateEntry<TTrigger, TState> added = { instance, instance, true };
+		m_pMap->Add(state, added);
 		return instance;
 	}
 
@@ -423,7 +512,7 @@ namespace FSM
 	template<typename TTrigger, typename TState>
 	inline const TState* CFiniteStateMachine<TTrigger, TState>::CurrentState() const
 	{
-		if (m_pCurrentState == nullptr) throw std::exception("Current state is null! This should not happen!");
+		if (m_pCurrentState == nullptr) throw std::runtime_error("Current state is null! This should not happen!");
 
 		return &m_pCurrentState->StateType;
 	}
@@ -433,10 +522,25 @@ namespace FSM
 	template<typename TTrigger, typename TState>
 	inline bool CFiniteStateMachine<TTrigger, TState>::AddState(const TState & state, IState<TTrigger, TState>* instance)
 	{
-		if (m_pMap->Has(state)) return false;
+		if (instance == nullptr) return false;
+
+		// Only the state's own Configurator() is known through IState, IConfigurableState supplies it
+		const SStateEntry<TTrigger, TState> entry = { instance, instance->Configurator(), false };
+		return m_pMap->Add(state, entry);
+	}
+
+	//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+	template<typename TTrigger, typename TState>
+	template<typename TCustomState>
+	inline bool CFiniteStateMachine<TTrigger, TState>::AddState(const TState & state, TCustomState* instance)
+	{
+		if (instance == nullptr) return false;
+
+		SStateEntry<TTrigger, TState> entry = { instance, instance->Configurator(), false };
+		if constexpr (std::is_base_of<IStateConfigurator<TTrigger, TState>, TCustomState>::value) entry.Configurator = instance;
 
-		m_pMap->Add(state, instance);
-		return true;
+		return m_pMap->Add(state, entry);
 	}
 
 	//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
@@ -446,9 +550,10 @@ namespace FSM
 	{
 		const TState& state = m_pCurrentState->FindStateForTrigger(trigger);
 
-		if (!m_pMap->Has(state)) throw std::exception("Cannot find state for type");
+		const SStateEntry<TTrigger, TState>* entry = m_pMap->Find(state);
+		if (entry == nullptr) throw std::runtime_error("Cannot find state for type");
 
-		IState<TTrigger, TState>* target = m_pMap->Get(state);
+		IState<TTrigger, TState>* target = entry->State;
 
 		m_pCurrentState->OnExit();
 		{
@@ -459,6 +564,14 @@ namespace FSM
 	}
 
 	//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+	template<typename TTrigger, typename TState>
+	inline void CFiniteStateMachine<TTrigger, TState>::Accept(IStateVisitor<TTrigger, TState>* visitor) const
+	{
+		m_pMap->Accept(visitor);
+	}
+
+	//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 }
 
 
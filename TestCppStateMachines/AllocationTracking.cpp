@@ -0,0 +1,123 @@
+#include "stdafx.h"
+
+#include "AllocationTracking.h"
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+	thread_local AllocationTracking::CAllocationCounter* t_pCounter = nullptr;
+}
+
+namespace AllocationTracking
+{
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	bool Enabled()
+	{
+#ifdef TRACK_ALLOCATIONS
+		return true;
+#else
+		return false;
+#endif
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	CAllocationCounter::CAllocationCounter() : m_pOuter(t_pCounter), m_count(0)
+	{
+		t_pCounter = this;
+	}
+
+	CAllocationCounter::~CAllocationCounter()
+	{
+		t_pCounter = m_pOuter;
+	}
+
+	void CAllocationCounter::Record()
+	{
+		for (CAllocationCounter* counter = t_pCounter; counter != nullptr; counter = counter->m_pOuter) ++counter->m_count;
+	}
+}
+
+#ifdef TRACK_ALLOCATIONS
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Plain malloc & free underneath, so every operator delete can release any operator new's block. Over-aligned blocks
+// keep malloc's pointer just before the aligned one, for the aligned operator deletes.
+
+namespace
+{
+	void* Allocate(size_t size)
+	{
+		AllocationTracking::CAllocationCounter::Record();
+		return std::malloc(size != 0 ? size : 1);
+	}
+
+	void* Allocate(size_t size, std::align_val_t alignment)
+	{
+		char* block = (char*)Allocate(size + (size_t)alignment + sizeof(void*));
+		if (block == nullptr) return nullptr;
+
+		const uintptr_t aligned = ((uintptr_t)(block + sizeof(void*)) + (size_t)alignment - 1) & ~((uintptr_t)alignment - 1);
+		((void**)aligned)[-1] = block;
+		return (void*)aligned;
+	}
+
+	void Free(void* pointer, std::align_val_t)
+	{
+		if (pointer != nullptr) std::free(((void**)pointer)[-1]);
+	}
+}
+
+void* operator new(size_t size)
+{
+	void* pointer = Allocate(size);
+	if (pointer == nullptr) throw std::bad_alloc();
+	return pointer;
+}
+
+void* operator new[](size_t size)
+{
+	void* pointer = Allocate(size);
+	if (pointer == nullptr) throw std::bad_alloc();
+	return pointer;
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept { return Allocate(size); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { return Allocate(size); }
+
+void operator delete(void* pointer) noexcept { std::free(pointer); }
+void operator delete[](void* pointer) noexcept { std::free(pointer); }
+void operator delete(void* pointer, size_t) noexcept { std::free(pointer); }
+void operator delete[](void* pointer, size_t) noexcept { std::free(pointer); }
+void operator delete(void* pointer, const std::nothrow_t&) noexcept { std::free(pointer); }
+void operator delete[](void* pointer, const std::nothrow_t&) noexcept { std::free(pointer); }
+
+void* operator new(size_t size, std::align_val_t alignment)
+{
+	void* pointer = Allocate(size, alignment);
+	if (pointer == nullptr) throw std::bad_alloc();
+	return pointer;
+}
+
+void* operator new[](size_t size, std::align_val_t alignment)
+{
+	void* pointer = Allocate(size, alignment);
+	if (pointer == nullptr) throw std::bad_alloc();
+	return pointer;
+}
+
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept { return Allocate(size, alignment); }
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept { return Allocate(size, alignment); }
+
+void operator delete(void* pointer, std::align_val_t alignment) noexcept { Free(pointer, alignment); }
+void operator delete[](void* pointer, std::align_val_t alignment) noexcept { Free(pointer, alignment); }
+void operator delete(void* pointer, size_t, std::align_val_t alignment) noexcept { Free(pointer, alignment); }
+void operator delete[](void* pointer, size_t, std::align_val_t alignment) noexcept { Free(pointer, alignment); }
+void operator delete(void* pointer, std::align_val_t alignment, const std::nothrow_t&) noexcept { Free(pointer, alignment); }
+void operator delete[](void* pointer, std::align_val_t alignment, const std::nothrow_t&) noexcept { Free(pointer, alignment); }
+
+#endif
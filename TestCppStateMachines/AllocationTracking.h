@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+
+// Opt-in allocation counting for tests. With TRACK_ALLOCATIONS defined, AllocationTracking.cpp replaces the
+// global allocation functions of the test executable and counts every allocation made by a thread while it
+// holds a CAllocationCounter.
+
+namespace AllocationTracking
+{
+	// False when the test executable was built without the replaced allocation functions
+	bool Enabled();
+
+	// Counts the allocations of the constructing thread until destroyed; counters nest
+	class CAllocationCounter
+	{
+	private:
+		CAllocationCounter* m_pOuter;
+		size_t m_count;
+
+	public:
+		CAllocationCounter();
+		~CAllocationCounter();
+
+		CAllocationCounter(const CAllocationCounter&) = delete;
+		CAllocationCounter& operator=(const CAllocationCounter&) = delete;
+
+		size_t Count() const { return m_count; }
+
+		// Called by the replaced allocation functions
+		static void Record();
+	};
+}
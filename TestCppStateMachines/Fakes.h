@@ -3,6 +3,7 @@
 //#include "FSMInterfaces.h"
 #include "export.h"
 #include <exception>
+#include <string>
 
 namespace Fakes
 {
@@ -16,8 +17,12 @@ namespace Fakes
 
 	class FakeState : public FSM::IState<TestTriggers, TestStates>
 	{
+	private:
+		// Every trigger leads here
+		const TestStates m_target;
+
 	public:
-		FakeState(const TestStates& state) : IState<TestTriggers, TestStates>(state, false) {  }
+		FakeState(const TestStates& state) : IState<TestTriggers, TestStates>(state, false), m_target(TestStates::TestState1) {  }
 		virtual ~FakeState() { /* Needs to remain empty */ }
 
 
@@ -30,14 +35,53 @@ namespace Fakes
 		{
 		}
 
-// Disable returning address of local variable or temporary, since this is a fake
-#pragma warning( push )
-#pragma warning( disable : 4172)
-		virtual const TestStates& FindStateForTrigger(const TestTriggers& trigger) override
+		virtual const TestStates& FindStateForTrigger(const TestTriggers&) override
 		{
-			return TestStates::TestState1;
+			return m_target;
 		}
-#pragma warning( pop ) 
+	};
+
+
+
+	class FakeConfigurableState : public FakeState, public FSM::IStateConfigurator<TestTriggers, TestStates>
+	{
+	public:
+		FakeConfigurableState(const TestStates& state) : FakeState(state) {  }
+
+		// Inherited via IStateConfigurator
+		virtual IStateConfigurator<TestTriggers, TestStates>* AddTrigger(const TestTriggers&, const TestStates&) override { return this; }
+		virtual IStateConfigurator<TestTriggers, TestStates>* OnEntry(FSM::ICallback*) override { return this; }
+		virtual IStateConfigurator<TestTriggers, TestStates>* OnEntry(FSM::state_change_callback) override { return this; }
+		virtual IStateConfigurator<TestTriggers, TestStates>* OnExit(FSM::ICallback*) override { return this; }
+		virtual IStateConfigurator<TestTriggers, TestStates>* OnExit(FSM::state_change_callback) override { return this; }
+		virtual FSM::IState<TestTriggers, TestStates>* State() override { return this; }
+
+		// Inherited via IState
+		virtual IStateConfigurator<TestTriggers, TestStates>* Configurator() override { return this; }
+
+		// Both IState & IStateConfigurator declare these, keep the state's
+		using FakeState::OnEntry;
+		using FakeState::OnExit;
+	};
+
+
+
+	// Declared with FSM_STATE only, without overriding Configurator(); its configurator is found from its type
+	class FakeDeclaredState : FSM_STATE(TestTriggers, TestStates)
+	{
+	public:
+		FakeDeclaredState(const TestStates& state) : IState<TestTriggers, TestStates>(state, false) {  }
+
+		virtual const TestStates& FindStateForTrigger(const TestTriggers&) override { return StateType; }
+		virtual void OnEntry() override { }
+		virtual void OnExit() override { }
+
+		virtual IStateConfigurator<TestTriggers, TestStates>* AddTrigger(const TestTriggers&, const TestStates&) override { return this; }
+		virtual IStateConfigurator<TestTriggers, TestStates>* OnEntry(FSM::ICallback*) override { return this; }
+		virtual IStateConfigurator<TestTriggers, TestStates>* OnEntry(FSM::state_change_callback) override { return this; }
+		virtual IStateConfigurator<TestTriggers, TestStates>* OnExit(FSM::ICallback*) override { return this; }
+		virtual IStateConfigurator<TestTriggers, TestStates>* OnExit(FSM::state_change_callback) override { return this; }
+		virtual FSM::IState<TestTriggers, TestStates>* State() override { return this; }
 	};
 
 
@@ -53,6 +97,26 @@ namespace Fakes
 		}
 	};
 
+
+
+	// Connection: 0 idle, 1 open, 2 authenticated; trigger 0 closes, 1 opens, 2 authenticates
+	inline void ConfigureConnection(FSM::CFiniteStateMachine<int, int>& fsm)
+	{
+		fsm.Configure(0)->AddTrigger(1, 1);
+		fsm.Configure(1)->AddTrigger(0, 0)->AddTrigger(2, 2);
+		fsm.Configure(2)->AddTrigger(0, 0)->AddTrigger(1, 1);
+	}
+
+
+
+	// How often 'part' occurs in 'text', overlaps included
+	inline size_t Occurrences(const std::string& text, const std::string& part)
+	{
+		size_t count = 0;
+		for (size_t i = text.find(part); i != std::string::npos; i = text.find(part, i + 1)) ++count;
+		return count;
+	}
+
 }
 
 
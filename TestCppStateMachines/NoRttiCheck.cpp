@@ -0,0 +1,37 @@
+// Compiled without RTTI by the build, so the library headers cannot come to rely on dynamic_cast or typeid again
+
+#include "export.h"
+
+namespace
+{
+	enum class ECheckTriggers { Go };
+	enum class ECheckStates { Idle, Busy };
+
+	class CDeclaredState : FSM_STATE(ECheckTriggers, ECheckStates)
+	{
+	public:
+		CDeclaredState() : IState<ECheckTriggers, ECheckStates>(ECheckStates::Busy, false) {  }
+
+		virtual const ECheckStates& FindStateForTrigger(const ECheckTriggers&) override { return StateType; }
+		virtual void OnEntry() override { }
+		virtual void OnExit() override { }
+
+		virtual IStateConfigurator<ECheckTriggers, ECheckStates>* AddTrigger(const ECheckTriggers&, const ECheckStates&) override { return this; }
+		virtual IStateConfigurator<ECheckTriggers, ECheckStates>* OnEntry(FSM::ICallback*) override { return this; }
+		virtual IStateConfigurator<ECheckTriggers, ECheckStates>* OnEntry(FSM::state_change_callback) override { return this; }
+		virtual IStateConfigurator<ECheckTriggers, ECheckStates>* OnExit(FSM::ICallback*) override { return this; }
+		virtual IStateConfigurator<ECheckTriggers, ECheckStates>* OnExit(FSM::state_change_callback) override { return this; }
+		virtual FSM::IState<ECheckTriggers, ECheckStates>* State() override { return this; }
+	};
+}
+
+// Instantiates the machine, its virtual members included
+bool NoRttiCheck()
+{
+	FSM::CFiniteStateMachine<ECheckTriggers, ECheckStates> fsm(ECheckStates::Idle);
+	fsm.Configure(ECheckStates::Idle)->AddTrigger(ECheckTriggers::Go, ECheckStates::Busy);
+
+	CDeclaredState declared;
+	FSM::IFiniteStateMachine<ECheckTriggers, ECheckStates>& machine = fsm;
+	return fsm.AddState(ECheckStates::Busy, &declared) && !machine.AddState(ECheckStates::Busy, &declared);
+}
@@ -0,0 +1,169 @@
+#include "stdafx.h"
+
+#include <catch2/catch.hpp>
+
+#include "export.h"
+#include "CCompiledStateMachine.h"
+#include "CWorkloadGenerator.h"
+#include "AllocationTracking.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace FSM;
+using namespace AllocationTracking;
+
+
+
+
+TEST_CASE("Allocation Tracking - Counts this thread's allocations")
+{
+	if (!Enabled()) WARN("Built without TRACK_ALLOCATIONS, allocations are not counted");
+	if (!Enabled()) return;
+
+	// Counted before any Catch assertion, which may itself allocate while reporting
+	size_t innerCount = 0, outerCount = 0;
+	{
+		CAllocationCounter outer;
+		{
+			CAllocationCounter inner;
+			std::vector<int>* vector = new std::vector<int>(16);
+			delete vector;
+
+			innerCount = inner.Count();
+		}
+		outerCount = outer.Count();
+	}
+	REQUIRE(innerCount == 2);
+	REQUIRE(outerCount == 2);
+
+	SECTION("Over-aligned allocations")
+	{
+		struct alignas(64) SLine { char Bytes[64]; };
+
+		uintptr_t lineAddress = 0, linesAddress = 0;
+		size_t count = 0;
+		{
+			CAllocationCounter counter;
+			SLine* line = new SLine();
+			SLine* lines = new SLine[3];
+			lineAddress = (uintptr_t)line;
+			linesAddress = (uintptr_t)lines;
+			delete line;
+			delete[] lines;
+
+			count = counter.Count();
+		}
+		REQUIRE(lineAddress % 64 == 0);
+		REQUIRE(linesAddress % 64 == 0);
+		REQUIRE(count == 2);
+	}
+}
+
+
+
+
+
+
+
+
+TEST_CASE("Allocation Tracking - Compiled machines fire without allocating")
+{
+	if (!Enabled()) WARN("Built without TRACK_ALLOCATIONS, allocations are not counted");
+	if (!Enabled()) return;
+
+	const ETableLayout layout = GENERATE(DenseTable, CompressedTable);
+	const uint32_t states = GENERATE(100u, 1000u, 100000u);	// 8, 16 & 32 bit indices
+
+	SGraphOptions options;
+	options.States = states;
+	options.Triggers = 16;
+	options.FanOut = PowerLawFanOut;
+	options.ResetTrigger = true;
+	const CGeneratedMachine generated(options);
+
+	std::vector<uint32_t> keys(states);
+	for (uint32_t i = 0; i < states; ++i) keys[i] = i;
+
+	CFiniteStateMachine<uint32_t, uint32_t> fsm(0);
+	generated.Configure(fsm, keys, keys);
+
+	const CCompiledDefinition<uint32_t, uint32_t> definition(fsm, layout);
+	CCompiledStateMachine<uint32_t, uint32_t> compiled(&definition);
+
+	SStreamOptions streamOptions;
+	streamOptions.Distribution = ZipfStream;
+	const std::vector<uint32_t> stream = generated.Stream(streamOptions);
+
+	const size_t transitions = 2000000;
+	size_t allocations = 0, rejected = 0;
+	uintptr_t sink = 0;
+	{
+		CAllocationCounter counter;
+		for (size_t i = 0; i < transitions; ++i)
+		{
+			const uint32_t trigger = stream[i % stream.size()];
+			if (i % 2 == 0) compiled.Fire(trigger);
+			else if (!compiled.TryFire(trigger)) ++rejected;
+
+			// Unknown triggers are only reported, never thrown
+			if (compiled.TryFire(options.Triggers + 1)) ++rejected;
+			sink += *compiled.CurrentState();
+		}
+		allocations = counter.Count();
+	}
+
+	CAPTURE(layout, states, sink);
+	REQUIRE(definition.Layout() == layout);
+	REQUIRE(rejected == 0);
+	REQUIRE(allocations == 0);
+}
+
+
+
+
+
+
+
+
+TEST_CASE("Allocation Tracking - String triggers fire without allocating")
+{
+	if (!Enabled()) WARN("Built without TRACK_ALLOCATIONS, allocations are not counted");
+	if (!Enabled()) return;
+
+	const ETableLayout layout = GENERATE(DenseTable, CompressedTable);
+
+	// Longer than any small string buffer, so copying a trigger would allocate
+	std::vector<std::string> verbs;
+	for (int i = 0; i < 300; ++i) verbs.push_back("A_RATHER_LONG_TRIGGER_NAME_" + std::to_string(i));
+
+	CFiniteStateMachine<std::string, int> fsm(0);
+	for (int i = 0; i < 300; ++i)
+	{
+		fsm.Configure(i)->AddTrigger(verbs[i], (i + 1) % 300);
+	}
+
+	const CCompiledDefinition<std::string, int> definition(fsm, layout);
+	CCompiledStateMachine<std::string, int> compiled(&definition);
+	const std::string unknown = "A_RATHER_LONG_TRIGGER_NAME_THAT_IS_NOT_KNOWN";
+
+	const size_t transitions = 1000000;
+	size_t allocations = 0, rejected = 0;
+	{
+		CAllocationCounter counter;
+		for (size_t i = 0; i < transitions; ++i)
+		{
+			const std::string& trigger = verbs[i % verbs.size()];
+			if (i % 2 == 0) compiled.Fire(trigger);
+			else if (!compiled.TryFireString(trigger)) ++rejected;
+
+			// Unknown, and known but not handled by the current state
+			if (compiled.TryFire(unknown) || compiled.TryFireString(verbs[(i + 150) % verbs.size()])) ++rejected;
+		}
+		allocations = counter.Count();
+	}
+
+	REQUIRE(rejected == 0);
+	REQUIRE(allocations == 0);
+	REQUIRE(*compiled.CurrentState() == (int)(transitions % verbs.size()));
+}
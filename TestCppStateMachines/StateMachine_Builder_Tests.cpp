@@ -0,0 +1,156 @@
+#include "stdafx.h"
+
+#include <catch2/catch.hpp>
+
+#include "export.h"
+#include "CCompiledStateMachine.h"
+#include "CDefinitionBuilder.h"
+#include "Fakes.h"
+#include <algorithm>
+#include <string>
+#include <vector>
+
+using namespace FSM;
+using namespace Fakes;
+
+
+
+
+TEST_CASE("Definition Builder - Matches configured machine")
+{
+	CFiniteStateMachine<std::string, int> fsm(0);
+	CDefinitionBuilder<std::string, int> builder(0);
+	for (int state = 0; state < 50; ++state)
+	{
+		fsm.Configure(state)
+			->AddTrigger("next", (state + 1) % 50)
+			->AddTrigger("skip", (state + 7) % 50)
+			->AddTrigger("reset", 0);
+
+		builder.Add(state, "next", (state + 1) % 50);
+		builder.Add(state, "skip", (state + 7) % 50);
+		builder.Add(state, "reset", 0);
+	}
+
+	const ETableLayout layout = GENERATE(DenseTable, CompressedTable);
+	const unsigned int threads = GENERATE(1u, 4u);
+
+	CCompiledDefinition<std::string, int> configured(fsm, layout);
+	CCompiledDefinition<std::string, int> built = builder.Build(layout, threads);
+
+	REQUIRE(builder.Issues().empty());
+	REQUIRE(built.StateCount() == configured.StateCount());
+	REQUIRE(built.TriggerCount() == configured.TriggerCount());
+	REQUIRE(built.Layout() == layout);
+	REQUIRE(built.Transitions() == configured.Transitions());
+
+	CCompiledStateMachine<std::string, int> compiled(&built);
+	compiled.Fire("skip");
+	compiled.Fire("next");
+	REQUIRE(*compiled.CurrentState() == 8);
+	compiled.FireString("reset");
+	REQUIRE(*compiled.CurrentState() == 0);
+}
+
+
+
+
+
+
+
+
+TEST_CASE("Definition Builder - Large machine in parallel")
+{
+	std::vector<STransitionDefinition<int, int>> transitions;
+	for (int state = 0; state < 20000; ++state)
+	{
+		for (int trigger = 0; trigger < 8; ++trigger)
+		{
+			const STransitionDefinition<int, int> transition = { state, trigger, (state * 31 + trigger * 7 + 1) % 20000 };
+			transitions.push_back(transition);
+		}
+	}
+	std::reverse(transitions.begin(), transitions.end());
+
+	CDefinitionBuilder<int, int> single(0), parallel(0);
+	single.Add(transitions.data(), transitions.size());
+	parallel.Add(transitions.data(), transitions.size());
+
+	CCompiledDefinition<int, int> a = single.Build(DenseTable, 1);
+	CCompiledDefinition<int, int> b = parallel.Build(DenseTable, 8);
+
+	REQUIRE(a.StateCount() == 20000);
+	REQUIRE(a.TriggerCount() == 8);
+	REQUIRE(a.Transitions() == b.Transitions());
+	REQUIRE(a.Transitions().size() == transitions.size());
+	REQUIRE(b.State(b.Next(b.FindState(123), b.FindTrigger(5))) == (123 * 31 + 5 * 7 + 1) % 20000);
+}
+
+
+
+
+
+
+
+
+TEST_CASE("Definition Builder - Duplicates and conflicts")
+{
+	CDefinitionBuilder<TestTriggers, TestStates> builder(TestState1);
+	builder.Add(TestState1, TestTrigger1, TestState2);
+	builder.Add(TestState2, TestTrigger1, TestState3);
+	builder.Add(TestState1, TestTrigger1, TestState2);
+
+	SECTION("Duplicates are reported and kept once")
+	{
+		CCompiledDefinition<TestTriggers, TestStates> definition = builder.Build();
+
+		REQUIRE(definition.Transitions().size() == 2);
+		REQUIRE(builder.Issues().size() == 1);
+		REQUIRE(builder.Issues()[0].From == TestState1);
+		REQUIRE(builder.Issues()[0].Trigger == TestTrigger1);
+		REQUIRE_FALSE(builder.Issues()[0].Conflict);
+	}
+
+	SECTION("Conflicts are all reported and fail the build")
+	{
+		builder.Add(TestState1, TestTrigger1, TestState3);
+		builder.Add(TestState2, TestTrigger1, TestState1);
+
+		REQUIRE_THROWS_AS(builder.Build(), std::invalid_argument);
+		REQUIRE(builder.Issues().size() == 3);
+
+		size_t conflicts = 0;
+		for (const SBuildIssue<TestTriggers, TestStates>& issue : builder.Issues())
+		{
+			if (issue.Conflict) ++conflicts;
+		}
+		REQUIRE(conflicts == 2);
+	}
+}
+
+
+
+
+
+
+
+
+TEST_CASE("Definition Builder - Callbacks")
+{
+	FakeCallback callback;
+	SStateCallbacks callbacks = { nullptr, nullptr, &callback, nullptr };
+
+	CDefinitionBuilder<TestTriggers, TestStates> builder(TestState1);
+	builder.Add(TestState1, TestTrigger1, TestState2);
+	builder.Add(TestState2, TestTrigger2, TestState1);
+	builder.Callbacks(TestState2, callbacks);
+
+	CCompiledDefinition<TestTriggers, TestStates> definition = builder.Build();
+	CCompiledStateMachine<TestTriggers, TestStates> compiled(&definition);
+
+	compiled.Fire(TestTrigger1);
+	compiled.Fire(TestTrigger2);
+	compiled.Fire(TestTrigger1);
+	REQUIRE(callback.CallbackCount == 2);
+	REQUIRE(*compiled.CurrentState() == TestState2);
+}
@@ -0,0 +1,205 @@
+#include "stdafx.h"
+
+#include <catch2/catch.hpp>
+
+#include "export.h"
+#include "CCompiledStateMachine.h"
+#include "CChromeTraceWriter.h"
+#include "Fakes.h"
+#include <chrono>
+#include <sstream>
+#include <string>
+#include <thread>
+
+using namespace FSM;
+using namespace Fakes;
+
+namespace
+{
+	void SlowCallback()
+	{
+		std::this_thread::sleep_for(std::chrono::microseconds(200));
+	}
+
+	// Braces & brackets balance outside of strings
+	bool Balanced(const std::string& json)
+	{
+		int depth = 0;
+		bool inString = false;
+		for (size_t i = 0; i < json.size(); ++i)
+		{
+			const char c = json[i];
+			if (inString)
+			{
+				if (c == '\\') ++i;
+				else if (c == '"') inString = false;
+			}
+			else if (c == '"') inString = true;
+			else if (c == '{' || c == '[') ++depth;
+			else if (c == '}' || c == ']') { if (--depth < 0) return false; }
+		}
+		return depth == 0 && !inString;
+	}
+}
+
+
+
+
+TEST_CASE("Chrome Trace - Writing recorded transitions")
+{
+	CREATE_FSM(fsm, TestState1);
+	fsm.Configure(TestState1)->AddTrigger(TestTrigger1, TestState2)->OnExit(&SlowCallback);
+	fsm.Configure(TestState2)->AddTrigger(TestTrigger2, TestState1)->OnEntry(&SlowCallback);
+
+	const CCompiledDefinition<TestTriggers, TestStates> definition(fsm);
+	CFlightRecorder recorder(64, MultipleWriters);
+	CCompiledStateMachine<TestTriggers, TestStates, CFlightRecorderInstrumentation> first(&definition, CFlightRecorderInstrumentation(&recorder, 1));
+	CCompiledStateMachine<TestTriggers, TestStates, CFlightRecorderInstrumentation> second(&definition, CFlightRecorderInstrumentation(&recorder, 2));
+
+	for (int i = 0; i < 3; ++i)
+	{
+		first.Fire(TestTrigger1);
+		first.Fire(TestTrigger2);
+	}
+	second.Fire(TestTrigger1);
+
+	const std::vector<STransitionRecord> records = recorder.Snapshot();
+	REQUIRE(records.size() == 7);
+
+	SECTION("Records carry callback times")
+	{
+		REQUIRE(records[0].ExitTicks > 0);
+		REQUIRE(records[0].EntryTicks > 0);
+		REQUIRE(records[1].ExitTicks == 0);
+		REQUIRE(records[1].EntryTicks == 0);
+	}
+
+	std::ostringstream out;
+	{
+		CChromeTraceWriter<TestTriggers, TestStates> writer(out, &definition);
+		writer.NameMachine(1, "First \"motor\"");
+		writer.Write(records);
+	}
+	const std::string json = out.str();
+
+	SECTION("Complete JSON")
+	{
+		REQUIRE(json.find("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[") == 0);
+		REQUIRE(json.substr(json.size() - 3) == "]}\n");
+		REQUIRE(Balanced(json));
+	}
+
+	SECTION("One named track per machine")
+	{
+		REQUIRE(Occurrences(json, "\"thread_name\"") == 2);
+		REQUIRE(json.find("\"name\":\"First \\\"motor\\\"\"") != std::string::npos);
+		REQUIRE(json.find("\"name\":\"Machine 2\"") != std::string::npos);
+	}
+
+	SECTION("States are slices, callbacks nested slices")
+	{
+		REQUIRE(Occurrences(json, "\"ph\":\"B\"") == Occurrences(json, "\"ph\":\"E\""));
+		REQUIRE(Occurrences(json, "\"ph\":\"B\"") == 7 + 2);
+		REQUIRE(Occurrences(json, "\"name\":\"OnExit 0\"") == 4);
+		REQUIRE(Occurrences(json, "\"name\":\"OnEntry 1\"") == 4);
+		REQUIRE(Occurrences(json, "\"args\":{\"trigger\":\"0\"}") == 4);
+	}
+
+	SECTION("Overlapping snapshots are written once")
+	{
+		std::ostringstream twice;
+		{
+			CChromeTraceWriter<TestTriggers, TestStates> writer(twice, &definition);
+			writer.NameMachine(1, "First \"motor\"");
+			writer.Write(records);
+			writer.Write(recorder.Snapshot());
+		}
+		REQUIRE(twice.str() == json);
+	}
+}
+
+
+
+
+
+
+
+
+TEST_CASE("Chrome Trace - Gaps & closed traces")
+{
+	CREATE_FSM(fsm, TestState1);
+	fsm.Configure(TestState1)->AddTrigger(TestTrigger1, TestState2);
+	fsm.Configure(TestState2)->AddTrigger(TestTrigger2, TestState3);
+	fsm.Configure(TestState3)->AddTrigger(TestTrigger3, TestState1);
+
+	const CCompiledDefinition<TestTriggers, TestStates> definition(fsm);
+	CFlightRecorder recorder(2);
+	CCompiledStateMachine<TestTriggers, TestStates, CFlightRecorderInstrumentation> machine(&definition, CFlightRecorderInstrumentation(&recorder, 1));
+
+	std::ostringstream out;
+	CChromeTraceWriter<TestTriggers, TestStates> writer(out, &definition);
+
+	SECTION("Overwritten records end the open state")
+	{
+		// 0 -> 1, drained; 1 -> 2 & 2 -> 0 get overwritten by 0 -> 1 & 1 -> 2
+		machine.Fire(TestTrigger1);
+		writer.Write(recorder.Snapshot());
+		machine.Fire(TestTrigger2);
+		machine.Fire(TestTrigger3);
+		machine.Fire(TestTrigger1);
+		machine.Fire(TestTrigger2);
+		const std::vector<STransitionRecord> records = recorder.Snapshot();
+		REQUIRE(records.front().From == definition.FindState(TestState1));
+		writer.Write(records);
+		writer.Close();
+
+		const std::string json = out.str();
+		REQUIRE(Balanced(json));
+		REQUIRE(Occurrences(json, "\"ph\":\"B\"") == Occurrences(json, "\"ph\":\"E\""));
+		REQUIRE(Occurrences(json, "\"ph\":\"B\"") == 5);
+		REQUIRE(Occurrences(json, "{\"ph\":\"E\",\"name\":\"1\"") == 2);
+		REQUIRE(Occurrences(json, "{\"ph\":\"E\",\"name\":\"0\"") == 2);
+		REQUIRE(Occurrences(json, "{\"ph\":\"E\",\"name\":\"2\"") == 1);
+	}
+
+	SECTION("Nothing is written once closed")
+	{
+		machine.Fire(TestTrigger1);
+		writer.Close();
+		const std::string json = out.str();
+
+		REQUIRE_THROWS_AS(writer.Write(recorder.Snapshot()), std::runtime_error);
+		REQUIRE_THROWS_AS(writer.NameMachine(2, "Late"), std::runtime_error);
+		writer.Close();
+		REQUIRE(out.str() == json);
+		REQUIRE(Balanced(json));
+	}
+
+	SECTION("Records without ticks are rejected")
+	{
+		CFlightRecorder coarse(2, SingleWriter, CoarseTimestamps);
+		CCompiledStateMachine<TestTriggers, TestStates, CFlightRecorderInstrumentation> other(&definition, CFlightRecorderInstrumentation(&coarse, 2));
+		other.Fire(TestTrigger1);
+
+		REQUIRE_THROWS_AS(writer.Write(coarse), std::invalid_argument);
+		REQUIRE_THROWS_AS(writer.Write(coarse.Snapshot(), NoTimestamps), std::invalid_argument);
+
+		machine.Fire(TestTrigger1);
+		writer.Write(recorder);
+		writer.Close();
+		REQUIRE(out.str().find("\"tid\":2") == std::string::npos);
+		REQUIRE(Occurrences(out.str(), "\"ph\":\"B\"") == 2);
+	}
+
+	SECTION("Records of another definition are rejected")
+	{
+		STransitionRecord record = { 1000, 0, 0, 1, 3, 0, 0 };
+		const uint32_t field = GENERATE(0u, 1u, 2u);
+		(field == 0 ? record.From : field == 1 ? record.To : record.Trigger) = 3;
+
+		REQUIRE_THROWS_AS(writer.Write(record), std::invalid_argument);
+		writer.Close();
+		REQUIRE(out.str().find("\"tid\":3") == std::string::npos);
+		REQUIRE(Balanced(out.str()));
+	}
+}
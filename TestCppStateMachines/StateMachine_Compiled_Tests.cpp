@@ -0,0 +1,529 @@
+#include "stdafx.h"
+
+#include <catch2/catch.hpp>
+
+#include "export.h"
+#include "CCompiledStateMachine.h"
+#include "Fakes.h"
+#include <memory>
+
+using namespace FSM;
+using namespace Fakes;
+
+
+
+
+
+
+
+
+TEST_CASE("Compiled State Machine - Firing")
+{
+	CREATE_FSM(fsm, TestState1);
+	fsm.Configure(TestState1)->AddTrigger(TestTrigger1, TestState2);
+	fsm.Configure(TestState2)->AddTrigger(TestTrigger2, TestState1);
+
+	CCompiledDefinition<TestTriggers, TestStates> definition(fsm);
+	CCompiledStateMachine<TestTriggers, TestStates> compiled(&definition);
+
+	SECTION("Starts in machine's current state")
+	{
+		REQUIRE(*compiled.CurrentState() == TestState1);
+	}
+
+	SECTION("Fire initialized trigger, changes state")
+	{
+		compiled.Fire(TestTrigger1);
+		REQUIRE(*compiled.CurrentState() == TestState2);
+
+		compiled.Fire(TestTrigger2);
+		REQUIRE(*compiled.CurrentState() == TestState1);
+	}
+
+	SECTION("Fire unregistered trigger, throws")
+	{
+		REQUIRE_THROWS_AS(compiled.Fire(TestTrigger3), std::runtime_error);
+	}
+
+	SECTION("Fire trigger not handled by current state, throws")
+	{
+		REQUIRE_THROWS_AS(compiled.Fire(TestTrigger2), std::runtime_error);
+		REQUIRE_THROWS_AS(fsm.Fire(TestTrigger2), std::runtime_error);
+		REQUIRE(*compiled.CurrentState() == TestState1);
+	}
+
+	SECTION("TryFire handled trigger, changes state")
+	{
+		REQUIRE(compiled.TryFire(TestTrigger1));
+		REQUIRE(*compiled.CurrentState() == TestState2);
+	}
+
+	SECTION("TryFire rejected triggers, returns false and keeps state")
+	{
+		REQUIRE_FALSE(compiled.TryFire(TestTrigger3));
+		REQUIRE_FALSE(compiled.TryFire(TestTrigger2));
+		REQUIRE(*compiled.CurrentState() == TestState1);
+	}
+}
+
+
+
+
+
+
+
+
+TEST_CASE("Compiled State Machine - Uninitialized target")
+{
+	CREATE_FSM(fsm, TestState1);
+	fsm.Configure(TestState1)->AddTrigger(TestTrigger1, TestState2);
+
+	CCompiledDefinition<TestTriggers, TestStates> definition(fsm);
+	CCompiledStateMachine<TestTriggers, TestStates> compiled(&definition);
+
+	REQUIRE_THROWS(compiled.Fire(TestTrigger1));
+	REQUIRE(*compiled.CurrentState() == TestState1);
+}
+
+
+
+
+
+
+
+
+TEST_CASE("Compiled State Machine - Callbacks")
+{
+	CREATE_FSM(fsm, TestState1);
+	FakeCallback onExitCallback, onEntryCallback;
+	fsm.Configure(TestState1)->AddTrigger(TestTrigger1, TestState2)->OnExit(&onExitCallback);
+	fsm.Configure(TestState2)->OnEntry(&onEntryCallback);
+
+	CCompiledDefinition<TestTriggers, TestStates> definition(fsm);
+	CCompiledStateMachine<TestTriggers, TestStates> compiled(&definition);
+
+	compiled.Fire(TestTrigger1);
+
+	REQUIRE(onExitCallback.CallbackCount == 1);
+	REQUIRE(onEntryCallback.CallbackCount == 1);
+}
+
+
+
+
+
+
+
+
+TEST_CASE("Compiled State Machine - Custom states cannot be compiled")
+{
+	CREATE_FSM(fsm, TestState1);
+	FakeState state(TestState3);
+	fsm.AddState(TestState3, &state);
+
+	REQUIRE_THROWS(CCompiledDefinition<TestTriggers, TestStates>(fsm));
+}
+
+
+
+
+
+
+
+
+TEST_CASE("Compiled State Machine - String triggers")
+{
+	std::vector<std::string> verbs;
+	for (int i = 0; i < 300; ++i) verbs.push_back("VERB_" + std::to_string(i));
+
+	CFiniteStateMachine<std::string, int> fsm(0);
+	for (int i = 0; i < 300; ++i)
+	{
+		fsm.Configure(i)->AddTrigger(verbs[i], (i + 1) % 300)->AddTrigger("RESET", 0);
+	}
+
+	CCompiledDefinition<std::string, int> definition(fsm);
+	CCompiledStateMachine<std::string, int> compiled(&definition);
+
+	SECTION("Every trigger has a unique index")
+	{
+		REQUIRE(definition.TriggerCount() == 301);
+		for (uint32_t i = 0; i < definition.TriggerCount(); ++i)
+		{
+			REQUIRE(definition.FindTrigger(definition.Trigger(i)) == i);
+		}
+	}
+
+	SECTION("Unknown triggers are rejected")
+	{
+		REQUIRE(definition.FindTriggerString("VERB_300") == InvalidIndex);
+		REQUIRE(definition.FindTriggerString("") == InvalidIndex);
+		REQUIRE_THROWS_AS(compiled.FireString("NOT_A_VERB"), std::runtime_error);
+		REQUIRE_FALSE(compiled.TryFireString("NOT_A_VERB"));
+		REQUIRE(*compiled.CurrentState() == 0);
+	}
+
+	SECTION("FireString walks the machine")
+	{
+		for (int i = 0; i < 300; ++i)
+		{
+			compiled.FireString(verbs[i]);
+		}
+		REQUIRE(*compiled.CurrentState() == 0);
+
+		compiled.FireString("VERB_0");
+		compiled.FireString("RESET");
+		REQUIRE(*compiled.CurrentState() == 0);
+	}
+}
+
+
+
+
+
+
+
+
+TEST_CASE("Compiled State Machine - Compressed table")
+{
+	// Sparse machine: every state handles a handful of the 64 triggers
+	CFiniteStateMachine<int, int> fsm(0);
+	for (int state = 0; state < 500; ++state)
+	{
+		IStateConfigurator<int, int>* configurator = fsm.Configure(state);
+		for (int k = 0; k < 1 + state % 5; ++k)
+		{
+			configurator->AddTrigger((state * 7 + k * 13) % 64, (state * 31 + k) % 500);
+		}
+	}
+
+	CCompiledDefinition<int, int> dense(fsm, DenseTable);
+	CCompiledDefinition<int, int> compressed(fsm, CompressedTable);
+
+	REQUIRE(compressed.Layout() == CompressedTable);
+	REQUIRE(compressed.TableBytes() < dense.TableBytes());
+
+	SECTION("Same transitions as dense table")
+	{
+		bool same = true;
+		for (uint32_t state = 0; state < dense.StateCount(); ++state)
+		{
+			for (uint32_t trigger = 0; trigger < dense.TriggerCount(); ++trigger)
+			{
+				same = same && dense.Next(state, trigger) == compressed.Next(state, trigger);
+			}
+		}
+		REQUIRE(same);
+	}
+
+	SECTION("Firing follows the same path")
+	{
+		CCompiledStateMachine<int, int> a(&dense), b(&compressed);
+		for (int i = 0; i < 1000; ++i)
+		{
+			const int trigger = (*a.CurrentState() * 7) % 64;
+			a.Fire(trigger);
+			b.Fire(trigger);
+			REQUIRE(*a.CurrentState() == *b.CurrentState());
+		}
+	}
+}
+
+
+
+
+
+
+
+
+TEST_CASE("Compiled State Machine - Index width")
+{
+	const auto compileRing = [](int states, ETableLayout layout)
+	{
+		CFiniteStateMachine<int, int> fsm(0);
+		for (int state = 0; state < states; ++state)
+		{
+			fsm.Configure(state)->AddTrigger(0, (state + 1) % states);
+		}
+		return std::make_unique<CCompiledDefinition<int, int>>(fsm, layout);
+	};
+
+	const ETableLayout layout = GENERATE(DenseTable, CompressedTable);
+
+	SECTION("Narrowest width that fits the state count")
+	{
+		REQUIRE(compileRing(254, layout)->IndexBytes() == 1);
+		REQUIRE(compileRing(255, layout)->IndexBytes() == 2);
+		REQUIRE(compileRing(65534, layout)->IndexBytes() == 2);
+		REQUIRE(compileRing(65535, layout)->IndexBytes() == 4);
+	}
+
+	SECTION("Transitions survive narrowing")
+	{
+		const int sizes[] = { 254, 255, 65535 };
+		for (int states : sizes)
+		{
+			std::unique_ptr<CCompiledDefinition<int, int>> definition = compileRing(states, layout);
+			REQUIRE(definition->Next(states - 1, 0) == 0);
+			REQUIRE(definition->Next(states - 2, 0) == (uint32_t)states - 1);
+		}
+	}
+}
+
+
+
+
+
+
+
+
+TEST_CASE("Compiled State Machine - Automatic layout")
+{
+	SECTION("Full machine gets a dense table")
+	{
+		CFiniteStateMachine<int, int> fsm(0);
+		for (int state = 0; state < 100; ++state)
+		{
+			for (int trigger = 0; trigger < 8; ++trigger) fsm.Configure(state)->AddTrigger(trigger, (state + trigger) % 100);
+		}
+
+		CCompiledDefinition<int, int> definition(fsm);
+		REQUIRE(definition.Layout() == DenseTable);
+		REQUIRE(definition.TableChoice().Requested == AutoTable);
+		REQUIRE(definition.TableChoice().Layout == DenseTable);
+		REQUIRE(definition.TableChoice().Shape.Density == Approx(1));
+		REQUIRE(definition.TableChoice().Reason.find("dense is smaller") != std::string::npos);
+	}
+
+	// Every state handles a handful of the 64 triggers
+	CFiniteStateMachine<int, int> sparse(0);
+	for (int state = 0; state < 500; ++state)
+	{
+		for (int k = 0; k < 1 + state % 5; ++k) sparse.Configure(state)->AddTrigger((state * 7 + k * 13) % 64, (state * 31 + k) % 500);
+	}
+
+	SECTION("Sparse machine gets a compressed table")
+	{
+		CCompiledDefinition<int, int> definition(sparse);
+		const STableChoice& choice = definition.TableChoice();
+		REQUIRE(definition.Layout() == CompressedTable);
+		REQUIRE(choice.Shape.States == 500);
+		REQUIRE(choice.Shape.Triggers == 64);
+		REQUIRE(choice.Shape.MaxFanOut == 5);
+		REQUIRE(choice.Shape.MeanFanOut == Approx(3));
+		REQUIRE(choice.CompressedBytes < choice.DenseBytes);
+		REQUIRE(choice.IndexBytes == definition.IndexBytes());
+
+		std::vector<uint32_t> mapping;
+		REQUIRE(definition.Minimize(mapping).TableChoice().Requested == AutoTable);
+	}
+
+	SECTION("Layout can be overridden")
+	{
+		CCompiledDefinition<int, int> definition(sparse, DenseTable);
+		REQUIRE(definition.Layout() == DenseTable);
+		REQUIRE(definition.TableChoice().Requested == DenseTable);
+		REQUIRE(definition.TableChoice().Reason == "dense table requested; the cost model would pick compressed");
+
+		std::vector<uint32_t> mapping;
+		REQUIRE(definition.Minimize(mapping).Layout() == DenseTable);
+	}
+
+	SECTION("Larger table is picked when it is cheap enough")
+	{
+		// Dense fits the L1 cache, compressed is smaller but takes two reads
+		STableShape shape;
+		shape.States = 200;
+		shape.Triggers = 64;
+		shape.Transitions = 1920;
+
+		STableChoice choice = ChooseTableLayout(shape);
+		REQUIRE(choice.CompressedBytes < choice.DenseBytes);
+		REQUIRE(choice.Layout == DenseTable);
+		REQUIRE(choice.Reason.find("worth") != std::string::npos);
+
+		STableCostModel model;
+		model.SizePremium = 0.9;
+		choice = ChooseTableLayout(shape, model);
+		REQUIRE(choice.Layout == CompressedTable);
+		REQUIRE(choice.Reason.find("not worth") != std::string::npos);
+	}
+
+	SECTION("Huge sparse machine stays out of memory")
+	{
+		STableShape shape;
+		shape.States = 1 << 20;
+		shape.Triggers = 64;
+		shape.Transitions = 4 << 20;
+
+		const STableChoice choice = ChooseTableLayout(shape);
+		REQUIRE(choice.IndexBytes == 4);
+		REQUIRE(choice.DenseBytes == (size_t)256 << 20);
+		REQUIRE(choice.Layout == CompressedTable);
+	}
+}
+
+
+
+
+
+
+
+
+TEST_CASE("Compiled State Machine - Minimize")
+{
+	// 3 & 4 only handle trigger 1 back to 0, so they are equivalent, which makes 1 & 2 equivalent too
+	CFiniteStateMachine<int, int> fsm(0);
+	fsm.Configure(0)->AddTrigger(0, 1)->AddTrigger(1, 2);
+	fsm.Configure(1)->AddTrigger(0, 3);
+	fsm.Configure(2)->AddTrigger(0, 4);
+	fsm.Configure(3)->AddTrigger(1, 0);
+	fsm.Configure(4)->AddTrigger(1, 0);
+	fsm.Configure(5)->AddTrigger(0, 5);
+
+	const ETableLayout layout = GENERATE(DenseTable, CompressedTable);
+
+	SECTION("Equivalent states are merged")
+	{
+		CCompiledDefinition<int, int> definition(fsm, layout);
+		std::vector<uint32_t> mapping;
+		CCompiledDefinition<int, int> minimized = definition.Minimize(mapping);
+
+		REQUIRE(minimized.StateCount() == 4);
+		REQUIRE(minimized.Layout() == layout);
+		REQUIRE(mapping == std::vector<uint32_t>({ 0, 1, 1, 2, 2, 3 }));
+		REQUIRE(minimized.FindState(4) == 2);
+
+		CCompiledStateMachine<int, int> compiled(&minimized);
+		compiled.Fire(1);
+		compiled.Fire(0);
+		REQUIRE(*compiled.CurrentState() == 3);
+		REQUIRE_THROWS(compiled.Fire(0));
+		compiled.Fire(1);
+		REQUIRE(*compiled.CurrentState() == 0);
+	}
+
+	SECTION("States with different callbacks are kept apart")
+	{
+		FakeCallback callback;
+		fsm.Configure(4)->OnEntry(&callback);
+
+		CCompiledDefinition<int, int> definition(fsm, layout);
+		std::vector<uint32_t> mapping;
+		CCompiledDefinition<int, int> minimized = definition.Minimize(mapping);
+
+		REQUIRE(minimized.StateCount() == 6);
+
+		CCompiledStateMachine<int, int> compiled(&minimized);
+		compiled.Fire(1);
+		compiled.Fire(0);
+		REQUIRE(callback.CallbackCount == 1);
+	}
+}
+
+
+
+
+
+
+
+
+TEST_CASE("Compiled State Machine - Minimize preserves transitions")
+{
+	// Every state's transitions only depend on state % 12, so 300 states collapse into at most 12
+	CFiniteStateMachine<int, int> fsm(0);
+	for (int state = 0; state < 300; ++state)
+	{
+		IStateConfigurator<int, int>* configurator = fsm.Configure(state);
+		for (int trigger = 0; trigger < 8; ++trigger)
+		{
+			if ((state + trigger) % 3 == 0) configurator->AddTrigger(trigger, (state * 5 + trigger * 12) % 300);
+		}
+	}
+
+	CCompiledDefinition<int, int> definition(fsm);
+	std::vector<uint32_t> mapping;
+	CCompiledDefinition<int, int> minimized = definition.Minimize(mapping);
+
+	REQUIRE(minimized.StateCount() <= 12);
+
+	bool consistent = true;
+	for (uint32_t state = 0; state < definition.StateCount(); ++state)
+	{
+		for (uint32_t trigger = 0; trigger < definition.TriggerCount(); ++trigger)
+		{
+			const uint32_t next = definition.Next(state, trigger);
+			const uint32_t expected = next == InvalidIndex ? InvalidIndex : mapping[next];
+			consistent = consistent && minimized.Next(mapping[state], trigger) == expected;
+		}
+	}
+	REQUIRE(consistent);
+
+	std::vector<uint32_t> again;
+	REQUIRE(minimized.Minimize(again).StateCount() == minimized.StateCount());
+}
+
+
+
+
+
+
+
+
+TEST_CASE("Compiled State Machine - Equivalence")
+{
+	const auto configureRing = [](CFiniteStateMachine<std::string, int>& fsm, int states)
+	{
+		for (int state = 0; state < states; ++state)
+		{
+			fsm.Configure(state)
+				->AddTrigger("next", (state + 1) % states)
+				->AddTrigger("reset", 0);
+		}
+	};
+
+	CFiniteStateMachine<std::string, int> ring4(0), ring8(0);
+	configureRing(ring4, 4);
+	configureRing(ring8, 8);
+
+	CCompiledDefinition<std::string, int> a(ring4), b(ring8, CompressedTable);
+	std::vector<std::string> counterexample;
+
+	SECTION("Definition is equivalent to itself and its minimized form")
+	{
+		std::vector<uint32_t> mapping;
+		REQUIRE(AreEquivalent(a, a, counterexample));
+		REQUIRE(AreEquivalent(a, a.Minimize(mapping), counterexample));
+		REQUIRE(counterexample.empty());
+	}
+
+	SECTION("Rings of different lengths are equivalent without callbacks")
+	{
+		REQUIRE(AreEquivalent(a, b, counterexample));
+	}
+
+	SECTION("Missing transition is found")
+	{
+		CFiniteStateMachine<std::string, int> broken(0);
+		configureRing(broken, 4);
+		broken.Configure(2)->AddTrigger("halt", 2);
+
+		CCompiledDefinition<std::string, int> c(broken);
+		REQUIRE_FALSE(AreEquivalent(a, c, counterexample));
+		REQUIRE(counterexample == std::vector<std::string>({ "next", "next", "halt" }));
+	}
+
+	SECTION("Differing callbacks are found")
+	{
+		FakeCallback callback;
+		ring8.Configure(5)->OnEntry(&callback);
+
+		CCompiledDefinition<std::string, int> c(ring8);
+		REQUIRE_FALSE(AreEquivalent(a, c, counterexample));
+		REQUIRE(counterexample.size() == 5);
+
+		CCompiledStateMachine<std::string, int> compiled(&c);
+		for (const std::string& trigger : counterexample) compiled.Fire(trigger);
+		REQUIRE(callback.CallbackCount == 1);
+	}
+}
@@ -0,0 +1,300 @@
+#include "stdafx.h"
+
+#include <catch2/catch.hpp>
+
+#include "export.h"
+#include "CDefinitionBuilder.h"
+#include "CDefinitionImage.h"
+#include "Fakes.h"
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace FSM;
+using namespace Fakes;
+
+namespace
+{
+	// Two equivalent branches which meet again: 1 & 2 as well as 3 & 4 merge when minimized
+	void ConfigureBranches(CFiniteStateMachine<int, int>& fsm)
+	{
+		fsm.Configure(0)->AddTrigger(0, 1)->AddTrigger(1, 2);
+		fsm.Configure(1)->AddTrigger(0, 3);
+		fsm.Configure(2)->AddTrigger(0, 4);
+		fsm.Configure(3)->AddTrigger(1, 0);
+		fsm.Configure(4)->AddTrigger(1, 0);
+		fsm.Configure(5)->AddTrigger(0, 5);
+	}
+
+	void WriteBytes(const std::string& path, const std::vector<char>& bytes)
+	{
+		std::FILE* file = std::fopen(path.c_str(), "wb");
+		std::fwrite(bytes.data(), 1, bytes.size(), file);
+		std::fclose(file);
+	}
+
+	std::vector<char> ReadBytes(const std::string& path)
+	{
+		std::vector<char> bytes;
+		std::FILE* file = std::fopen(path.c_str(), "rb");
+		for (int c = std::fgetc(file); c != EOF; c = std::fgetc(file)) bytes.push_back((char)c);
+		std::fclose(file);
+		return bytes;
+	}
+}
+
+
+
+
+TEST_CASE("Definition image - Round trip")
+{
+	const std::string path = "definition.fsmimage";
+
+	CFiniteStateMachine<int, int> fsm(0);
+	ConfigureBranches(fsm);
+
+	const ETableLayout layout = GENERATE(DenseTable, CompressedTable);
+	const CCompiledDefinition<int, int> definition(fsm, layout);
+	WriteDefinitionImage(path, definition);
+
+	SECTION("Same machine, read in place")
+	{
+		const EImageCheck check = GENERATE(QuickImageCheck, FullImageCheck);
+		const CCompiledDefinition<int, int> loaded = LoadDefinitionImage<int, int>(path, check);
+		REQUIRE(loaded.Mapped());
+		REQUIRE_FALSE(definition.Mapped());
+
+		REQUIRE(loaded.StateCount() == definition.StateCount());
+		REQUIRE(loaded.TriggerCount() == definition.TriggerCount());
+		REQUIRE(loaded.InitialState() == definition.InitialState());
+		REQUIRE(loaded.Layout() == layout);
+		REQUIRE(loaded.IndexBytes() == definition.IndexBytes());
+		REQUIRE(loaded.TableBytes() == definition.TableBytes());
+		REQUIRE(loaded.TableChoice().Requested == layout);
+		REQUIRE(loaded.Transitions() == definition.Transitions());
+		REQUIRE(DefinitionFingerprint(loaded) == DefinitionFingerprint(definition));
+
+		for (int state = 0; state <= 5; ++state) REQUIRE(loaded.FindState(state) == definition.FindState(state));
+		REQUIRE(loaded.FindState(6) == InvalidIndex);
+		REQUIRE(loaded.FindTrigger(1) == definition.FindTrigger(1));
+		REQUIRE(loaded.FindTrigger(2) == InvalidIndex);
+	}
+
+	SECTION("Callbacks are only dropped when asked to, and bound again by state")
+	{
+		FakeCallback entered, exited;
+		fsm.Configure(3)->OnEntry(&entered);
+		const CCompiledDefinition<int, int> withCallbacks(fsm, layout);
+		REQUIRE_THROWS_AS(WriteDefinitionImage(path, withCallbacks), std::invalid_argument);
+
+		WriteDefinitionImage(path, withCallbacks, true);
+		CCompiledDefinition<int, int> loaded = LoadDefinitionImage<int, int>(path);
+		REQUIRE(DefinitionFingerprint(loaded) == DefinitionFingerprint(withCallbacks));
+		{
+			CCompiledStateMachine<int, int> compiled(&loaded);
+			compiled.Fire(0);
+			compiled.Fire(0);
+			REQUIRE(*compiled.CurrentState() == 3);
+			REQUIRE(entered.CallbackCount == 0);
+		}
+
+		loaded.BindCallbacks(3, { nullptr, nullptr, &entered, nullptr });
+		loaded.BindCallbacks(0, { nullptr, nullptr, nullptr, &exited });
+		REQUIRE_THROWS_AS(loaded.BindCallbacks(6, { nullptr, nullptr, &entered, nullptr }), std::out_of_range);
+
+		CCompiledStateMachine<int, int> compiled(&loaded);
+		compiled.Fire(0);
+		compiled.Fire(0);
+		REQUIRE(*compiled.CurrentState() == 3);
+		REQUIRE(entered.CallbackCount == 1);
+		REQUIRE(exited.CallbackCount == 1);
+		REQUIRE_THROWS(compiled.Fire(0));
+		compiled.Fire(1);
+		REQUIRE(*compiled.CurrentState() == 0);
+	}
+
+	SECTION("Copies keep the image mapped")
+	{
+		CCompiledDefinition<int, int> copy = definition;
+		{
+			const CCompiledDefinition<int, int> loaded = LoadDefinitionImage<int, int>(path);
+			copy = loaded;
+		}
+		std::remove(path.c_str());
+
+		REQUIRE(copy.Transitions() == definition.Transitions());
+		REQUIRE(copy.FindState(4) == definition.FindState(4));
+	}
+
+	SECTION("Minimized definitions keep resolving merged states")
+	{
+		std::vector<uint32_t> mapping;
+		const CCompiledDefinition<int, int> minimized = definition.Minimize(mapping);
+		WriteDefinitionImage(path, minimized);
+
+		const CCompiledDefinition<int, int> loaded = LoadDefinitionImage<int, int>(path);
+		REQUIRE(loaded.StateCount() == 4);
+		REQUIRE(loaded.FindState(2) == minimized.FindState(2));
+		REQUIRE(loaded.FindState(4) == minimized.FindState(4));
+		REQUIRE(loaded.Transitions() == minimized.Transitions());
+	}
+
+	SECTION("Loaded definitions can be minimized & saved again")
+	{
+		const CCompiledDefinition<int, int> loaded = LoadDefinitionImage<int, int>(path);
+
+		std::vector<uint32_t> mapping, expected;
+		const CCompiledDefinition<int, int> minimized = loaded.Minimize(mapping);
+		definition.Minimize(expected);
+		REQUIRE(mapping == expected);
+		REQUIRE(minimized.FindState(4) == mapping[definition.FindState(4)]);
+
+		WriteDefinitionImage(path, loaded);
+		REQUIRE(LoadDefinitionImage<int, int>(path).Transitions() == definition.Transitions());
+	}
+
+	std::remove(path.c_str());
+}
+
+
+
+
+
+
+
+
+TEST_CASE("Definition image - Large machines")
+{
+	const std::string path = "large_definition.fsmimage";
+
+	// 20000 states need 16 bit indices
+	CDefinitionBuilder<int, int> builder(0);
+	for (int state = 0; state < 20000; ++state)
+	{
+		for (int trigger = 0; trigger < 4; ++trigger) builder.Add(state, trigger, (state * 31 + trigger * 7 + 1) % 20000);
+	}
+
+	const ETableLayout layout = GENERATE(DenseTable, CompressedTable);
+	const CCompiledDefinition<int, int> definition = builder.Build(layout);
+	WriteDefinitionImage(path, definition);
+
+	const CCompiledDefinition<int, int> loaded = LoadDefinitionImage<int, int>(path);
+	REQUIRE(loaded.IndexBytes() == 2);
+	REQUIRE(loaded.Layout() == layout);
+	REQUIRE(loaded.Transitions() == definition.Transitions());
+	REQUIRE(loaded.State(loaded.Next(loaded.FindState(123), loaded.FindTrigger(3))) == (123 * 31 + 3 * 7 + 1) % 20000);
+
+	std::remove(path.c_str());
+}
+
+
+
+
+
+
+
+
+TEST_CASE("Definition image - Rejected files")
+{
+	const std::string path = "rejected_definition.fsmimage";
+
+	CFiniteStateMachine<int, int> fsm(0);
+	ConfigureBranches(fsm);
+	const CCompiledDefinition<int, int> definition(fsm);
+	WriteDefinitionImage(path, definition);
+	const std::vector<char> bytes = ReadBytes(path);
+
+	SECTION("Missing & foreign files")
+	{
+		REQUIRE_THROWS_AS((LoadDefinitionImage<int, int>("no_such_definition.fsmimage")), std::runtime_error);
+
+		WriteBytes(path, std::vector<char>(bytes.size(), 'x'));
+		REQUIRE_THROWS_AS((LoadDefinitionImage<int, int>(path)), std::runtime_error);
+
+		WriteBytes(path, std::vector<char>());
+		REQUIRE_THROWS_AS((LoadDefinitionImage<int, int>(path)), std::runtime_error);
+	}
+
+	SECTION("Other state or trigger types")
+	{
+		REQUIRE_THROWS_AS((LoadDefinitionImage<int, long long>(path)), std::invalid_argument);
+		REQUIRE_THROWS_AS((LoadDefinitionImage<char, int>(path)), std::invalid_argument);
+	}
+
+	SECTION("Truncated images")
+	{
+		WriteBytes(path, std::vector<char>(bytes.begin(), bytes.end() - 1));
+		REQUIRE_THROWS_AS((LoadDefinitionImage<int, int>(path)), std::runtime_error);
+	}
+
+	SECTION("Sections outside the image")
+	{
+		std::vector<char> corrupt = bytes;
+		SDefinitionImageHeader header;
+		std::memcpy(&header, corrupt.data(), sizeof(header));
+		header.Table.Offset += ImageAlignment * 1000;
+		std::memcpy(corrupt.data(), &header, sizeof(header));
+
+		WriteBytes(path, corrupt);
+		REQUIRE_THROWS_AS((LoadDefinitionImage<int, int>(path)), std::runtime_error);
+	}
+
+	SECTION("State indices outside the definition")
+	{
+		const ETableLayout layout = GENERATE(DenseTable, CompressedTable);
+		WriteDefinitionImage(path, CCompiledDefinition<int, int>(fsm, layout));
+		std::vector<char> image = ReadBytes(path);
+		SDefinitionImageHeader header;
+		std::memcpy(&header, image.data(), sizeof(header));
+
+		// Table & lookup contents are only read by a full check, the header always
+		bool checkedQuickly = false;
+
+		// The first state's row: its dense next states, or its compressed base
+		SECTION("In the table")
+		{
+			const uint32_t wild = layout == DenseTable ? 200 : 0x7FFFFFFF;
+			if (layout == DenseTable) image[(size_t)header.Table.Offset] = (char)wild;
+			else std::memcpy(&image[(size_t)header.Table.Offset], &wild, sizeof(wild));
+		}
+
+		SECTION("In the state lookups")
+		{
+			const uint32_t wild = 1000;
+			std::memcpy(&image[(size_t)header.IndexOfStates.Offset], &wild, sizeof(wild));
+		}
+
+		SECTION("As the initial state")
+		{
+			header.InitialState = header.States;
+			std::memcpy(image.data(), &header, sizeof(header));
+			checkedQuickly = true;
+		}
+
+		WriteBytes(path, image);
+		REQUIRE_THROWS_AS((LoadDefinitionImage<int, int>(path, FullImageCheck)), std::runtime_error);
+		if (checkedQuickly) REQUIRE_THROWS_AS((LoadDefinitionImage<int, int>(path)), std::runtime_error);
+		else REQUIRE_NOTHROW(LoadDefinitionImage<int, int>(path));
+	}
+
+	SECTION("Compressed entries of states the table does not have")
+	{
+		WriteDefinitionImage(path, CCompiledDefinition<int, int>(fsm, CompressedTable));
+		std::vector<char> image = ReadBytes(path);
+		SDefinitionImageHeader header;
+		std::memcpy(&header, image.data(), sizeof(header));
+
+		// Entries are (check, next) byte pairs for 8 bit indices: aim the first occupied one at a missing state
+		size_t entry = (size_t)header.TableEntries.Offset;
+		while ((unsigned char)image[entry] == 0xFF) entry += 2;
+		const size_t field = GENERATE(0, 1);
+		image[entry + field] = (char)100;
+
+		WriteBytes(path, image);
+		REQUIRE_THROWS_AS((LoadDefinitionImage<int, int>(path, FullImageCheck)), std::runtime_error);
+		REQUIRE_NOTHROW(LoadDefinitionImage<int, int>(path));
+	}
+
+	std::remove(path.c_str());
+}
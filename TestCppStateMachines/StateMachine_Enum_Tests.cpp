@@ -1,6 +1,6 @@
 #include "stdafx.h"
 
-#include <catch2\catch.hpp>
+#include <catch2/catch.hpp>
 
 #include "export.h"
 #include "Fakes.h"
@@ -13,6 +13,8 @@ TEST_CASE("State Machine - Adding States")
 {
 	CREATE_FSM(fsm, TestState1);
 	FakeState state(TestState3);
+	FakeConfigurableState configurable(TestState3);
+	FakeDeclaredState declared(TestState3);
 
 
 	//:::::::::::::::::::::: Auto states ::::::::::::::::::::::
@@ -25,6 +27,14 @@ TEST_CASE("State Machine - Adding States")
 		REQUIRE(config != nullptr);
 	}
 
+	SECTION("Configuring an existing auto state, same configurator returned")
+	{
+		auto* config = fsm.Configure(TestState3);
+
+		REQUIRE(fsm.Configure(TestState3) == config);
+		REQUIRE(fsm.Configure(TestState3)->State() == config->State());
+	}
+
 
 	//:::::::::::::::::::::: Custom states ::::::::::::::::::::::
 
@@ -44,6 +54,51 @@ TEST_CASE("State Machine - Adding States")
 
 		REQUIRE(result == false);
 	}
+
+	SECTION("Configuring a custom state, no configurator returned")
+	{
+		fsm.AddState(TestState3, &state);
+
+		REQUIRE(fsm.Configure(TestState3) == nullptr);
+	}
+
+	SECTION("Configuring a configurable custom state, its own configurator returned")
+	{
+		fsm.AddState(TestState3, &configurable);
+
+		REQUIRE(fsm.Configure(TestState3) == &configurable);
+		REQUIRE(fsm.Configure(TestState3)->State() == &configurable);
+	}
+
+	SECTION("Configuring a configurable custom state added through the interface, its own configurator returned")
+	{
+		IFiniteStateMachine<TestTriggers, TestStates>& machine = fsm;
+		IState<TestTriggers, TestStates>* added = &configurable;
+		machine.AddState(TestState3, added);
+
+		REQUIRE(machine.Configure(TestState3) == &configurable);
+	}
+
+	SECTION("Configuring a state declared with FSM_STATE, its own configurator returned")
+	{
+		fsm.AddState(TestState3, &declared);
+
+		REQUIRE(fsm.Configure(TestState3) == &declared);
+	}
+
+	SECTION("Configuring a state declared with FSM_STATE added as a plain IState, no configurator returned")
+	{
+		IFiniteStateMachine<TestTriggers, TestStates>& machine = fsm;
+		machine.AddState(TestState3, static_cast<IState<TestTriggers, TestStates>*>(&declared));
+
+		REQUIRE(machine.Configure(TestState3) == nullptr);
+	}
+
+	SECTION("Adding a null state, state not added")
+	{
+		REQUIRE(fsm.AddState(TestState3, nullptr) == false);
+		REQUIRE(fsm.Configure(TestState3) != nullptr);
+	}
 }
 
 
@@ -335,7 +390,7 @@ TEST_CASE("State Machine - resubscribing to event - func ptrs")
 			{
 				THEN("Throws exception")
 				{
-					REQUIRE_THROWS(state2Configurator->OnEntry(&EntryCallback1));
+					REQUIRE_THROWS_AS(state2Configurator->OnEntry(&EntryCallback1), std::runtime_error);
 
 					AND_THEN("Nothing called")
 					{
@@ -350,7 +405,7 @@ TEST_CASE("State Machine - resubscribing to event - func ptrs")
 			{
 				THEN("Throws exception")
 				{
-					REQUIRE_THROWS(state1Configurator->OnExit(&ExitCallback1));
+					REQUIRE_THROWS_AS(state1Configurator->OnExit(&ExitCallback1), std::runtime_error);
 
 					AND_THEN("Nothing called")
 					{
@@ -389,7 +444,7 @@ TEST_CASE("State Machine - resubscribing to event - functors")
 			{
 				THEN("Throws exception")
 				{
-					REQUIRE_THROWS(state1Configurator->OnEntry(&callbackInstance2));
+					REQUIRE_THROWS_AS(state1Configurator->OnEntry(&callbackInstance2), std::runtime_error);
 
 					AND_THEN("Nothing called")
 					{
@@ -0,0 +1,211 @@
+#include "stdafx.h"
+
+#include <catch2/catch.hpp>
+
+#include "export.h"
+#include "CCompiledStateMachine.h"
+#include "CFlightRecorder.h"
+#include "Fakes.h"
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using namespace FSM;
+using namespace Fakes;
+
+
+
+
+TEST_CASE("Flight Recorder - Ring")
+{
+	CFlightRecorder recorder(8);
+
+	SECTION("Capacity must be a power of two")
+	{
+		REQUIRE_THROWS(CFlightRecorder(0));
+		REQUIRE_THROWS(CFlightRecorder(12));
+		REQUIRE(recorder.Capacity() == 8);
+	}
+
+	SECTION("Empty recorder has no records")
+	{
+		REQUIRE(recorder.Snapshot().empty());
+	}
+
+	SECTION("Records come back oldest first")
+	{
+		for (uint32_t i = 0; i < 5; ++i) recorder.Record(i, i + 1, i + 2, 7);
+
+		const std::vector<STransitionRecord> records = recorder.Snapshot();
+		REQUIRE(records.size() == 5);
+		for (uint32_t i = 0; i < 5; ++i)
+		{
+			REQUIRE(records[i].From == i);
+			REQUIRE(records[i].Trigger == i + 1);
+			REQUIRE(records[i].To == i + 2);
+			REQUIRE(records[i].Machine == 7);
+			if (i > 0) REQUIRE(records[i].Timestamp >= records[i - 1].Timestamp);
+		}
+	}
+
+	SECTION("Only the last transitions are kept")
+	{
+		for (uint32_t i = 0; i < 100; ++i) recorder.Record(i, 0, 0);
+
+		const std::vector<STransitionRecord> records = recorder.Snapshot();
+		REQUIRE(recorder.Recorded() == 100);
+		REQUIRE(records.size() == 8);
+		REQUIRE(records.front().From == 92);
+		REQUIRE(records.back().From == 99);
+	}
+}
+
+
+
+
+
+
+
+
+TEST_CASE("Flight Recorder - Instrumented machine")
+{
+	CREATE_FSM(fsm, TestState1);
+	fsm.Configure(TestState1)->AddTrigger(TestTrigger1, TestState2);
+	fsm.Configure(TestState2)->AddTrigger(TestTrigger2, TestState1);
+
+	const CCompiledDefinition<TestTriggers, TestStates> definition(fsm);
+	CFlightRecorder recorder(16);
+	CCompiledStateMachine<TestTriggers, TestStates, CFlightRecorderInstrumentation> compiled(&definition, CFlightRecorderInstrumentation(&recorder, 3));
+
+	compiled.Fire(TestTrigger1);
+	REQUIRE_FALSE(compiled.TryFire(TestTrigger1));
+	compiled.Fire(TestTrigger2);
+
+	const std::vector<STransitionRecord> records = recorder.Snapshot();
+	REQUIRE(records.size() == 2);
+	REQUIRE(records[0].From == definition.FindState(TestState1));
+	REQUIRE(records[0].Trigger == definition.FindTrigger(TestTrigger1));
+	REQUIRE(records[0].To == definition.FindState(TestState2));
+	REQUIRE(records[1].From == definition.FindState(TestState2));
+	REQUIRE(records[1].Machine == 3);
+}
+
+
+
+
+
+
+
+
+TEST_CASE("Flight Recorder - Timestamps")
+{
+	CREATE_FSM(fsm, TestState1);
+	fsm.Configure(TestState1)->AddTrigger(TestTrigger1, TestState2);
+	fsm.Configure(TestState2)->AddTrigger(TestTrigger2, TestState1);
+	const CCompiledDefinition<TestTriggers, TestStates> definition(fsm);
+
+	SECTION("Ticks by default")
+	{
+		CFlightRecorder recorder(16);
+		REQUIRE(recorder.Timestamps() == TickTimestamps);
+
+		const uint64_t before = CLatencyClock::Now();
+		recorder.Record(0, 0, 1);
+		REQUIRE(recorder.Snapshot()[0].Timestamp >= before);
+	}
+
+	SECTION("Coarse clock")
+	{
+		CFlightRecorder recorder(16, SingleWriter, CoarseTimestamps);
+		CCompiledStateMachine<TestTriggers, TestStates, CFlightRecorderInstrumentation> compiled(&definition, CFlightRecorderInstrumentation(&recorder));
+
+		recorder.SetTime(7);
+		compiled.Fire(TestTrigger1);
+		compiled.Fire(TestTrigger2);
+		recorder.SetTime(8);
+		compiled.Fire(TestTrigger1);
+		recorder.Record(1, 1, 0, 5);
+
+		const std::vector<STransitionRecord> records = recorder.Snapshot();
+		REQUIRE(records.size() == 4);
+		REQUIRE(records[0].Timestamp == 7);
+		REQUIRE(records[1].Timestamp == 7);
+		REQUIRE(records[2].Timestamp == 8);
+		REQUIRE(records[3].Timestamp == 8);
+		REQUIRE(records[3].Machine == 5);
+		REQUIRE(records[1].From == definition.FindState(TestState2));
+	}
+
+	SECTION("None, in order all the same")
+	{
+		CFlightRecorder recorder(16, MultipleWriters, NoTimestamps);
+		recorder.SetTime(7);
+		for (uint32_t i = 0; i < 3; ++i) recorder.Record(i, i + 10, i + 20, i + 30);
+
+		const std::vector<STransitionRecord> records = recorder.Snapshot();
+		REQUIRE(records.size() == 3);
+		for (uint32_t i = 0; i < 3; ++i)
+		{
+			REQUIRE(records[i].Timestamp == 0);
+			REQUIRE(records[i].From == i);
+			REQUIRE(records[i].Trigger == i + 10);
+			REQUIRE(records[i].To == i + 20);
+			REQUIRE(records[i].Machine == i + 30);
+		}
+	}
+}
+
+
+
+
+
+
+
+
+TEST_CASE("Flight Recorder - Snapshots while writing")
+{
+	const EFlightRecorderWriters writers = GENERATE(SingleWriter, MultipleWriters);
+	const unsigned int threads = writers == SingleWriter ? 1 : 4;
+	const uint32_t records = 500000;
+
+	CFlightRecorder recorder(1024, writers);
+	std::atomic<unsigned int> running(threads);
+
+	// Every record is self describing, so a torn one shows
+	std::vector<std::thread> writing;
+	for (unsigned int thread = 0; thread < threads; ++thread)
+	{
+		writing.push_back(std::thread([&recorder, &running, thread, records]()
+		{
+			for (uint32_t i = 0; i < records; ++i) recorder.Record(i, i * 3 + 1, i ^ 0x5A5A5A5A, thread);
+			--running;
+		}));
+	}
+
+	bool consistent = true, ordered = true;
+	size_t snapshots = 0;
+	while (running > 0 || snapshots == 0)
+	{
+		const std::vector<STransitionRecord> snapshot = recorder.Snapshot();
+		std::vector<uint32_t> last(threads, 0);
+		std::vector<bool> seen(threads, false);
+		for (const STransitionRecord& record : snapshot)
+		{
+			consistent = consistent && record.Machine < threads
+				&& record.Trigger == record.From * 3 + 1 && record.To == (record.From ^ 0x5A5A5A5A);
+			if (!consistent) break;
+
+			ordered = ordered && (!seen[record.Machine] || record.From > last[record.Machine]);
+			seen[record.Machine] = true;
+			last[record.Machine] = record.From;
+		}
+		++snapshots;
+	}
+	for (std::thread& thread : writing) thread.join();
+
+	CAPTURE(snapshots);
+	REQUIRE(consistent);
+	REQUIRE(ordered);
+	REQUIRE(recorder.Recorded() == (uint64_t)records * threads);
+	REQUIRE(recorder.Snapshot().size() == recorder.Capacity());
+}
@@ -0,0 +1,203 @@
+#include "stdafx.h"
+
+#include <catch2/catch.hpp>
+
+#include "export.h"
+#include "CCompiledStateMachine.h"
+#include "CGraphvizWriter.h"
+#include "CHeatProfile.h"
+#include "Fakes.h"
+#include <sstream>
+#include <string>
+
+using namespace FSM;
+using namespace Fakes;
+
+namespace
+{
+	void Callback()
+	{
+	}
+}
+
+
+
+
+TEST_CASE("Heat Profile - Gathering measurements")
+{
+	CREATE_FSM(fsm, TestState1);
+	fsm.Configure(TestState1)->AddTrigger(TestTrigger1, TestState2)->AddTrigger(TestTrigger3, TestState3);
+	fsm.Configure(TestState2)->AddTrigger(TestTrigger2, TestState1)->OnEntry(&Callback);
+	fsm.Configure(TestState3)->AddTrigger(TestTrigger2, TestState1);
+
+	const CCompiledDefinition<TestTriggers, TestStates> definition(fsm);
+	CHeatProfile<TestTriggers, TestStates> profile(&definition);
+
+	SECTION("Counters from several threads add up")
+	{
+		CInstrumentationCounters counters(definition), otherCounters(definition);
+		CCompiledStateMachine<TestTriggers, TestStates, CCountingInstrumentation> compiled(&definition, CCountingInstrumentation(&counters));
+		CCompiledStateMachine<TestTriggers, TestStates, CCountingInstrumentation> other(&definition, CCountingInstrumentation(&otherCounters));
+
+		for (int i = 0; i < 10; ++i)
+		{
+			compiled.Fire(TestTrigger1);
+			compiled.Fire(TestTrigger2);
+		}
+		other.Fire(TestTrigger3);
+
+		profile.Add(counters.Snapshot());
+		profile.Add(otherCounters.Snapshot());
+
+		REQUIRE(profile.Hits(TestState1, TestTrigger1) == 10);
+		REQUIRE(profile.Hits(TestState1, TestTrigger3) == 1);
+		REQUIRE(profile.Hits(TestState3, TestTrigger2) == 0);
+		REQUIRE(profile.Hits(TestState1, TestTrigger2) == 0);
+		REQUIRE(profile.MaxHits() == 10);
+		REQUIRE(profile.State(TestState2)->Entries == 10);
+		REQUIRE(profile.State(TestState3)->Entries == 1);
+	}
+
+	SECTION("Time in state comes from flight records")
+	{
+		STransitionRecord records[] =
+		{
+			{ 1000, 0, 0, 1, 0, 0, 0 },
+			{ 1000, 0, 0, 1, 7, 0, 0 },
+			{ 3000, 1, 1, 0, 0, 0, 0 },
+			{ 3000, 1, 1, 0, 0, 0, 0 },		// Repeated by an overlapping snapshot
+			{ 5000, 0, 0, 1, 0, 0, 0 },
+			{ 9000, 1, 1, 0, 0, 0, 0 },
+			{ 1500, 1, 1, 0, 7, 0, 0 },
+		};
+		for (STransitionRecord& record : records)
+		{
+			record.From = definition.FindState(record.From == 0 ? TestState1 : TestState2);
+			record.To = definition.FindState(record.To == 0 ? TestState1 : TestState2);
+		}
+		profile.Add(std::vector<STransitionRecord>(records, records + 4));
+		profile.Add(std::vector<STransitionRecord>(records + 3, records + 7));
+
+		const SStateHeat& state2 = *profile.State(TestState2);
+		REQUIRE(state2.Visits == 3);
+		REQUIRE(state2.TicksInState == 2000 + 4000 + 500);
+		REQUIRE(profile.State(TestState1)->Visits == 1);
+	}
+
+	SECTION("Only tick stamped records are timed")
+	{
+		const EFlightRecorderTimestamps timestamps = GENERATE(CoarseTimestamps, NoTimestamps);
+		CFlightRecorder recorder(16, SingleWriter, timestamps);
+		recorder.SetTime(7);
+		CCompiledStateMachine<TestTriggers, TestStates, CFlightRecorderInstrumentation> compiled(&definition, CFlightRecorderInstrumentation(&recorder));
+		compiled.Fire(TestTrigger1);
+		compiled.Fire(TestTrigger2);
+		compiled.Fire(TestTrigger1);
+
+		REQUIRE_THROWS_AS(profile.Add(recorder), std::invalid_argument);
+		REQUIRE_THROWS_AS(profile.Add(recorder.Snapshot(), timestamps), std::invalid_argument);
+		REQUIRE(profile.State(TestState2)->Visits == 0);
+		REQUIRE(profile.State(TestState2)->TicksInState == 0);
+	}
+
+	SECTION("Snapshots of other definitions are rejected")
+	{
+		CREATE_FSM(small, TestState1);
+		small.Configure(TestState1)->AddTrigger(TestTrigger1, TestState1);
+		const CCompiledDefinition<TestTriggers, TestStates> other(small);
+
+		REQUIRE_THROWS_AS(profile.Add(CInstrumentationCounters(other).Snapshot()), std::invalid_argument);
+	}
+}
+
+
+
+
+
+
+
+
+TEST_CASE("Graphviz - Configured machine")
+{
+	CREATE_FSM(fsm, TestState1);
+	fsm.Configure(TestState1)->AddTrigger(TestTrigger1, TestState2)->AddTrigger(TestTrigger3, TestState3);
+	fsm.Configure(TestState2)->AddTrigger(TestTrigger2, TestState1)->OnEntry(&Callback);
+	fsm.Configure(TestState3)->AddTrigger(TestTrigger2, TestState1);
+
+	SECTION("Every state & transition, current state bold")
+	{
+		std::ostringstream out;
+		WriteGraphviz(out, fsm);
+		const std::string dot = out.str();
+
+		REQUIRE(dot.find("digraph StateMachine {") == 0);
+		REQUIRE(dot.substr(dot.size() - 2) == "}\n");
+		REQUIRE(Occurrences(dot, " -> ") == 4);
+		REQUIRE(dot.find("s0 -> s1 [label=\"0\"]") != std::string::npos);
+		REQUIRE(dot.find("s0 [label=\"0\", style=\"rounded,filled,bold\"]") != std::string::npos);
+		REQUIRE(dot.find("s1 [label=\"1\", style=\"rounded,filled\"]") != std::string::npos);
+	}
+
+	SECTION("Custom states are dashed, unconfigured targets a placeholder")
+	{
+		FakeState custom(TestState3);
+		CREATE_FSM(mixed, TestState1);
+		mixed.Configure(TestState1)->AddTrigger(TestTrigger1, TestState2);
+		mixed.AddState(TestState3, &custom);
+
+		std::ostringstream out;
+		WriteGraphviz(out, mixed);
+		const std::string dot = out.str();
+
+		REQUIRE(dot.find("s1 [label=\"2\", style=\"rounded,filled,dashed\"]") != std::string::npos);
+		REQUIRE(dot.find("s0 -> unknown") != std::string::npos);
+		REQUIRE(dot.find("unknown [label=\"(not configured)\"") != std::string::npos);
+	}
+
+	SECTION("Heat colors edges & annotates states")
+	{
+		const CCompiledDefinition<TestTriggers, TestStates> definition(fsm);
+		CInstrumentationCounters counters(definition);
+		CLatencyHistograms histograms(definition);
+		{
+			CCompiledStateMachine<TestTriggers, TestStates, CCountingInstrumentation> counting(&definition, CCountingInstrumentation(&counters));
+			CCompiledStateMachine<TestTriggers, TestStates, CLatencyInstrumentation> timing(&definition, CLatencyInstrumentation(&histograms));
+			for (int i = 0; i < 100; ++i)
+			{
+				counting.Fire(TestTrigger1);
+				counting.Fire(TestTrigger2);
+				timing.Fire(TestTrigger1);
+				timing.Fire(TestTrigger2);
+			}
+			counting.Fire(TestTrigger3);
+		}
+
+		CHeatProfile<TestTriggers, TestStates> profile(&definition);
+		profile.Add(counters.Snapshot());
+		profile.Add(histograms.Snapshot());
+
+		std::ostringstream out;
+		WriteGraphviz(out, fsm, &profile);
+		const std::string dot = out.str();
+
+		REQUIRE(dot.find("s0 -> s1 [label=\"0 (100)\", color=\"0.000 0.85 0.90\", penwidth=6.00") != std::string::npos);
+		REQUIRE(dot.find("s0 -> s2 [label=\"2 (1)\", color=\"0.660 0.85 0.90\"") != std::string::npos);
+		REQUIRE(dot.find("label=\"1\\nentries: 100\\ncallbacks p99: ") != std::string::npos);
+
+		SECTION("Cold edges & isolated states are pruned")
+		{
+			SGraphvizOptions options;
+			options.MinEdgeShare = 0.05;
+			options.HideIsolatedStates = true;
+
+			std::ostringstream pruned;
+			WriteGraphviz(pruned, fsm, &profile, options);
+			const std::string prunedDot = pruned.str();
+
+			REQUIRE(Occurrences(prunedDot, " -> ") == 2);
+			REQUIRE(prunedDot.find("s0 -> s2") == std::string::npos);
+			REQUIRE(prunedDot.find("\ts2 [") == std::string::npos);
+			REQUIRE(prunedDot.find("\ts0 [") != std::string::npos);
+		}
+	}
+}
@@ -0,0 +1,302 @@
+#include "stdafx.h"
+
+#include <catch2/catch.hpp>
+
+#include "export.h"
+#include "CCompiledStateMachine.h"
+#include "CInstrumentation.h"
+#include "CLatencyHistograms.h"
+#include "Fakes.h"
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+using namespace FSM;
+using namespace Fakes;
+
+namespace
+{
+	void SlowCallback()
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+}
+
+
+
+
+TEST_CASE("Instrumentation - Disabled policy costs nothing")
+{
+	typedef CCompiledStateMachine<TestTriggers, TestStates> plain_machine;
+	typedef CCompiledStateMachine<TestTriggers, TestStates, CNoInstrumentation> disabled_machine;
+	typedef CCompiledStateMachine<TestTriggers, TestStates, CCountingInstrumentation> counting_machine;
+
+	REQUIRE(sizeof(disabled_machine) == sizeof(plain_machine));
+	REQUIRE(sizeof(counting_machine) > sizeof(plain_machine));
+	REQUIRE_FALSE(CNoInstrumentation::Enabled);
+	REQUIRE(CCountingInstrumentation::Enabled);
+}
+
+
+
+
+
+
+
+
+TEST_CASE("Instrumentation - Counting")
+{
+	CREATE_FSM(fsm, TestState1);
+	fsm.Configure(TestState1)->AddTrigger(TestTrigger1, TestState2);
+	fsm.Configure(TestState2)->AddTrigger(TestTrigger2, TestState1)->AddTrigger(TestTrigger1, TestState2)->OnEntry(&SlowCallback);
+	fsm.Configure(TestState3)->AddTrigger(TestTrigger2, TestState1);
+
+	const CCompiledDefinition<TestTriggers, TestStates> definition(fsm);
+	CInstrumentationCounters counters(definition);
+	CCompiledStateMachine<TestTriggers, TestStates, CCountingInstrumentation> compiled(&definition, CCountingInstrumentation(&counters));
+
+	const uint32_t state1 = definition.FindState(TestState1), state2 = definition.FindState(TestState2);
+	const uint32_t trigger1 = definition.FindTrigger(TestTrigger1), trigger2 = definition.FindTrigger(TestTrigger2);
+
+	SECTION("Nothing counted before firing")
+	{
+		const SInstrumentationSnapshot snapshot = counters.Snapshot();
+		REQUIRE(snapshot.Transitions.size() == definition.Transitions().size());
+		REQUIRE(snapshot.Entries.size() == definition.StateCount());
+		for (uint64_t value : snapshot.Transitions) REQUIRE(value == 0);
+		for (uint64_t value : snapshot.Entries) REQUIRE(value == 0);
+		REQUIRE(snapshot.UnknownTriggers == 0);
+	}
+
+	SECTION("Transitions & entries are counted")
+	{
+		for (int i = 0; i < 3; ++i)
+		{
+			compiled.Fire(TestTrigger1);
+			compiled.Fire(TestTrigger2);
+		}
+		compiled.Fire(TestTrigger1);
+		compiled.Fire(TestTrigger1);
+
+		const SInstrumentationSnapshot snapshot = counters.Snapshot();
+		REQUIRE(snapshot.Transitions[counters.TransitionIndex(state1, trigger1)] == 4);
+		REQUIRE(snapshot.Transitions[counters.TransitionIndex(state2, trigger2)] == 3);
+		REQUIRE(snapshot.Transitions[counters.TransitionIndex(state2, trigger1)] == 1);
+		REQUIRE(snapshot.Entries[state1] == 3);
+		REQUIRE(snapshot.Entries[state2] == 5);
+		REQUIRE(snapshot.Entries[definition.FindState(TestState3)] == 0);
+	}
+
+	SECTION("Transition indices follow the definition's transitions")
+	{
+		const std::vector<___IMPL___::STransition> transitions = definition.Transitions();
+		for (uint32_t i = 0; i < (uint32_t)transitions.size(); ++i)
+		{
+			REQUIRE(counters.TransitionIndex(transitions[i].From, transitions[i].Trigger) == i);
+		}
+		REQUIRE(counters.TransitionIndex(state1, trigger2) == InvalidIndex);
+	}
+
+	SECTION("Rejected & unknown triggers are counted")
+	{
+		REQUIRE_FALSE(compiled.TryFire(TestTrigger2));
+		REQUIRE_THROWS(compiled.Fire(TestTrigger2));
+		REQUIRE_FALSE(compiled.TryFire(TestTrigger3));
+
+		const SInstrumentationSnapshot snapshot = counters.Snapshot();
+		REQUIRE(snapshot.Rejected[state1] == 2);
+		REQUIRE(snapshot.UnknownTriggers == 1);
+		REQUIRE(snapshot.Entries[state1] == 0);
+	}
+
+	SECTION("Callback time is counted for states with callbacks")
+	{
+		compiled.Fire(TestTrigger1);
+		compiled.Fire(TestTrigger2);
+		compiled.Fire(TestTrigger1);
+
+		const SInstrumentationSnapshot snapshot = counters.Snapshot();
+		REQUIRE(snapshot.CallbackNanoseconds[state2] >= 2000000);
+		REQUIRE(snapshot.CallbackNanoseconds[state1] == 0);
+	}
+
+	SECTION("Snapshots of several counters merge")
+	{
+		CInstrumentationCounters other(definition);
+		CCompiledStateMachine<TestTriggers, TestStates, CCountingInstrumentation> second(&definition, CCountingInstrumentation(&other));
+
+		compiled.Fire(TestTrigger1);
+		second.Fire(TestTrigger1);
+		second.Fire(TestTrigger2);
+
+		SInstrumentationSnapshot merged = counters.Snapshot();
+		merged.Merge(other.Snapshot());
+		REQUIRE(merged.Transitions[counters.TransitionIndex(state1, trigger1)] == 2);
+		REQUIRE(merged.Transitions[counters.TransitionIndex(state2, trigger2)] == 1);
+		REQUIRE(merged.Entries[state2] == 2);
+	}
+
+	SECTION("Counters of another definition are refused")
+	{
+		const CCompiledDefinition<TestTriggers, TestStates> copy = definition;
+		CCompiledStateMachine<TestTriggers, TestStates, CCountingInstrumentation> sameCounters(&copy, CCountingInstrumentation(&counters));
+		sameCounters.Fire(TestTrigger1);
+		REQUIRE(counters.Snapshot().Transitions[counters.TransitionIndex(state1, trigger1)] == 1);
+
+		// Same states, one more transition: its index is past the end of the counters
+		fsm.Configure(TestState3)->AddTrigger(TestTrigger3, TestState2);
+		const CCompiledDefinition<TestTriggers, TestStates> other(fsm);
+		REQUIRE_FALSE(counters.Matches(other));
+		REQUIRE_THROWS_AS((CCompiledStateMachine<TestTriggers, TestStates, CCountingInstrumentation>(&other, CCountingInstrumentation(&counters))), std::invalid_argument);
+
+		CLatencyHistograms histograms(definition);
+		REQUIRE_THROWS_AS((CCompiledStateMachine<TestTriggers, TestStates, CLatencyInstrumentation>(&other, CLatencyInstrumentation(&histograms))), std::invalid_argument);
+	}
+}
+
+
+
+
+
+
+
+
+TEST_CASE("Instrumentation - Snapshots while firing")
+{
+	CREATE_FSM(fsm, TestState1);
+	fsm.Configure(TestState1)->AddTrigger(TestTrigger1, TestState2);
+	fsm.Configure(TestState2)->AddTrigger(TestTrigger1, TestState1);
+
+	const CCompiledDefinition<TestTriggers, TestStates> definition(fsm);
+	CInstrumentationCounters counters(definition);
+	const uint32_t index = counters.TransitionIndex(definition.FindState(TestState1), definition.FindTrigger(TestTrigger1));
+
+	const uint64_t transitions = 2000000;
+	std::atomic<bool> done(false);
+	std::thread firing([&]()
+	{
+		CCompiledStateMachine<TestTriggers, TestStates, CCountingInstrumentation> compiled(&definition, CCountingInstrumentation(&counters));
+		for (uint64_t i = 0; i < transitions; ++i) compiled.Fire(TestTrigger1);
+		done = true;
+	});
+
+	// Counters only ever grow, whenever they are read
+	bool monotonic = true;
+	uint64_t last = 0;
+	while (!done)
+	{
+		const uint64_t current = counters.Snapshot().Transitions[index];
+		monotonic = monotonic && current >= last;
+		last = current;
+	}
+	firing.join();
+
+	REQUIRE(monotonic);
+	REQUIRE(counters.Snapshot().Transitions[index] == transitions / 2);
+}
+
+
+
+
+
+
+
+
+TEST_CASE("Instrumentation - Relayout by profile")
+{
+	// 1000 states, of which a core of 50 (500 to 549) is where the machine spends its time
+	CFiniteStateMachine<int, int> fsm(500);
+	for (int state = 0; state < 1000; ++state)
+	{
+		IStateConfigurator<int, int>* configurator = fsm.Configure(state);
+		configurator->AddTrigger(0, (state + 1) % 1000)->AddTrigger(1, 0);
+		if (state >= 500 && state < 550)
+		{
+			configurator->AddTrigger(2, 500 + (state - 500 + 1) % 50)->AddTrigger(3, 500 + (state - 500) * 7 % 50);
+		}
+	}
+
+	const ETableLayout layout = GENERATE(DenseTable, CompressedTable);
+	CAPTURE(layout);
+
+	const CCompiledDefinition<int, int> definition(fsm, layout);
+	CInstrumentationCounters counters(definition);
+	CCompiledStateMachine<int, int, CCountingInstrumentation> compiled(&definition, CCountingInstrumentation(&counters));
+	for (int i = 0; i < 5000; ++i) compiled.Fire(i % 10 == 9 ? 3 : 2);
+	for (int i = 0; i < 50; ++i) compiled.Fire(2);
+
+	std::vector<uint32_t> mapping;
+	const CCompiledDefinition<int, int> relaid = definition.Relayout(counters.Snapshot().Transitions, mapping);
+
+	SECTION("Behavior is unchanged")
+	{
+		std::vector<int> counterexample;
+		REQUIRE(AreEquivalent(definition, relaid, counterexample));
+		REQUIRE(relaid.Layout() == layout);
+		REQUIRE(relaid.StateCount() == definition.StateCount());
+		REQUIRE(relaid.InitialState() == mapping[definition.InitialState()]);
+
+		bool consistent = true;
+		for (uint32_t state = 0; state < definition.StateCount(); ++state)
+		{
+			consistent = consistent && relaid.State(mapping[state]) == definition.State(state);
+			for (uint32_t trigger = 0; trigger < definition.TriggerCount(); ++trigger)
+			{
+				const uint32_t next = definition.Next(state, trigger);
+				const uint32_t relaidNext = relaid.Next(mapping[state], relaid.FindTrigger(definition.Trigger(trigger)));
+				consistent = consistent && (next == InvalidIndex ? relaidNext == InvalidIndex : relaidNext == mapping[next]);
+			}
+		}
+		REQUIRE(consistent);
+	}
+
+	SECTION("Hot states come first")
+	{
+		for (int state = 500; state < 550; ++state) REQUIRE(relaid.FindState(state) < 50);
+		REQUIRE(relaid.FindState(0) >= 50);
+		REQUIRE(relaid.State(0) == 500);
+	}
+
+	SECTION("Hot triggers come first")
+	{
+		REQUIRE(relaid.Trigger(0) == 2);
+		REQUIRE(relaid.Trigger(1) == 3);
+		REQUIRE(relaid.FindTrigger(0) == 2);
+	}
+
+	SECTION("Profile must be of the same definition")
+	{
+		REQUIRE_THROWS_AS(definition.Relayout(std::vector<uint64_t>(3, 0), mapping), std::invalid_argument);
+	}
+}
+
+
+
+
+
+
+
+
+TEST_CASE("Instrumentation - Relayout keeps string trigger slots")
+{
+	CFiniteStateMachine<std::string, int> fsm(0);
+	for (int state = 0; state < 20; ++state)
+	{
+		fsm.Configure(state)->AddTrigger("next", (state + 1) % 20)->AddTrigger("back", (state + 19) % 20)->AddTrigger("reset", 0);
+	}
+
+	const CCompiledDefinition<std::string, int> definition(fsm);
+	std::vector<uint64_t> hits(definition.Transitions().size(), 0);
+	hits.back() = 10;
+
+	std::vector<uint32_t> mapping;
+	const CCompiledDefinition<std::string, int> relaid = definition.Relayout(hits, mapping);
+
+	std::vector<std::string> counterexample;
+	REQUIRE(AreEquivalent(definition, relaid, counterexample));
+	for (uint32_t i = 0; i < definition.TriggerCount(); ++i)
+	{
+		REQUIRE(relaid.Trigger(i) == definition.Trigger(i));
+		REQUIRE(relaid.FindTriggerString(definition.Trigger(i)) == i);
+	}
+}
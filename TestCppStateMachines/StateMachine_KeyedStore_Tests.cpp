@@ -0,0 +1,534 @@
+#include "stdafx.h"
+
+#include <catch2/catch.hpp>
+
+#include "export.h"
+#include "CKeyedStateMachineStore.h"
+#include "AllocationTracking.h"
+#include "Fakes.h"
+#include <cstdio>
+#include <random>
+#include <string>
+#include <unordered_map>
+
+using namespace FSM;
+using namespace Fakes;
+
+
+
+
+TEST_CASE("Keyed Store - Instances")
+{
+	CFiniteStateMachine<int, int> fsm(0);
+	ConfigureConnection(fsm);
+	const CCompiledDefinition<int, int> definition(fsm);
+	CKeyedStateMachineStore<uint64_t, int, int> store(&definition);
+
+	SECTION("Unknown keys are in the initial state")
+	{
+		REQUIRE(store.Size() == 0);
+		REQUIRE_FALSE(store.Contains(42));
+		REQUIRE(store.State(42) == 0);
+		REQUIRE(store.StateIndex(42) == definition.InitialState());
+	}
+
+	SECTION("First accepted trigger creates the instance")
+	{
+		store.Fire(42, 1);
+		REQUIRE(store.Contains(42));
+		REQUIRE(store.Size() == 1);
+		REQUIRE(store.State(42) == 1);
+
+		store.Fire(42, 2);
+		REQUIRE(store.State(42) == 2);
+		REQUIRE(store.Size() == 1);
+	}
+
+	SECTION("Rejected triggers create nothing")
+	{
+		REQUIRE_FALSE(store.TryFire(42, 2));
+		REQUIRE_FALSE(store.TryFire(42, 7));
+		REQUIRE_THROWS_AS(store.Fire(42, 0), std::runtime_error);
+		REQUIRE(store.Size() == 0);
+
+		store.Fire(42, 1);
+		REQUIRE_FALSE(store.TryFire(42, 1));
+		REQUIRE(store.State(42) == 1);
+	}
+
+	SECTION("Keys are independent")
+	{
+		store.Fire(1, 1);
+		store.Fire(2, 1);
+		store.Fire(2, 2);
+		REQUIRE(store.State(1) == 1);
+		REQUIRE(store.State(2) == 2);
+		REQUIRE(store.State(3) == 0);
+	}
+
+	SECTION("Erased instances start over")
+	{
+		store.Fire(42, 1);
+		REQUIRE(store.Erase(42));
+		REQUIRE_FALSE(store.Erase(42));
+		REQUIRE_FALSE(store.Contains(42));
+		REQUIRE(store.Size() == 0);
+		REQUIRE(store.State(42) == 0);
+	}
+
+	SECTION("Entries hold the key, state & time only")
+	{
+		REQUIRE(store.Bytes() == store.Capacity() * 16);
+	}
+}
+
+
+
+
+
+
+
+
+TEST_CASE("Keyed Store - Matches a map of machines")
+{
+	CFiniteStateMachine<int, int> fsm(0);
+	ConfigureConnection(fsm);
+	const CCompiledDefinition<int, int> definition(fsm);
+	CKeyedStateMachineStore<uint64_t, int, int> store(&definition);
+
+	// Small key range so that clusters form, grow and get erased from
+	std::unordered_map<uint64_t, int> expected;
+	std::mt19937 random(7);
+	bool same = true;
+	for (int i = 0; i < 200000; ++i)
+	{
+		const uint64_t key = random() % 5000;
+		const int trigger = (int)(random() % 4);
+		if (trigger == 3)
+		{
+			same = same && store.Erase(key) == (expected.erase(key) == 1);
+			continue;
+		}
+
+		const std::unordered_map<uint64_t, int>::iterator itr = expected.find(key);
+		const int current = itr != expected.end() ? itr->second : 0;
+		const uint32_t next = definition.Next(definition.FindState(current), definition.FindTrigger(trigger));
+
+		same = same && store.TryFire(key, trigger) == (next != InvalidIndex);
+		if (next != InvalidIndex) expected[key] = definition.State(next);
+	}
+	REQUIRE(same);
+	REQUIRE(store.Size() == expected.size());
+
+	size_t visited = 0;
+	store.ForEach([&](uint64_t key, uint32_t state)
+	{
+		++visited;
+		same = same && expected.count(key) == 1 && definition.State(state) == expected[key];
+	});
+	REQUIRE(same);
+	REQUIRE(visited == expected.size());
+}
+
+
+
+
+
+
+
+
+TEST_CASE("Keyed Store - Callbacks")
+{
+	CFiniteStateMachine<int, int> fsm(0);
+	ConfigureConnection(fsm);
+
+	FakeCallback opened, closed;
+	fsm.Configure(1)->OnEntry(&opened);
+	fsm.Configure(1)->OnExit(&closed);
+
+	SECTION("Entry & exit callbacks run")
+	{
+		const CCompiledDefinition<int, int> definition(fsm);
+		CKeyedStateMachineStore<uint64_t, int, int> store(&definition);
+
+		store.Fire(1, 1);
+		store.Fire(2, 1);
+		REQUIRE(opened.CallbackCount == 2);
+
+		store.Fire(1, 0);
+		REQUIRE(closed.CallbackCount == 1);
+	}
+
+	SECTION("Callbacks may fire at the store")
+	{
+		// Authenticating a key opens a hundred more, growing the table from inside the callback
+		struct SFanOut : public ICallback
+		{
+			CKeyedStateMachineStore<uint64_t, int, int>* Store = nullptr;
+			uint64_t Next = 1000;
+
+			virtual void Call() override
+			{
+				for (int i = 0; i < 100; ++i) Store->Fire(Next++, 1);
+			}
+		} fanOut;
+		fsm.Configure(2)->OnEntry(&fanOut);
+
+		const CCompiledDefinition<int, int> definition(fsm);
+		CKeyedStateMachineStore<uint64_t, int, int> store(&definition);
+		fanOut.Store = &store;
+
+		store.Fire(1, 1);
+		store.Fire(1, 2);
+		REQUIRE(store.State(1) == 2);
+		REQUIRE(store.Size() == 101);
+		REQUIRE(store.State(1099) == 1);
+	}
+}
+
+
+
+
+
+
+
+
+TEST_CASE("Keyed Store - String keys & triggers")
+{
+	CFiniteStateMachine<std::string, int> fsm(0);
+	fsm.Configure(0)->AddTrigger("open", 1);
+	fsm.Configure(1)->AddTrigger("close", 0);
+
+	const CCompiledDefinition<std::string, int> definition(fsm);
+	CKeyedStateMachineStore<std::string, std::string, int> store(&definition);
+
+	for (int i = 0; i < 1000; ++i) store.FireString("order-" + std::to_string(i), "open");
+	for (int i = 0; i < 1000; i += 2) store.Fire("order-" + std::to_string(i), "close");
+
+	REQUIRE(store.Size() == 1000);
+	REQUIRE(store.State("order-1") == 1);
+	REQUIRE(store.State("order-2") == 0);
+	REQUIRE_FALSE(store.TryFireString("order-2", "close"));
+}
+
+
+
+
+
+
+
+
+TEST_CASE("Keyed Store - Eviction")
+{
+	CFiniteStateMachine<int, int> fsm(0);
+	ConfigureConnection(fsm);
+	const CCompiledDefinition<int, int> definition(fsm);
+	CKeyedStateMachineStore<uint64_t, int, int> store(&definition);
+
+	store.SetTime(100);
+	for (uint64_t key = 0; key < 100; ++key) store.Fire(key, 1);
+	store.SetTime(160);
+	for (uint64_t key = 0; key < 100; key += 2) store.Fire(key, 2);
+
+	SECTION("Transitions are stamped with the store's time")
+	{
+		uint32_t time = 0;
+		REQUIRE(store.LastTransition(1, time));
+		REQUIRE(time == 100);
+		REQUIRE(store.LastTransition(2, time));
+		REQUIRE(time == 160);
+		REQUIRE_FALSE(store.LastTransition(1000, time));
+	}
+
+	SECTION("Idle instances are evicted")
+	{
+		store.SetTime(200);
+		REQUIRE(store.EvictIdle(50) == 50);
+		REQUIRE(store.Size() == 50);
+		REQUIRE(store.Contains(2));
+		REQUIRE_FALSE(store.Contains(1));
+
+		// Without a spill file, evicted instances start over
+		REQUIRE(store.State(1) == 0);
+		REQUIRE(store.EvictIdle(50) == 0);
+	}
+
+	SECTION("Sweeps can be spread out")
+	{
+		store.SetTime(200);
+		size_t evicted = 0, sweeps = 0;
+		for (; sweeps < 100 && store.Size() > 50; ++sweeps) evicted += store.EvictIdle(50, 16);
+		REQUIRE(evicted == 50);
+		REQUIRE(sweeps <= store.Capacity() / 16);
+	}
+
+	SECTION("Evicting to size spares recently used instances")
+	{
+		REQUIRE(store.EvictToSize(80) == 20);
+		REQUIRE(store.Size() == 80);
+
+		// Instances used since the hand went by survive the next sweep
+		for (uint64_t key = 0; key < 100; ++key)
+		{
+			if (store.Contains(key)) store.Fire(key, key % 2 == 0 ? 1 : 2);
+		}
+		store.Fire(1000, 1);
+		REQUIRE(store.EvictToSize(80) == 1);
+		REQUIRE(store.Size() == 80);
+
+		REQUIRE(store.EvictToSize(0) == 80);
+		REQUIRE(store.Size() == 0);
+
+		const size_t capacity = store.Capacity();
+		store.Shrink();
+		REQUIRE(store.Capacity() < capacity);
+		store.Fire(1, 1);
+		REQUIRE(store.State(1) == 1);
+	}
+}
+
+
+
+
+
+
+
+
+TEST_CASE("Keyed Store - Spill file")
+{
+	const std::string path = "keyed_store_spill.bin";
+
+	CFiniteStateMachine<int, int> fsm(0);
+	ConfigureConnection(fsm);
+	const CCompiledDefinition<int, int> definition(fsm);
+
+	SECTION("Evicted instances come back")
+	{
+		CKeyedSpillFile<uint64_t> spill(path);
+		CKeyedStateMachineStore<uint64_t, int, int> store(&definition);
+		store.SetSpill(&spill);
+
+		store.SetTime(10);
+		for (uint64_t key = 0; key < 1000; ++key) store.Fire(key, 1);
+		for (uint64_t key = 0; key < 1000; key += 3) store.Fire(key, 2);
+
+		store.SetTime(20);
+		REQUIRE(store.EvictIdle(5) == 1000);
+		REQUIRE(store.Size() == 0);
+		REQUIRE(spill.Size() == 1000);
+		REQUIRE(spill.FileBytes() == 1000 * 16);
+
+		// Still known, without reloading
+		REQUIRE(store.Contains(3));
+		REQUIRE(store.State(3) == 2);
+		REQUIRE(store.State(4) == 1);
+		REQUIRE_FALSE(store.Contains(1000));
+		uint32_t time = 0;
+		REQUIRE(store.LastTransition(4, time));
+		REQUIRE(time == 10);
+
+		// Firing reloads
+		store.Fire(4, 2);
+		REQUIRE(store.Size() == 1);
+		REQUIRE(spill.Size() == 999);
+		REQUIRE(store.State(4) == 2);
+		REQUIRE(store.LastTransition(4, time));
+		REQUIRE(time == 20);
+
+		// Also for rejected triggers
+		REQUIRE_FALSE(store.TryFire(5, 1));
+		REQUIRE(store.Size() == 2);
+		REQUIRE(store.State(5) == 1);
+		REQUIRE(store.LastTransition(5, time));
+		REQUIRE(time == 10);
+
+		bool same = true;
+		for (uint64_t key = 0; key < 1000; ++key) same = same && store.State(key) == (key % 3 == 0 || key == 4 ? 2 : 1);
+		REQUIRE(same);
+
+		// Erasing reaches the spill file
+		REQUIRE(store.Erase(6));
+		REQUIRE_FALSE(store.Contains(6));
+		REQUIRE(store.State(6) == 0);
+	}
+
+	SECTION("Compacting drops taken records")
+	{
+		CKeyedSpillFile<uint64_t> spill(path);
+		CKeyedSpillFile<uint64_t>::SRecord record;
+		for (uint64_t key = 0; key < 100; ++key)
+		{
+			record.Key = key;
+			record.State = (uint32_t)key;
+			record.Touched = 7;
+			spill.Write(record);
+		}
+		record.Key = 5;
+		spill.Write(record);
+
+		for (uint64_t key = 0; key < 50; ++key) REQUIRE(spill.Take(key, record));
+		REQUIRE(spill.Size() == 50);
+		REQUIRE(spill.Records() == 101);
+
+		spill.Compact();
+		REQUIRE(spill.Records() == 50);
+		REQUIRE(spill.Size() == 50);
+		REQUIRE_FALSE(spill.Read(5, record));
+		REQUIRE(spill.Read(75, record));
+		REQUIRE(record.State == 75);
+		REQUIRE(record.Touched == 7);
+
+		size_t visited = 0;
+		spill.ForEach([&](const CKeyedSpillFile<uint64_t>::SRecord& live) { visited += live.Key >= 50 ? 1 : 0; });
+		REQUIRE(visited == 50);
+	}
+
+	SECTION("Matches a map of machines across evictions")
+	{
+		CKeyedSpillFile<uint64_t> spill(path);
+		CKeyedStateMachineStore<uint64_t, int, int> store(&definition);
+		store.SetSpill(&spill);
+
+		std::unordered_map<uint64_t, int> expected;
+		std::mt19937 random(11);
+		bool same = true;
+		for (uint32_t i = 0; i < 100000; ++i)
+		{
+			store.SetTime(i / 100);
+			if (i % 1000 == 0) store.EvictIdle(3);
+			if (i % 1500 == 0) store.EvictToSize(500);
+
+			const uint64_t key = random() % 3000;
+			const int trigger = (int)(random() % 3);
+			const std::unordered_map<uint64_t, int>::iterator itr = expected.find(key);
+			const int current = itr != expected.end() ? itr->second : 0;
+			const uint32_t next = definition.Next(definition.FindState(current), definition.FindTrigger(trigger));
+
+			same = same && store.TryFire(key, trigger) == (next != InvalidIndex);
+			if (next != InvalidIndex) expected[key] = definition.State(next);
+		}
+		REQUIRE(same);
+		REQUIRE(store.Size() + spill.Size() == expected.size());
+
+		for (const std::pair<const uint64_t, int>& instance : expected) same = same && store.State(instance.first) == instance.second;
+		REQUIRE(same);
+	}
+
+	std::remove(path.c_str());
+}
+
+
+
+
+
+
+
+
+TEST_CASE("Keyed Store - Sequence numbers")
+{
+	CFiniteStateMachine<int, int> fsm(0);
+	ConfigureConnection(fsm);
+	const CCompiledDefinition<int, int> definition(fsm);
+	CKeyedStateMachineStore<uint64_t, int, int, std::hash<uint64_t>, CSequenced> store(&definition);
+
+	SECTION("Sequence numbers take 8 more bytes")
+	{
+		REQUIRE(store.Bytes() == store.Capacity() * 24);
+	}
+
+	SECTION("Duplicates apply once")
+	{
+		REQUIRE(store.Fire(42, 1, 1));
+		REQUIRE(store.LastSequence(42) == 1);
+		REQUIRE_FALSE(store.Fire(42, 1, 1));
+		REQUIRE(store.State(42) == 1);
+
+		REQUIRE(store.Fire(42, 2, 2));
+		REQUIRE_FALSE(store.TryFire(42, 2, 2));
+		REQUIRE(store.FireIndex(42, 2, definition.FindTrigger(2)) == SequencedDuplicate);
+		REQUIRE(store.State(42) == 2);
+		REQUIRE(store.LastSequence(42) == 2);
+	}
+
+	SECTION("Older triggers are dropped")
+	{
+		store.Fire(42, 10, 1);
+		REQUIRE_FALSE(store.Fire(42, 5, 0));
+		REQUIRE(store.State(42) == 1);
+
+		// Gaps are fine
+		REQUIRE(store.Fire(42, 20, 0));
+		REQUIRE(store.State(42) == 0);
+	}
+
+	SECTION("Rejected triggers take no sequence number")
+	{
+		REQUIRE(store.FireIndex(42, 1, definition.FindTrigger(2)) == SequencedRejected);
+		REQUIRE_FALSE(store.Contains(42));
+		REQUIRE(store.LastSequence(42) == 0);
+
+		store.Fire(42, 1, 1);
+		REQUIRE_THROWS_AS(store.Fire(42, 2, 1), std::runtime_error);
+		REQUIRE(store.LastSequence(42) == 1);
+		REQUIRE(store.Fire(42, 2, 2));
+	}
+
+	SECTION("Unsequenced fires keep the number")
+	{
+		store.Fire(42, 7, 1);
+		store.Fire(42, 2);
+		REQUIRE(store.LastSequence(42) == 7);
+		REQUIRE_FALSE(store.Fire(42, 7, 0));
+		REQUIRE(store.State(42) == 2);
+	}
+
+	SECTION("Spilled instances keep their number")
+	{
+		const std::string path = "keyed_store_sequence_spill.bin";
+		{
+			CKeyedSpillFile<uint64_t, std::hash<uint64_t>, CSequenced> spill(path);
+			store.SetSpill(&spill);
+
+			for (uint64_t key = 0; key < 100; ++key) store.Fire(key, 100 + key, 1);
+			REQUIRE(store.EvictIdle(0) == 100);
+			REQUIRE(store.LastSequence(7) == 107);
+
+			REQUIRE_FALSE(store.Fire(7, 107, 2));
+			REQUIRE(store.State(7) == 1);
+			REQUIRE(store.Fire(7, 108, 2));
+			REQUIRE(store.State(7) == 2);
+			store.SetSpill(nullptr);
+		}
+		std::remove(path.c_str());
+	}
+}
+
+
+
+
+
+
+
+
+TEST_CASE("Keyed Store - Reserved store fires without allocating")
+{
+	if (!AllocationTracking::Enabled()) WARN("Built without TRACK_ALLOCATIONS, allocations are not counted");
+	if (!AllocationTracking::Enabled()) return;
+
+	CFiniteStateMachine<int, int> fsm(0);
+	ConfigureConnection(fsm);
+	const CCompiledDefinition<int, int> definition(fsm);
+
+	CKeyedStateMachineStore<uint64_t, int, int> store(&definition, 100000);
+	const size_t capacity = store.Capacity();
+
+	AllocationTracking::CAllocationCounter counter;
+	for (uint64_t key = 0; key < 100000; ++key)
+	{
+		store.Fire(key * 0x9e3779b97f4a7c15ull, 1);
+		store.Fire(key * 0x9e3779b97f4a7c15ull, 2);
+	}
+	REQUIRE(counter.Count() == 0);
+	REQUIRE(store.Capacity() == capacity);
+	REQUIRE(store.Size() == 100000);
+}
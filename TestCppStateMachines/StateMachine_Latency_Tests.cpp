@@ -0,0 +1,205 @@
+#include "stdafx.h"
+
+#include <catch2/catch.hpp>
+
+#include "export.h"
+#include "CCompiledStateMachine.h"
+#include "CLatencyHistograms.h"
+#include "Fakes.h"
+#include <chrono>
+#include <random>
+#include <thread>
+
+using namespace FSM;
+using namespace Fakes;
+
+namespace
+{
+	void SlowCallback()
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(2));
+	}
+}
+
+
+
+
+TEST_CASE("Latency Histogram - Buckets")
+{
+	SECTION("Small values are exact")
+	{
+		for (uint64_t value = 0; value < CLatencyHistogram::SubBuckets; ++value)
+		{
+			REQUIRE(CLatencyHistogram::BucketLimit(CLatencyHistogram::Bucket(value)) == value);
+		}
+	}
+
+	SECTION("Buckets are ordered, contiguous & within 1/16th of their values")
+	{
+		for (unsigned int bucket = 1; bucket < CLatencyHistogram::BucketCount; ++bucket)
+		{
+			const uint64_t lowest = CLatencyHistogram::BucketLimit(bucket - 1) + 1;
+			const uint64_t limit = CLatencyHistogram::BucketLimit(bucket);
+
+			REQUIRE(CLatencyHistogram::Bucket(lowest) == bucket);
+			REQUIRE(CLatencyHistogram::Bucket(limit) == bucket);
+			REQUIRE(limit - lowest <= lowest / CLatencyHistogram::SubBuckets);
+		}
+		REQUIRE(CLatencyHistogram::Bucket(UINT64_MAX) == CLatencyHistogram::BucketCount - 1);
+	}
+}
+
+
+
+
+
+
+
+
+TEST_CASE("Latency Histogram - Percentiles")
+{
+	CLatencyHistogram histogram;
+	REQUIRE(histogram.Count() == 0);
+	REQUIRE(histogram.Percentile(50) == 0);
+
+	std::vector<uint64_t> values;
+	std::mt19937_64 random(7);
+	for (int i = 0; i < 100000; ++i) values.push_back(random() % 1000000);
+	for (uint64_t value : values) histogram.Record(value);
+	std::sort(values.begin(), values.end());
+
+	const double percentile = GENERATE(0.0, 50.0, 90.0, 99.0, 99.9, 100.0);
+	const size_t rank = std::max<size_t>(1, (size_t)std::ceil(percentile / 100 * values.size()));
+	const uint64_t exact = values[rank - 1];
+
+	CAPTURE(percentile, exact);
+	REQUIRE(histogram.Count() == values.size());
+	REQUIRE(histogram.Percentile(percentile) >= exact);
+	REQUIRE(histogram.Percentile(percentile) <= exact + exact / CLatencyHistogram::SubBuckets);
+}
+
+
+
+
+
+
+
+
+TEST_CASE("Latency Histogram - Merge")
+{
+	CLatencyHistogram a, b, empty;
+	for (uint64_t i = 0; i < 1000; ++i) a.Record(100);
+	for (uint64_t i = 0; i < 1000; ++i) b.Record(10000);
+
+	a.Merge(empty);
+	REQUIRE(a.Count() == 1000);
+
+	empty.Merge(a);
+	empty.Merge(b);
+	REQUIRE(empty.Count() == 2000);
+	REQUIRE(empty.Percentile(50) == CLatencyHistogram::BucketLimit(CLatencyHistogram::Bucket(100)));
+	REQUIRE(empty.Percentile(50.1) == CLatencyHistogram::BucketLimit(CLatencyHistogram::Bucket(10000)));
+}
+
+
+
+
+
+
+
+
+TEST_CASE("Latency Histogram - Instrumented machine")
+{
+	CREATE_FSM(fsm, TestState1);
+	fsm.Configure(TestState1)->AddTrigger(TestTrigger1, TestState2);
+	fsm.Configure(TestState2)->AddTrigger(TestTrigger2, TestState1)->OnEntry(&SlowCallback);
+
+	const CCompiledDefinition<TestTriggers, TestStates> definition(fsm);
+	CLatencyHistograms histograms(definition);
+	CCompiledStateMachine<TestTriggers, TestStates, CLatencyInstrumentation> compiled(&definition, CLatencyInstrumentation(&histograms));
+
+	const uint32_t state1 = definition.FindState(TestState1), state2 = definition.FindState(TestState2);
+
+	for (int i = 0; i < 5; ++i)
+	{
+		compiled.Fire(TestTrigger1);
+		compiled.Fire(TestTrigger2);
+	}
+	REQUIRE_FALSE(compiled.TryFire(TestTrigger2));
+
+	const SLatencySnapshot snapshot = histograms.Snapshot();
+
+	SECTION("Every fire is recorded")
+	{
+		REQUIRE(snapshot.Fire.Count() == 11);
+	}
+
+	SECTION("Callbacks are recorded per state")
+	{
+		REQUIRE(snapshot.Entry[state2].Count() == 5);
+		REQUIRE(snapshot.Entry[state1].Count() == 0);
+		REQUIRE(snapshot.Exit[state1].Count() == 0);
+		REQUIRE(snapshot.Exit[state2].Count() == 0);
+	}
+
+	SECTION("Slow callbacks show in the percentiles")
+	{
+		REQUIRE(snapshot.Entry[state2].PercentileNanoseconds(50) >= 1.5e6);
+		REQUIRE(snapshot.Fire.PercentileNanoseconds(99) >= 1.5e6);
+	}
+
+	SECTION("Snapshots merge")
+	{
+		SLatencySnapshot merged = snapshot;
+		merged.Merge(histograms.Snapshot());
+		REQUIRE(merged.Fire.Count() == 22);
+		REQUIRE(merged.Entry[state2].Count() == 10);
+	}
+}
+
+
+
+
+
+
+
+
+TEST_CASE("Latency Histogram - Sampled fires")
+{
+	FakeCallback entered;
+	CREATE_FSM(fsm, TestState1);
+	fsm.Configure(TestState1)->AddTrigger(TestTrigger1, TestState2);
+	fsm.Configure(TestState2)->AddTrigger(TestTrigger2, TestState1)->OnEntry(&entered);
+
+	const CCompiledDefinition<TestTriggers, TestStates> definition(fsm);
+	CLatencyHistograms histograms(definition);
+	REQUIRE_THROWS_AS(CLatencyInstrumentation(&histograms, 0), std::invalid_argument);
+
+	// Every third fire is timed: the 3rd & 9th enter TestState2, the 6th & 12th leave it
+	CCompiledStateMachine<TestTriggers, TestStates, CLatencyInstrumentation> compiled(&definition, CLatencyInstrumentation(&histograms, 3));
+	for (int i = 0; i < 6; ++i)
+	{
+		compiled.Fire(TestTrigger1);
+		compiled.Fire(TestTrigger2);
+	}
+
+	const SLatencySnapshot snapshot = histograms.Snapshot();
+	REQUIRE(snapshot.Fire.Count() == 4);
+	REQUIRE(snapshot.Entry[definition.FindState(TestState2)].Count() == 2);
+	REQUIRE(entered.CallbackCount == 6);
+}
+
+
+
+
+
+
+
+
+TEST_CASE("Latency Histogram - Clock calibration")
+{
+	const double nanosecondsPerTick = CLatencyClock::Calibrate();
+	REQUIRE(nanosecondsPerTick > 0);
+	REQUIRE(CLatencyClock::NanosecondsPerTick() == nanosecondsPerTick);
+	REQUIRE(CLatencyClock::Nanoseconds(1000) == Approx(1000 * nanosecondsPerTick));
+}
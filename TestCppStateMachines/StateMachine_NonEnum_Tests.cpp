@@ -1,6 +1,6 @@
 #include "stdafx.h"
 
-#include <catch2\catch.hpp>
+#include <catch2/catch.hpp>
 
 using namespace FSM;
 using namespace Fakes;
@@ -67,4 +67,5 @@ TEST_CASE("State machine - non-enum types")
 
 	fsm.Fire(&trigger1);
 	const CustomState* current = *fsm.CurrentState();
+	REQUIRE(current == &state1);
 }
\ No newline at end of file
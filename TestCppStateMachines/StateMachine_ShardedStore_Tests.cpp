@@ -0,0 +1,264 @@
+#include "stdafx.h"
+
+#include <catch2/catch.hpp>
+
+#include "export.h"
+#include "CShardedStateMachineStore.h"
+#include "Fakes.h"
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace FSM;
+using namespace Fakes;
+
+namespace
+{
+	// State s only accepts trigger s, so triggers which arrive out of order are rejected
+	void ConfigureStrictRing(CFiniteStateMachine<int, int>& fsm, int states)
+	{
+		for (int state = 0; state < states; ++state) fsm.Configure(state)->AddTrigger(state, (state + 1) % states);
+	}
+}
+
+
+
+
+TEST_CASE("Sharded Store - Bounded queue")
+{
+	___IMPL___::CBoundedMpscQueue<int> queue(4);
+	int item = 0;
+
+	SECTION("Capacity must be a power of two")
+	{
+		REQUIRE_THROWS(___IMPL___::CBoundedMpscQueue<int>(0));
+		REQUIRE_THROWS(___IMPL___::CBoundedMpscQueue<int>(6));
+		REQUIRE(queue.Capacity() == 4);
+	}
+
+	SECTION("First in, first out, until full")
+	{
+		REQUIRE_FALSE(queue.TryPop(item));
+		for (int i = 0; i < 4; ++i) REQUIRE(queue.TryPush(i));
+		REQUIRE_FALSE(queue.TryPush(4));
+
+		for (int i = 0; i < 4; ++i)
+		{
+			REQUIRE(queue.TryPop(item));
+			REQUIRE(item == i);
+		}
+		REQUIRE_FALSE(queue.TryPop(item));
+	}
+
+	SECTION("Cells are reused lap after lap")
+	{
+		for (int i = 0; i < 100; ++i)
+		{
+			REQUIRE(queue.TryPush(i));
+			REQUIRE(queue.TryPush(-i));
+			REQUIRE(queue.TryPop(item));
+			REQUIRE(item == i);
+			REQUIRE(queue.TryPop(item));
+			REQUIRE(item == -i);
+		}
+		REQUIRE(queue.Pushed() == 200);
+		REQUIRE(queue.Popped() == 200);
+	}
+
+	SECTION("Every producer's items arrive in order")
+	{
+		const int producers = 4, items = 100000;
+
+		___IMPL___::CBoundedMpscQueue<std::pair<int, int>> shared(1024);
+		std::vector<std::thread> threads;
+		for (int producer = 0; producer < producers; ++producer)
+		{
+			threads.emplace_back([&shared, producer]()
+			{
+				for (int i = 0; i < items; ++i)
+				{
+					while (!shared.TryPush(std::make_pair(producer, i))) std::this_thread::yield();
+				}
+			});
+		}
+
+		std::vector<int> next(producers, 0);
+		bool ordered = true;
+		std::pair<int, int> popped;
+		for (int received = 0; received < producers * items;)
+		{
+			if (!shared.TryPop(popped))
+			{
+				std::this_thread::yield();
+				continue;
+			}
+			ordered = ordered && popped.second == next[popped.first]++;
+			++received;
+		}
+		for (std::thread& thread : threads) thread.join();
+
+		REQUIRE(ordered);
+		REQUIRE_FALSE(shared.TryPop(popped));
+	}
+}
+
+
+
+
+
+
+
+
+TEST_CASE("Sharded Store - Posting")
+{
+	CFiniteStateMachine<int, int> fsm(0);
+	ConfigureStrictRing(fsm, 3);
+	const CCompiledDefinition<int, int> definition(fsm);
+
+	const unsigned int shards = GENERATE(1u, 4u);
+	CAPTURE(shards);
+
+	SECTION("Shards must exist")
+	{
+		REQUIRE_THROWS_AS((CShardedStateMachineStore<uint64_t, int, int>(&definition, 0)), std::invalid_argument);
+	}
+
+	SECTION("Triggers of one producer reach a key in order")
+	{
+		CShardedStateMachineStore<uint64_t, int, int> store(&definition, shards, 256);
+		for (int i = 0; i < 10000; ++i)
+		{
+			for (uint64_t key = 0; key < 10; ++key) store.Post(key, i % 3);
+		}
+		store.Flush();
+
+		const SShardStatistics statistics = store.Statistics();
+		REQUIRE(statistics.Processed == 100000);
+		REQUIRE(statistics.Rejected == 0);
+		REQUIRE(statistics.Keys == 10);
+		for (uint64_t key = 0; key < 10; ++key) REQUIRE(store.State(key) == 10000 % 3);
+	}
+
+	SECTION("Many producers, each with its own keys")
+	{
+		const int producers = 4, keysPerProducer = 100, rounds = 300;
+
+		CShardedStateMachineStore<uint64_t, int, int> store(&definition, shards, 1024);
+		std::vector<std::thread> threads;
+		for (int producer = 0; producer < producers; ++producer)
+		{
+			threads.emplace_back([&store, producer]()
+			{
+				for (int round = 0; round < rounds; ++round)
+				{
+					for (int key = 0; key < keysPerProducer; ++key) store.Post((uint64_t)(producer * keysPerProducer + key), round % 3);
+				}
+			});
+		}
+		for (std::thread& thread : threads) thread.join();
+		store.Flush();
+
+		const SShardStatistics statistics = store.Statistics();
+		REQUIRE(statistics.Processed == (uint64_t)producers * keysPerProducer * rounds);
+		REQUIRE(statistics.Rejected == 0);
+		REQUIRE(statistics.Keys == (uint64_t)producers * keysPerProducer);
+
+		bool done = true;
+		for (uint64_t key = 0; key < (uint64_t)producers * keysPerProducer; ++key) done = done && store.State(key) == rounds % 3;
+		REQUIRE(done);
+
+		if (shards > 1)
+		{
+			for (unsigned int shard = 0; shard < shards; ++shard) REQUIRE(store.Shard(shard).Size() > 0);
+		}
+	}
+
+	SECTION("Rejected & unknown triggers are counted")
+	{
+		CShardedStateMachineStore<uint64_t, int, int> store(&definition, shards);
+		store.Post(1, 1);
+		store.Post(1, 42);
+		store.Post(1, 0);
+		store.Flush();
+
+		REQUIRE(store.Statistics().Rejected == 2);
+		REQUIRE(store.State(1) == 1);
+	}
+
+	SECTION("Redelivered triggers are dropped by sequence number")
+	{
+		CShardedStateMachineStore<uint64_t, int, int, std::hash<uint64_t>, CSequenced> store(&definition, shards);
+		for (uint64_t sequence = 1; sequence <= 300; ++sequence)
+		{
+			for (uint64_t key = 0; key < 10; ++key)
+			{
+				store.Post(key, sequence, (int)((sequence - 1) % 3));
+				store.Post(key, sequence, (int)((sequence - 1) % 3));
+				if (sequence > 1) store.Post(key, sequence - 1, (int)((sequence - 2) % 3));
+			}
+		}
+		store.Flush();
+
+		const SShardStatistics statistics = store.Statistics();
+		REQUIRE(statistics.Processed == 10 * (300 + 300 + 299));
+		REQUIRE(statistics.Duplicates == 10 * (300 + 299));
+		REQUIRE(statistics.Rejected == 0);
+		for (uint64_t key = 0; key < 10; ++key) REQUIRE(store.State(key) == 0);
+	}
+
+	SECTION("Workers finish posted triggers before stopping")
+	{
+		std::atomic<int> entries(0);
+		struct SCount : public ICallback
+		{
+			std::atomic<int>* Entries = nullptr;
+			virtual void Call() override { ++*Entries; }
+		} count;
+		count.Entries = &entries;
+
+		CFiniteStateMachine<int, int> counted(0);
+		ConfigureStrictRing(counted, 3);
+		counted.Configure(1)->OnEntry(&count);
+		const CCompiledDefinition<int, int> countedDefinition(counted);
+		{
+			CShardedStateMachineStore<uint64_t, int, int> store(&countedDefinition, shards);
+			for (uint64_t key = 0; key < 5000; ++key) store.Post(key, 0);
+		}
+		REQUIRE(entries == 5000);
+	}
+
+	SECTION("Full queue refuses TryPost")
+	{
+		// Keeps the single worker busy in a callback until released
+		std::atomic<bool> release(false), started(false);
+		struct SBlock : public ICallback
+		{
+			std::atomic<bool>* Release = nullptr;
+			std::atomic<bool>* Started = nullptr;
+			virtual void Call() override
+			{
+				*Started = true;
+				while (!*Release) std::this_thread::yield();
+			}
+		} block;
+		block.Release = &release;
+		block.Started = &started;
+
+		CFiniteStateMachine<int, int> blocking(0);
+		ConfigureStrictRing(blocking, 3);
+		blocking.Configure(1)->OnEntry(&block);
+		const CCompiledDefinition<int, int> blockingDefinition(blocking);
+
+		CShardedStateMachineStore<uint64_t, int, int> store(&blockingDefinition, 1, 4);
+		store.Post(0, 0);
+		while (!started) std::this_thread::yield();
+
+		for (int i = 0; i < 4; ++i) REQUIRE(store.TryPost(1, 0));
+		REQUIRE_FALSE(store.TryPost(1, 0));
+
+		release = true;
+		store.Flush();
+		REQUIRE(store.Statistics().Processed == 5);
+	}
+}
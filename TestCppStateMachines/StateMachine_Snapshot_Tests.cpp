@@ -0,0 +1,404 @@
+#include "stdafx.h"
+
+#include <catch2/catch.hpp>
+
+#include "export.h"
+#include "CDefinitionBuilder.h"
+#include "CKeyedStateMachineStore.h"
+#include "CSnapshot.h"
+#include "Fakes.h"
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+
+using namespace FSM;
+using namespace Fakes;
+
+namespace
+{
+	// Three bytes of padding after Kind, left as they were in memory by copies
+	struct SPaddedState
+	{
+		char Kind;
+		int Value;
+
+		bool operator<(const SPaddedState& other) const { return Kind != other.Kind ? Kind < other.Kind : Value < other.Value; }
+	};
+
+	SPaddedState PaddedState(char kind, int value, unsigned char padding)
+	{
+		SPaddedState state;
+		std::memset(&state, padding, sizeof(state));
+		state.Kind = kind;
+		state.Value = value;
+		return state;
+	}
+
+	// Hashes keys backwards, so that tables are laid out differently than with std::hash
+	struct SReversedHash
+	{
+		size_t operator()(uint64_t key) const { return (size_t)~key; }
+	};
+
+	// Agrees with std::hash on every key but one, so only that key sits elsewhere in the table
+	struct SOneKeyHash
+	{
+		size_t operator()(uint64_t key) const { return std::hash<uint64_t>()(key) ^ (key == 7777 ? 0x5555 : 0); }
+	};
+}
+
+
+
+
+TEST_CASE("Snapshot - Definition fingerprint")
+{
+	CFiniteStateMachine<int, int> fsm(0);
+	ConfigureConnection(fsm);
+	const CCompiledDefinition<int, int> definition(fsm);
+
+	SECTION("Same machine, same fingerprint")
+	{
+		const CCompiledDefinition<int, int> again(fsm, CompressedTable);
+		REQUIRE(DefinitionFingerprint(definition) == DefinitionFingerprint(again));
+	}
+
+	SECTION("Another transition, another fingerprint")
+	{
+		fsm.Configure(2)->AddTrigger(2, 0);
+		const CCompiledDefinition<int, int> changed(fsm);
+		REQUIRE(DefinitionFingerprint(definition) != DefinitionFingerprint(changed));
+	}
+
+	SECTION("Renumbering changes the fingerprint")
+	{
+		std::vector<uint64_t> hits(definition.Transitions().size(), 0);
+		hits.back() = 100;
+
+		std::vector<uint32_t> mapping;
+		const CCompiledDefinition<int, int> relaid = definition.Relayout(hits, mapping);
+		REQUIRE(mapping[0] != 0);
+		REQUIRE(DefinitionFingerprint(definition) != DefinitionFingerprint(relaid));
+	}
+
+	SECTION("Addresses do not count, so restarts keep the fingerprint")
+	{
+		const int first[2] = { 0, 1 }, second[2] = { 0, 1 };
+		CFiniteStateMachine<int, const int*> a(&first[0]), b(&second[0]);
+		a.Configure(&first[0])->AddTrigger(1, &first[1]);
+		b.Configure(&second[0])->AddTrigger(1, &second[1]);
+		a.Configure(&first[1]);
+		b.Configure(&second[1]);
+
+		REQUIRE(DefinitionFingerprint(CCompiledDefinition<int, const int*>(a)) == DefinitionFingerprint(CCompiledDefinition<int, const int*>(b)));
+	}
+
+	SECTION("Padding bytes do not count")
+	{
+		CFiniteStateMachine<int, SPaddedState> a(PaddedState('a', 0, 0x00)), b(PaddedState('a', 0, 0xFF));
+		a.Configure(PaddedState('a', 0, 0x00))->AddTrigger(1, PaddedState('b', 1, 0x00));
+		b.Configure(PaddedState('a', 0, 0xFF))->AddTrigger(1, PaddedState('b', 1, 0xFF));
+		a.Configure(PaddedState('b', 1, 0x00));
+		b.Configure(PaddedState('b', 1, 0xFF));
+
+		REQUIRE(DefinitionFingerprint(CCompiledDefinition<int, SPaddedState>(a)) == DefinitionFingerprint(CCompiledDefinition<int, SPaddedState>(b)));
+	}
+
+	SECTION("Floats count by value")
+	{
+		CFiniteStateMachine<int, double> a(0.0), b(-0.0), c(0.5);
+		a.Configure(0.0)->AddTrigger(1, 1.5);
+		b.Configure(-0.0)->AddTrigger(1, 1.5);
+		c.Configure(0.5)->AddTrigger(1, 1.5);
+
+		REQUIRE(DefinitionFingerprint(CCompiledDefinition<int, double>(a)) == DefinitionFingerprint(CCompiledDefinition<int, double>(b)));
+		REQUIRE(DefinitionFingerprint(CCompiledDefinition<int, double>(a)) != DefinitionFingerprint(CCompiledDefinition<int, double>(c)));
+	}
+
+	SECTION("Built & configured definitions of one machine match")
+	{
+		CDefinitionBuilder<int, int> builder(0);
+		builder.Add(0, 1, 1);
+		builder.Add(1, 0, 0);
+		builder.Add(1, 2, 2);
+		builder.Add(2, 0, 0);
+		builder.Add(2, 1, 1);
+		REQUIRE(DefinitionFingerprint(builder.Build()) == DefinitionFingerprint(definition));
+	}
+}
+
+
+
+
+
+
+
+
+TEST_CASE("Snapshot - Fleet")
+{
+	const std::string path = "fleet_snapshot.bin";
+
+	CFiniteStateMachine<int, int> fsm(0);
+	ConfigureConnection(fsm);
+	const CCompiledDefinition<int, int> definition(fsm);
+
+	std::vector<CCompiledStateMachine<int, int>> fleet(1000, CCompiledStateMachine<int, int>(&definition));
+	for (size_t i = 0; i < fleet.size(); ++i)
+	{
+		if (i % 2 == 0) fleet[i].Fire(1);
+		if (i % 4 == 0) fleet[i].Fire(2);
+	}
+	WriteFleetSnapshot(path, definition, fleet.data(), fleet.size());
+
+	SECTION("States come back without callbacks")
+	{
+		FakeCallback entered;
+		fsm.Configure(2)->OnEntry(&entered);
+		const CCompiledDefinition<int, int> withCallbacks(fsm);
+
+		std::vector<CCompiledStateMachine<int, int>> restored(1000, CCompiledStateMachine<int, int>(&withCallbacks));
+		ReadFleetSnapshot(path, withCallbacks, restored.data(), restored.size());
+
+		bool same = true;
+		for (size_t i = 0; i < fleet.size(); ++i) same = same && *restored[i].CurrentState() == *fleet[i].CurrentState();
+		REQUIRE(same);
+		REQUIRE(entered.CallbackCount == 0);
+
+		restored[1].Fire(1);
+		restored[1].Fire(2);
+		REQUIRE(entered.CallbackCount == 1);
+	}
+
+	SECTION("Snapshots of another definition are rejected")
+	{
+		fsm.Configure(3)->AddTrigger(0, 0);
+		const CCompiledDefinition<int, int> other(fsm);
+		std::vector<CCompiledStateMachine<int, int>> restored(1000, CCompiledStateMachine<int, int>(&other));
+		REQUIRE_THROWS_AS(ReadFleetSnapshot(path, other, restored.data(), restored.size()), std::invalid_argument);
+	}
+
+	SECTION("Snapshots of another fleet size are rejected")
+	{
+		std::vector<CCompiledStateMachine<int, int>> restored(999, CCompiledStateMachine<int, int>(&definition));
+		REQUIRE_THROWS_AS(ReadFleetSnapshot(path, definition, restored.data(), restored.size()), std::invalid_argument);
+	}
+
+	SECTION("Missing & foreign files are reported")
+	{
+		REQUIRE_THROWS_AS(ReadFleetSnapshot("no_such_snapshot.bin", definition, fleet.data(), fleet.size()), std::runtime_error);
+
+		std::FILE* file = std::fopen(path.c_str(), "wb");
+		std::fputs("not a snapshot, but long enough to hold a snapshot header of sixty four bytes", file);
+		std::fclose(file);
+		REQUIRE_THROWS_AS(ReadFleetSnapshot(path, definition, fleet.data(), fleet.size()), std::runtime_error);
+	}
+
+	std::remove(path.c_str());
+}
+
+
+
+
+
+
+
+
+TEST_CASE("Snapshot - Keyed store")
+{
+	const std::string path = "keyed_snapshot.bin", spillPath = "keyed_snapshot_spill.bin";
+
+	CFiniteStateMachine<int, int> fsm(0);
+	ConfigureConnection(fsm);
+	const CCompiledDefinition<int, int> definition(fsm);
+
+	CKeyedStateMachineStore<uint64_t, int, int> store(&definition);
+	store.SetTime(42);
+	for (uint64_t key = 0; key < 10000; ++key)
+	{
+		store.Fire(key, 1);
+		if (key % 3 == 0) store.Fire(key, 2);
+	}
+
+	const auto matches = [](const CKeyedStateMachineStore<uint64_t, int, int>& restored)
+	{
+		bool same = true;
+		for (uint64_t key = 0; key < 10000; ++key) same = same && restored.Contains(key) && restored.State(key) == (key % 3 == 0 ? 2 : 1);
+		return same && !restored.Contains(10000);
+	};
+
+	SECTION("Instances come back")
+	{
+		store.WriteSnapshot(path);
+
+		CKeyedStateMachineStore<uint64_t, int, int> restored(&definition);
+		restored.Fire(123456, 1);
+		restored.ReadSnapshot(path);
+
+		REQUIRE(restored.Size() == 10000);
+		REQUIRE(restored.Capacity() == store.Capacity());
+		REQUIRE(restored.Time() == 42);
+		REQUIRE(matches(restored));
+		REQUIRE_FALSE(restored.Contains(123456));
+
+		restored.Fire(10000, 1);
+		REQUIRE(restored.Erase(5));
+		REQUIRE(restored.Size() == 10000);
+	}
+
+	SECTION("Spilled instances are saved too")
+	{
+		{
+			CKeyedSpillFile<uint64_t> spill(spillPath);
+			store.SetSpill(&spill);
+			store.SetTime(100);
+			for (uint64_t key = 0; key < 10000; key += 2) store.Fire(key, key % 3 == 0 ? 0 : 2);
+			for (uint64_t key = 0; key < 10000; key += 2) store.Fire(key, key % 3 == 0 ? 1 : 0);
+			for (uint64_t key = 0; key < 10000; key += 2) store.Fire(key, key % 3 == 0 ? 2 : 1);
+			REQUIRE(store.EvictIdle(50) == 5000);
+
+			store.WriteSnapshot(path);
+			store.SetSpill(nullptr);
+		}
+
+		// Into memory
+		CKeyedStateMachineStore<uint64_t, int, int> restored(&definition);
+		restored.ReadSnapshot(path);
+		REQUIRE(restored.Size() == 10000);
+		REQUIRE(matches(restored));
+
+		// Into a spill file, dropping what it held
+		CKeyedSpillFile<uint64_t> spill(spillPath);
+		CKeyedStateMachineStore<uint64_t, int, int> spilling(&definition);
+		spilling.SetSpill(&spill);
+		spilling.Fire(123456, 1);
+		spilling.EvictIdle(0);
+		spilling.ReadSnapshot(path);
+		REQUIRE(spilling.Size() == 5000);
+		REQUIRE(spill.Size() == 5000);
+		REQUIRE(matches(spilling));
+		REQUIRE_FALSE(spilling.Contains(123456));
+		spilling.SetSpill(nullptr);
+	}
+
+	SECTION("Tables laid out by another hash are rebuilt")
+	{
+		CKeyedStateMachineStore<uint64_t, int, int, SReversedHash> reversed(&definition);
+		for (uint64_t key = 0; key < 10000; ++key)
+		{
+			reversed.Fire(key, 1);
+			if (key % 3 == 0) reversed.Fire(key, 2);
+		}
+		reversed.WriteSnapshot(path);
+
+		CKeyedStateMachineStore<uint64_t, int, int> restored(&definition);
+		restored.ReadSnapshot(path);
+		REQUIRE(matches(restored));
+	}
+
+	SECTION("Tables with a single key laid out by another hash are rebuilt")
+	{
+		CKeyedStateMachineStore<uint64_t, int, int, SOneKeyHash> almost(&definition);
+		for (uint64_t key = 0; key < 10000; ++key)
+		{
+			almost.Fire(key, 1);
+			if (key % 3 == 0) almost.Fire(key, 2);
+		}
+		almost.WriteSnapshot(path);
+
+		CKeyedStateMachineStore<uint64_t, int, int> restored(&definition);
+		restored.ReadSnapshot(path);
+		REQUIRE(restored.Contains(7777));
+		REQUIRE(matches(restored));
+	}
+
+	SECTION("Snapshots of another definition or store type are rejected")
+	{
+		store.WriteSnapshot(path);
+
+		fsm.Configure(2)->AddTrigger(2, 0);
+		const CCompiledDefinition<int, int> other(fsm);
+		CKeyedStateMachineStore<uint64_t, int, int> restored(&other);
+		REQUIRE_THROWS_AS(restored.ReadSnapshot(path), std::invalid_argument);
+
+		CKeyedStateMachineStore<uint64_t, int, int, std::hash<uint64_t>, CSequenced> sequenced(&definition);
+		REQUIRE_THROWS_AS(sequenced.ReadSnapshot(path), std::invalid_argument);
+
+		CKeyedStateMachineStore<uint32_t, int, int> narrow(&definition);
+		REQUIRE_THROWS_AS(narrow.ReadSnapshot(path), std::invalid_argument);
+
+		WriteFleetSnapshot(path, definition, (const CCompiledStateMachine<int, int>*)nullptr, 0);
+		REQUIRE_THROWS_AS(store.ReadSnapshot(path), std::invalid_argument);
+	}
+
+	SECTION("Truncated snapshots are reported")
+	{
+		store.WriteSnapshot(path);
+
+		std::vector<char> bytes(1000);
+		std::FILE* file = std::fopen(path.c_str(), "rb");
+		REQUIRE(std::fread(bytes.data(), 1, bytes.size(), file) == bytes.size());
+		std::fclose(file);
+		file = std::fopen(path.c_str(), "wb");
+		std::fwrite(bytes.data(), 1, bytes.size(), file);
+		std::fclose(file);
+
+		CKeyedStateMachineStore<uint64_t, int, int> restored(&definition);
+		restored.Fire(1, 1);
+		REQUIRE_THROWS_AS(restored.ReadSnapshot(path), std::runtime_error);
+		REQUIRE(restored.Size() == 1);
+	}
+
+	SECTION("Snapshots with a truncated spilled tail leave the store as it was")
+	{
+		{
+			CKeyedSpillFile<uint64_t> spill(spillPath);
+			store.SetSpill(&spill);
+			REQUIRE(store.EvictToSize(5000) == 5000);
+			store.WriteSnapshot(path);
+			store.SetSpill(nullptr);
+		}
+
+		std::vector<char> bytes;
+		std::FILE* file = std::fopen(path.c_str(), "rb");
+		for (int c = std::fgetc(file); c != EOF; c = std::fgetc(file)) bytes.push_back((char)c);
+		std::fclose(file);
+		file = std::fopen(path.c_str(), "wb");
+		std::fwrite(bytes.data(), 1, bytes.size() - 1, file);
+		std::fclose(file);
+
+		CKeyedSpillFile<uint64_t> spill(spillPath);
+		CKeyedStateMachineStore<uint64_t, int, int> restored(&definition);
+		restored.SetSpill(&spill);
+		restored.Fire(1, 1);
+		restored.Fire(2, 1);
+		restored.Fire(2, 2);
+		restored.EvictToSize(1);
+		REQUIRE(spill.Size() == 1);
+
+		REQUIRE_THROWS_AS(restored.ReadSnapshot(path), std::runtime_error);
+		REQUIRE(restored.Size() == 1);
+		REQUIRE(spill.Size() == 1);
+		REQUIRE(restored.Contains(1));
+		REQUIRE(restored.State(1) == 1);
+		REQUIRE(restored.State(2) == 2);
+		REQUIRE_FALSE(restored.Contains(3));
+		restored.SetSpill(nullptr);
+	}
+
+	SECTION("Sequence numbers are saved")
+	{
+		CKeyedStateMachineStore<uint64_t, int, int, std::hash<uint64_t>, CSequenced> sequenced(&definition);
+		for (uint64_t key = 0; key < 100; ++key) sequenced.Fire(key, 10 + key, 1);
+		sequenced.WriteSnapshot(path);
+
+		CKeyedStateMachineStore<uint64_t, int, int, std::hash<uint64_t>, CSequenced> restored(&definition);
+		restored.ReadSnapshot(path);
+		REQUIRE(restored.LastSequence(7) == 17);
+		REQUIRE_FALSE(restored.Fire(7, 17, 2));
+		REQUIRE(restored.Fire(7, 18, 2));
+	}
+
+	std::remove(path.c_str());
+	std::remove(spillPath.c_str());
+}
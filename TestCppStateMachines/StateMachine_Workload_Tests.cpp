@@ -0,0 +1,183 @@
+#include "stdafx.h"
+
+#include <catch2/catch.hpp>
+
+#include "export.h"
+#include "CCompiledStateMachine.h"
+#include "CWorkloadGenerator.h"
+#include <algorithm>
+#include <vector>
+
+using namespace FSM;
+
+
+
+
+TEST_CASE("Workload Generator - Graphs")
+{
+	SGraphOptions options;
+	options.States = 2000;
+	options.Triggers = 32;
+
+	SECTION("Same seed, same graph")
+	{
+		CGeneratedMachine a(options), b(options);
+		options.Seed = 2;
+		CGeneratedMachine c(options);
+
+		bool sameAsC = true;
+		for (uint32_t state = 0; state < a.StateCount(); ++state)
+		{
+			for (uint32_t trigger = 0; trigger < a.TriggerCount(); ++trigger)
+			{
+				REQUIRE(a.Next(state, trigger) == b.Next(state, trigger));
+				sameAsC = sameAsC && a.Next(state, trigger) == c.Next(state, trigger);
+			}
+		}
+		REQUIRE_FALSE(sameAsC);
+	}
+
+	SECTION("Fan-out distributions keep their mean")
+	{
+		options.MeanFanOut = 6;
+		options.FanOut = GENERATE(FixedFanOut, UniformFanOut, PowerLawFanOut);
+		CGeneratedMachine machine(options);
+
+		uint32_t largest = 0;
+		for (uint32_t state = 0; state < machine.StateCount(); ++state)
+		{
+			REQUIRE(machine.FanOut(state) >= 1);
+			largest = std::max(largest, machine.FanOut(state));
+		}
+
+		const double mean = (double)machine.TransitionCount() / machine.StateCount();
+		REQUIRE(mean == Approx(6).epsilon(0.15));
+		if (options.FanOut == FixedFanOut) REQUIRE(largest == 6);
+		if (options.FanOut == PowerLawFanOut) REQUIRE(largest > 18);
+	}
+
+	SECTION("Self loops")
+	{
+		options.SelfLoopRatio = 0.25;
+		CGeneratedMachine machine(options);
+
+		size_t loops = 0;
+		for (uint32_t state = 0; state < machine.StateCount(); ++state)
+		{
+			for (uint32_t trigger = 0; trigger < machine.TriggerCount(); ++trigger) loops += machine.Next(state, trigger) == state;
+		}
+		REQUIRE((double)loops / machine.TransitionCount() == Approx(0.25).epsilon(0.15));
+	}
+
+	SECTION("Skewed targets concentrate on hot states")
+	{
+		options.TargetSkew = 1.2;
+		CGeneratedMachine machine(options);
+
+		std::vector<size_t> incoming(machine.StateCount(), 0);
+		for (uint32_t state = 0; state < machine.StateCount(); ++state)
+		{
+			for (uint32_t trigger = 0; trigger < machine.TriggerCount(); ++trigger)
+			{
+				const uint32_t next = machine.Next(state, trigger);
+				if (next != InvalidIndex) ++incoming[next];
+			}
+		}
+		std::sort(incoming.begin(), incoming.end());
+		REQUIRE(incoming.back() > machine.TransitionCount() / 10);
+	}
+}
+
+
+
+
+
+
+
+
+TEST_CASE("Workload Generator - Streams")
+{
+	SGraphOptions options;
+	options.States = 500;
+	options.Triggers = 12;
+	options.FanOut = PowerLawFanOut;
+	options.TargetSkew = 1;
+	options.ResetTrigger = true;
+
+	CGeneratedMachine machine(options);
+
+	std::vector<int> states, triggers;
+	for (int i = 0; i < (int)machine.StateCount(); ++i) states.push_back(i);
+	for (int i = 0; i < (int)machine.TriggerCount(); ++i) triggers.push_back(i);
+
+	CDefinitionBuilder<int, int> builder(0);
+	machine.AddTo(builder, states, triggers);
+	CCompiledDefinition<int, int> definition = builder.Build();
+
+	CFiniteStateMachine<int, int> configured(0);
+	machine.Configure(configured, states, triggers);
+
+	SStreamOptions streamOptions;
+	streamOptions.Distribution = GENERATE(UniformStream, ZipfStream, MarkovStream);
+	streamOptions.Length = 20000;
+	const std::vector<uint32_t> stream = machine.Stream(streamOptions);
+	REQUIRE(stream.size() == 20000);
+
+	SECTION("Streams replay on every backend and end in the initial state")
+	{
+		CCompiledStateMachine<int, int> compiled(&definition);
+		const std::vector<int> keys = CGeneratedMachine::Keys(stream, triggers);
+		for (int pass = 0; pass < 2; ++pass)
+		{
+			for (int trigger : keys)
+			{
+				compiled.Fire(trigger);
+				configured.Fire(trigger);
+				REQUIRE(*compiled.CurrentState() == *configured.CurrentState());
+			}
+			REQUIRE(*compiled.CurrentState() == 0);
+		}
+	}
+}
+
+
+
+
+
+
+
+
+TEST_CASE("Workload Generator - Skewed streams")
+{
+	SGraphOptions options;
+	options.States = 500;
+	options.Triggers = 12;
+	options.MeanFanOut = 8;
+
+	CGeneratedMachine machine(options);
+
+	// How often the walk takes the lowest trigger of its state
+	const auto lowestShare = [&machine](EStreamDistribution distribution)
+	{
+		SStreamOptions streamOptions;
+		streamOptions.Distribution = distribution;
+		streamOptions.Length = 20000;
+
+		size_t lowest = 0;
+		uint32_t state = 0;
+		for (uint32_t trigger : machine.Stream(streamOptions))
+		{
+			uint32_t first = 0;
+			while (machine.Next(state, first) == InvalidIndex) ++first;
+
+			lowest += trigger == first;
+			state = machine.Next(state, trigger);
+		}
+		return (double)lowest / streamOptions.Length;
+	};
+
+	const double uniform = lowestShare(UniformStream);
+	REQUIRE(uniform == Approx(1.0 / 8).epsilon(0.2));
+	REQUIRE(lowestShare(ZipfStream) > uniform * 2);
+	REQUIRE(lowestShare(MarkovStream) == Approx(uniform).epsilon(0.3));
+}